@@ -35,12 +35,24 @@ extern "C" {
 extern ADC_HandleTypeDef hadc1;
 
 /* USER CODE BEGIN Private defines */
+#define ADC_SCAN_CHANNELS   4      // IN0..IN3, ranks 1..4
+#define ADC_SCAN_RATE_HZ    4000   // TIM1 triggered scans per second
+#define ADC_OVERSAMPLE      64     // scans averaged into one output sample
+#define ADC_BLOCK_MS        (ADC_OVERSAMPLE * 1000 / ADC_SCAN_RATE_HZ)  // time per output sample
+#define ADC_CLOCK_MAX_HZ    36000000U  // datasheet limit for VDDA >= 2.4 V
+#define ADC_SAMPLE_MIN_NS   10500U     // per channel: 84 cycles at the 8 MHz boot clock
+
+extern DMA_HandleTypeDef hdma_adc1;
 
 /* USER CODE END Private defines */
 
 void MX_ADC1_Init(void);
 
 /* USER CODE BEGIN Prototypes */
+void adc_scan_start(void);
+void adc_scan_stop(void);
+int adc_scan_active(void);
+uint32_t adc_scan_read(uint16_t out[ADC_SCAN_CHANNELS]);
 
 /* USER CODE END Prototypes */
 
@@ -4,6 +4,51 @@
 
 #include <stdint.h>
 
+#define ADS1115_ADDR       (0x48 << 1)
+#define ADS1115_CHANNELS   4
+
+// Route conversion-ready through the ALERT/RDY pin (ADS_ALRT_Pin in main.h).
+// If the pin is not wired the driver still works: every wait falls back to
+// polling the OS bit once the nominal conversion time has passed.
+#define ADS1115_USE_ALRT   1
+
+// Full-scale range, config register bits [11:9]
+typedef enum {
+    ADS_PGA_6144MV = 0,
+    ADS_PGA_4096MV,
+    ADS_PGA_2048MV,
+    ADS_PGA_1024MV,
+    ADS_PGA_512MV,
+    ADS_PGA_256MV,
+} ads_pga_t;
+
+// Data rate, config register bits [7:5]
+typedef enum {
+    ADS_DR_8SPS = 0,
+    ADS_DR_16SPS,
+    ADS_DR_32SPS,
+    ADS_DR_64SPS,
+    ADS_DR_128SPS,
+    ADS_DR_250SPS,
+    ADS_DR_475SPS,
+    ADS_DR_860SPS,
+} ads_rate_t;
+
+void ads_init(void);
+void ads_set_config(ads_pga_t pga, ads_rate_t rate);
+void ads_get_config(ads_pga_t *pga, ads_rate_t *rate);
+
+// Convert AIN0..AIN3 one after another. Returns a bitmask of the channels
+// that produced a valid result; the calling task sleeps between conversions.
+uint8_t ads_scan(int16_t out[ADS1115_CHANNELS]);
 int16_t ads_read_channel(uint8_t ch);
 
+// Continuous conversion of a single channel
+int ads_continuous_start(uint8_t ch);
+int ads_continuous_read(int16_t *value);
+void ads_continuous_stop(void);
+
+// Called from the ALERT/RDY EXTI line
+void ads_alert_irq(void);
+
 #endif
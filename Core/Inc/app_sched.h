@@ -0,0 +1,72 @@
+#ifndef APP_SCHED_H
+#define APP_SCHED_H
+
+#include <stdint.h>
+#include "sensors.h"
+
+// Event-driven task graph.
+//
+// The sensor task is the only periodic application task. After each sample
+// it hands the snapshot to sched_sampled(), which posts events to the tasks
+// that subscribed to them:
+//
+//   SCHED_EV_SAMPLE     a new snapshot was published
+//   SCHED_EV_THRESHOLD  a moisture probe went below the alarm level or
+//                       back above it (with SCHED_ALARM_HYST_PCT hysteresis)
+//   SCHED_EV_LOG_DUE    the log period is up
+//
+// Every subscriber has its own SCHED_EV_COUNT bits in the app_sched_events
+// event group and sleeps on them, so an event is seen by each subscriber
+// exactly once and events posted while it was busy are merged into one
+// wake-up. The LCD and OLED redraw from the same snapshot, the logger
+// writes once per log period and the alarm task only runs on a crossing.
+//
+// The periods and the alarm level are set with the `sched` command.
+
+#define SCHED_EV_SAMPLE         (1U << 0)
+#define SCHED_EV_THRESHOLD      (1U << 1)
+#define SCHED_EV_LOG_DUE        (1U << 2)
+#define SCHED_EV_COUNT          3
+#define SCHED_EV_ALL            ((1U << SCHED_EV_COUNT) - 1U)
+
+#define SCHED_SAMPLE_MS         2000        // also the display refresh
+#define SCHED_LOG_MS            60000
+#define SCHED_SAMPLE_MIN_MS     100
+#define SCHED_SAMPLE_MAX_MS     600000
+#define SCHED_LOG_MAX_MS        86400000UL
+#define SCHED_ALARM_PCT         20          // dry alarm below this, 0 = off
+#define SCHED_ALARM_HYST_PCT    5
+
+typedef enum {
+    SCHED_LCD = 0,
+    SCHED_OLED,
+    SCHED_LOGGER,
+    SCHED_ALARM,
+    SCHED_SUBSCRIBER_COUNT      // at most 24 / SCHED_EV_COUNT
+} sched_subscriber_t;
+
+// Set which events a subscriber receives; from the subscriber's task
+void sched_subscribe(sched_subscriber_t sub, uint32_t events);
+
+// Block until at least one subscribed event was posted. Returns the
+// SCHED_EV_* bits posted since the previous call.
+uint32_t sched_wait(sched_subscriber_t sub);
+// Same with a timeout; returns 0 when it ran out
+uint32_t sched_wait_timeout(sched_subscriber_t sub, TickType_t timeout);
+
+// Post events to everyone subscribed to them
+void sched_post(uint32_t events);
+
+// Sensor task: called with every published snapshot
+void sched_sampled(const sensor_snapshot_t *snap);
+
+// Sensor task: ticks until the next periodic sample
+TickType_t sched_next_sample(void);
+
+// Bit n set: probe n (SENSOR_M1, SENSOR_M2) is below the alarm level
+uint32_t sched_alarms(void);
+
+// Registers the `sched` command. Before the scheduler starts.
+void sched_init(void);
+
+#endif // APP_SCHED_H
@@ -3,6 +3,8 @@
 
 #include "main.h"
 
+#define CLI_BUFFER_SIZE 64      // longest command line, terminator included
+
 typedef struct {
     const char *name;
     const char *help;
@@ -10,6 +12,16 @@ typedef struct {
 } cli_command_t;
 
 void CLI_Task(void *argument);
-void CLI_RegisterCommands(const cli_command_t *table, size_t count);
+// Add a module's command table (kept in flash, sorted by name). Call before
+// the scheduler starts. Commands can be typed as any unique abbreviation;
+// if two tables use the same name, the one registered first wins. Returns
+// 0 if the table is not sorted or there is no free slot.
+int CLI_RegisterCommands(const cli_command_t *table, size_t count);
+// Run one command line as if it had been typed
+void CLI_Execute(const char *line);
+// Exact name, else a unique abbreviation ("logf" for "logflush"); NULL if
+// there is no such command. Lookup also tells the user why it failed.
+const cli_command_t *CLI_Find(const char *name);
+const cli_command_t *CLI_Lookup(const char *name);
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef CLI_HISTORY_H
+#define CLI_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Command history for the CLI line editor.
+//
+// Lines are packed back to back in a byte ring, each one followed by its
+// '\0', so short commands cost only their length. Adding a line evicts the
+// oldest ones until it fits. Entries are numbered from the newest (0).
+//
+// If the SPI flash has a sector to spare after the log area, the history is
+// also appended there as [len][text] records and reloaded at boot. The
+// sector is erased and rewritten from RAM only when it fills up.
+
+#define CLI_HISTORY_BYTES       512     // power of two
+#define CLI_HISTORY_LINE_MAX    63      // longest line kept
+#define CLI_HISTORY_MAGIC       0x54534948  // "HIST"
+
+// Reload the history from flash if there is room for it there. Call from a
+// task, after spi_flash_init.
+void cli_history_init(void);
+// Store a line; empty lines and repeats of the newest entry are ignored
+void cli_history_add(const char *line);
+void cli_history_clear(void);
+uint16_t cli_history_count(void);
+// Copy entry n (0 = newest) into buf; returns its length, -1 if there is none
+int cli_history_get(uint16_t n, char *buf, size_t max);
+// Newest entry at n or older containing pattern; returns its number, -1 if none
+int cli_history_search(const char *pattern, uint16_t n, char *buf, size_t max);
+// 1 if the history is kept in flash
+int cli_history_persistent(void);
+
+#endif // CLI_HISTORY_H
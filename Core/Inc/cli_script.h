@@ -0,0 +1,36 @@
+#ifndef CLI_SCRIPT_H
+#define CLI_SCRIPT_H
+
+#include <stdint.h>
+
+// Command lines with sequences, repetition and macros:
+//
+//   read M1; read M2; ads          run the commands in order
+//   repeat 10 <sequence>           run it 10 times
+//   watch 500 <sequence>           run it every 500 ms until a key is pressed
+//   repeat 10 watch 500 <sequence> both
+//
+// A line is compiled once: it is split into tokens and every command is
+// looked up, then the loop calls the handlers straight from the compiled
+// steps. Handlers must treat argv as read-only since the same strings are
+// passed again on every run. watch keeps a fixed cadence (a late run does
+// not shift the ones after it); any key stops repeat and watch.
+//
+// Macros are named sequences used like commands. A few are built in (const
+// tables in MCU flash); up to CLI_MACRO_MAX more can be defined with the
+// `macro` command and are kept in the SPI flash when it has a spare sector
+// after the log and history. Macros cannot call other macros.
+
+#define CLI_SCRIPT_STEPS    10      // commands in one compiled line
+#define CLI_SCRIPT_ARGS     32      // argv slots, one NULL per command included
+#define CLI_SCRIPT_TEXT     160     // token storage, macros expanded
+#define CLI_MACRO_MAX       4
+#define CLI_MACRO_MAGIC     0x4F52434D  // "MCRO"
+
+// Register the script commands and load the user macros. Call before the
+// scheduler starts, after spi_flash_init.
+void cli_script_init(void);
+// Compile and run one command line; returns 0 if it did not compile
+int cli_script_exec(const char *line);
+
+#endif // CLI_SCRIPT_H
@@ -0,0 +1,78 @@
+#ifndef CLI_UART_H
+#define CLI_UART_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Console I/O on USART6.
+//
+// Output: writers copy into a ring buffer and return; the TX DMA stream
+// drains it in the background. Any task or ISR may write: space is claimed
+// with a compare-and-swap on the reserve index, so producers never take a
+// lock and copy with interrupts enabled, and a message is never interleaved
+// with another. Only publishing the copied bytes to the DMA masks
+// interrupts, for a few instructions. Before the scheduler starts output
+// goes out blocking.
+//
+// Input: a circular DMA receive with IDLE-line detection. The half, full
+// and idle events copy what arrived into a stream buffer, and the reader
+// sleeps on that buffer. Pasted input lands in the larger stream buffer
+// within half a DMA buffer of arriving, so the DMA ring never laps the
+// reader.
+
+#define CLI_TX_BUF_SIZE     1024    // power of two
+#define CLI_TX_DMA_CHUNK    128     // bytes per DMA transfer, bounds overwrite latency
+#define CLI_PRINTF_MAX      160     // longest formatted message
+#define CLI_RX_DMA_SIZE     128     // circular DMA buffer
+#define CLI_RX_STREAM_SIZE  512     // received bytes waiting for the reader
+#define CLI_WAIT_FOREVER    0xFFFFFFFFUL
+
+// What a writer does when the ring has no room for its message
+typedef enum {
+    CLI_TX_BLOCK = 0,       // wait for the DMA to make room (ISRs drop instead)
+    CLI_TX_DROP,            // discard the new message
+    CLI_TX_OVERWRITE,       // discard the oldest output not yet sent
+} cli_tx_policy_t;
+
+typedef struct {
+    uint32_t written;       // bytes accepted
+    uint32_t dropped;       // bytes discarded by either policy
+    uint16_t pending;       // bytes queued right now
+    uint16_t peak;          // high-water mark of pending
+} cli_tx_stats_t;
+
+typedef struct {
+    uint32_t received;      // bytes handed to the stream buffer
+    uint32_t dropped;       // bytes lost because the reader fell behind
+    uint32_t errors;        // UART errors (the receiver is restarted)
+} cli_rx_stats_t;
+
+void cli_uart_init(void);
+void cli_tx_set_policy(cli_tx_policy_t policy);
+cli_tx_policy_t cli_tx_get_policy(void);
+void cli_tx_get_stats(cli_tx_stats_t *stats);
+
+// All return 1 if the whole message was queued. cli_write is ISR-safe;
+// cli_printf formats on the caller's stack and is meant for tasks.
+int cli_write(const void *data, size_t len);
+int cli_puts(const char *s);
+int cli_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Text written through cli_write/cli_puts/cli_printf goes to the hook
+// instead of the wire while one is set (binary telemetry wraps it in
+// frames). cli_uart_send always writes raw bytes.
+typedef int (*cli_text_hook_t)(const void *data, size_t len);
+void cli_set_text_hook(cli_text_hook_t hook);
+int cli_uart_send(const void *data, size_t len);
+
+// Start reception; returns 1 on success
+int cli_uart_rx_start(void);
+// Wait up to timeout_ms (or CLI_WAIT_FOREVER) for input; returns the number
+// of bytes copied, at most len. Single reader, task context.
+size_t cli_read(void *buf, size_t len, uint32_t timeout_ms);
+void cli_rx_get_stats(cli_rx_stats_t *stats);
+
+// Block until everything queued so far has left the UART (task context)
+void cli_tx_flush(uint32_t timeout_ms);
+
+#endif // CLI_UART_H
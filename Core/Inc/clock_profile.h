@@ -0,0 +1,44 @@
+#ifndef CLOCK_PROFILE_H
+#define CLOCK_PROFILE_H
+
+#include <stdint.h>
+
+// Core clock profiles, switched at run time with the `clock` command.
+//
+//   low       HSI 16 MHz, no PLL, 0 wait states, regulator scale 3
+//   balanced  PLL 50 MHz from the HSI, 1 wait state, regulator scale 3
+//   full      PLL 100 MHz from the HSI, 3 wait states, regulator scale 1,
+//             APB1 at 50 MHz (its limit)
+//
+// SystemClock_Config in main.c boots into `low`. The ART accelerator
+// (instruction and data caches) stays on in every profile; prefetch is only
+// on when there are wait states to hide.
+//
+// A switch waits until the console, I2C and SPI are idle and no ADC scan
+// is running, then changes the clocks with interrupts masked and re-derives
+// the peripheral timing from the new bus clocks: the USART6 baud rate, the
+// I2C1 SCL timing and the SPI prescalers, which are chosen so SCK never gets
+// faster than at boot. ADC scans pick their ADC clock, sample time and
+// TIM1 trigger when they start. SysTick follows through HAL_InitTick.
+
+#define CLOCK_PROFILE_BOOT          CLOCK_LOW
+#define CLOCK_SWITCH_TIMEOUT_MS     500     // waiting for the buses to go idle
+
+typedef enum {
+    CLOCK_LOW = 0,
+    CLOCK_BALANCED,
+    CLOCK_FULL,
+    CLOCK_PROFILE_COUNT
+} clock_profile_t;
+
+// Records the boot SPI rates, applies CLOCK_PROFILE_BOOT and registers the
+// `clock` command. Before the scheduler starts.
+void clock_profile_init(void);
+
+// 1 when the profile is running, 0 if the buses stayed busy or the clocks
+// would not start (the previous profile is then restored)
+int clock_profile_set(clock_profile_t profile);
+clock_profile_t clock_profile_get(void);
+const char *clock_profile_name(clock_profile_t profile);
+
+#endif // CLOCK_PROFILE_H
@@ -0,0 +1,86 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+// Shared I2C1 bus manager. Every driver on the bus (OLED, ST7032, ADS1115,
+// CLI) hands its transfers to one service task, which runs them one at a
+// time, highest priority first, using DMA for anything but tiny transfers.
+// Before the scheduler starts, requests run as plain blocking HAL calls.
+
+#define I2C_BUS_QUEUE_LEN       8     // pending requests per priority
+#define I2C_BUS_DMA_MIN         8     // shorter transfers use IT mode
+#define I2C_BUS_TIMEOUT_MS      100   // default queueing timeout
+
+typedef enum {
+    I2C_PRIO_LOW = 0,   // bulk display traffic
+    I2C_PRIO_NORMAL,    // character LCD, CLI
+    I2C_PRIO_HIGH,      // sensor conversions
+    I2C_PRIO_COUNT
+} i2c_prio_t;
+
+typedef enum {
+    I2C_OP_WRITE,
+    I2C_OP_READ,
+    I2C_OP_MEM_WRITE,   // 8-bit register address followed by data
+    I2C_OP_MEM_READ,
+    I2C_OP_PROBE,       // address only, ACK check
+} i2c_op_t;
+
+typedef enum {
+    I2C_OK = 0,
+    I2C_PENDING,
+    I2C_ERR_NACK,       // device did not acknowledge
+    I2C_ERR_BUS,        // bus error or arbitration lost; bus was recovered
+    I2C_ERR_TIMEOUT,    // not started in time, or transfer hung (recovered)
+    I2C_ERR_FULL,       // request queue stayed full
+} i2c_status_t;
+
+// A transfer request. It must stay valid (and the buffer untouched) until
+// i2c_bus_wait() returns, so it normally lives on the caller's stack.
+typedef struct {
+    i2c_op_t op;
+    i2c_prio_t prio;
+    uint16_t addr;          // 8-bit address as HAL expects (7-bit << 1)
+    uint8_t reg;            // register for MEM ops
+    uint8_t *buf;
+    uint16_t len;
+    uint16_t timeout_ms;    // how long the request may wait for the bus
+
+    // Private
+    volatile i2c_status_t status;
+    uint8_t queued;
+    TickType_t queued_at;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t done_buf;
+} i2c_xfer_t;
+
+typedef struct {
+    uint32_t xfers;
+    uint32_t nacks;
+    uint32_t bus_errors;
+    uint32_t timeouts;
+    uint32_t recoveries;
+} i2c_bus_stats_t;
+
+// The bus service task; its queues and handle live in rtos_objects.c
+void i2c_bus_task(void *argument);
+
+// Asynchronous API: submit, do something else, then wait for completion
+i2c_status_t i2c_bus_submit(i2c_xfer_t *x);
+i2c_status_t i2c_bus_wait(i2c_xfer_t *x);
+
+// Blocking helpers; the calling task sleeps until the transfer finishes
+i2c_status_t i2c_bus_write(uint16_t addr, const uint8_t *buf, uint16_t len, i2c_prio_t prio);
+i2c_status_t i2c_bus_read(uint16_t addr, uint8_t *buf, uint16_t len, i2c_prio_t prio);
+i2c_status_t i2c_bus_mem_write(uint16_t addr, uint8_t reg, const uint8_t *buf, uint16_t len, i2c_prio_t prio);
+i2c_status_t i2c_bus_mem_read(uint16_t addr, uint8_t reg, uint8_t *buf, uint16_t len, i2c_prio_t prio);
+i2c_status_t i2c_bus_probe(uint16_t addr);
+
+// Clock out a slave stuck mid-byte, issue a STOP and re-init I2C1
+void i2c_bus_recover(void);
+void i2c_bus_get_stats(i2c_bus_stats_t *out);
+
+#endif // I2C_BUS_H
@@ -0,0 +1,55 @@
+#ifndef LOG_EXPORT_H
+#define LOG_EXPORT_H
+
+#include <stdint.h>
+
+// Background export of the flash log to the console UART.
+//
+// A low-priority task reads the log in bursts of up to LOG_EXPORT_BURST
+// records, cut short at sector boundaries, and writes the records as text
+// lines or, in binary mode, as TLM_LOG_DATA frames. The CLI stays usable
+// while it runs. Progress is a cursor in record ids (see
+// log_flash_first_id), so a paused or interrupted export can be resumed
+// from where it stopped, even after old sectors were reclaimed.
+
+#define LOG_EXPORT_BURST      32        // records per flash read
+#define LOG_EXPORT_ALL        0xFFFFFFFFUL
+
+typedef struct {
+    uint32_t first_id;      // first record id to send
+    uint32_t end_id;        // stop before this id; LOG_EXPORT_ALL = up to the newest
+    uint32_t t_min;         // only records with t_min <= timestamp_ms <= t_max
+    uint32_t t_max;
+    uint16_t rate;          // records per second, 0 = as fast as the UART drains
+    uint8_t binary;         // telemetry frames instead of text
+    uint8_t seq;            // telemetry seq for the frames
+} log_export_req_t;
+
+typedef enum {
+    LOG_EXPORT_IDLE = 0,
+    LOG_EXPORT_RUNNING,
+    LOG_EXPORT_PAUSED,
+    LOG_EXPORT_DONE,
+} log_export_state_t;
+
+typedef struct {
+    log_export_state_t state;
+    uint32_t cursor;        // next record id to read
+    uint32_t end_id;
+    uint32_t sent;          // records written to the UART
+    uint32_t filtered;      // records outside the time range
+    uint32_t lost;          // records reclaimed before they could be read
+    uint32_t elapsed_ms;
+} log_export_status_t;
+
+void log_export_init(void);
+// Streams records while an export runs; created from rtos_objects.c
+void log_export_task(void *argument);
+// Returns 0 if an export is already running
+int log_export_start(const log_export_req_t *req);
+void log_export_pause(void);
+// Continue a paused export; returns 0 if there is nothing to resume
+int log_export_resume(void);
+void log_export_get_status(log_export_status_t *st);
+
+#endif // LOG_EXPORT_H
@@ -2,9 +2,38 @@
 #define LOG_FLASH_H
 
 #include <stdint.h>
+#include "FreeRTOS.h"
+
+// Circular, log-structured store on the SPI NOR flash.
+//
+// Each 4 KB sector holds a header page and 15 record pages:
+//   page 0:   log_sector_hdr_t (16 bytes) + one commit byte per record slot
+//   page 1-15: 240 records of 16 bytes
+// Sectors are filled in order and carry an increasing sequence number.
+// When the ring is full the sector holding the oldest records is erased
+// and reused, so every sector wears at the same rate. A record's commit
+// byte (its CRC8) is programmed before the record itself, so a power cut
+// leaves at worst one slot that fails its CRC check.
+
+#define LOG_FLASH_BASE         0x0000
+#define LOG_FLASH_SECTORS      16
+#define LOG_SECTOR_SIZE        4096
+#define LOG_FLASH_END          (LOG_FLASH_BASE + LOG_FLASH_SECTORS * LOG_SECTOR_SIZE)
+#define LOG_PAGE_SIZE          256
+#define LOG_SLOTS_PER_SECTOR   240
+#define LOG_HDR_MAGIC          0x474C4F47   // "GOLG"
+#define LOG_RECORDS_PER_PAGE   (LOG_PAGE_SIZE / 16)
+
+// Records are staged in RAM and programmed a page at a time. Bounded loss:
+// at most one page of records, and never anything older than
+// LOG_STAGE_MAX_AGE_MS, is held back from flash. The age limit holds
+// between writes too because the logger task calls log_flash_service()
+// by the deadline it returns. The `reset` command flushes before it
+// restarts; a power cut or a fault reset gets no warning, so for those
+// the age limit is the only bound.
+#define LOG_STAGE_MAX_AGE_MS   (5 * 60 * 1000)
 
 #define LOG_ENTRY_MAX 256
-extern uint32_t flash_log_index;
 
 typedef struct __attribute__((packed)) {
     uint32_t timestamp_ms;
@@ -13,8 +42,53 @@ typedef struct __attribute__((packed)) {
     int16_t ads[4];
 } log_entry_t;
 
-void flash_write_log_entry(const log_entry_t *entry);
-void flash_read_log_entry(uint32_t index, log_entry_t *entry);
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t seq;           // increments every time a sector is opened
+    uint32_t erase_count;   // lifetime erases of this sector
+    uint8_t reserved[3];
+    uint8_t crc;            // CRC8 of the preceding 15 bytes
+} log_sector_hdr_t;
+
+typedef struct {
+    uint8_t head_sector;
+    uint8_t tail_sector;
+    uint8_t sectors_used;
+    uint16_t head_used;     // slots programmed in the head sector
+    uint8_t staged;         // records waiting in RAM
+    uint32_t head_seq;
+    uint32_t head_erase_count;
+} log_flash_info_t;
+
+// Number of readable entries, staged ones included; index 0 is the oldest
 extern uint32_t flash_log_index;
 
+// Boot-time scan: rebuilds head and tail from the sector headers
+void log_flash_init(void);
+void log_flash_get_info(log_flash_info_t *info);
+
+// For flash tests that overwrite the log area. claim() locks the log until
+// release(), which rescans the flash and then programs the records that were
+// staged at claim() time on top of whatever log it found.
+void log_flash_claim(void);
+void log_flash_release(void);
+
+void flash_write_log_entry(const log_entry_t *entry);
+// Program any staged records now (logflush, logtest and reset commands)
+void log_flash_flush(void);
+// Program the staged records if the oldest has reached LOG_STAGE_MAX_AGE_MS.
+// Returns the ticks until it is due again, portMAX_DELAY with nothing staged.
+TickType_t log_flash_service(void);
+// Returns 1 if the entry passed its CRC check
+int flash_read_log_entry(uint32_t index, log_entry_t *entry);
+
+// Record ids number every record ever written: id = index + first id. Unlike
+// an index, an id keeps pointing at the same record when the oldest sector
+// is reclaimed, and across reboots, so it can be used as a resume cursor.
+uint32_t log_flash_first_id(void);
+// Burst read of up to max consecutive records starting at id, stopping at a
+// sector boundary. valid[i] is 1 if record i passed its CRC check. Returns
+// the number read, 0 if id is not in the log (reclaimed or not written yet).
+uint16_t flash_read_log_range(uint32_t id, log_entry_t *entries, uint8_t *valid, uint16_t max);
+
 #endif // LOG_FLASH_H
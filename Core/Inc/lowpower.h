@@ -0,0 +1,75 @@
+#ifndef LOWPOWER_H
+#define LOWPOWER_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+
+// Tickless idle (configUSE_TICKLESS_IDLE 2).
+//
+// When every task is blocked for at least two ticks, the idle task stops
+// SysTick and sleeps until the next task is due. LPTIM1 on the LSI (32 kHz,
+// runs in STOP) wakes the chip at that point and measures how long it
+// actually slept, which also covers early wake-ups by other interrupts, and
+// the RTOS and HAL tick counts are stepped by that amount.
+//
+// The sleep is STOP mode (regulator in low-power mode, flash powered down,
+// all clocks off) when nothing needs a clock: no DMA transfer, no ADC scan,
+// no binary link and no console input for LOWPOWER_CONSOLE_HOLD_MS. Anything
+// else gets SLEEP mode, where peripherals keep running and any interrupt
+// ends the sleep. After STOP the PLL is restarted if it was the system clock.
+//
+// USART6 cannot receive in STOP. Its RX pin (PA12) is armed as an EXTI
+// wake-up instead: the first character typed at a sleeping board is lost,
+// wakes it, and keeps it out of STOP while the console is in use.
+//
+// The LSI is only accurate to a few percent and drifts with temperature,
+// so it is measured against the core clock at start-up and again every
+// LOWPOWER_CAL_PERIOD_MS from the default task.
+
+#define LOWPOWER_CONSOLE_HOLD_MS    60000   // STOP stays off after console input
+#define LOWPOWER_STOP_MIN_TICKS     5       // shorter idle periods use SLEEP
+#define LOWPOWER_STOP_WAKE_US       150     // wake-up from STOP, LP regulator + flash off
+#define LOWPOWER_CAL_PERIOD_MS      600000
+#define LOWPOWER_CAL_COUNTS         1024    // LSI periods per calibration (~32 ms)
+
+#define LOWPOWER_WAKE_RX_Pin        GPIO_PIN_12     // USART6_RX on PA12
+
+// Reasons to keep the clocks running; more than one may be held
+typedef enum {
+    LP_HOLD_ADC       = 1U << 0,    // TIM1 triggered ADC scan running
+    LP_HOLD_TELEMETRY = 1U << 1,    // binary link, the host may send any time
+    LP_HOLD_USER      = 1U << 2,    // `power stop off`
+} lowpower_hold_t;
+
+typedef struct {
+    uint32_t lsi_hz;                // last calibration
+    uint32_t stop_count;
+    uint32_t sleep_count;           // SLEEP mode entries
+    uint32_t aborted;               // a task became ready before sleeping
+    uint32_t early;                 // woken before the timer by another interrupt
+    uint64_t stop_us;               // time spent in each mode
+    uint64_t sleep_us;
+    uint32_t holds;                 // lowpower_hold_t bits held right now
+} lowpower_stats_t;
+
+// LSI, LPTIM1, console wake-up and the `power` command. Before the
+// scheduler starts.
+void lowpower_init(void);
+
+// ISR safe
+void lowpower_hold(uint32_t reasons);
+void lowpower_release(uint32_t reasons);
+void lowpower_console_activity(void);
+
+// Measure the LSI against the core clock; busy-waits ~32 ms
+uint32_t lowpower_calibrate(void);
+void lowpower_get_stats(lowpower_stats_t *out);
+
+// portSUPPRESS_TICKS_AND_SLEEP, from the idle task with the scheduler suspended
+void lowpower_suppress_ticks_and_sleep(TickType_t expected_idle);
+
+// LPTIM1 is run at register level, outside CubeMX, so its vector lives in
+// lowpower.c rather than stm32f4xx_it.c
+void LPTIM1_IRQHandler(void);
+
+#endif // LOWPOWER_H
@@ -69,6 +69,9 @@ void Error_Handler(void);
 #define DRV1_GPIO_Port GPIOB
 
 /* USER CODE BEGIN Private defines */
+#define ADS_ALRT_Pin GPIO_PIN_5
+#define ADS_ALRT_GPIO_Port GPIOB
+#define ADS_ALRT_EXTI_IRQn EXTI9_5_IRQn
 
 /* USER CODE END Private defines */
 
@@ -11,4 +11,7 @@ typedef struct {
 extern moisture_cal_t m1_cal;
 extern moisture_cal_t m2_cal;
 
+// 0 % at the dry reading, 100 % at the wet one (the probes read lower when wet)
+uint8_t moisture_percent(uint16_t raw, const moisture_cal_t *cal);
+
 #endif // MOISTURE_H
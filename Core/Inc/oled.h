@@ -6,8 +6,13 @@
 extern u8g2_t u8g2;
 
 void oled_init(void);
+void oled_test_basic_i2c(void);
+void oled_test_draw_line(void);
 void OledDisplayTask(void *argument);
 uint8_t u8x8_byte_hw_i2c_hal_stm32(u8x8_t *, uint8_t, uint8_t, void *);
+uint8_t u8x8_cad_ssd13xx_i2c_dma(u8x8_t *, uint8_t, uint8_t, void *);
+// Wait for the queued display transfers. 1 if any was lost since the last call.
+uint8_t oled_i2c_sync(void);
 
 
 #endif
@@ -0,0 +1,96 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+// Cycle-accurate timing probes on the Cortex-M4 DWT cycle counter.
+//
+// Each probe keeps count, min/avg/max and a histogram of its durations in
+// a static table; the CLI command `perf` prints them and `perf reset`
+// clears them. A probe costs a few dozen cycles and can be used from tasks
+// and interrupt handlers alike.
+//
+//     uint32_t t0 = perf_begin();
+//     ...
+//     perf_end(PERF_FLASH_WRITE, t0);
+//
+// or, for a whole block with several exits, PERF_SCOPE(PERF_FLASH_WRITE);
+// at its top ends the measurement wherever the block is left.
+//
+// The counter is 32 bits, so a single measurement may span at most
+// 2^32 cycles (43 s at 100 MHz).
+
+// 0 compiles every probe away
+#define PERF_ENABLE         1
+
+// Histogram bin b counts durations of [2^(b-1), 2^b) us; bin 0 is < 1 us
+// and the last bin takes everything longer
+#define PERF_HIST_BINS      16
+
+typedef enum {
+    PERF_ADC_SAMPLE = 0,    // ADC1 DMA half: decimation of one block
+    PERF_ADS_READ,          // one ADS1115 channel: start, conversion, read
+    PERF_FLASH_WRITE,       // spi_flash_program, until the chip is done
+    PERF_OLED_SEND,         // frame buffer to the panel
+    PERF_OLED_TEXT,         // u8g2_DrawStr: glyph lookup and decode
+    PERF_PROBE_COUNT,
+} perf_probe_id_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;           // cycles
+    uint32_t max;
+    uint64_t total;
+    uint32_t hist[PERF_HIST_BINS];
+} perf_probe_t;
+
+// Start the cycle counter and register the CLI command
+void perf_init(void);
+
+uint32_t perf_cycles_to_us(uint32_t cycles);
+void perf_reset(void);
+// Copy of one probe, consistent even while it is being updated
+void perf_get(perf_probe_id_t id, perf_probe_t *out);
+const char *perf_name(perf_probe_id_t id);
+
+#if PERF_ENABLE
+
+#include "main.h"
+
+static inline uint32_t perf_begin(void) {
+    return DWT->CYCCNT;
+}
+
+void perf_end(perf_probe_id_t id, uint32_t start);
+
+typedef struct {
+    perf_probe_id_t id;
+    uint32_t start;
+} perf_scope_t;
+
+static inline void perf_scope_end(perf_scope_t *s) {
+    perf_end(s->id, s->start);
+}
+
+#define PERF_SCOPE_NAME2(line)  perf_scope_##line
+#define PERF_SCOPE_NAME(line)   PERF_SCOPE_NAME2(line)
+#define PERF_SCOPE(probe) \
+    perf_scope_t PERF_SCOPE_NAME(__LINE__) __attribute__((cleanup(perf_scope_end))) = \
+        { (probe), perf_begin() }
+
+#else
+
+static inline uint32_t perf_begin(void) {
+    return 0;
+}
+
+static inline void perf_end(perf_probe_id_t id, uint32_t start) {
+    (void)id;
+    (void)start;
+}
+
+#define PERF_SCOPE(probe)   do { } while (0)
+
+#endif // PERF_ENABLE
+
+#endif // PERF_H
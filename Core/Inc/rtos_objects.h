@@ -0,0 +1,44 @@
+#ifndef RTOS_OBJECTS_H
+#define RTOS_OBJECTS_H
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "stream_buffer.h"
+#include "event_groups.h"
+#include "i2c_bus.h"
+
+// Every application task, queue, stream buffer, event group and semaphore,
+// created from one table in rtos_objects.c. Stacks and control blocks are
+// static, so the linker accounts for all of it and nothing comes from the
+// FreeRTOS heap. The storage of object <obj> is named <obj>_stack/<obj>_tcb
+// or <obj>_storage/<obj>_cb, which is what Tools/ram_report.py goes by; the
+// default task is CubeMX generated and stays in freertos.c.
+
+// Tasks
+extern TaskHandle_t sensors_task_handle;
+extern TaskHandle_t moisture_display_task_handle;
+extern TaskHandle_t moisture_log_task_handle;
+extern TaskHandle_t oled_task_handle;
+extern TaskHandle_t cli_task_handle;
+extern TaskHandle_t i2c_bus_task_handle;
+extern TaskHandle_t log_export_task_handle;
+extern TaskHandle_t alarm_task_handle;
+
+// Queues, stream buffers and event groups
+extern QueueHandle_t i2c_bus_queue[I2C_PRIO_COUNT];
+extern StreamBufferHandle_t cli_uart_rx_stream;
+extern EventGroupHandle_t app_sched_events;
+
+// Semaphores
+extern SemaphoreHandle_t cli_uart_tx_space;
+extern SemaphoreHandle_t spi_flash_mutex;
+extern SemaphoreHandle_t log_flash_mutex;
+extern SemaphoreHandle_t ads1115_sem;
+
+// Create everything in the table. First thing in MX_FREERTOS_Init, before
+// the scheduler starts.
+void rtos_objects_create(void);
+
+#endif // RTOS_OBJECTS_H
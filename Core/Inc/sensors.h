@@ -0,0 +1,30 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+
+#define SENSOR_ADC_CHANNELS   4   // ADC1 IN0..IN3 (PA0..PA3)
+#define SENSOR_ADS_CHANNELS   4   // ADS1115 AIN0..AIN3
+#define SENSOR_M1             0   // ADC index of moisture sensor M1 (PA0)
+#define SENSOR_M2             1   // ADC index of moisture sensor M2 (PA1)
+
+// One coherent set of readings. The acquisition task is the only code that
+// touches ADC1 and the ADS1115; everyone else reads the latest snapshot.
+typedef struct {
+    uint32_t version;        // increments with every published sample
+    uint32_t timestamp_ms;   // tick count when the sample was taken
+    uint16_t adc[SENSOR_ADC_CHANNELS];
+    int16_t ads[SENSOR_ADS_CHANNELS];
+} sensor_snapshot_t;
+
+void SensorTask(void *argument);
+
+// Copy the latest snapshot into *out. Returns its version (0 = no sample yet).
+uint32_t sensors_get(sensor_snapshot_t *out);
+
+// Ask the acquisition task for an immediate sample and wait for it to be
+// published. Returns 1 when a newer snapshot was copied into *out.
+int sensors_sample_now(sensor_snapshot_t *out, TickType_t timeout);
+
+#endif // SENSORS_H
@@ -0,0 +1,50 @@
+#ifndef SPI_FLASH_H
+#define SPI_FLASH_H
+
+#include <stdint.h>
+
+// Shared driver for the SPI NOR flash on SPI1 (CS = FLASH_CS_Pin).
+// All users (flash log, CLI tests) go through here so accesses are
+// serialised and completion is detected from the status register instead
+// of fixed delays.
+
+#define SPI_FLASH_CMD_WREN      0x06
+#define SPI_FLASH_CMD_RDSR      0x05
+#define SPI_FLASH_CMD_READ      0x03
+#define SPI_FLASH_CMD_PP        0x02
+#define SPI_FLASH_CMD_SE        0x20
+#define SPI_FLASH_CMD_RDID      0x9F
+
+#define SPI_FLASH_SR_WIP        0x01
+
+// Timing and geometry of one part; typical values decide when to start
+// polling, maximum values when to give up
+typedef struct {
+    const char *name;
+    uint32_t jedec_id;          // manufacturer << 16 | type << 8 | capacity
+    uint32_t size;
+    uint16_t page_size;
+    uint16_t sector_size;
+    uint16_t page_prog_typ_us;
+    uint16_t page_prog_max_us;
+    uint16_t sector_erase_typ_ms;
+    uint16_t sector_erase_max_ms;
+} spi_flash_chip_t;
+
+// Read the JEDEC ID and select the matching descriptor (conservative
+// generic timings if the part is unknown)
+void spi_flash_init(void);
+const spi_flash_chip_t *spi_flash_chip(void);
+uint32_t spi_flash_read_id(void);
+
+// All return 1 on success, 0 on SPI error or timeout
+int spi_flash_read(uint32_t addr, uint8_t *data, uint32_t len);
+int spi_flash_program(uint32_t addr, const uint8_t *data, uint32_t len);   // splits at page boundaries
+int spi_flash_erase_sector(uint32_t addr);
+
+// Data phases of SPI_FLASH_DMA_MIN bytes or more run on the SPI1 DMA
+// streams; the calling task blocks on its direct-to-task notification until
+// the transfer completes, so it must not rely on that notification for
+// anything else while it is inside this driver.
+
+#endif // SPI_FLASH_H
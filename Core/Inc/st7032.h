@@ -14,5 +14,6 @@ void st7032_write_str(const char *str);
 void st7032_clear(void);
 void st7032_draw_moisture_bar(uint8_t line, uint8_t percent);
 void st7032_write_data(uint8_t data);
+void st7032_init_bar_chars(void);
 
 #endif
@@ -0,0 +1,77 @@
+#ifndef SYSMON_H
+#define SYSMON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "stream_buffer.h"
+
+// Run-time view of the RTOS: CPU load, state and stack high-water mark per
+// task, heap headroom and the fill level of the queues that matter.
+//
+// The kernel's run-time counter is the DWT cycle counter, extended in
+// software and scaled down by 2^SYSMON_RUNTIME_SHIFT so it runs for hours
+// before wrapping. Loads are computed over the window since the previous
+// sample, so `top` measures for a moment before printing and a host that
+// polls the telemetry snapshot gets the load since its last poll.
+//
+// Stack overflows (configCHECK_FOR_STACK_OVERFLOW 2) reset the board; the
+// name of the task is kept in .noinit RAM and reported after the restart.
+
+#define SYSMON_MAX_TASKS        16
+#define SYSMON_MAX_QUEUES       8
+#define SYSMON_RUNTIME_SHIFT    8       // run-time counter = cycles / 256
+#define SYSMON_TOP_WINDOW_MS    1000    // default measuring time of `top`
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    uint8_t number;             // creation order, as the kernel counts
+    uint8_t state;              // eTaskState
+    uint8_t prio;
+    uint16_t cpu_permille;      // share of the window
+    uint16_t stack_free;        // words never touched since the task started
+} sysmon_task_t;
+
+typedef struct {
+    const char *name;
+    uint16_t waiting;           // items (bytes for a stream buffer)
+    uint16_t length;
+} sysmon_queue_t;
+
+typedef struct {
+    uint32_t uptime_ms;
+    uint32_t window_ms;         // what the loads cover; 0 on the first sample
+    size_t heap_free;
+    size_t heap_min;            // lowest free heap since boot
+    uint8_t task_count;
+    uint8_t queue_count;
+    sysmon_task_t task[SYSMON_MAX_TASKS];
+    sysmon_queue_t queue[SYSMON_MAX_QUEUES];
+} sysmon_snapshot_t;
+
+// Registers the `top` command and reports a stack overflow that caused
+// the last reset
+void sysmon_init(void);
+
+// Add a queue or stream buffer to the ones `top` shows; returns 0 when the
+// table is full. name must stay valid.
+int sysmon_watch_queue(const char *name, QueueHandle_t q);
+int sysmon_watch_stream(const char *name, StreamBufferHandle_t sb, size_t size);
+
+// Take a snapshot and start a new load window. CLI task only: the result
+// lives in a static buffer that the next call overwrites.
+const sysmon_snapshot_t *sysmon_sample(void);
+
+// Run-time counter for the kernel (portCONFIGURE_TIMER_FOR_RUN_TIME_STATS
+// and portGET_RUN_TIME_COUNTER_VALUE, see freertos.c)
+void sysmon_runtime_init(void);
+uint32_t sysmon_runtime_now(void);
+// Cycles that passed with the core clock stopped (tickless idle), which the
+// cycle counter did not see
+void sysmon_runtime_skip(uint32_t cycles);
+
+// From vApplicationStackOverflowHook: record the task and reset
+void sysmon_stack_overflow(const char *task) __attribute__((noreturn));
+
+#endif // SYSMON_H
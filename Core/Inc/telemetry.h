@@ -0,0 +1,134 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary mode for USART6, entered with the CLI command `bin`.
+//
+// Every message is one frame: COBS-encoded and terminated by a 0x00 byte.
+// Decoded, a frame is
+//   version (1) | type (1) | seq (1) | body (0..TLM_MAX_BODY) | crc16 (2, LE)
+// with CRC-16/CCITT-FALSE over everything before it. Replies carry the seq
+// of the request they answer; unsolicited frames (samples, text) count up
+// on their own. Frames with a bad CRC, unknown type or wrong version are
+// answered with TLM_NAK. While binary mode is active, text written with
+// cli_write/cli_printf (command output, debug prints) is sent as TLM_TEXT
+// frames so it cannot corrupt the stream.
+
+#define TLM_PROTO_VERSION   1
+#define TLM_MAX_BODY        136
+#define TLM_LOG_PER_FRAME   8       // log records per TLM_LOG_DATA frame
+#define TLM_TEXT_MAX        128
+
+typedef enum {
+    // host -> device
+    TLM_HELLO       = 0x01,     // empty; answered with TLM_HELLO + tlm_hello_t
+    TLM_EXIT        = 0x02,     // back to the text CLI (after the ACK)
+    TLM_STREAM      = 0x03,     // tlm_stream_t: live samples on/off
+    TLM_LOG_READ    = 0x04,     // tlm_log_read_t: background log export
+    TLM_CMD         = 0x05,     // CLI command line; output as TLM_TEXT, then TLM_CMD_DONE
+    TLM_SYSMON      = 0x06,     // empty; answered with TLM_SYS_INFO, TLM_SYS_TASK per task,
+                                // TLM_SYS_QUEUE per watched queue
+
+    // device -> host
+    TLM_ACK         = 0x40,     // tlm_ack_t
+    TLM_NAK         = 0x41,     // tlm_ack_t
+    TLM_SAMPLE      = 0x42,     // sensor_snapshot_t
+    TLM_LOG_DATA    = 0x43,     // tlm_log_data_t + records
+    TLM_LOG_END     = 0x44,     // tlm_log_end_t
+    TLM_TEXT        = 0x45,     // UTF-8 text, not terminated
+    TLM_CMD_DONE    = 0x46,     // empty
+    TLM_SYS_INFO    = 0x47,     // tlm_sys_info_t
+    TLM_SYS_TASK    = 0x48,     // tlm_sys_task_t + task name, not terminated
+    TLM_SYS_QUEUE   = 0x49,     // tlm_sys_queue_t + queue name, not terminated
+} tlm_type_t;
+
+typedef enum {
+    TLM_OK = 0,
+    TLM_ERR_CRC,
+    TLM_ERR_VERSION,
+    TLM_ERR_TYPE,
+    TLM_ERR_LENGTH,
+    TLM_ERR_BUSY,
+} tlm_status_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t proto;
+    uint8_t log_entry_size;
+    uint32_t log_count;
+    uint32_t log_first_id;      // id of the oldest record
+    uint32_t uptime_ms;
+} tlm_hello_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t period_ms;         // 0 = off
+} tlm_stream_t;
+
+// Log records are addressed by id (see log_flash_first_id). The export is
+// acknowledged, runs in the background and ends with TLM_LOG_END; a new
+// TLM_LOG_READ from the id in that frame resumes an interrupted export.
+typedef struct __attribute__((packed)) {
+    uint32_t start;             // first record id
+    uint32_t count;             // 0 = to the end of the log
+    uint32_t t_min;             // timestamp filter, inclusive
+    uint32_t t_max;
+    uint16_t rate;              // records per second, 0 = wire speed
+} tlm_log_read_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t id;                // id of the first record in this frame
+    uint8_t count;
+    uint8_t valid;              // bit n set = record n passed its CRC
+} tlm_log_data_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t next;              // first id not sent
+} tlm_log_end_t;
+
+// RTOS snapshot, see sysmon.h. Loads cover the time since the previous
+// snapshot (window_ms, 0 on the first), so a host polling at a steady rate
+// gets the load per poll period.
+typedef struct __attribute__((packed)) {
+    uint32_t uptime_ms;
+    uint32_t window_ms;
+    uint32_t heap_free;
+    uint32_t heap_min;
+    uint8_t tasks;              // TLM_SYS_TASK frames that follow
+    uint8_t queues;             // then TLM_SYS_QUEUE frames
+} tlm_sys_info_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t number;
+    uint8_t state;              // 0 running, 1 ready, 2 blocked, 3 suspended, 4 deleted
+    uint8_t prio;
+    uint16_t cpu_permille;
+    uint16_t stack_free;        // words
+} tlm_sys_task_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t waiting;
+    uint16_t length;
+} tlm_sys_queue_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;               // type of the request being answered
+    uint8_t seq;
+    uint8_t status;             // tlm_status_t
+} tlm_ack_t;
+
+// Registers the `bin` command
+void telemetry_init(void);
+void telemetry_enter(void);
+void telemetry_exit(void);
+int telemetry_active(void);
+
+// CLI task side: feed received bytes, and service periodic work. poll
+// returns how long the caller may sleep (ms) before calling it again.
+void telemetry_input(const uint8_t *data, size_t len);
+uint32_t telemetry_poll(void);
+
+// Send one frame; returns 1 if it was queued
+int telemetry_send(uint8_t type, uint8_t seq, const void *body, uint16_t len);
+
+#endif // TELEMETRY_H
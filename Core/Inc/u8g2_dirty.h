@@ -0,0 +1,27 @@
+#ifndef U8G2_DIRTY_H
+#define U8G2_DIRTY_H
+
+#include "u8g2.h"
+
+// Delta refresh for u8g2 full-buffer mode. A shadow copy holds what the
+// panel currently shows; u8g2_SendDirty() compares the frame buffer against
+// it tile by tile and only transmits runs of changed tiles. This suits code
+// that redraws the whole frame (u8g2_ClearBuffer + draw) every cycle.
+
+// Clean gaps up to this many tiles are sent rather than splitting a run,
+// since each run costs a tile's worth of addressing overhead
+#define U8G2_DIRTY_MERGE_GAP   1
+
+typedef struct {
+    uint8_t *shadow;     // u8g2_GetBufferSize() bytes
+    uint16_t size;
+    uint8_t valid;       // 0 = panel contents unknown, send everything
+} u8g2_dirty_t;
+
+void u8g2_DirtyInit(u8g2_dirty_t *d, uint8_t *shadow, uint16_t size);
+void u8g2_DirtyInvalidate(u8g2_dirty_t *d);
+
+// Send changed tiles. Returns the number of tiles transmitted.
+uint16_t u8g2_SendDirty(u8g2_t *u8g2, u8g2_dirty_t *d);
+
+#endif // U8G2_DIRTY_H
@@ -37,6 +37,7 @@ extern UART_HandleTypeDef huart6;
 
 
 /* USER CODE BEGIN Private defines */
+extern DMA_HandleTypeDef hdma_usart6_tx;
 
 /* USER CODE END Private defines */
 
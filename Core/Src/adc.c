@@ -21,10 +21,63 @@
 #include "adc.h"
 
 /* USER CODE BEGIN 0 */
+#include "tim.h"
+#include "perf.h"
+#include "lowpower.h"
+#include <string.h>
+
+// Circular DMA target: two halves of ADC_OVERSAMPLE scans each. While DMA
+// fills one half, the half/full transfer callback decimates the other.
+static uint16_t adc_dma_buf[2][ADC_OVERSAMPLE][ADC_SCAN_CHANNELS];
+
+// Latest decimated result, published from the DMA ISR. adc_scan_seq is odd
+// while the ISR is updating adc_scan_avg.
+static volatile uint32_t adc_scan_seq = 0;
+static volatile uint16_t adc_scan_avg[ADC_SCAN_CHANNELS];
+static volatile uint8_t adc_scan_running;
+
+// Fastest ADC clock the datasheet allows from the current PCLK2
+static uint32_t adc_clock_prescaler(uint32_t *adcclk)
+{
+  static const uint32_t prescalers[] = {
+    ADC_CLOCK_SYNC_PCLK_DIV2, ADC_CLOCK_SYNC_PCLK_DIV4,
+    ADC_CLOCK_SYNC_PCLK_DIV6, ADC_CLOCK_SYNC_PCLK_DIV8
+  };
+  uint32_t pclk2 = HAL_RCC_GetPCLK2Freq();
+  uint32_t i;
+
+  for (i = 0; i < 3 && pclk2 / (2U * (i + 1U)) > ADC_CLOCK_MAX_HZ; i++)
+  {
+  }
+  *adcclk = pclk2 / (2U * (i + 1U));
+  return prescalers[i];
+}
+
+// Shortest sampling time that still gives the probes ADC_SAMPLE_MIN_NS at
+// that clock, so readings do not change with the clock profile
+static uint32_t adc_sampling_time(uint32_t adcclk)
+{
+  static const struct { uint16_t cycles; uint32_t code; } times[] = {
+    { 3, ADC_SAMPLETIME_3CYCLES }, { 15, ADC_SAMPLETIME_15CYCLES },
+    { 28, ADC_SAMPLETIME_28CYCLES }, { 56, ADC_SAMPLETIME_56CYCLES },
+    { 84, ADC_SAMPLETIME_84CYCLES }, { 112, ADC_SAMPLETIME_112CYCLES },
+    { 144, ADC_SAMPLETIME_144CYCLES }, { 480, ADC_SAMPLETIME_480CYCLES },
+  };
+
+  for (uint32_t i = 0; i < sizeof(times) / sizeof(times[0]); i++)
+  {
+    if ((uint64_t)times[i].cycles * 1000000000U >= (uint64_t)ADC_SAMPLE_MIN_NS * adcclk)
+    {
+      return times[i].code;
+    }
+  }
+  return ADC_SAMPLETIME_480CYCLES;
+}
 
 /* USER CODE END 0 */
 
 ADC_HandleTypeDef hadc1;
+DMA_HandleTypeDef hdma_adc1;
 
 /* ADC1 init function */
 void MX_ADC1_Init(void)
@@ -99,6 +152,26 @@ void HAL_ADC_MspInit(ADC_HandleTypeDef* adcHandle)
     HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
   /* USER CODE BEGIN ADC1_MspInit 1 */
+    /* ADC1 DMA Init */
+    hdma_adc1.Instance = DMA2_Stream0;
+    hdma_adc1.Init.Channel = DMA_CHANNEL_0;
+    hdma_adc1.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_adc1.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_adc1.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_adc1.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma_adc1.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    hdma_adc1.Init.Mode = DMA_CIRCULAR;
+    hdma_adc1.Init.Priority = DMA_PRIORITY_MEDIUM;
+    hdma_adc1.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if (HAL_DMA_Init(&hdma_adc1) != HAL_OK)
+    {
+      Error_Handler();
+    }
+    __HAL_LINKDMA(adcHandle, DMA_Handle, hdma_adc1);
+
+    /* DMA2_Stream0_IRQn interrupt configuration */
+    HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
 
   /* USER CODE END ADC1_MspInit 1 */
   }
@@ -124,11 +197,131 @@ void HAL_ADC_MspDeInit(ADC_HandleTypeDef* adcHandle)
     HAL_GPIO_DeInit(GPIOA, GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3);
 
   /* USER CODE BEGIN ADC1_MspDeInit 1 */
+    HAL_DMA_DeInit(adcHandle->DMA_Handle);
+    HAL_NVIC_DisableIRQ(DMA2_Stream0_IRQn);
 
   /* USER CODE END ADC1_MspDeInit 1 */
   }
 }
 
 /* USER CODE BEGIN 1 */
+// Reconfigure ADC1 from the single-channel software-start setup generated
+// above into a TIM1 triggered scan of IN0..IN3 and start circular DMA.
+// TIM1 and the ADC need their clocks, so STOP mode is off until
+// adc_scan_stop. The ADC and TIM1 clocks are derived here from whatever
+// clock profile is active; the profile does not change during a scan.
+void adc_scan_start(void)
+{
+  static const uint32_t channels[ADC_SCAN_CHANNELS] = {
+    ADC_CHANNEL_0, ADC_CHANNEL_1, ADC_CHANNEL_2, ADC_CHANNEL_3
+  };
+  ADC_ChannelConfTypeDef sConfig = {0};
+  uint32_t adcclk;
+
+  lowpower_hold(LP_HOLD_ADC);
+  adc_scan_running = 1;
+  hadc1.Init.ClockPrescaler = adc_clock_prescaler(&adcclk);
+  hadc1.Init.ScanConvMode = ENABLE;
+  hadc1.Init.ContinuousConvMode = DISABLE;
+  hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+  hadc1.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T1_CC1;
+  hadc1.Init.NbrOfConversion = ADC_SCAN_CHANNELS;
+  hadc1.Init.DMAContinuousRequests = ENABLE;
+  hadc1.Init.EOCSelection = ADC_EOC_SEQ_CONV;
+  if (HAL_ADC_Init(&hadc1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  // Longer sample time than the 3 cycles used for one-off reads: the
+  // moisture probes are high impedance and we have plenty of time per scan.
+  sConfig.SamplingTime = adc_sampling_time(adcclk);
+  for (uint32_t i = 0; i < ADC_SCAN_CHANNELS; i++)
+  {
+    sConfig.Channel = channels[i];
+    sConfig.Rank = i + 1;
+    if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+    {
+      Error_Handler();
+    }
+  }
+
+  HAL_ADC_Start_DMA(&hadc1, (uint32_t *)adc_dma_buf,
+                    sizeof(adc_dma_buf) / sizeof(adc_dma_buf[0][0][0]));
+  tim1_set_rate(ADC_SCAN_RATE_HZ);
+  HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_1);
+}
+
+void adc_scan_stop(void)
+{
+  HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_1);
+  HAL_ADC_Stop_DMA(&hadc1);
+  adc_scan_running = 0;
+  lowpower_release(LP_HOLD_ADC);
+}
+
+int adc_scan_active(void)
+{
+  return adc_scan_running;
+}
+
+// Copy the latest decimated sample. Returns the number of blocks produced so
+// far (0 = none yet), so callers can tell a stale result from a fresh one.
+uint32_t adc_scan_read(uint16_t out[ADC_SCAN_CHANNELS])
+{
+  uint32_t seq;
+
+  do {
+    seq = adc_scan_seq;
+    __DMB();
+    for (uint32_t ch = 0; ch < ADC_SCAN_CHANNELS; ch++)
+    {
+      out[ch] = adc_scan_avg[ch];
+    }
+    __DMB();
+  } while ((seq & 1) || seq != adc_scan_seq);
+
+  return seq / 2;
+}
+
+static void adc_scan_decimate(uint16_t (*block)[ADC_SCAN_CHANNELS])
+{
+  uint32_t t0 = perf_begin();
+  uint32_t sum[ADC_SCAN_CHANNELS] = {0};
+
+  for (uint32_t i = 0; i < ADC_OVERSAMPLE; i++)
+  {
+    for (uint32_t ch = 0; ch < ADC_SCAN_CHANNELS; ch++)
+    {
+      sum[ch] += block[i][ch];
+    }
+  }
+
+  adc_scan_seq++;
+  __DMB();
+  for (uint32_t ch = 0; ch < ADC_SCAN_CHANNELS; ch++)
+  {
+    adc_scan_avg[ch] = (uint16_t)((sum[ch] + ADC_OVERSAMPLE / 2) / ADC_OVERSAMPLE);
+  }
+  __DMB();
+  adc_scan_seq++;
+  perf_end(PERF_ADC_SAMPLE, t0);
+}
+
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* adcHandle)
+{
+  if (adcHandle->Instance == ADC1)
+  {
+    adc_scan_decimate(adc_dma_buf[0]);
+  }
+}
+
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* adcHandle)
+{
+  if (adcHandle->Instance == ADC1)
+  {
+    adc_scan_decimate(adc_dma_buf[1]);
+  }
+}
 
 /* USER CODE END 1 */
@@ -1,22 +1,211 @@
 // ads1115.c
 #include "ads1115.h"
-#include "i2c.h"
+#include "main.h"
+#include "i2c_bus.h"
+#include "perf.h"
 #include "stm32f4xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "rtos_objects.h"
 
-#define ADS1115_ADDR     (0x48 << 1)
-#define I2C_TIMEOUT      100
+#define ADS_REG_CONVERSION  0x00
+#define ADS_REG_CONFIG      0x01
+#define ADS_REG_LO_THRESH   0x02
+#define ADS_REG_HI_THRESH   0x03
+
+#define ADS_CFG_OS          0x8000  // write: start single shot, read: 1 = idle
+#define ADS_CFG_MUX_SINGLE  0x4000  // AINx vs GND, channel in bits [13:12]
+#define ADS_CFG_MODE_SINGLE 0x0100
+#define ADS_CFG_COMP_QUE_1  0x0000  // assert ALERT/RDY after one conversion
+#define ADS_CFG_COMP_OFF    0x0003
+
+// Nominal conversion time per data rate, in microseconds
+static const uint32_t ads_conv_us[8] = {
+    125000, 62500, 31250, 15625, 7813, 4000, 2106, 1163
+};
+
+typedef enum {
+    ADS_ST_CONFIG,   // write config register, starting the conversion
+    ADS_ST_WAIT,     // sleep until ALERT/RDY or the OS bit reports ready
+    ADS_ST_READ,     // fetch the conversion register
+    ADS_ST_NEXT,     // advance the MUX to the next channel
+    ADS_ST_DONE,
+} ads_state_t;
+
+static volatile ads_pga_t ads_pga = ADS_PGA_6144MV;
+static volatile ads_rate_t ads_rate = ADS_DR_128SPS;
+
+static volatile uint8_t ads_rdy;
+
+static uint16_t ads_config_word(uint8_t ch, uint16_t mode) {
+    uint16_t cfg = ADS_CFG_MUX_SINGLE | ((uint16_t)(ch & 0x03) << 12) |
+                   ((uint16_t)ads_pga << 9) | mode | ((uint16_t)ads_rate << 5);
+#if ADS1115_USE_ALRT
+    cfg |= ADS_CFG_COMP_QUE_1;
+#else
+    cfg |= ADS_CFG_COMP_OFF;
+#endif
+    return cfg;
+}
+
+static TickType_t ads_conv_ticks(void) {
+    // +10% for the internal oscillator tolerance, rounded up to whole ticks
+    uint32_t us = ads_conv_us[ads_rate] + ads_conv_us[ads_rate] / 10;
+    return pdMS_TO_TICKS((us + 999) / 1000) + 1;
+}
+
+// Sleep until the RDY flag is set by the EXTI ISR or the timeout expires
+static int ads_wait_flag(volatile uint8_t *flag, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+
+    while (!*flag) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) return 0;
+        xSemaphoreTake(ads1115_sem, timeout - elapsed);
+    }
+    return 1;
+}
+
+static int ads_write_reg(uint8_t reg, uint16_t value) {
+    uint8_t buf[2] = { value >> 8, value & 0xFF };
+    return i2c_bus_mem_write(ADS1115_ADDR, reg, buf, 2, I2C_PRIO_HIGH) == I2C_OK;
+}
+
+static int ads_read_reg(uint8_t reg, uint16_t *value) {
+    uint8_t buf[2];
+
+    if (i2c_bus_mem_read(ADS1115_ADDR, reg, buf, 2, I2C_PRIO_HIGH) != I2C_OK) return 0;
+    *value = ((uint16_t)buf[0] << 8) | buf[1];
+    return 1;
+}
+
+static int ads_start(uint8_t ch, uint16_t mode) {
+    ads_rdy = 0;
+    return ads_write_reg(ADS_REG_CONFIG, ads_config_word(ch, mode));
+}
+
+static int ads_wait_ready(void) {
+    TickType_t conv = ads_conv_ticks();
+    uint16_t cfg;
+
+#if ADS1115_USE_ALRT
+    if (ads_wait_flag(&ads_rdy, conv)) return 1;
+#else
+    vTaskDelay(conv);
+#endif
+
+    // No RDY edge (pin not wired, or a slow part): poll the OS bit
+    for (uint8_t tries = 0; tries < 4; tries++) {
+        if (ads_read_reg(ADS_REG_CONFIG, &cfg) && (cfg & ADS_CFG_OS)) return 1;
+        vTaskDelay(1);
+    }
+    return 0;
+}
+
+void ads_init(void) {
+#if ADS1115_USE_ALRT
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+    // Hi_thresh MSB = 1 and Lo_thresh MSB = 0 turns ALERT into a
+    // conversion-ready output (active low, open drain)
+    ads_write_reg(ADS_REG_LO_THRESH, 0x0000);
+    ads_write_reg(ADS_REG_HI_THRESH, 0x8000);
+
+    GPIO_InitStruct.Pin = ADS_ALRT_Pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    HAL_GPIO_Init(ADS_ALRT_GPIO_Port, &GPIO_InitStruct);
+    HAL_NVIC_SetPriority(ADS_ALRT_EXTI_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(ADS_ALRT_EXTI_IRQn);
+#endif
+}
+
+void ads_set_config(ads_pga_t pga, ads_rate_t rate) {
+    if (pga <= ADS_PGA_256MV) ads_pga = pga;
+    if (rate <= ADS_DR_860SPS) ads_rate = rate;
+}
+
+void ads_get_config(ads_pga_t *pga, ads_rate_t *rate) {
+    *pga = ads_pga;
+    *rate = ads_rate;
+}
+
+uint8_t ads_scan(int16_t out[ADS1115_CHANNELS]) {
+    ads_state_t state = ADS_ST_CONFIG;
+    uint8_t ch = 0;
+    uint8_t valid = 0;
+    uint16_t raw;
+    uint32_t t0 = 0;
+
+    while (state != ADS_ST_DONE) {
+        switch (state) {
+        case ADS_ST_CONFIG:
+            t0 = perf_begin();
+            state = ads_start(ch, ADS_CFG_OS | ADS_CFG_MODE_SINGLE) ? ADS_ST_WAIT : ADS_ST_NEXT;
+            break;
+        case ADS_ST_WAIT:
+            state = ads_wait_ready() ? ADS_ST_READ : ADS_ST_NEXT;
+            break;
+        case ADS_ST_READ:
+            if (ads_read_reg(ADS_REG_CONVERSION, &raw)) {
+                out[ch] = (int16_t)raw;
+                valid |= 1 << ch;
+                perf_end(PERF_ADS_READ, t0);
+            }
+            state = ADS_ST_NEXT;
+            break;
+        case ADS_ST_NEXT:
+        default:
+            state = (++ch < ADS1115_CHANNELS) ? ADS_ST_CONFIG : ADS_ST_DONE;
+            break;
+        }
+    }
+    return valid;
+}
 
 int16_t ads_read_channel(uint8_t ch) {
+    uint32_t t0 = perf_begin();
+    uint16_t raw;
+
+    if (ch > 3) return 0;
+    if (!ads_start(ch, ADS_CFG_OS | ADS_CFG_MODE_SINGLE)) return 0;
+    if (!ads_wait_ready()) return 0;
+    if (!ads_read_reg(ADS_REG_CONVERSION, &raw)) return 0;
+    perf_end(PERF_ADS_READ, t0);
+    return (int16_t)raw;
+}
+
+int ads_continuous_start(uint8_t ch) {
     if (ch > 3) return 0;
+    return ads_start(ch, 0);
+}
+
+int ads_continuous_read(int16_t *value) {
+    uint16_t raw;
 
-    uint8_t config[] = {0x01, 0xC1 | (ch << 4), 0x83};  // MUX config
-    uint8_t pointer = 0x00;
-    uint8_t result[2] = {0};
+    // In continuous mode the OS bit always reads "busy", so without an RDY
+    // edge just wait one conversion period for a fresh result
+#if ADS1115_USE_ALRT
+    ads_rdy = 0;
+    ads_wait_flag(&ads_rdy, ads_conv_ticks());
+#else
+    vTaskDelay(ads_conv_ticks());
+#endif
+    if (!ads_read_reg(ADS_REG_CONVERSION, &raw)) return 0;
+    *value = (int16_t)raw;
+    return 1;
+}
+
+void ads_continuous_stop(void) {
+    // Back to single-shot mode, which powers the converter down
+    ads_write_reg(ADS_REG_CONFIG, ads_config_word(0, ADS_CFG_MODE_SINGLE));
+}
 
-    if (HAL_I2C_Master_Transmit(&hi2c1, ADS1115_ADDR, config, 3, I2C_TIMEOUT) != HAL_OK) return 0;
-    HAL_Delay(10);
-    if (HAL_I2C_Master_Transmit(&hi2c1, ADS1115_ADDR, &pointer, 1, I2C_TIMEOUT) != HAL_OK) return 0;
-    if (HAL_I2C_Master_Receive(&hi2c1, ADS1115_ADDR, result, 2, I2C_TIMEOUT) != HAL_OK) return 0;
+void ads_alert_irq(void) {
+    BaseType_t woken = pdFALSE;
 
-    return (int16_t)((result[0] << 8) | result[1]);
+    ads_rdy = 1;
+    if (ads1115_sem != NULL) xSemaphoreGiveFromISR(ads1115_sem, &woken);
+    portYIELD_FROM_ISR(woken);
 }
@@ -0,0 +1,193 @@
+#include "app_sched.h"
+#include "moisture.h"
+#include "rtos_objects.h"
+#include "cli.h"
+#include "cli_uart.h"
+#include "task.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHED_PROBES    2       // SENSOR_M1, SENSOR_M2
+
+static const char *const event_names[SCHED_EV_COUNT] = { "sample", "threshold", "log" };
+static const char *const subscriber_names[SCHED_SUBSCRIBER_COUNT] = { "lcd", "oled", "logger", "alarm" };
+
+// Written by the CLI, read by the sensor task
+static volatile uint32_t sample_ms = SCHED_SAMPLE_MS;
+static volatile uint32_t log_ms = SCHED_LOG_MS;
+static volatile uint8_t alarm_pct = SCHED_ALARM_PCT;
+static volatile uint8_t log_restart = 1;
+
+static volatile uint8_t subscribed[SCHED_SUBSCRIBER_COUNT];
+static volatile uint32_t alarms;
+static uint32_t posted[SCHED_EV_COUNT];
+static uint32_t wakeups[SCHED_SUBSCRIBER_COUNT];
+
+// Sensor task only
+static TickType_t next_sample;
+static TickType_t next_log;
+
+// pdMS_TO_TICKS multiplies in 32 bits and wraps above ~71 min at 1 kHz;
+// the log period may be up to a day
+static TickType_t ms_to_ticks(uint32_t ms) {
+    return (TickType_t)(((uint64_t)ms * configTICK_RATE_HZ) / 1000U);
+}
+
+static EventBits_t sub_bits(sched_subscriber_t sub, uint32_t events) {
+    return (EventBits_t)(events & SCHED_EV_ALL) << (sub * SCHED_EV_COUNT);
+}
+
+void sched_subscribe(sched_subscriber_t sub, uint32_t events) {
+    if (sub >= SCHED_SUBSCRIBER_COUNT) return;
+    subscribed[sub] = (uint8_t)(events & SCHED_EV_ALL);
+}
+
+uint32_t sched_wait_timeout(sched_subscriber_t sub, TickType_t timeout) {
+    EventBits_t mask = sub_bits(sub, SCHED_EV_ALL);
+    EventBits_t bits;
+
+    do {
+        bits = xEventGroupWaitBits(app_sched_events, mask, pdTRUE, pdFALSE, timeout);
+    } while ((bits & mask) == 0 && timeout == portMAX_DELAY);
+    if ((bits & mask) == 0) return 0;
+    wakeups[sub]++;
+    return (uint32_t)(bits >> (sub * SCHED_EV_COUNT)) & SCHED_EV_ALL;
+}
+
+uint32_t sched_wait(sched_subscriber_t sub) {
+    return sched_wait_timeout(sub, portMAX_DELAY);
+}
+
+void sched_post(uint32_t events) {
+    EventBits_t bits = 0;
+
+    for (uint32_t e = 0; e < SCHED_EV_COUNT; e++) {
+        if (events & (1U << e)) posted[e]++;
+    }
+    for (uint32_t s = 0; s < SCHED_SUBSCRIBER_COUNT; s++) {
+        bits |= sub_bits((sched_subscriber_t)s, subscribed[s] & events);
+    }
+    if (bits != 0) xEventGroupSetBits(app_sched_events, bits);
+}
+
+uint32_t sched_alarms(void) {
+    return alarms;
+}
+
+// Same percentages the displays show, so an alarm always matches them
+static uint32_t check_alarms(const sensor_snapshot_t *snap) {
+    static const uint8_t channel[SCHED_PROBES] = { SENSOR_M1, SENSOR_M2 };
+    uint32_t now = alarms;
+    uint8_t level = alarm_pct;
+
+    for (uint32_t i = 0; i < SCHED_PROBES; i++) {
+        const moisture_cal_t *cal = (channel[i] == SENSOR_M1) ? &m1_cal : &m2_cal;
+        uint8_t pct = moisture_percent(snap->adc[channel[i]], cal);
+        uint32_t bit = 1U << channel[i];
+
+        if (level == 0 || pct >= level + SCHED_ALARM_HYST_PCT) {
+            now &= ~bit;
+        } else if (pct < level) {
+            now |= bit;
+        }
+    }
+    return now;
+}
+
+void sched_sampled(const sensor_snapshot_t *snap) {
+    TickType_t now = xTaskGetTickCount();
+    TickType_t period = ms_to_ticks(log_ms);
+    uint32_t events = SCHED_EV_SAMPLE;
+    uint32_t a = check_alarms(snap);
+
+    if (a != alarms) {
+        alarms = a;
+        events |= SCHED_EV_THRESHOLD;
+    }
+
+    if (log_restart) {
+        log_restart = 0;
+        next_log = now + period;
+    } else if ((int32_t)(now - next_log) >= 0) {
+        events |= SCHED_EV_LOG_DUE;
+        // From the previous deadline so the log does not drift by the
+        // sampling time; start over after falling a whole period behind
+        next_log += period;
+        if ((int32_t)(now - next_log) >= 0) next_log = now + period;
+    }
+    sched_post(events);
+}
+
+// Samples on a fixed grid. A sample taken early (sensors_sample_now, a new
+// period) starts the grid over from that sample.
+TickType_t sched_next_sample(void) {
+    TickType_t now = xTaskGetTickCount();
+    TickType_t period = ms_to_ticks(sample_ms);
+
+    next_sample += period;
+    if ((int32_t)(next_sample - now) <= 0 || next_sample - now > period) next_sample = now + period;
+    return next_sample - now;
+}
+
+static void print_events(uint32_t events) {
+    if (events == 0) cli_puts(" -");
+    for (uint32_t e = 0; e < SCHED_EV_COUNT; e++) {
+        if (events & (1U << e)) cli_printf(" %s", event_names[e]);
+    }
+    cli_puts("\r\n");
+}
+
+static void cmd_sched(int argc, char **argv) {
+    uint32_t v;
+    char *end;
+    int num;
+
+    if (argc >= 3) {
+        v = strtoul(argv[2], &end, 10);
+        num = (end != argv[2] && *end == '\0');
+        if (num && strcmp(argv[1], "sample") == 0 && v >= SCHED_SAMPLE_MIN_MS && v <= SCHED_SAMPLE_MAX_MS) {
+            sample_ms = v;
+        } else if (num && strcmp(argv[1], "log") == 0 && v >= sample_ms && v <= SCHED_LOG_MAX_MS) {
+            log_ms = v;
+            log_restart = 1;
+        } else if (num && strcmp(argv[1], "alarm") == 0 && v <= 100 - SCHED_ALARM_HYST_PCT) {
+            alarm_pct = (uint8_t)v;
+        } else {
+            cli_printf("Usage: sched [sample %u..%u | log MS | alarm 0..%u]  (log >= sample, alarm 0 = off)\r\n",
+                       SCHED_SAMPLE_MIN_MS, SCHED_SAMPLE_MAX_MS, 100 - SCHED_ALARM_HYST_PCT);
+            return;
+        }
+        // Sample now so the new setting applies from here on
+        xTaskNotifyGive(sensors_task_handle);
+    } else if (argc == 2) {
+        cli_puts("Usage: sched [sample MS | log MS | alarm PCT]\r\n");
+        return;
+    }
+
+    cli_printf("Sample every %lu ms, log every %lu ms\r\n", sample_ms, log_ms);
+    if (alarm_pct == 0) {
+        cli_puts("Dry alarm off\r\n");
+    } else {
+        cli_printf("Dry alarm below %u%%, clears at %u%%:%s%s%s\r\n", alarm_pct,
+                   alarm_pct + SCHED_ALARM_HYST_PCT,
+                   (alarms & (1U << SENSOR_M1)) ? " M1" : "",
+                   (alarms & (1U << SENSOR_M2)) ? " M2" : "", alarms == 0 ? " none" : "");
+    }
+    cli_puts("Event      Posted\r\n");
+    for (uint32_t e = 0; e < SCHED_EV_COUNT; e++) {
+        cli_printf("%-9s %7lu\r\n", event_names[e], posted[e]);
+    }
+    cli_puts("Task      Wake-ups  Events\r\n");
+    for (uint32_t s = 0; s < SCHED_SUBSCRIBER_COUNT; s++) {
+        cli_printf("%-9s %7lu ", subscriber_names[s], wakeups[s]);
+        print_events(subscribed[s]);
+    }
+}
+
+static const cli_command_t sched_commands[] = {
+    { "sched", "sched [sample MS | log MS | alarm PCT] - Sampling, log period and dry alarm", cmd_sched },
+};
+
+void sched_init(void) {
+    CLI_RegisterCommands(sched_commands, sizeof(sched_commands) / sizeof(sched_commands[0]));
+}
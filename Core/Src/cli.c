@@ -1,5 +1,8 @@
 #include "cli.h"
 #include "usart.h"
+#include "cli_uart.h"
+#include "cli_history.h"
+#include "cli_script.h"
 #include "gpio.h"
 #include "adc.h"
 #include <string.h>
@@ -8,57 +11,58 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "i2c.h"
+#include "i2c_bus.h"
 #include "cmsis_os.h"
 #include "st7032.h"
 #include "spi.h"
 #include "log_flash.h"
+#include "spi_flash.h"
 #include "ads1115.h"
 #include "moisture.h"
+#include "sensors.h"
+#include "telemetry.h"
+#include "log_export.h"
+#include "perf.h"
 
 
-#define CLI_BUFFER_SIZE 64
-#define MAX_COMMANDS 20
-#define MAX_ARGS 10
+#define CLI_MAX_TABLES 12     // command tables registered by modules
 #define I2C_TIMEOUT 100
-#define CLI_INPUT_QUEUE_LEN 1
-#define CLI_DMA_RX_BUFFER_SIZE 128
-#define CLI_HISTORY_SIZE 10  // number of commands to keep
+#define CLI_RX_CHUNK 32
+#define CLI_SEARCH_MAX 24     // Ctrl-R pattern length
 #define FLASH_TOTAL_SIZE    (64 * 1024)  // 64KB
 #define FLASH_PAGE_SIZE     256
 #define FLASH_SECTOR_SIZE   4096
+// Slowest fresh sample: an ADC1 block plus four ADS1115 conversions at 8 SPS
+#define MOISTCAL_SAMPLE_MS  (ADC_BLOCK_MS + ADS1115_CHANNELS * 140 + 200)
 
-static uint8_t dma_rx_buf[CLI_DMA_RX_BUFFER_SIZE];
-static uint16_t dma_rx_pos = 0;
-static char cli_history[CLI_HISTORY_SIZE][CLI_BUFFER_SIZE];
-static int history_count = 0;       // how many commands stored
-static int history_index = 0;       // where to store next
-static int history_browse = -1;     // -1 = not browsing
+static int history_browse = -1;     // history entry being edited, -1 = new line
 
 extern UART_HandleTypeDef huart6;
 extern ADC_HandleTypeDef hadc1;
 extern I2C_HandleTypeDef hi2c1;
 extern SPI_HandleTypeDef hspi1;
 
-static const cli_command_t *command_table[MAX_COMMANDS];
-static size_t command_count = 0;
-
 static uint8_t rx_byte = 0;
-static osMessageQueueId_t cli_input_queue;
 static char temp_line[CLI_BUFFER_SIZE];
-static uint8_t temp_index = 0;
+static uint8_t temp_index = 0;      // line length
+static uint8_t cursor_pos = 0;
 
 static char last_command[CLI_BUFFER_SIZE] = {0};
 static uint8_t escape_state = 0; // Tracks ESC sequence
+static uint8_t escape_arg = 0;   // number in ESC [ n ~
 
-static int16_t ads_results[4] = {0};
+// Ctrl-R reverse search
+static uint8_t searching = 0;
+static char search_pattern[CLI_SEARCH_MAX];
+static uint8_t search_len = 0;
+static int search_match = -1;
 
-typedef struct {
-    char line[CLI_BUFFER_SIZE];
-} cli_input_t;
+static int16_t ads_results[4] = {0};
 
 // --- Forward Declarations ---
 static void CLI_ProcessCommand(const char *cmd);
 static void cmd_help(int argc, char **argv);
+static void cmd_history(int argc, char **argv);
 static void cmd_led(int argc, char **argv);
 static void cmd_adc(int argc, char **argv);
 static void cmd_i2c(int argc, char **argv);
@@ -70,361 +74,593 @@ static void cmd_flash_test_full(int argc, char **argv);
 static void cmd_logtest(int argc, char **argv);
 static void cmd_logindex(int argc, char **argv);
 static void cmd_logdump(int argc, char **argv);
+static void cmd_logflush(int argc, char **argv);
 static void cmd_moistcal(int argc, char **argv);
+static void cmd_reset(int argc, char **argv);
 static void cmd_uptime(int argc, char **argv);
 
 // --- Command Table ---
+// Kept sorted by name: lookups are a binary search per table
 static const cli_command_t commands[] = {
+    { "ads",   "ads [cfg P R] - ADS1115 inputs / set PGA, rate", cmd_ads },
+    { "flash", "flash id      - Read JEDEC ID from SPI flash", cmd_flash },
+    { "ftest", "ftest         - Stress test flash R/W", cmd_flash_test },
+	{ "ftestfull", "ftestfull     - Full flash write/read/verify", cmd_flash_test_full },
     { "help",  "help         - Show command list",             cmd_help },
-    { "led",   "led on/off   - Control LED",                  cmd_led },
-    { "read",  "read M1/M2    - Read moisture sensors",        cmd_adc },
-    { "i2c",   "i2c scan | read | write",                     cmd_i2c },
+    { "history", "history [clear] - List or forget recent commands", cmd_history },
+    { "i2c",   "i2c scan | stats",                           cmd_i2c },
     { "i2cr",  "alias: i2c read",                             cmd_i2c },
     { "i2cw",  "alias: i2c write",                            cmd_i2c },
-    { "ads",   "ads           - Read all ADS1115 inputs",      cmd_ads },
     { "lcd",   "lcd write <line> <text>",                     cmd_lcd },
-    { "flash", "flash id      - Read JEDEC ID from SPI flash", cmd_flash },
-    { "ftest", "ftest         - Stress test flash R/W", cmd_flash_test },
-	{ "ftestfull", "ftestfull     - Full flash write/read/verify", cmd_flash_test_full },
-	{ "logtest", "logtest       - Write test entry to flash", cmd_logtest },
-	{ "logindex", "logindex      - Show current flash log index", cmd_logindex },
+    { "led",   "led on/off   - Control LED",                  cmd_led },
 	{ "logdump", "logdump N|all - Dump last N or all log entries", cmd_logdump },
+	{ "logflush", "logflush      - Write staged log entries to flash", cmd_logflush },
+	{ "logindex", "logindex      - Show current flash log index", cmd_logindex },
+	{ "logtest", "logtest       - Write test entry to flash", cmd_logtest },
 	{ "moistcal", "moistcal 1|2|both - Calibrate moisture sensor(s)", cmd_moistcal },
-	{ "uptime", cmd_uptime, "Show system uptime in seconds" },
+    { "read",  "read M1/M2    - Read moisture sensors",        cmd_adc },
+    { "reset", "reset         - Flush the log and restart",    cmd_reset },
+	{ "uptime", "uptime        - Show system uptime in seconds", cmd_uptime },
+};
 
+typedef struct {
+    const cli_command_t *cmds;
+    size_t count;
+} cli_table_t;
+
+// Only the table pointers live in RAM; the core table is always first
+static cli_table_t cli_tables[CLI_MAX_TABLES] = {
+    { commands, sizeof(commands) / sizeof(commands[0]) },
 };
+static size_t cli_table_count = 1;
 
-void CLI_RegisterCommands(const cli_command_t *table, size_t count) {
-    if (count > MAX_COMMANDS) count = MAX_COMMANDS;
-    for (size_t i = 0; i < count; i++) {
-        command_table[i] = &table[i];
+int CLI_RegisterCommands(const cli_command_t *table, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        if (strcmp(table[i - 1].name, table[i].name) >= 0) return 0;  // not sorted
+    }
+    for (size_t t = 0; t < cli_table_count; t++) {
+        if (cli_tables[t].cmds == table) return 1;
     }
-    command_count = count;
+    if (cli_table_count >= CLI_MAX_TABLES) return 0;
+
+    cli_tables[cli_table_count].cmds = table;
+    cli_tables[cli_table_count].count = count;
+    cli_table_count++;
+    return 1;
 }
 
-void CLI_Task(void *argument) {
-    cli_input_queue = osMessageQueueNew(CLI_INPUT_QUEUE_LEN, sizeof(cli_input_t), NULL);
-    CLI_RegisterCommands(commands, sizeof(commands) / sizeof(commands[0]));
-    HAL_UART_Transmit(&huart6, (uint8_t*)"CLI Task running\r\n> ", 22, HAL_MAX_DELAY);
+// Index of the first entry whose name is >= key
+static size_t cli_lower_bound(const cli_command_t *cmds, size_t n, const char *key) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (strcmp(cmds[mid].name, key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
 
-    // Debug print before DMA setup
-	HAL_UART_Transmit(&huart6, (uint8_t*)"Initializing CLI DMA...\r\n", 26, HAL_MAX_DELAY);
+static const cli_command_t *cli_find(const char *name) {
+    for (size_t t = 0; t < cli_table_count; t++) {
+        const cli_command_t *cmds = cli_tables[t].cmds;
+        size_t i = cli_lower_bound(cmds, cli_tables[t].count, name);
+        if (i < cli_tables[t].count && strcmp(cmds[i].name, name) == 0) return &cmds[i];
+    }
+    return NULL;
+}
 
-	if (HAL_UART_Receive_DMA(&huart6, dma_rx_buf, CLI_DMA_RX_BUFFER_SIZE) != HAL_OK) {
-	   HAL_UART_Transmit(&huart6, (uint8_t*)"ERROR: UART DMA start failed\r\n", 31, HAL_MAX_DELAY);
-	} else {
-	   HAL_UART_Transmit(&huart6, (uint8_t*)"CLI DMA active\r\n> ", 19, HAL_MAX_DELAY);
-	}
+typedef void (*cli_visit_fn)(const cli_command_t *cmd, void *ctx);
 
-    TickType_t lastUpdate = xTaskGetTickCount();
+// Calls fn for every command starting with prefix; returns how many there were
+static size_t cli_visit_prefix(const char *prefix, cli_visit_fn fn, void *ctx) {
+    size_t len = strlen(prefix), count = 0;
 
-    while (1) {
-        uint16_t pos = CLI_DMA_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart6.hdmarx);
-        while (dma_rx_pos != pos) {
-            uint8_t ch = dma_rx_buf[dma_rx_pos++];
-            if (dma_rx_pos >= CLI_DMA_RX_BUFFER_SIZE)
-                dma_rx_pos = 0;
-            if (escape_state == 0 && ch == 0x1B) {
-                escape_state = 1;  // ESC received
-                continue;
-            } else if (escape_state == 1 && ch == '[') {
-                escape_state = 2;  // '[' received
-                continue;
-            } else if (escape_state == 2 && ch == 'A') {
-                // Up arrow detected
-                escape_state = 0;
-
-                if (history_count == 0) continue;
-
-                if (history_browse < history_count - 1)
-                    history_browse++;
-
-                int idx = (CLI_HISTORY_SIZE + history_index - history_browse - 1) % CLI_HISTORY_SIZE;
-
-                // Clear current input line visually
-                while (temp_index--) HAL_UART_Transmit(&huart6, (uint8_t*)"\b \b", 3, HAL_MAX_DELAY);
-                temp_index = 0;
-
-                // Copy history entry into temp_line
-                strncpy(temp_line, cli_history[idx], CLI_BUFFER_SIZE);
-                temp_index = strlen(temp_line);
-
-                HAL_UART_Transmit(&huart6, (uint8_t*)temp_line, temp_index, HAL_MAX_DELAY);
-                continue;
-            } else if (escape_state != 0) {
-                escape_state = 0;  // Reset unknown escape
-                continue;
-            }
-            if (ch == '\r' || ch == '\n') {
-                temp_line[temp_index] = '\0';
+    for (size_t t = 0; t < cli_table_count; t++) {
+        const cli_command_t *cmds = cli_tables[t].cmds;
+        size_t n = cli_tables[t].count;
+        for (size_t i = cli_lower_bound(cmds, n, prefix);
+             i < n && strncmp(cmds[i].name, prefix, len) == 0; i++) {
+            if (fn) fn(&cmds[i], ctx);
+            count++;
+        }
+    }
+    return count;
+}
+
+static void visit_first(const cli_command_t *cmd, void *ctx) {
+    const cli_command_t **first = ctx;
+    if (*first == NULL) *first = cmd;
+}
+
+static void visit_print(const cli_command_t *cmd, void *ctx) {
+    cli_puts(" ");
+    cli_puts(cmd->name);
+}
+
+typedef struct {
+    char common[CLI_BUFFER_SIZE];
+    size_t len;
+    uint8_t any;
+} cli_completion_t;
+
+// Longest prefix shared by all the candidates
+static void visit_common(const cli_command_t *cmd, void *ctx) {
+    cli_completion_t *c = ctx;
+    size_t i = 0;
+
+    if (!c->any) {
+        strncpy(c->common, cmd->name, CLI_BUFFER_SIZE - 1);
+        c->common[CLI_BUFFER_SIZE - 1] = '\0';
+        c->len = strlen(c->common);
+        c->any = 1;
+        return;
+    }
+    while (i < c->len && c->common[i] == cmd->name[i]) i++;
+    c->len = i;
+}
+
+const cli_command_t *CLI_Find(const char *name) {
+    const cli_command_t *cmd = cli_find(name);
+
+    if (cmd) return cmd;
+    if (cli_visit_prefix(name, visit_first, &cmd) == 1) return cmd;
+    return NULL;
+}
+
+const cli_command_t *CLI_Lookup(const char *name) {
+    const cli_command_t *cmd = CLI_Find(name);
+
+    if (cmd) return cmd;
+    if (cli_visit_prefix(name, NULL, NULL) > 1) {
+        cli_puts("Ambiguous command:");
+        cli_visit_prefix(name, visit_print, NULL);
+        cli_puts("\r\n");
+    } else {
+        cli_printf("Unknown command: %s\r\n", name);
+    }
+    return NULL;
+}
+
+// Tab on the command word: complete it as far as it is unambiguous, list
+// the candidates when it cannot be extended
+static void cli_complete(void) {
+    cli_completion_t c = { .len = 0, .any = 0 };
+    size_t n;
+
+    temp_line[temp_index] = '\0';
+    if (cursor_pos != temp_index) return;
+    if (memchr(temp_line, ' ', temp_index)) return;   // arguments: nothing to offer
+
+    n = cli_visit_prefix(temp_line, visit_common, &c);
+    if (n == 0) return;
+
+    if (c.len > temp_index) {
+        if (c.len > CLI_BUFFER_SIZE - 2) c.len = CLI_BUFFER_SIZE - 2;
+        cli_write(&c.common[temp_index], c.len - temp_index);
+        memcpy(&temp_line[temp_index], &c.common[temp_index], c.len - temp_index);
+        temp_index = c.len;
+        if (n == 1) {
+            temp_line[temp_index++] = ' ';
+            cli_puts(" ");
+        }
+        cursor_pos = temp_index;
+    } else if (n > 1) {
+        cli_puts("\r\n");
+        cli_visit_prefix(temp_line, visit_print, NULL);
+        cli_puts("\r\n> ");
+        cli_write(temp_line, temp_index);
+    }
+}
+
+// --- Line editor ---
+
+// Reprint the prompt and line, then put the terminal cursor back
+static void line_redraw(void) {
+    cli_puts("\r\x1b[K> ");
+    cli_write(temp_line, temp_index);
+    if (temp_index > cursor_pos) cli_printf("\x1b[%uD", temp_index - cursor_pos);
+}
+
+static void line_set(const char *text) {
+    strncpy(temp_line, text, CLI_BUFFER_SIZE - 1);
+    temp_line[CLI_BUFFER_SIZE - 1] = '\0';
+    temp_index = cursor_pos = strlen(temp_line);
+    line_redraw();
+}
+
+static void line_insert(uint8_t ch) {
+    if (temp_index >= CLI_BUFFER_SIZE - 1) return;
+    memmove(&temp_line[cursor_pos + 1], &temp_line[cursor_pos], temp_index - cursor_pos);
+    temp_line[cursor_pos++] = ch;
+    temp_index++;
+    if (cursor_pos == temp_index) cli_write(&ch, 1); // echo
+    else line_redraw();
+}
+
+// Remove the character at pos
+static void line_delete(uint8_t pos) {
+    if (pos >= temp_index) return;
+    memmove(&temp_line[pos], &temp_line[pos + 1], temp_index - pos - 1);
+    temp_index--;
+    if (cursor_pos > pos) cursor_pos--;
+    line_redraw();
+}
+
+static void line_move(uint8_t pos) {
+    if (pos > temp_index) pos = temp_index;
+    if (pos < cursor_pos) cli_printf("\x1b[%uD", cursor_pos - pos);
+    else if (pos > cursor_pos) cli_printf("\x1b[%uC", pos - cursor_pos);
+    cursor_pos = pos;
+}
+
+// Up (older) / Down (newer); below the newest entry is an empty line
+static void history_step(int older) {
+    char entry[CLI_BUFFER_SIZE];
+    int next = history_browse + (older ? 1 : -1);
+
+    if (next >= (int)cli_history_count() || next < -1) return;
+    history_browse = next;
+    if (next < 0 || cli_history_get(next, entry, sizeof(entry)) < 0) entry[0] = '\0';
+    line_set(entry);
+}
+
+static void search_redraw(void) {
+    cli_printf("\r\x1b[K(%sreverse-i-search)`%s': %s",
+               search_match < 0 && search_len ? "failing " : "", search_pattern, temp_line);
+}
+
+// Look for the pattern from entry `from` on; the line keeps the last hit
+static void search_from(int from) {
+    char entry[CLI_BUFFER_SIZE];
+    int hit = cli_history_search(search_pattern, from < 0 ? 0 : from, entry, sizeof(entry));
+
+    search_match = hit;
+    if (hit >= 0) {
+        strcpy(temp_line, entry);
+        temp_index = cursor_pos = strlen(temp_line);
+    }
+    search_redraw();
+}
+
+static void search_end(void) {
+    searching = 0;
+    history_browse = search_match;
+    line_redraw();
+}
+
+// Keys while searching. Returns 0 if the key ends the search and should
+// then be handled by the normal editor (Enter, arrows, ...).
+static int search_key(uint8_t ch) {
+    if (ch == 0x12) {                               // Ctrl-R: next older match
+        search_from(search_match + 1);
+    } else if (ch == 0x07) {                        // Ctrl-G: give up
+        searching = 0;
+        temp_index = cursor_pos = 0;
+        line_redraw();
+    } else if (ch == 0x7F || ch == '\b') {
+        if (search_len > 0) search_pattern[--search_len] = '\0';
+        search_from(0);
+    } else if (ch >= 0x20 && ch < 0x7F) {
+        if (search_len < CLI_SEARCH_MAX - 1) {
+            search_pattern[search_len++] = ch;
+            search_pattern[search_len] = '\0';
+        }
+        search_from(search_match);
+    } else {
+        search_end();
+        return 0;
+    }
+    return 1;
+}
+
+// ESC [ and ESC O sequences; ch is the byte after the introducer
+static void escape_key(uint8_t ch) {
+    if (ch >= '0' && ch <= '9') {
+        escape_arg = escape_arg * 10 + (ch - '0');
+        return;                                     // sequence continues
+    }
+    escape_state = 0;
+    switch (ch) {
+        case 'A': history_step(1); break;
+        case 'B': history_step(0); break;
+        case 'C': line_move(cursor_pos + 1); break;
+        case 'D': if (cursor_pos > 0) line_move(cursor_pos - 1); break;
+        case 'H': line_move(0); break;
+        case 'F': line_move(temp_index); break;
+        case '~':
+            if (escape_arg == 1 || escape_arg == 7) line_move(0);
+            else if (escape_arg == 4 || escape_arg == 8) line_move(temp_index);
+            else if (escape_arg == 3) line_delete(cursor_pos);
+            break;
+        default: break;
+    }
+}
+
+static void cli_edit_input(uint8_t ch) {
+    if (searching && search_key(ch)) return;
+
+    if (escape_state == 1) {
+        escape_state = (ch == '[' || ch == 'O') ? 2 : 0;
+        escape_arg = 0;
+        return;
+    }
+    if (escape_state == 2) {
+        escape_key(ch);
+        return;
+    }
+
+    switch (ch) {
+        case 0x1B: escape_state = 1; break;
+        case '\r':
+        case '\n':
+            temp_line[temp_index] = '\0';
+            if (temp_index > 0) {
+                cli_puts("\r\n");
+                cli_history_add(temp_line);
                 CLI_ProcessCommand(temp_line);
-                temp_index = 0;
-                HAL_UART_Transmit(&huart6, (uint8_t*)"\r\n> ", 4, HAL_MAX_DELAY);
-            } else if (ch == 0x7F || ch == '\b') {
-                if (temp_index > 0) {
+            }
+            temp_index = cursor_pos = 0;
+            history_browse = -1;
+            cli_puts("\r\n> ");
+            break;
+        case '\t': cli_complete(); break;
+        case 0x01: line_move(0); break;                         // Ctrl-A
+        case 0x05: line_move(temp_index); break;                // Ctrl-E
+        case 0x02: if (cursor_pos > 0) line_move(cursor_pos - 1); break;   // Ctrl-B
+        case 0x06: line_move(cursor_pos + 1); break;            // Ctrl-F
+        case 0x04: line_delete(cursor_pos); break;              // Ctrl-D
+        case 0x03:                                              // Ctrl-C: drop the line
+            temp_index = cursor_pos = 0;
+            history_browse = -1;
+            cli_puts("^C\r\n> ");
+            break;
+        case 0x12:                                              // Ctrl-R
+            searching = 1;
+            search_len = 0;
+            search_pattern[0] = '\0';
+            search_match = -1;
+            search_redraw();
+            break;
+        case 0x7F:
+        case '\b':
+            if (cursor_pos > 0) {
+                if (cursor_pos == temp_index) {
                     temp_index--;
-                    HAL_UART_Transmit(&huart6, (uint8_t*)"\b \b", 3, HAL_MAX_DELAY);
+                    cursor_pos--;
+                    cli_puts("\b \b");
+                } else {
+                    line_delete(cursor_pos - 1);
                 }
-            } else if (temp_index < CLI_BUFFER_SIZE - 1) {
-                temp_line[temp_index++] = ch;
-                HAL_UART_Transmit(&huart6, &ch, 1, HAL_MAX_DELAY); // echo
             }
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(10));
+            break;
+        default:
+            if (ch >= 0x20 && ch < 0x7F) line_insert(ch);
+            break;
     }
 }
 
-static void CLI_ProcessCommand(const char *cmd) {
-	if (cmd[0] != '\0') {
-	    strncpy(cli_history[history_index], cmd, CLI_BUFFER_SIZE);
-	    history_index = (history_index + 1) % CLI_HISTORY_SIZE;
-	    if (history_count < CLI_HISTORY_SIZE) history_count++;
-	    history_browse = -1; // reset browsing on new input
-	}
-    char *argv[MAX_ARGS] = {0};
-    char buffer[CLI_BUFFER_SIZE];
-    strncpy(buffer, cmd, CLI_BUFFER_SIZE);
+void CLI_Task(void *argument) {
+    cli_history_init();
+    cli_puts("CLI Task running\r\n> ");
 
-    int argc = 0;
-    char *token = strtok(buffer, " ");
-    while (token && argc < MAX_ARGS) {
-        argv[argc++] = token;
-        token = strtok(NULL, " ");
-    }
+    // Debug print before DMA setup
+	cli_puts("Initializing CLI DMA...\r\n");
+
+	if (!cli_uart_rx_start()) {
+	   cli_puts("ERROR: UART DMA start failed\r\n");
+	} else {
+	   cli_puts("CLI DMA active\r\n> ");
+	}
 
-    if (argc == 0) return;
+    while (1) {
+        uint8_t rx[CLI_RX_CHUNK];
+        // Sleeps until the UART reports an idle line or a half-full buffer
+        // (or, in binary mode, until the next streamed sample is due)
+        uint32_t wait = telemetry_active() ? telemetry_poll() : CLI_WAIT_FOREVER;
+        size_t n = cli_read(rx, sizeof(rx), wait);
+
+        if (telemetry_active()) {
+            telemetry_input(rx, n);
+            if (!telemetry_active()) cli_puts("\r\n> ");
+            continue;
+        }
 
-    for (size_t i = 0; i < command_count; i++) {
-        if (strcmp(argv[0], command_table[i]->name) == 0) {
-        	strncpy(last_command, cmd, CLI_BUFFER_SIZE);
-        	command_table[i]->handler(argc, argv);
-            return;
+        for (size_t i = 0; i < n; i++) {
+            cli_edit_input(rx[i]);
         }
     }
+}
 
-    HAL_UART_Transmit(&huart6, (uint8_t*)"Unknown command\r\n", 18, HAL_MAX_DELAY);
+void CLI_Execute(const char *line) {
+    CLI_ProcessCommand(line);
+}
+
+static void CLI_ProcessCommand(const char *cmd) {
+    strncpy(last_command, cmd, CLI_BUFFER_SIZE);
+    cli_script_exec(cmd);
 }
 
 static void cmd_help(int argc, char **argv) {
-    for (size_t i = 0; i < command_count; i++) {
-        const char *line = command_table[i]->help;
-        HAL_UART_Transmit(&huart6, (uint8_t*)line, strlen(line), HAL_MAX_DELAY);
-        HAL_UART_Transmit(&huart6, (uint8_t*)"\r\n", 2, HAL_MAX_DELAY);
+    size_t pos[CLI_MAX_TABLES] = {0};
+
+    // Merge the sorted tables so the list comes out in one alphabetical run
+    for (;;) {
+        const cli_command_t *next = NULL;
+        size_t from = 0;
+        for (size_t t = 0; t < cli_table_count; t++) {
+            if (pos[t] >= cli_tables[t].count) continue;
+            const cli_command_t *c = &cli_tables[t].cmds[pos[t]];
+            if (next == NULL || strcmp(c->name, next->name) < 0) {
+                next = c;
+                from = t;
+            }
+        }
+        if (next == NULL) break;
+        pos[from]++;
+        cli_puts(next->help);
+        cli_puts("\r\n");
+    }
+}
+
+static void cmd_history(int argc, char **argv) {
+    char line[CLI_BUFFER_SIZE];
+    uint16_t count = cli_history_count();
+
+    if (argc >= 2 && strcmp(argv[1], "clear") == 0) {
+        cli_history_clear();
+        return;
+    }
+    for (uint16_t n = count; n-- > 0;) {
+        cli_history_get(n, line, sizeof(line));
+        cli_printf("%3u  %s\r\n", count - n, line);
     }
+    cli_printf("%u commands in %u bytes%s\r\n", count, CLI_HISTORY_BYTES,
+               cli_history_persistent() ? ", saved to flash" : "");
 }
 
 static void cmd_led(int argc, char **argv) {
     if (argc < 2) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Usage: led on/off\r\n", 21, HAL_MAX_DELAY);
+        cli_puts("Usage: led on/off\r\n");
         return;
     }
     if (strcmp(argv[1], "on") == 0) {
         HAL_GPIO_WritePin(GPIOB, GPIO_PIN_12, GPIO_PIN_SET);
-        HAL_UART_Transmit(&huart6, (uint8_t*)"LED ON\r\n", 8, HAL_MAX_DELAY);
+        cli_puts("LED ON\r\n");
     } else if (strcmp(argv[1], "off") == 0) {
         HAL_GPIO_WritePin(GPIOB, GPIO_PIN_12, GPIO_PIN_RESET);
-        HAL_UART_Transmit(&huart6, (uint8_t*)"LED OFF\r\n", 9, HAL_MAX_DELAY);
+        cli_puts("LED OFF\r\n");
     }
 }
 
 static void wait_for_enter(void) {
-    // Wait for a single '\r' to appear in the DMA buffer
-    uint16_t last_pos = CLI_DMA_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart6.hdmarx);
+    // Block on the RX stream until ENTER; anything typed before it is discarded
+    uint8_t ch;
     while (1) {
-        uint16_t new_pos = CLI_DMA_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart6.hdmarx);
-        while (last_pos != new_pos) {
-            uint8_t ch = dma_rx_buf[last_pos++];
-            if (last_pos >= CLI_DMA_RX_BUFFER_SIZE) last_pos = 0;
-            if (ch == '\r' || ch == '\n') return;  // ENTER detected
-        }
-        vTaskDelay(pdMS_TO_TICKS(10));
+        if (cli_read(&ch, 1, CLI_WAIT_FOREVER) == 1 && (ch == '\r' || ch == '\n')) return;
     }
 }
 
 static void cmd_adc(int argc, char **argv) {
     if (argc < 2) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Usage: read M1/M2\r\n", 20, HAL_MAX_DELAY);
+        cli_puts("Usage: read M1/M2\r\n");
         return;
     }
 
+    sensor_snapshot_t snap;
     uint32_t val = 0;
-    ADC_ChannelConfTypeDef sConfig = {0};
-    sConfig.Rank = 1;
-    sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
 
+    sensors_get(&snap);
     if (strcmp(argv[1], "M1") == 0) {
-        sConfig.Channel = ADC_CHANNEL_0;
+        val = snap.adc[SENSOR_M1];
     } else if (strcmp(argv[1], "M2") == 0) {
-        sConfig.Channel = ADC_CHANNEL_1;
+        val = snap.adc[SENSOR_M2];
     } else {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Invalid channel. Use M1 or M2\r\n", 31, HAL_MAX_DELAY);
+        cli_puts("Invalid channel. Use M1 or M2\r\n");
         return;
     }
 
-    HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-    HAL_ADC_Start(&hadc1);
-    HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-    val = HAL_ADC_GetValue(&hadc1);
-
-    char msg[64];
-    snprintf(msg, sizeof(msg), "MCU ADC %s: %lu\r\n", argv[1], val);
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    cli_printf("MCU ADC %s: %lu\r\n", argv[1], val);
 }
 
 static void cmd_ads(int argc, char **argv) {
-    uint8_t config[] = {0x01, 0xC1, 0x83};
-    uint8_t pointer = 0x00;
-    uint8_t result[2];
-    char msg[64];
+    sensor_snapshot_t snap;
+
+    if (argc >= 2 && strcmp(argv[1], "cfg") == 0) {
+        ads_pga_t pga;
+        ads_rate_t rate;
+        if (argc >= 4) {
+            ads_set_config((ads_pga_t)atoi(argv[2]), (ads_rate_t)atoi(argv[3]));
+        }
+        ads_get_config(&pga, &rate);
+        cli_printf("ADS PGA %d (0=6.144V..5=0.256V), DR %d (0=8..7=860SPS)\r\n", pga, rate);
+        return;
+    }
 
+    sensors_get(&snap);
     for (uint8_t ch = 0; ch < 4; ch++) {
-        config[1] = 0xC1 | (ch << 4);  // Change mux
-        if (HAL_I2C_Master_Transmit(&hi2c1, 0x48 << 1, config, 3, I2C_TIMEOUT) != HAL_OK) continue;
-        HAL_Delay(10);
-        if (HAL_I2C_Master_Transmit(&hi2c1, 0x48 << 1, &pointer, 1, I2C_TIMEOUT) != HAL_OK) continue;
-        if (HAL_I2C_Master_Receive(&hi2c1, 0x48 << 1, result, 2, I2C_TIMEOUT) != HAL_OK) continue;
-        int16_t value = (result[0] << 8) | result[1];
-        snprintf(msg, sizeof(msg), "ADS CH%d: %d\r\n", ch, value);
-        HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+        cli_printf("ADS CH%d: %d\r\n", ch, snap.ads[ch]);
     }
 }
 
 static void cmd_i2c(int argc, char **argv) {
     if (argc >= 2 && strcmp(argv[1], "scan") == 0) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"     00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F\r\n", 53, HAL_MAX_DELAY);
+        cli_puts("     00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F\r\n");
         for (int row = 0; row < 8; row++) {
-            char line[128];
-            snprintf(line, sizeof(line), "0x%02X:", row << 4);
-            HAL_UART_Transmit(&huart6, (uint8_t*)line, strlen(line), HAL_MAX_DELAY);
+            cli_printf("0x%02X:", row << 4);
             for (int col = 0; col < 16; col++) {
                 uint8_t addr = (row << 4) | col;
                 if (addr < 0x03 || addr > 0x77) {
-                    HAL_UART_Transmit(&huart6, (uint8_t*)"   ", 3, HAL_MAX_DELAY);
+                    cli_puts("   ");
                     continue;
                 }
-                if (HAL_I2C_IsDeviceReady(&hi2c1, addr << 1, 3, 10) == HAL_OK) {
-                    snprintf(line, sizeof(line), " %02X", addr);
+                if (i2c_bus_probe(addr << 1) == I2C_OK) {
+                    cli_printf(" %02X", addr);
                 } else {
-                    snprintf(line, sizeof(line), " --");
+                    cli_puts(" --");
                 }
-                HAL_UART_Transmit(&huart6, (uint8_t*)line, 3, HAL_MAX_DELAY);
             }
-            HAL_UART_Transmit(&huart6, (uint8_t*)"\r\n", 2, HAL_MAX_DELAY);
+            cli_puts("\r\n");
         }
         return;
     }
-    HAL_UART_Transmit(&huart6, (uint8_t*)"Usage: i2c scan\r\n", 18, HAL_MAX_DELAY);
+    if (argc >= 2 && strcmp(argv[1], "stats") == 0) {
+        i2c_bus_stats_t st;
+
+        i2c_bus_get_stats(&st);
+        cli_printf("xfers %lu nack %lu buserr %lu timeout %lu recover %lu\r\n",
+                   st.xfers, st.nacks, st.bus_errors, st.timeouts, st.recoveries);
+        return;
+    }
+    cli_puts("Usage: i2c scan|stats\r\n");
 }
 
 static void cmd_lcd(int argc, char **argv) {
     if (argc < 4 || strcmp(argv[1], "write") != 0) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Usage: lcd write <line> <text>\r\n", 33, HAL_MAX_DELAY);
+        cli_puts("Usage: lcd write <line> <text>\r\n");
         return;
     }
     uint8_t line = atoi(argv[2]);
     if (line > 1) line = 0;
     st7032_set_cursor(line, 0);
     st7032_write_str(argv[3]);
-    HAL_UART_Transmit(&huart6, (uint8_t*)"LCD write OK\r\n", 14, HAL_MAX_DELAY);
+    cli_puts("LCD write OK\r\n");
 }
 
 static void cmd_flash(int argc, char **argv) {
     if (argc < 2 || strcmp(argv[1], "id") != 0) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Usage: flash id\r\n", 17, HAL_MAX_DELAY);
+        cli_puts("Usage: flash id\r\n");
+        return;
+    }
+    uint32_t id = spi_flash_read_id();
+    if (id == 0) {
+        cli_puts("Flash read failed\r\n");
         return;
     }
-    uint8_t cmd = 0x9F;
-    uint8_t id[3] = {0};
-
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_RESET);
-    if (HAL_SPI_Transmit(&hspi1, &cmd, 1, 100) != HAL_OK) goto fail;
-    if (HAL_SPI_Receive(&hspi1, id, 3, 100) != HAL_OK) goto fail;
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
-
-    char msg[64];
-    snprintf(msg, sizeof(msg), "Flash ID: %02X %02X %02X\r\n", id[0], id[1], id[2]);
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-    return;
-
-fail:
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
-    HAL_UART_Transmit(&huart6, (uint8_t*)"Flash read failed\r\n", 20, HAL_MAX_DELAY);
-}
-
-static void flash_write_enable(void) {
-    uint8_t cmd = 0x06;
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_RESET);
-    HAL_SPI_Transmit(&hspi1, &cmd, 1, 100);
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
-}
-
-static void flash_sector_erase(uint32_t addr) {
-    uint8_t cmd[4] = { 0x20, (addr >> 16), (addr >> 8), addr };
-    flash_write_enable();
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_RESET);
-    HAL_SPI_Transmit(&hspi1, cmd, 4, 100);
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
-    HAL_Delay(50);  // Sector erase time
-}
-
-static void flash_write_page(uint32_t addr, uint8_t *data, uint32_t len) {
-    uint8_t cmd[4] = { 0x02, (addr >> 16), (addr >> 8), addr };
-    flash_write_enable();
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_RESET);
-    HAL_SPI_Transmit(&hspi1, cmd, 4, 100);
-    HAL_SPI_Transmit(&hspi1, data, len, 500);
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
-    HAL_Delay(5);
-}
 
-static void flash_read_page(uint32_t addr, uint8_t *data, uint32_t len) {
-    uint8_t cmd[4] = { 0x03, (addr >> 16), (addr >> 8), addr };
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_RESET);
-    HAL_SPI_Transmit(&hspi1, cmd, 4, 100);
-    HAL_SPI_Receive(&hspi1, data, len, 500);
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
+    cli_printf("Flash ID: %02lX %02lX %02lX (%s)\r\n",
+               id >> 16, (id >> 8) & 0xFF, id & 0xFF, spi_flash_chip()->name);
 }
 
-
 static void cmd_flash_test(int argc, char **argv) {
     const uint32_t size = 256;
     uint8_t tx[size], rx[size];
 
     for (uint32_t i = 0; i < size; i++) tx[i] = i;
 
-    uint32_t startTick, endTick;
-    char msg[128];
-
-    // --- Write Enable ---
-    uint8_t we = 0x06;
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_RESET);
-    HAL_SPI_Transmit(&hspi1, &we, 1, 100);
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
+    uint32_t t0;
 
-    // --- Write Data ---
-    startTick = HAL_GetTick();
-    uint8_t cmd[4] = { 0x02, 0x00, 0x00, 0x00 };
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_RESET);
-    HAL_SPI_Transmit(&hspi1, cmd, 4, 100);
-    HAL_SPI_Transmit(&hspi1, tx, size, 500);
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
-    endTick = HAL_GetTick();
-    snprintf(msg, sizeof(msg), "Wrote %lu bytes in %lu ms\r\n", (uint32_t)size, (endTick - startTick));
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    // Page 0 belongs to the log; keep the logger off it until the rescan
+    log_flash_claim();
 
-    HAL_Delay(10);  // wait for flash write
+    // --- Write Data (returns once the chip reports the program done) ---
+    t0 = perf_begin();
+    spi_flash_program(0x000000, tx, size);
+    cli_printf("Wrote %lu bytes in %lu us\r\n", (uint32_t)size, perf_cycles_to_us(perf_begin() - t0));
 
     // --- Read Back ---
-    startTick = HAL_GetTick();
-    uint8_t read_cmd[4] = { 0x03, 0x00, 0x00, 0x00 };
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_RESET);
-    HAL_SPI_Transmit(&hspi1, read_cmd, 4, 100);
-    HAL_SPI_Receive(&hspi1, rx, size, 500);
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
-    endTick = HAL_GetTick();
-    snprintf(msg, sizeof(msg), "Read %lu bytes in %lu ms\r\n", (uint32_t)size, (endTick - startTick));
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    t0 = perf_begin();
+    spi_flash_read(0x000000, rx, size);
+    cli_printf("Read %lu bytes in %lu us\r\n", (uint32_t)size, perf_cycles_to_us(perf_begin() - t0));
 
     // --- Verify ---
     int errors = 0;
@@ -432,29 +668,30 @@ static void cmd_flash_test(int argc, char **argv) {
         if (rx[i] != tx[i]) errors++;
     }
 
-    snprintf(msg, sizeof(msg), "Flash test %s (%d mismatches)\r\n",
-             errors == 0 ? "OK" : "FAIL", errors);
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    cli_printf("Flash test %s (%d mismatches)\r\n",
+               errors == 0 ? "OK" : "FAIL", errors);
 
     // --- Optional: Dump first few bytes ---
-    snprintf(msg, sizeof(msg), "TX: ");
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    cli_puts("TX: ");
     for (int i = 0; i < 8; i++) {
-        snprintf(msg, sizeof(msg), "%02X ", tx[i]);
-        HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+        cli_printf("%02X ", tx[i]);
     }
-    HAL_UART_Transmit(&huart6, (uint8_t*)"\r\nRX: ", 6, HAL_MAX_DELAY);
+    cli_puts("\r\nRX: ");
     for (int i = 0; i < 8; i++) {
-        snprintf(msg, sizeof(msg), "%02X ", rx[i]);
-        HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+        cli_printf("%02X ", rx[i]);
     }
-    HAL_UART_Transmit(&huart6, (uint8_t*)"\r\n", 2, HAL_MAX_DELAY);
+    cli_puts("\r\n");
+
+    // Page 0 holds the first log sector header; rescan in case we broke it
+    log_flash_release();
 }
 
 static void cmd_flash_test_full(int argc, char **argv) {
     uint8_t tx[FLASH_PAGE_SIZE], rx[FLASH_PAGE_SIZE];
     uint32_t errors = 0;
-    char msg[128];
+
+    // Keep the logger and the export task off the chip until the rescan
+    log_flash_claim();
 
     // Fill tx with pattern
     for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) {
@@ -465,22 +702,19 @@ static void cmd_flash_test_full(int argc, char **argv) {
 
     for (uint32_t addr = 0; addr < FLASH_TOTAL_SIZE; addr += FLASH_PAGE_SIZE) {
         if (addr % FLASH_SECTOR_SIZE == 0) {
-            snprintf(msg, sizeof(msg), "Erasing sector at 0x%04lX\r\n", addr);
-            HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-            flash_sector_erase(addr);
+            cli_printf("Erasing sector at 0x%04lX\r\n", addr);
+            spi_flash_erase_sector(addr);
         }
 
-        flash_write_page(addr, tx, FLASH_PAGE_SIZE);
-        flash_read_page(addr, rx, FLASH_PAGE_SIZE);
+        spi_flash_program(addr, tx, FLASH_PAGE_SIZE);
+        spi_flash_read(addr, rx, FLASH_PAGE_SIZE);
 
         for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) {
             if (rx[i] != tx[i]) {
                 errors++;
                 if (errors < 5) {
-                    snprintf(msg, sizeof(msg),
-                             "Error @ 0x%04lX: wrote 0x%02X, read 0x%02X\r\n",
-                             addr + i, tx[i], rx[i]);
-                    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+                    cli_printf("Error @ 0x%04lX: wrote 0x%02X, read 0x%02X\r\n",
+                               addr + i, tx[i], rx[i]);
                 }
             }
         }
@@ -488,79 +722,58 @@ static void cmd_flash_test_full(int argc, char **argv) {
 
     uint32_t elapsed = HAL_GetTick() - start_tick;
 
-    snprintf(msg, sizeof(msg),
-             "Done: %lu bytes tested in %lu ms. Errors: %lu\r\n",
-             FLASH_TOTAL_SIZE, elapsed, errors);
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    cli_printf("Done: %lu bytes tested in %lu ms. Errors: %lu\r\n",
+               FLASH_TOTAL_SIZE, elapsed, errors);
+
+    // The test pattern overwrote the log; rescan so logging starts afresh,
+    // with the records that were staged when the test began
+    log_flash_release();
 }
 
 static void cmd_logtest(int argc, char **argv) {
     log_entry_t entry;
-    ADC_ChannelConfTypeDef sConfig = {0};
-    sConfig.Rank = 1;
-    sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
-
-    // --- Read M1 (PA0)
-    sConfig.Channel = ADC_CHANNEL_0;
-    HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-    HAL_ADC_Start(&hadc1);
-    HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-    entry.m1 = HAL_ADC_GetValue(&hadc1);
-
-    // --- Read M2 (PA1)
-    sConfig.Channel = ADC_CHANNEL_1;
-    HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-    HAL_ADC_Start(&hadc1);
-    HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-    entry.m2 = HAL_ADC_GetValue(&hadc1);
-
-    // --- Read ADS1115 channels
-    uint8_t config[] = {0x01, 0xC1, 0x83}; // Start with AIN0
-    uint8_t pointer = 0x00;
-    uint8_t result[2];
+    sensor_snapshot_t snap;
+
+    // --- Latest sample from the acquisition task
+    sensors_get(&snap);
+    entry.m1 = snap.adc[SENSOR_M1];
+    entry.m2 = snap.adc[SENSOR_M2];
     for (uint8_t ch = 0; ch < 4; ch++) {
-        config[1] = 0xC1 | (ch << 4);  // MUX channel select
-        HAL_I2C_Master_Transmit(&hi2c1, 0x48 << 1, config, 3, 100);
-        HAL_Delay(10);
-        HAL_I2C_Master_Transmit(&hi2c1, 0x48 << 1, &pointer, 1, 100);
-        HAL_I2C_Master_Receive(&hi2c1, 0x48 << 1, result, 2, 100);
-        entry.ads[ch] = (result[0] << 8) | result[1];
+        entry.ads[ch] = snap.ads[ch];
     }
 
     // --- Timestamp
     entry.timestamp_ms = xTaskGetTickCount();
 
-    // --- Flash write
+    // --- Flash write (flushed so the readback really comes from flash)
     flash_write_log_entry(&entry);
-    HAL_UART_Transmit(&huart6, (uint8_t*)"Entry written\r\n", 15, HAL_MAX_DELAY);
+    log_flash_flush();
+    cli_puts("Entry written\r\n");
 
     // --- Readback
     log_entry_t check;
     flash_read_log_entry(flash_log_index - 1, &check);
 
-    char msg[128];
-    snprintf(msg, sizeof(msg),
-        "Readback:\r\n  Time: %lu\r\n  M1: %u  M2: %u\r\n  ADS: %d %d %d %d\r\n",
+    cli_printf("Readback:\r\n  Time: %lu\r\n  M1: %u  M2: %u\r\n  ADS: %d %d %d %d\r\n",
         check.timestamp_ms,
         check.m1,
         check.m2,
         check.ads[0], check.ads[1], check.ads[2], check.ads[3]);
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
 
     // --- Verify
     if (memcmp(&entry, &check, sizeof(log_entry_t)) == 0) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Log entry verified OK\r\n", 24, HAL_MAX_DELAY);
+        cli_puts("Log entry verified OK\r\n");
     } else {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"WARNING: mismatch!\r\n", 21, HAL_MAX_DELAY);
+        cli_puts("WARNING: mismatch!\r\n");
     }
 }
 
 static void cmd_logdump(int argc, char **argv) {
+    log_export_req_t req = { 0, LOG_EXPORT_ALL, 0, UINT32_MAX, 0, 0, 0 };
     uint32_t count = 0;
-    char msg[128];
 
     if (argc < 2) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Usage: logdump <N|all>\r\n", 25, HAL_MAX_DELAY);
+        cli_puts("Usage: logdump <N|all>\r\n");
         return;
     }
 
@@ -572,38 +785,40 @@ static void cmd_logdump(int argc, char **argv) {
     }
 
     if (count == 0) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"No log entries to show\r\n", 25, HAL_MAX_DELAY);
+        cli_puts("No log entries to show\r\n");
         return;
     }
 
-    uint32_t start = flash_log_index - count;
+    // Runs in the background; the prompt comes back straight away
+    req.first_id = log_flash_first_id() + flash_log_index - count;
+    if (!log_export_start(&req)) cli_puts("Export already running (export stop)\r\n");
+}
 
-    for (uint32_t i = 0; i < count; i++) {
-        log_entry_t entry;
-        flash_read_log_entry(start + i, &entry);
+static void cmd_logindex(int argc, char **argv) {
+    log_flash_info_t info;
 
-        snprintf(msg, sizeof(msg),
-            "#%03lu  Time: %lu ms  M1: %u  M2: %u  ADS: %d %d %d %d\r\n",
-            start + i,
-            entry.timestamp_ms,
-            entry.m1, entry.m2,
-            entry.ads[0], entry.ads[1], entry.ads[2], entry.ads[3]);
+    log_flash_get_info(&info);
+    cli_printf("Log index = %lu (%u staged)\r\n  Sectors: %u used, tail %u, head %u (%u/%u slots)\r\n  Head seq %lu, erased %lu times\r\n",
+        flash_log_index, info.staged, info.sectors_used, info.tail_sector, info.head_sector,
+        info.head_used, LOG_SLOTS_PER_SECTOR, info.head_seq, info.head_erase_count);
+}
 
-        HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-    }
+static void cmd_logflush(int argc, char **argv) {
+    log_flash_flush();
+    cli_puts("Log flushed\r\n");
 }
 
-static void cmd_logindex(int argc, char **argv) {
-    char msg[64];
-    snprintf(msg, sizeof(msg), "Log index = %lu\r\n", flash_log_index);
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+// Fresh sample for calibration; says so and returns 0 if none arrives
+static int moistcal_sample(sensor_snapshot_t *snap) {
+    if (sensors_sample_now(snap, pdMS_TO_TICKS(MOISTCAL_SAMPLE_MS))) return 1;
+    cli_puts("No fresh sample from the sensor task, calibration aborted\r\n");
+    return 0;
 }
 
 static void cmd_moistcal(int argc, char **argv) {
-    char msg[128];
 
     if (argc < 2) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Usage: moistcal 1|2|both\r\n", 27, HAL_MAX_DELAY);
+        cli_puts("Usage: moistcal 1|2|both\r\n");
         return;
     }
 
@@ -613,64 +828,59 @@ static void cmd_moistcal(int argc, char **argv) {
     else if (strcmp(argv[1], "2") == 0) calibrate_m2 = 1;
     else if (strcmp(argv[1], "both") == 0) calibrate_m1 = calibrate_m2 = 1;
     else {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Invalid arg. Use 1, 2, or both\r\n", 32, HAL_MAX_DELAY);
+        cli_puts("Invalid arg. Use 1, 2, or both\r\n");
         return;
     }
 
-    ADC_ChannelConfTypeDef sConfig = {0};
-    sConfig.Rank = 1;
-    sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
+    sensor_snapshot_t snap;
+    uint16_t dry;
 
     if (calibrate_m1) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Confirm sensor M1 is dry, then press ENTER...\r\n", 47, HAL_MAX_DELAY);
+        cli_puts("Confirm sensor M1 is dry, then press ENTER...\r\n");
         wait_for_enter();
 
-        sConfig.Channel = ADC_CHANNEL_0;
-        HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        m1_cal.dry = HAL_ADC_GetValue(&hadc1);
+        if (!moistcal_sample(&snap)) return;
+        dry = snap.adc[SENSOR_M1];
 
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Confirm sensor M1 is wet, then press ENTER...\r\n", 47, HAL_MAX_DELAY);
+        cli_puts("Confirm sensor M1 is wet, then press ENTER...\r\n");
         wait_for_enter();
 
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        m1_cal.wet = HAL_ADC_GetValue(&hadc1);
+        if (!moistcal_sample(&snap)) return;
+        m1_cal.dry = dry;
+        m1_cal.wet = snap.adc[SENSOR_M1];
 
-        snprintf(msg, sizeof(msg), "M1 calibration done: Dry=%lu  Wet=%lu\r\n", m1_cal.dry, m1_cal.wet);
-        HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+        cli_printf("M1 calibration done: Dry=%lu  Wet=%lu\r\n", m1_cal.dry, m1_cal.wet);
     }
 
     if (calibrate_m2) {
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Confirm sensor M2 is dry, then press ENTER...\r\n", 47, HAL_MAX_DELAY);
+        cli_puts("Confirm sensor M2 is dry, then press ENTER...\r\n");
         wait_for_enter();
 
-        sConfig.Channel = ADC_CHANNEL_1;
-        HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        m2_cal.dry = HAL_ADC_GetValue(&hadc1);
+        if (!moistcal_sample(&snap)) return;
+        dry = snap.adc[SENSOR_M2];
 
-        HAL_UART_Transmit(&huart6, (uint8_t*)"Confirm sensor M2 is wet, then press ENTER...\r\n", 47, HAL_MAX_DELAY);
+        cli_puts("Confirm sensor M2 is wet, then press ENTER...\r\n");
         wait_for_enter();
 
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        m2_cal.wet = HAL_ADC_GetValue(&hadc1);
+        if (!moistcal_sample(&snap)) return;
+        m2_cal.dry = dry;
+        m2_cal.wet = snap.adc[SENSOR_M2];
 
-        snprintf(msg, sizeof(msg), "M2 calibration done: Dry=%lu  Wet=%lu\r\n", m2_cal.dry, m2_cal.wet);
-        HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+        cli_printf("M2 calibration done: Dry=%lu  Wet=%lu\r\n", m2_cal.dry, m2_cal.wet);
     }
 }
 
+static void cmd_reset(int argc, char **argv) {
+    // Staged records would otherwise be lost with the RAM
+    log_flash_flush();
+    cli_puts("Log flushed, resetting\r\n");
+    cli_tx_flush(100);
+    NVIC_SystemReset();
+}
+
 static void cmd_uptime(int argc, char **argv) {
     uint32_t ticks = xTaskGetTickCount();
     uint32_t seconds = ticks / 1000;  // assuming 1ms tick
-    char msg[64];
-    snprintf(msg, sizeof(msg), "Uptime: %lu seconds\r\n", seconds);
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-}
-
-
 
+    cli_printf("Uptime: %lu seconds\r\n", seconds);
+}
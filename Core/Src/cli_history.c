@@ -0,0 +1,164 @@
+#include "cli_history.h"
+#include "log_flash.h"
+#include "spi_flash.h"
+#include <string.h>
+
+#define HIST_MASK          (CLI_HISTORY_BYTES - 1)
+#define HIST_FLASH_ADDR    LOG_FLASH_END
+#define HIST_FLASH_START   4        // records follow the magic word
+#define HIST_REC_END       0xFF     // length byte of erased flash
+
+_Static_assert((CLI_HISTORY_BYTES & HIST_MASK) == 0, "CLI_HISTORY_BYTES must be a power of two");
+_Static_assert(CLI_HISTORY_LINE_MAX < HIST_REC_END, "line length must fit the record length byte");
+
+// Free-running byte counters, taken modulo the ring size on access.
+// [hist_tail, hist_head) holds whole entries, oldest first.
+static char hist_buf[CLI_HISTORY_BYTES];
+static uint16_t hist_head;
+static uint16_t hist_tail;
+static uint16_t hist_entries;
+
+static uint16_t flash_size;         // sector size, 0 = history not persisted
+static uint16_t flash_off;          // next free byte in the history sector
+
+static void drop_oldest(void) {
+    while (hist_buf[hist_tail++ & HIST_MASK] != '\0') {}
+    hist_entries--;
+}
+
+static void ring_add(const char *line, size_t len) {
+    while ((uint16_t)(hist_head - hist_tail) + len + 1 > CLI_HISTORY_BYTES) drop_oldest();
+    for (size_t i = 0; i < len; i++) hist_buf[hist_head++ & HIST_MASK] = line[i];
+    hist_buf[hist_head++ & HIST_MASK] = '\0';
+    hist_entries++;
+}
+
+// Start of entry n, or where the scan gave up; *end gets its terminator
+static uint16_t entry_start(uint16_t n, uint16_t *end) {
+    uint16_t p = hist_head - 1;
+
+    for (;;) {
+        uint16_t q = p;
+        while (q != hist_tail && hist_buf[(q - 1) & HIST_MASK] != '\0') q--;
+        if (n-- == 0) {
+            *end = p;
+            return q;
+        }
+        p = q - 1;
+    }
+}
+
+int cli_history_get(uint16_t n, char *buf, size_t max) {
+    uint16_t start, end;
+    size_t len = 0;
+
+    if (n >= hist_entries || max == 0) return -1;
+    start = entry_start(n, &end);
+    while (start != end && len < max - 1) buf[len++] = hist_buf[start++ & HIST_MASK];
+    buf[len] = '\0';
+    return (int)len;
+}
+
+uint16_t cli_history_count(void) {
+    return hist_entries;
+}
+
+int cli_history_search(const char *pattern, uint16_t n, char *buf, size_t max) {
+    for (; n < hist_entries; n++) {
+        cli_history_get(n, buf, max);
+        if (strstr(buf, pattern)) return n;
+    }
+    return -1;
+}
+
+// --- Flash copy ---
+
+static int flash_append(const char *line, uint8_t len) {
+    uint8_t rec[CLI_HISTORY_LINE_MAX + 1];
+
+    rec[0] = len;
+    memcpy(&rec[1], line, len);
+    if (!spi_flash_program(HIST_FLASH_ADDR + flash_off, rec, len + 1)) return 0;
+    flash_off += len + 1;
+    return 1;
+}
+
+// Erase the sector and write back what the RAM ring holds
+static void flash_rewrite(void) {
+    uint32_t magic = CLI_HISTORY_MAGIC;
+    char line[CLI_HISTORY_LINE_MAX + 1];
+
+    flash_off = HIST_FLASH_START;
+    if (!spi_flash_erase_sector(HIST_FLASH_ADDR) ||
+        !spi_flash_program(HIST_FLASH_ADDR, (const uint8_t *)&magic, sizeof(magic))) {
+        flash_size = 0;     // give up on persistence rather than retry every command
+        return;
+    }
+    for (uint16_t n = hist_entries; n-- > 0;) {
+        int len = cli_history_get(n, line, sizeof(line));
+        if (len > 0 && flash_off + len + 1 <= flash_size) flash_append(line, (uint8_t)len);
+    }
+}
+
+static int printable(const uint8_t *s, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) {
+        if (s[i] < 0x20 || s[i] > 0x7E) return 0;
+    }
+    return 1;
+}
+
+void cli_history_init(void) {
+    const spi_flash_chip_t *chip = spi_flash_chip();
+    uint8_t rec[CLI_HISTORY_LINE_MAX + 1];
+    uint32_t magic;
+
+    if (chip == NULL || chip->size < HIST_FLASH_ADDR + chip->sector_size) return;
+    flash_size = chip->sector_size;
+
+    if (!spi_flash_read(HIST_FLASH_ADDR, (uint8_t *)&magic, sizeof(magic)) ||
+        magic != CLI_HISTORY_MAGIC) {
+        flash_rewrite();
+        return;
+    }
+
+    flash_off = HIST_FLASH_START;
+    while (flash_off < flash_size) {
+        uint16_t n = flash_size - flash_off;
+        if (n > sizeof(rec)) n = sizeof(rec);
+        if (!spi_flash_read(HIST_FLASH_ADDR + flash_off, rec, n)) break;
+        if (rec[0] == HIST_REC_END) return;         // end of the records
+        if (rec[0] == 0 || rec[0] > CLI_HISTORY_LINE_MAX || rec[0] >= n ||
+            !printable(&rec[1], rec[0])) {
+            break;                                  // torn write
+        }
+        ring_add((const char *)&rec[1], rec[0]);
+        flash_off += rec[0] + 1;
+    }
+    // Damaged or full: the next line compacts the sector
+    flash_off = flash_size;
+}
+
+void cli_history_add(const char *line) {
+    char newest[CLI_HISTORY_LINE_MAX + 1];
+    size_t len = strlen(line);
+
+    if (len == 0) return;
+    if (len > CLI_HISTORY_LINE_MAX) len = CLI_HISTORY_LINE_MAX;
+    if (cli_history_get(0, newest, sizeof(newest)) == (int)len && memcmp(newest, line, len) == 0) return;
+
+    ring_add(line, len);
+
+    if (flash_size == 0) return;
+    if (flash_off + len + 1 > flash_size) flash_rewrite();
+    else if (!flash_append(line, (uint8_t)len)) flash_off = flash_size;
+}
+
+void cli_history_clear(void) {
+    hist_head = hist_tail = 0;
+    hist_entries = 0;
+    if (flash_size != 0) flash_rewrite();
+}
+
+int cli_history_persistent(void) {
+    return flash_size != 0;
+}
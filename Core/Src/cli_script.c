@@ -0,0 +1,368 @@
+#include "cli_script.h"
+#include "cli.h"
+#include "cli_uart.h"
+#include "log_flash.h"
+#include "spi_flash.h"
+#include "telemetry.h"
+#include <string.h>
+#include <stdlib.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define MACRO_FLASH_ADDR    (LOG_FLASH_END + LOG_SECTOR_SIZE)   // after the history sector
+#define MACRO_NAME_MAX      16
+
+typedef struct {
+    const cli_command_t *cmd;
+    uint8_t argc;
+    uint8_t arg0;           // argv of this step starts at args[arg0]
+} script_step_t;
+
+// The compiled line. Tokens live in text, args points into it.
+static struct {
+    script_step_t steps[CLI_SCRIPT_STEPS];
+    char *args[CLI_SCRIPT_ARGS];
+    char text[CLI_SCRIPT_TEXT];
+    uint8_t nsteps;
+    uint8_t nargs;
+    uint16_t text_len;
+    uint8_t overflow;
+    uint16_t repeat;        // 0 = until a key is pressed
+    uint32_t period_ms;     // 0 = back to back
+} script;
+
+typedef struct {
+    const char *name;
+    const char *body;
+} cli_macro_t;
+
+static const cli_macro_t builtin_macros[] = {
+    { "sensors", "read M1; read M2; ads" },
+    { "status",  "uptime; logindex; export; console" },
+};
+
+// "name body", empty = free slot
+static char user_macros[CLI_MACRO_MAX][CLI_BUFFER_SIZE];
+static uint8_t macro_flash;         // 1 = user macros are saved to flash
+
+static void cmd_macro(int argc, char **argv);
+static void cmd_repeat(int argc, char **argv);
+static void cmd_watch(int argc, char **argv);
+
+static const cli_command_t script_commands[] = {
+    { "macro",  "macro [NAME <cmd>[; <cmd>...] | del NAME] - List/define macros", cmd_macro },
+    { "repeat", "repeat N <cmd>[; <cmd>...] - Run a command sequence N times", cmd_repeat },
+    { "watch",  "watch MS <cmd>[; <cmd>...] - Run it every MS ms until a key", cmd_watch },
+};
+
+// --- Macros ---
+
+static int user_macro_is(const char *slot, const char *name) {
+    size_t len = strlen(name);
+    return slot[0] != '\0' && strncmp(slot, name, len) == 0 && slot[len] == ' ';
+}
+
+static const char *macro_body(const char *name) {
+    for (size_t i = 0; i < sizeof(builtin_macros) / sizeof(builtin_macros[0]); i++) {
+        if (strcmp(builtin_macros[i].name, name) == 0) return builtin_macros[i].body;
+    }
+    for (uint8_t i = 0; i < CLI_MACRO_MAX; i++) {
+        if (user_macro_is(user_macros[i], name)) return strchr(user_macros[i], ' ') + 1;
+    }
+    return NULL;
+}
+
+static void macros_save(void) {
+    uint32_t magic = CLI_MACRO_MAGIC;
+
+    if (!macro_flash) return;
+    if (!spi_flash_erase_sector(MACRO_FLASH_ADDR) ||
+        !spi_flash_program(MACRO_FLASH_ADDR, (const uint8_t *)&magic, sizeof(magic)) ||
+        !spi_flash_program(MACRO_FLASH_ADDR + sizeof(magic), (const uint8_t *)user_macros,
+                           sizeof(user_macros))) {
+        cli_puts("Macro save to flash failed\r\n");
+    }
+}
+
+static void macros_load(void) {
+    const spi_flash_chip_t *chip = spi_flash_chip();
+    uint32_t magic;
+
+    if (chip == NULL || chip->size < MACRO_FLASH_ADDR + chip->sector_size) return;
+    macro_flash = 1;
+
+    if (!spi_flash_read(MACRO_FLASH_ADDR, (uint8_t *)&magic, sizeof(magic)) ||
+        magic != CLI_MACRO_MAGIC ||
+        !spi_flash_read(MACRO_FLASH_ADDR + sizeof(magic), (uint8_t *)user_macros, sizeof(user_macros))) {
+        memset(user_macros, 0, sizeof(user_macros));
+        return;
+    }
+    for (uint8_t i = 0; i < CLI_MACRO_MAX; i++) {
+        char *m = user_macros[i];
+        size_t len = strnlen(m, CLI_BUFFER_SIZE);
+        uint8_t ok = len < CLI_BUFFER_SIZE && (len == 0 || strchr(m, ' ') != NULL);
+        for (size_t j = 0; ok && j < len; j++) ok = m[j] >= 0x20 && m[j] < 0x7F;
+        if (!ok) m[0] = '\0';
+    }
+}
+
+static void cmd_macro(int argc, char **argv) {
+    char text[CLI_BUFFER_SIZE];
+    const cli_command_t *cmd;
+    size_t len;
+    int slot = -1;
+
+    if (argc < 2) {
+        for (size_t i = 0; i < sizeof(builtin_macros) / sizeof(builtin_macros[0]); i++) {
+            cli_printf("  %-10s %s (built in)\r\n", builtin_macros[i].name, builtin_macros[i].body);
+        }
+        for (uint8_t i = 0; i < CLI_MACRO_MAX; i++) {
+            if (user_macros[i][0] != '\0') cli_printf("  %s\r\n", user_macros[i]);
+        }
+        cli_printf("%s\r\n", macro_flash ? "User macros are kept in flash" : "User macros are lost on reset");
+        return;
+    }
+
+    if (strcmp(argv[1], "del") == 0 && argc == 3) {
+        for (uint8_t i = 0; i < CLI_MACRO_MAX; i++) {
+            if (user_macro_is(user_macros[i], argv[2])) {
+                user_macros[i][0] = '\0';
+                macros_save();
+                return;
+            }
+        }
+        cli_puts("No such macro\r\n");
+        return;
+    }
+    if (argc < 3) {
+        cli_puts("Usage: macro NAME <cmd>[; <cmd>...] | macro del NAME\r\n");
+        return;
+    }
+
+    cmd = CLI_Find(argv[1]);
+    if (strlen(argv[1]) >= MACRO_NAME_MAX || strcmp(argv[1], "del") == 0 ||
+        (cmd && strcmp(cmd->name, argv[1]) == 0)) {
+        cli_puts("Macro name taken or too long\r\n");
+        return;
+    }
+    for (size_t i = 0; i < sizeof(builtin_macros) / sizeof(builtin_macros[0]); i++) {
+        if (strcmp(builtin_macros[i].name, argv[1]) == 0) {
+            cli_puts("Built-in macros cannot be changed\r\n");
+            return;
+        }
+    }
+
+    // Tokens after the name are the body; rejoin them
+    len = 0;
+    for (int i = 1; i < argc; i++) {
+        size_t n = strlen(argv[i]);
+        if (len + n + 1 > sizeof(text)) {
+            cli_puts("Macro too long\r\n");
+            return;
+        }
+        memcpy(&text[len], argv[i], n);
+        len += n;
+        text[len++] = ' ';
+    }
+    text[len - 1] = '\0';
+
+    for (uint8_t i = 0; i < CLI_MACRO_MAX; i++) {
+        if (user_macro_is(user_macros[i], argv[1])) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && user_macros[i][0] == '\0') slot = i;
+    }
+    if (slot < 0) {
+        cli_puts("No free macro slot (macro del NAME)\r\n");
+        return;
+    }
+    strcpy(user_macros[slot], text);
+    macros_save();
+}
+
+// Reached only when repeat/watch are not at the start of the line
+static void cmd_repeat(int argc, char **argv) {
+    cli_puts("repeat and watch must start the line\r\n");
+}
+
+static void cmd_watch(int argc, char **argv) {
+    cmd_repeat(argc, argv);
+}
+
+// --- Compiler ---
+
+// Copy the next token into the text pool; NULL at the end of the command.
+// Raw tokens run to the end of the line, ';' included.
+static char *take_token(const char **src, int raw) {
+    const char *p = *src;
+    char *tok;
+
+    while (*p == ' ') p++;
+    *src = p;
+    if (*p == '\0' || (*p == ';' && !raw)) return NULL;
+
+    tok = &script.text[script.text_len];
+    while (*p != '\0' && *p != ' ' && (raw || *p != ';')) {
+        if (script.text_len >= CLI_SCRIPT_TEXT - 1) {
+            script.overflow = 1;
+            return NULL;
+        }
+        script.text[script.text_len++] = *p++;
+    }
+    script.text[script.text_len++] = '\0';
+    *src = p;
+    return tok;
+}
+
+static int compile_seq(const char *src, int in_macro) {
+    for (;;) {
+        uint8_t first = script.nargs;
+        uint16_t text_mark = script.text_len;
+        const cli_command_t *cmd = NULL;
+        const char *body = NULL;
+        uint8_t argc = 0;
+        int raw = 0;
+        char *tok;
+
+        while ((tok = take_token(&src, raw)) != NULL) {
+            if (script.nargs >= CLI_SCRIPT_ARGS - 1) {
+                script.overflow = 1;
+                break;
+            }
+            script.args[script.nargs++] = tok;
+            if (argc++ > 0) continue;
+
+            // Resolve the command word now: it decides how the rest is split
+            if (!in_macro) body = macro_body(tok);
+            if (body == NULL) {
+                cmd = CLI_Lookup(tok);
+                if (cmd == NULL) return 0;
+                raw = (cmd->handler == cmd_macro);
+            }
+        }
+        if (script.overflow) {
+            cli_puts("Line too long to compile\r\n");
+            return 0;
+        }
+
+        if (body != NULL) {
+            if (argc > 1) {
+                cli_puts("Macros take no arguments\r\n");
+                return 0;
+            }
+            script.nargs = first;
+            script.text_len = text_mark;
+            if (!compile_seq(body, 1)) return 0;
+        } else if (argc > 0) {
+            if (script.nsteps >= CLI_SCRIPT_STEPS) {
+                cli_puts("Too many commands in one line\r\n");
+                return 0;
+            }
+            script.args[script.nargs++] = NULL;     // argv[argc], as in C
+            script.steps[script.nsteps].cmd = cmd;
+            script.steps[script.nsteps].argc = argc;
+            script.steps[script.nsteps].arg0 = first;
+            script.nsteps++;
+        }
+
+        if (*src != ';') return 1;
+        src++;
+    }
+}
+
+// Leading "repeat N" / "watch MS"; returns 0 on a bad count
+static int compile_prefixes(const char **line) {
+    uint8_t repeat_set = 0;
+
+    for (;;) {
+        const char *p = *line;
+        char word[MACRO_NAME_MAX];
+        const cli_command_t *cmd;
+        unsigned long v;
+        char *end;
+        size_t n = 0;
+
+        while (*p == ' ') p++;
+        while (p[n] != '\0' && p[n] != ' ' && p[n] != ';' && n < sizeof(word) - 1) {
+            word[n] = p[n];
+            n++;
+        }
+        word[n] = '\0';
+        cmd = (n > 0) ? CLI_Find(word) : NULL;
+        if (cmd == NULL || (cmd->handler != cmd_repeat && cmd->handler != cmd_watch)) return 1;
+
+        v = strtoul(p + n, &end, 10);
+        if (end == p + n || v == 0 || v > 0xFFFF || (*end != ' ' && *end != '\0')) {
+            cli_puts(cmd->handler == cmd_repeat ? "Usage: repeat N <cmd>[; <cmd>...]\r\n"
+                                                : "Usage: watch MS <cmd>[; <cmd>...]\r\n");
+            return 0;
+        }
+        if (cmd->handler == cmd_repeat) {
+            script.repeat = (uint16_t)v;
+            repeat_set = 1;
+        } else {
+            script.period_ms = v;
+            if (!repeat_set) script.repeat = 0;
+        }
+        *line = end;
+    }
+}
+
+// --- Runner ---
+
+static void script_run(void) {
+    TickType_t next = xTaskGetTickCount();
+    uint32_t runs = 0, late = 0;
+    uint8_t key;
+
+    for (;;) {
+        if (script.repeat != 1) {
+            cli_printf("-- run %lu at %lu ms --\r\n", runs + 1, xTaskGetTickCount() * portTICK_PERIOD_MS);
+        }
+        for (uint8_t i = 0; i < script.nsteps; i++) {
+            const script_step_t *st = &script.steps[i];
+            st->cmd->handler(st->argc, &script.args[st->arg0]);
+        }
+        runs++;
+
+        if (script.repeat == 1) return;
+        if (script.repeat != 0 && runs >= script.repeat) break;
+        if (telemetry_active()) break;          // the console is no longer ours
+
+        if (script.period_ms != 0) {
+            TickType_t now = xTaskGetTickCount();
+            next += pdMS_TO_TICKS(script.period_ms);
+            if ((int32_t)(next - now) <= 0) {
+                late++;
+                next = now;                     // overran: restart the cadence
+            }
+            if (cli_read(&key, 1, (next - now) * portTICK_PERIOD_MS)) break;
+        } else if (cli_read(&key, 1, 0)) {
+            break;
+        }
+    }
+    cli_printf("%lu runs, %lu late\r\n", runs, late);
+}
+
+int cli_script_exec(const char *line) {
+    script.nsteps = 0;
+    script.nargs = 0;
+    script.text_len = 0;
+    script.overflow = 0;
+    script.repeat = 1;
+    script.period_ms = 0;
+
+    if (!compile_prefixes(&line) || !compile_seq(line, 0)) return 0;
+    if (script.nsteps == 0) {
+        if (script.repeat != 1 || script.period_ms != 0) cli_puts("Nothing to repeat\r\n");
+        return script.repeat == 1 && script.period_ms == 0;
+    }
+    script_run();
+    return 1;
+}
+
+void cli_script_init(void) {
+    CLI_RegisterCommands(script_commands, sizeof(script_commands) / sizeof(script_commands[0]));
+    macros_load();
+}
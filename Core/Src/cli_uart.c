@@ -0,0 +1,339 @@
+#include "cli_uart.h"
+#include "cli.h"
+#include "main.h"
+#include "usart.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "stream_buffer.h"
+#include "rtos_objects.h"
+#include "lowpower.h"
+
+#define TX_MASK   (CLI_TX_BUF_SIZE - 1)
+
+_Static_assert((CLI_TX_BUF_SIZE & TX_MASK) == 0, "CLI_TX_BUF_SIZE must be a power of two");
+
+// Free-running byte counters, taken modulo the buffer size on access.
+//   tx_next <= tx_commit <= tx_reserve, tx_reserve - tx_next <= size
+// [tx_next, tx_next + tx_dma_len) is on the wire, [.., tx_commit) is
+// waiting for the DMA, [tx_commit, tx_reserve) is still being copied in.
+static uint8_t tx_buf[CLI_TX_BUF_SIZE];
+static volatile uint32_t tx_reserve;
+static volatile uint32_t tx_commit;
+static volatile uint32_t tx_next;
+static volatile uint32_t tx_writers;     // producers between claim and release
+static volatile uint32_t tx_drop_to;     // overwrite: skip to here after the current DMA
+static volatile uint16_t tx_dma_len;     // 0 = DMA idle
+
+static volatile cli_tx_policy_t tx_policy = CLI_TX_BLOCK;
+static volatile uint32_t tx_written;
+static volatile uint32_t tx_dropped;
+static volatile uint16_t tx_peak;
+
+static volatile cli_text_hook_t tx_text_hook;
+
+static uint8_t rx_dma_buf[CLI_RX_DMA_SIZE];
+static uint16_t rx_pos;                  // DMA position already forwarded
+static volatile uint32_t rx_received;
+static volatile uint32_t rx_dropped;
+static volatile uint32_t rx_errors;
+
+static void cmd_console(int argc, char **argv) {
+    static const char *const names[] = { "block", "drop", "overwrite" };
+    cli_tx_stats_t st;
+    cli_rx_stats_t rx;
+
+    if (argc >= 2) {
+        uint8_t i;
+        for (i = 0; i < 3; i++) {
+            if (strcmp(argv[1], names[i]) == 0) break;
+        }
+        if (i == 3) {
+            cli_puts("Usage: console [block|drop|overwrite]\r\n");
+            return;
+        }
+        cli_tx_set_policy((cli_tx_policy_t)i);
+    }
+
+    cli_tx_get_stats(&st);
+    cli_printf("TX policy %s, written %lu, dropped %lu, pending %u, peak %u/%u\r\n",
+               names[cli_tx_get_policy()], st.written, st.dropped,
+               st.pending, st.peak, CLI_TX_BUF_SIZE);
+    cli_rx_get_stats(&rx);
+    cli_printf("RX received %lu, dropped %lu, errors %lu\r\n", rx.received, rx.dropped, rx.errors);
+}
+
+static const cli_command_t uart_commands[] = {
+    { "console", "console [block|drop|overwrite] - UART buffer policy/stats", cmd_console },
+};
+
+void cli_uart_init(void) {
+    CLI_RegisterCommands(uart_commands, sizeof(uart_commands) / sizeof(uart_commands[0]));
+}
+
+void cli_tx_set_policy(cli_tx_policy_t policy) {
+    tx_policy = policy;
+}
+
+cli_tx_policy_t cli_tx_get_policy(void) {
+    return tx_policy;
+}
+
+void cli_tx_get_stats(cli_tx_stats_t *stats) {
+    stats->written = tx_written;
+    stats->dropped = tx_dropped;
+    stats->pending = (uint16_t)(tx_commit - tx_next);
+    stats->peak = tx_peak;
+}
+
+// Start the next DMA transfer if the stream is idle. Interrupts masked.
+static void tx_kick_locked(void) {
+    uint32_t off, n;
+
+    if (tx_dma_len != 0 || tx_commit == tx_next) return;
+
+    off = tx_next & TX_MASK;
+    n = tx_commit - tx_next;
+    if (n > CLI_TX_BUF_SIZE - off) n = CLI_TX_BUF_SIZE - off;   // rest after the wrap goes next
+    if (n > CLI_TX_DMA_CHUNK) n = CLI_TX_DMA_CHUNK;
+
+    if (HAL_UART_Transmit_DMA(&huart6, &tx_buf[off], (uint16_t)n) == HAL_OK) {
+        tx_dma_len = (uint16_t)n;
+    }
+}
+
+static void tx_kick(void) {
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    tx_kick_locked();
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+// Leave the producer section. The last producer out publishes everything
+// reserved so far, so a message only becomes visible to the DMA once every
+// earlier claim has been filled. The count and the reserve index are read
+// together with interrupts masked; otherwise a producer could claim, copy
+// and leave between the two, and its bytes would stay unpublished.
+static void tx_release(void) {
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    if (--tx_writers == 0) tx_commit = tx_reserve;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+// Make room for `need` more bytes by discarding the oldest committed output
+// that has not reached the DMA yet. Space behind a transfer in flight is
+// only freed when that transfer completes. Interrupts masked.
+static void tx_overwrite_locked(uint32_t need) {
+    uint32_t start = tx_next + tx_dma_len;
+    uint32_t used = tx_reserve - tx_next;
+    uint32_t shortfall, drop;
+
+    if ((int32_t)(tx_drop_to - start) > 0) start = tx_drop_to;
+    if (used + need <= CLI_TX_BUF_SIZE) return;
+
+    shortfall = used + need - CLI_TX_BUF_SIZE;
+    drop = tx_commit - start;
+    if (drop > shortfall) drop = shortfall;
+    if (drop == 0) return;
+
+    if (tx_dma_len == 0) {
+        tx_next = start + drop;
+        tx_drop_to = tx_next;
+    } else {
+        tx_drop_to = start + drop;
+    }
+    tx_dropped += drop;
+}
+
+void cli_set_text_hook(cli_text_hook_t hook) {
+    tx_text_hook = hook;
+}
+
+int cli_write(const void *data, size_t len) {
+    cli_text_hook_t hook = tx_text_hook;
+
+    if (hook != NULL) return hook(data, len);
+    return cli_uart_send(data, len);
+}
+
+int cli_uart_send(const void *data, size_t len) {
+    const uint8_t *src = (const uint8_t *)data;
+    int isr = (__get_IPSR() != 0U);
+    int retried = 0;
+    uint32_t head, next, off, first;
+
+    if (len == 0) return 1;
+
+    // No interrupts until the scheduler runs: write it out directly
+    if (!isr && xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+        return HAL_UART_Transmit(&huart6, (uint8_t *)src, (uint16_t)len, HAL_MAX_DELAY) == HAL_OK;
+    }
+
+    if (len > CLI_TX_BUF_SIZE) {
+        tx_dropped += len;
+        return 0;
+    }
+
+    for (;;) {
+        int claimed = 0;
+
+        __atomic_add_fetch(&tx_writers, 1, __ATOMIC_ACQ_REL);
+        for (;;) {
+            // tx_next first: it can only grow, so the space seen is never
+            // more than what is really free
+            next = tx_next;
+            head = __atomic_load_n(&tx_reserve, __ATOMIC_ACQUIRE);
+            if (CLI_TX_BUF_SIZE - (head - next) < len) break;
+            if (__atomic_compare_exchange_n(&tx_reserve, &head, head + len, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                claimed = 1;
+                break;
+            }
+        }
+
+        if (claimed) {
+            off = head & TX_MASK;
+            first = CLI_TX_BUF_SIZE - off;
+            if (first > len) first = len;
+            memcpy(&tx_buf[off], src, first);
+            memcpy(tx_buf, src + first, len - first);
+            tx_release();
+            tx_kick();
+
+            tx_written += len;
+            if ((uint16_t)(tx_commit - tx_next) > tx_peak) tx_peak = (uint16_t)(tx_commit - tx_next);
+            return 1;
+        }
+        tx_release();
+
+        if (tx_policy == CLI_TX_OVERWRITE) {
+            UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+            tx_overwrite_locked(len);
+            taskEXIT_CRITICAL_FROM_ISR(mask);
+            if (isr) {
+                if (retried++) break;
+                continue;
+            }
+        } else if (isr || tx_policy == CLI_TX_DROP) {
+            break;
+        }
+
+        // Sleep until a transfer completes; the timeout covers a missed give
+        // when several writers wait at once
+        xSemaphoreTake(cli_uart_tx_space, pdMS_TO_TICKS(10));
+    }
+
+    tx_dropped += len;
+    return 0;
+}
+
+int cli_puts(const char *s) {
+    return cli_write(s, strlen(s));
+}
+
+int cli_printf(const char *fmt, ...) {
+    char buf[CLI_PRINTF_MAX];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (n < 0) return 0;
+    if (n >= (int)sizeof(buf)) n = sizeof(buf) - 1;   // truncated
+    return cli_write(buf, (size_t)n);
+}
+
+void cli_tx_flush(uint32_t timeout_ms) {
+    TickType_t start = xTaskGetTickCount();
+
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) return;
+    while (tx_next != tx_reserve || tx_dma_len != 0) {
+        if ((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(timeout_ms)) return;
+        xSemaphoreTake(cli_uart_tx_space, pdMS_TO_TICKS(10));
+    }
+}
+
+int cli_uart_rx_start(void) {
+    rx_pos = 0;
+    return HAL_UARTEx_ReceiveToIdle_DMA(&huart6, rx_dma_buf, CLI_RX_DMA_SIZE) == HAL_OK;
+}
+
+size_t cli_read(void *buf, size_t len, uint32_t timeout_ms) {
+    TickType_t ticks = (timeout_ms == CLI_WAIT_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+
+    if (cli_uart_rx_stream == NULL) return 0;
+    return xStreamBufferReceive(cli_uart_rx_stream, buf, len, ticks);
+}
+
+void cli_rx_get_stats(cli_rx_stats_t *stats) {
+    stats->received = rx_received;
+    stats->dropped = rx_dropped;
+    stats->errors = rx_errors;
+}
+
+static void rx_forward(uint16_t off, uint16_t n, BaseType_t *woken) {
+    size_t sent;
+
+    if (n == 0 || cli_uart_rx_stream == NULL) return;
+    sent = xStreamBufferSendFromISR(cli_uart_rx_stream, &rx_dma_buf[off], n, woken);
+    rx_received += sent;
+    rx_dropped += n - sent;
+}
+
+// Half transfer, transfer complete and IDLE line all land here; size is the
+// DMA write position in the circular buffer
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t size) {
+    BaseType_t woken = pdFALSE;
+
+    if (huart != &huart6 || size == rx_pos) return;
+    lowpower_console_activity();
+
+    if (size > rx_pos) {
+        rx_forward(rx_pos, size - rx_pos, &woken);
+    } else {
+        // Wrapped without a transfer-complete event in between
+        rx_forward(rx_pos, CLI_RX_DMA_SIZE - rx_pos, &woken);
+        rx_forward(0, size, &woken);
+    }
+    rx_pos = (size == CLI_RX_DMA_SIZE) ? 0 : size;
+    portYIELD_FROM_ISR(woken);
+}
+
+static void tx_done_from_isr(void) {
+    BaseType_t woken = pdFALSE;
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    tx_next += tx_dma_len;
+    if ((int32_t)(tx_drop_to - tx_next) > 0) tx_next = tx_drop_to;
+    tx_drop_to = tx_next;
+    tx_dma_len = 0;
+    tx_kick_locked();
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+
+    if (cli_uart_tx_space != NULL) xSemaphoreGiveFromISR(cli_uart_tx_space, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    if (huart == &huart6) tx_done_from_isr();
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+    if (huart != &huart6) return;
+
+    // A TX DMA error ends the transfer; skip it rather than stall the ring
+    if (tx_dma_len != 0 && huart->gState == HAL_UART_STATE_READY) {
+        tx_done_from_isr();
+    }
+    // Overrun, framing and noise errors stop the receiver; bytes already in
+    // the DMA buffer past the last event are lost with it
+    if (huart->RxState == HAL_UART_STATE_READY) {
+        rx_errors++;
+        cli_uart_rx_start();
+    }
+}
@@ -0,0 +1,222 @@
+#include "clock_profile.h"
+#include "main.h"
+#include "usart.h"
+#include "i2c.h"
+#include "spi.h"
+#include "adc.h"
+#include "cli.h"
+#include "cli_uart.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    uint32_t pll_p;             // 0: SYSCLK straight from the HSI
+    uint32_t apb1_div;
+    uint32_t apb2_div;
+    uint32_t latency;           // flash wait states, 30 MHz each at 2.7-3.6 V
+    uint32_t vos;
+} clock_config_t;
+
+// PLL input is HSI / 8 = 2 MHz, VCO 200 MHz; only PLLP differs
+#define CLOCK_PLL_M     8U
+#define CLOCK_PLL_N     100U
+
+static const clock_config_t profiles[CLOCK_PROFILE_COUNT] = {
+    [CLOCK_LOW]      = { "low",      0,             RCC_HCLK_DIV1, RCC_HCLK_DIV1, FLASH_LATENCY_0,
+                         PWR_REGULATOR_VOLTAGE_SCALE3 },
+    [CLOCK_BALANCED] = { "balanced", RCC_PLLP_DIV4, RCC_HCLK_DIV1, RCC_HCLK_DIV1, FLASH_LATENCY_1,
+                         PWR_REGULATOR_VOLTAGE_SCALE3 },
+    [CLOCK_FULL]     = { "full",     RCC_PLLP_DIV2, RCC_HCLK_DIV2, RCC_HCLK_DIV1, FLASH_LATENCY_3,
+                         PWR_REGULATOR_VOLTAGE_SCALE1 },
+};
+
+static clock_profile_t current = CLOCK_LOW;
+static uint32_t spi1_max_hz, spi2_max_hz;      // SCK as configured at boot
+
+static uint32_t spi_pclk(SPI_HandleTypeDef *hspi) {
+    return (hspi->Instance == SPI1) ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+}
+
+static uint32_t spi_sck(SPI_HandleTypeDef *hspi) {
+    return spi_pclk(hspi) / (2U << (hspi->Init.BaudRatePrescaler >> 3));
+}
+
+// Smallest divider that keeps SCK at or below max_hz; /256 at worst
+static void spi_retime(SPI_HandleTypeDef *hspi, uint32_t max_hz) {
+    uint32_t pclk = spi_pclk(hspi);
+    uint32_t shift = 0;
+
+    while (shift < 7 && pclk / (2U << shift) > max_hz) shift++;
+    hspi->Init.BaudRatePrescaler = shift << 3;
+    if (HAL_SPI_Init(hspi) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
+static void uart_retime(UART_HandleTypeDef *huart) {
+    uint32_t pclk = HAL_RCC_GetPCLK2Freq();         // USART1/6 are on APB2
+
+    // Only BRR: HAL_UART_Init would also reset the running RX DMA
+    if (huart->Init.OverSampling == UART_OVERSAMPLING_8) {
+        huart->Instance->BRR = UART_BRR_SAMPLING8(pclk, huart->Init.BaudRate);
+    } else {
+        huart->Instance->BRR = UART_BRR_SAMPLING16(pclk, huart->Init.BaudRate);
+    }
+}
+
+static int buses_idle(void) {
+    return huart6.gState == HAL_UART_STATE_READY && hi2c1.State == HAL_I2C_STATE_READY &&
+           hspi1.State == HAL_SPI_STATE_READY && hspi2.State == HAL_SPI_STATE_READY &&
+           !adc_scan_active();
+}
+
+// Via the HSI, since the PLL cannot be changed while it clocks the core.
+// Wait states go up before the clock does and down after; HAL_RCC_ClockConfig
+// takes care of that order.
+static int apply(const clock_config_t *p) {
+    RCC_OscInitTypeDef osc = {0};
+    RCC_ClkInitTypeDef clk = {0};
+
+    clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clk.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+    clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    clk.APB1CLKDivider = RCC_HCLK_DIV1;
+    clk.APB2CLKDivider = RCC_HCLK_DIV1;
+    if (HAL_RCC_ClockConfig(&clk, FLASH_LATENCY_0) != HAL_OK) return 0;
+
+    osc.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    osc.PLL.PLLState = RCC_PLL_OFF;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK) return 0;
+
+    __HAL_PWR_VOLTAGESCALING_CONFIG(p->vos);
+
+    if (p->pll_p != 0) {
+        osc.PLL.PLLState = RCC_PLL_ON;
+        osc.PLL.PLLSource = RCC_PLLSOURCE_HSI;
+        osc.PLL.PLLM = CLOCK_PLL_M;
+        osc.PLL.PLLN = CLOCK_PLL_N;
+        osc.PLL.PLLP = p->pll_p;
+        osc.PLL.PLLQ = 4;
+        osc.PLL.PLLR = 2;
+        if (HAL_RCC_OscConfig(&osc) != HAL_OK) return 0;
+        clk.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+    }
+    clk.APB1CLKDivider = p->apb1_div;
+    clk.APB2CLKDivider = p->apb2_div;
+    if (HAL_RCC_ClockConfig(&clk, p->latency) != HAL_OK) return 0;
+
+    if (p->latency != FLASH_LATENCY_0) {
+        __HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+    } else {
+        __HAL_FLASH_PREFETCH_BUFFER_DISABLE();
+    }
+    __HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
+    return 1;
+}
+
+static void retime_peripherals(void) {
+    uart_retime(&huart6);
+    if (HAL_I2C_Init(&hi2c1) != HAL_OK) {
+        Error_Handler();
+    }
+    spi_retime(&hspi1, spi1_max_hz);
+    spi_retime(&hspi2, spi2_max_hz);
+}
+
+int clock_profile_set(clock_profile_t profile) {
+    TickType_t start;
+    int ok;
+
+    if (profile >= CLOCK_PROFILE_COUNT) return 0;
+
+    // Nothing may start a transfer between the idle check and the retiming
+    start = xTaskGetTickCount();
+    for (;;) {
+        taskENTER_CRITICAL();
+        if (buses_idle()) break;
+        taskEXIT_CRITICAL();
+        if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING ||
+            xTaskGetTickCount() - start >= pdMS_TO_TICKS(CLOCK_SWITCH_TIMEOUT_MS)) {
+            return 0;
+        }
+        vTaskDelay(1);
+    }
+
+    ok = apply(&profiles[profile]);
+    if (ok) {
+        current = profile;
+    } else if (!apply(&profiles[current])) {
+        // The HSI always starts
+        apply(&profiles[CLOCK_LOW]);
+        current = CLOCK_LOW;
+    }
+    retime_peripherals();
+    taskEXIT_CRITICAL();
+    return ok;
+}
+
+clock_profile_t clock_profile_get(void) {
+    return current;
+}
+
+const char *clock_profile_name(clock_profile_t profile) {
+    return profile < CLOCK_PROFILE_COUNT ? profiles[profile].name : "?";
+}
+
+static void cmd_clock(int argc, char **argv) {
+    RCC_ClkInitTypeDef clk;
+    uint32_t latency, pclk2, brr, baud;
+
+    if (argc >= 2) {
+        for (uint32_t i = 0; i < CLOCK_PROFILE_COUNT; i++) {
+            if (strcmp(argv[1], profiles[i].name) == 0) {
+                if (clock_profile_set((clock_profile_t)i)) {
+                    cli_printf("Clock profile %s, SYSCLK %lu MHz\r\n", profiles[i].name,
+                               HAL_RCC_GetSysClockFreq() / 1000000U);
+                } else {
+                    cli_printf("Could not switch to %s (buses busy or ADC scan running), still %s\r\n",
+                               profiles[i].name, profiles[current].name);
+                }
+                return;
+            }
+        }
+        cli_puts("Usage: clock [low|balanced|full]\r\n");
+        return;
+    }
+
+    HAL_RCC_GetClockConfig(&clk, &latency);
+    pclk2 = HAL_RCC_GetPCLK2Freq();
+    brr = huart6.Instance->BRR;
+    baud = brr ? pclk2 / brr : 0;
+    if (brr && huart6.Init.OverSampling == UART_OVERSAMPLING_8) {
+        baud = 2U * pclk2 / (((brr & ~0xFU) | ((brr & 0x7U) << 1)));
+    }
+
+    cli_printf("Profile %s\r\n", profiles[current].name);
+    cli_printf("SYSCLK %lu Hz (%s), HCLK %lu Hz\r\n", HAL_RCC_GetSysClockFreq(),
+               clk.SYSCLKSource == RCC_SYSCLKSOURCE_PLLCLK ? "PLL" : "HSI", HAL_RCC_GetHCLKFreq());
+    cli_printf("PCLK1 %lu Hz, PCLK2 %lu Hz\r\n", HAL_RCC_GetPCLK1Freq(), pclk2);
+    cli_printf("Flash %lu wait states, prefetch %s, I-cache %s, D-cache %s\r\n", latency,
+               (FLASH->ACR & FLASH_ACR_PRFTEN) ? "on" : "off",
+               (FLASH->ACR & FLASH_ACR_ICEN) ? "on" : "off",
+               (FLASH->ACR & FLASH_ACR_DCEN) ? "on" : "off");
+    cli_printf("USART6 %lu baud (BRR 0x%04lx)\r\n", baud, brr);
+    cli_printf("SPI1 SCK %lu Hz, SPI2 SCK %lu Hz\r\n", spi_sck(&hspi1), spi_sck(&hspi2));
+    cli_printf("I2C1 %lu Hz from PCLK1\r\n", hi2c1.Init.ClockSpeed);
+}
+
+static const cli_command_t clock_commands[] = {
+    { "clock", "clock [low|balanced|full] - Show or switch the core clock profile", cmd_clock },
+};
+
+void clock_profile_init(void) {
+    spi1_max_hz = spi_sck(&hspi1);
+    spi2_max_hz = spi_sck(&hspi2);
+    if (CLOCK_PROFILE_BOOT != CLOCK_LOW) {
+        clock_profile_set(CLOCK_PROFILE_BOOT);
+    }
+    CLI_RegisterCommands(clock_commands, sizeof(clock_commands) / sizeof(clock_commands[0]));
+}
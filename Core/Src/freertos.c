@@ -33,6 +33,19 @@
 #include "ads1115.h"
 #include "oled.h"
 #include "moisture.h"
+#include "sensors.h"
+#include "i2c_bus.h"
+#include "spi_flash.h"
+#include "cli_uart.h"
+#include "log_export.h"
+#include "telemetry.h"
+#include "cli_script.h"
+#include "perf.h"
+#include "sysmon.h"
+#include "lowpower.h"
+#include "clock_profile.h"
+#include "app_sched.h"
+#include "rtos_objects.h"
 
 /* USER CODE END Includes */
 
@@ -54,18 +67,23 @@
 /* USER CODE END Variables */
 /* Definitions for defaultTask */
 osThreadId_t defaultTaskHandle;
+uint32_t defaultTaskBuffer[ 128 ];
+osStaticThreadDef_t defaultTaskControlBlock;
 const osThreadAttr_t defaultTask_attributes = {
   .name = "defaultTask",
-  .stack_size = 128 * 4,
+  .cb_mem = &defaultTaskControlBlock,
+  .cb_size = sizeof(defaultTaskControlBlock),
+  .stack_mem = &defaultTaskBuffer[0],
+  .stack_size = sizeof(defaultTaskBuffer),
   .priority = (osPriority_t) osPriorityNormal,
 };
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN FunctionPrototypes */
-extern void CLI_Task(void *argument);
 extern UART_HandleTypeDef huart6;
 void MoistureDisplayTask(void *argument);  // forward declaration
 void MoistureLogTask(void *argument);  // forward declaration for logging task
 void OledDisplayTask(void *argument);
+void AlarmTask(void *argument);
 
 /* USER CODE END FunctionPrototypes */
 
@@ -74,14 +92,31 @@ void StartDefaultTask(void *argument);
 void MX_FREERTOS_Init(void); /* (MISRA C 2004 rule 8.1) */
 
 /* Hook prototypes */
+void configureTimerForRunTimeStats(void);
+unsigned long getRunTimeCounterValue(void);
 void vApplicationStackOverflowHook(xTaskHandle xTask, signed char *pcTaskName);
 
+/* USER CODE BEGIN 1 */
+/* Functions needed when configGENERATE_RUN_TIME_STATS is on */
+void configureTimerForRunTimeStats(void)
+{
+  sysmon_runtime_init();
+}
+
+unsigned long getRunTimeCounterValue(void)
+{
+  return sysmon_runtime_now();
+}
+/* USER CODE END 1 */
+
 /* USER CODE BEGIN 4 */
 void vApplicationStackOverflowHook(xTaskHandle xTask, signed char *pcTaskName)
 {
    /* Run time stack overflow checking is performed if
    configCHECK_FOR_STACK_OVERFLOW is defined to 1 or 2. This hook function is
    called if a stack overflow is detected. */
+   (void)xTask;
+   sysmon_stack_overflow((const char *)pcTaskName);
 }
 /* USER CODE END 4 */
 
@@ -92,6 +127,18 @@ void vApplicationStackOverflowHook(xTaskHandle xTask, signed char *pcTaskName)
   */
 void MX_FREERTOS_Init(void) {
   /* USER CODE BEGIN Init */
+  rtos_objects_create();
+  perf_init();
+  sysmon_init();
+  lowpower_init();
+  clock_profile_init();
+  sched_init();
+  cli_uart_init();
+  spi_flash_init();
+  log_flash_init();
+  log_export_init();
+  telemetry_init();
+  cli_script_init();
   st7032_init_bar_chars();
 
   /* USER CODE END Init */
@@ -116,26 +163,7 @@ void MX_FREERTOS_Init(void) {
   /* creation of defaultTask */
   defaultTaskHandle = osThreadNew(StartDefaultTask, NULL, &defaultTask_attributes);
   /* USER CODE BEGIN RTOS_THREADS */
-  xTaskCreate(MoistureDisplayTask, "Moisture", 256, NULL, 1, NULL);
-  xTaskCreate(MoistureLogTask, "LogTask", 512, NULL, 1, NULL);
-  xTaskCreate(OledDisplayTask, "OLED", 256, NULL, 1, NULL);
-
-extern void CLI_Task(void *argument);
-
-osThreadId_t cliTaskHandle;
-const osThreadAttr_t cliTask_attributes = {
-  .name = "cliTask",
-  .stack_size = 1024 * 4,  // try increasing if CLI fails to run
-  .priority = (osPriority_t) osPriorityNormal
-};
-
-cliTaskHandle = osThreadNew(CLI_Task, NULL, &cliTask_attributes);
-if (cliTaskHandle == NULL) {
-    HAL_UART_Transmit(&huart6, (uint8_t*)"CLI task creation FAILED\r\n", 27, HAL_MAX_DELAY);
-} else {
-    HAL_UART_Transmit(&huart6, (uint8_t*)"CLI task created OK\r\n", 22, HAL_MAX_DELAY);
-}
-
+  // Application tasks are created by rtos_objects_create()
   /* USER CODE END RTOS_THREADS */
 
   /* USER CODE BEGIN RTOS_EVENTS */
@@ -145,89 +173,78 @@ if (cliTaskHandle == NULL) {
 }
 
 /* USER CODE BEGIN Header_StartDefaultTask */
+// Keeps the LSI calibration current for tickless idle; otherwise blocked,
+// so the idle task can sleep
 void StartDefaultTask(void *argument) {
   for(;;) {
-    osDelay(1);
+    osDelay(LOWPOWER_CAL_PERIOD_MS);
+    lowpower_calibrate();
   }
 }
 /* USER CODE END Header_StartDefaultTask */
 
 /* Private application code --------------------------------------------------*/
 /* USER CODE BEGIN Application */
+// The consumers below run only when the sensor task posts something for
+// them (see app_sched.h)
 void MoistureDisplayTask(void *argument) {
-    ADC_ChannelConfTypeDef sConfig = {0};
-    uint32_t val_m1 = 0, val_m2 = 0;
-    char line[17];
+    sensor_snapshot_t snap;
 
+    sched_subscribe(SCHED_LCD, SCHED_EV_SAMPLE);
     for (;;) {
-        // M1 = PA0
-        sConfig.Channel = ADC_CHANNEL_0;
-        sConfig.Rank = 1;
-        sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
-        HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        val_m1 = HAL_ADC_GetValue(&hadc1);
-
-        // M2 = PA1
-        sConfig.Channel = ADC_CHANNEL_1;
-        HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        val_m2 = HAL_ADC_GetValue(&hadc1);
-
-        // Convert to percentage (wet = 100%, dry = 0%)
-        uint8_t m1_pct = (val_m1 >= m1_cal.wet) ? 100 :
-                         (val_m1 <= m1_cal.dry) ? 0 :
-                         100 * (val_m1 - m1_cal.dry) / (m1_cal.wet - m1_cal.dry);
-
-        uint8_t m2_pct = (val_m2 >= m2_cal.wet) ? 100 :
-                         (val_m2 <= m2_cal.dry) ? 0 :
-                         100 * (val_m2 - m2_cal.dry) / (m2_cal.wet - m2_cal.dry);
-
-
-
-        // Update LCD
-        st7032_draw_moisture_bar(0, m1_pct); // Line 0
-        st7032_draw_moisture_bar(1, m2_pct); // Line 1
-
-        vTaskDelay(pdMS_TO_TICKS(2000));  // Update every 2s
+        sched_wait(SCHED_LCD);
+        sensors_get(&snap);
+
+        // Update LCD, wet = 100%, dry = 0%
+        st7032_draw_moisture_bar(0, moisture_percent(snap.adc[SENSOR_M1], &m1_cal)); // Line 0
+        st7032_draw_moisture_bar(1, moisture_percent(snap.adc[SENSOR_M2], &m2_cal)); // Line 1
     }
 }
 
 void MoistureLogTask(void *argument) {
-    TickType_t lastWakeTime = xTaskGetTickCount();
-
+    sched_subscribe(SCHED_LOGGER, SCHED_EV_LOG_DUE);
     for (;;) {
         log_entry_t entry;
-
-        // --- Read M1 (PA0)
-        ADC_ChannelConfTypeDef sConfig = {0};
-        sConfig.Channel = ADC_CHANNEL_0;
-        sConfig.Rank = 1;
-        sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
-        HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        entry.m1 = HAL_ADC_GetValue(&hadc1);
-
-        // --- Read M2 (PA1)
-        sConfig.Channel = ADC_CHANNEL_1;
-        HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        entry.m2 = HAL_ADC_GetValue(&hadc1);
-
-        // --- Read ADS channels
+        sensor_snapshot_t snap;
+
+        // Also wakes when staged records reach their age limit, so they
+        // reach the flash even if the log period is longer than that
+        if (!(sched_wait_timeout(SCHED_LOGGER, log_flash_service()) & SCHED_EV_LOG_DUE)) continue;
+        sensors_get(&snap);
+        entry.m1 = snap.adc[SENSOR_M1];
+        entry.m2 = snap.adc[SENSOR_M2];
         for (uint8_t ch = 0; ch < 4; ch++) {
-            entry.ads[ch] = ads_read_channel(ch);  // must be defined in cli.c or elsewhere
+            entry.ads[ch] = snap.ads[ch];
         }
-
-        entry.timestamp_ms = xTaskGetTickCount();
+        entry.timestamp_ms = snap.timestamp_ms;
 
         flash_write_log_entry(&entry);
+    }
+}
+
+// Dry alarm: console message and LED1 while any probe is below the level
+void AlarmTask(void *argument) {
+    sensor_snapshot_t snap;
+    uint32_t shown = 0;
 
-        vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(60000)); // log every 60 seconds
+    sched_subscribe(SCHED_ALARM, SCHED_EV_THRESHOLD);
+    for (;;) {
+        uint32_t now, changed;
+
+        sched_wait(SCHED_ALARM);
+        now = sched_alarms();
+        changed = now ^ shown;
+        sensors_get(&snap);
+        if (changed & (1U << SENSOR_M1)) {
+            cli_printf("Alarm: M1 %s (%u%%)\r\n", (now & (1U << SENSOR_M1)) ? "dry" : "ok",
+                       moisture_percent(snap.adc[SENSOR_M1], &m1_cal));
+        }
+        if (changed & (1U << SENSOR_M2)) {
+            cli_printf("Alarm: M2 %s (%u%%)\r\n", (now & (1U << SENSOR_M2)) ? "dry" : "ok",
+                       moisture_percent(snap.adc[SENSOR_M2], &m2_cal));
+        }
+        HAL_GPIO_WritePin(LED1_GPIO_Port, LED1_Pin, now != 0 ? GPIO_PIN_SET : GPIO_PIN_RESET);
+        shown = now;
     }
 }
 
@@ -22,6 +22,8 @@
 #include "gpio.h"
 
 /* USER CODE BEGIN 0 */
+#include "ads1115.h"
+#include "lowpower.h"
 
 /* USER CODE END 0 */
 
@@ -82,5 +84,17 @@ void MX_GPIO_Init(void)
 }
 
 /* USER CODE BEGIN 2 */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  if (GPIO_Pin == ADS_ALRT_Pin)
+  {
+    ads_alert_irq();
+  }
+  else if (GPIO_Pin == LOWPOWER_WAKE_RX_Pin)
+  {
+    // Start bit that woke the board from STOP; the character itself is lost
+    lowpower_console_activity();
+  }
+}
 
 /* USER CODE END 2 */
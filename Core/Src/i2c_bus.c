@@ -0,0 +1,289 @@
+#include "i2c_bus.h"
+#include "i2c.h"
+#include "task.h"
+#include "queue.h"
+#include "rtos_objects.h"
+
+// PB6/PB7, see HAL_I2C_MspInit
+#define I2C_BUS_SCL_Pin      GPIO_PIN_6
+#define I2C_BUS_SDA_Pin      GPIO_PIN_7
+#define I2C_BUS_GPIO_Port    GPIOB
+
+#define I2C_NOTIFY_REQ       (1UL << 0)
+#define I2C_NOTIFY_DONE      (1UL << 1)
+
+static volatile i2c_status_t i2c_bus_result;   // set by the HAL callbacks
+static i2c_bus_stats_t i2c_bus_stats;
+
+// Worst case bus time for len bytes plus address/register, with slack for
+// clock stretching
+static uint32_t i2c_bus_xfer_ms(uint16_t len) {
+    return ((uint32_t)(len + 2) * 9000U) / hi2c1.Init.ClockSpeed + 5;
+}
+
+static i2c_status_t i2c_bus_hal_status(HAL_StatusTypeDef rc) {
+    if (rc == HAL_OK) return I2C_OK;
+    if (rc == HAL_TIMEOUT) return I2C_ERR_TIMEOUT;
+    if (HAL_I2C_GetError(&hi2c1) & HAL_I2C_ERROR_AF) return I2C_ERR_NACK;
+    return I2C_ERR_BUS;
+}
+
+static void i2c_bus_count(i2c_status_t status) {
+    i2c_bus_stats.xfers++;
+    if (status == I2C_ERR_NACK) i2c_bus_stats.nacks++;
+    else if (status == I2C_ERR_BUS) i2c_bus_stats.bus_errors++;
+    else if (status == I2C_ERR_TIMEOUT) i2c_bus_stats.timeouts++;
+}
+
+static void i2c_bus_delay(void) {
+    // Roughly 5 us, half a 100 kHz bit period
+    for (volatile uint32_t n = SystemCoreClock / 1000000U; n > 0; n--) {
+    }
+}
+
+void i2c_bus_recover(void) {
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+    HAL_I2C_DeInit(&hi2c1);
+
+    HAL_GPIO_WritePin(I2C_BUS_GPIO_Port, I2C_BUS_SCL_Pin | I2C_BUS_SDA_Pin, GPIO_PIN_SET);
+    GPIO_InitStruct.Pin = I2C_BUS_SCL_Pin | I2C_BUS_SDA_Pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(I2C_BUS_GPIO_Port, &GPIO_InitStruct);
+    i2c_bus_delay();
+
+    // A slave holding SDA low is still in the middle of a byte: clock it out
+    for (uint8_t i = 0; i < 9; i++) {
+        if (HAL_GPIO_ReadPin(I2C_BUS_GPIO_Port, I2C_BUS_SDA_Pin) == GPIO_PIN_SET) break;
+        HAL_GPIO_WritePin(I2C_BUS_GPIO_Port, I2C_BUS_SCL_Pin, GPIO_PIN_RESET);
+        i2c_bus_delay();
+        HAL_GPIO_WritePin(I2C_BUS_GPIO_Port, I2C_BUS_SCL_Pin, GPIO_PIN_SET);
+        i2c_bus_delay();
+    }
+
+    // STOP: SDA rises while SCL is high
+    HAL_GPIO_WritePin(I2C_BUS_GPIO_Port, I2C_BUS_SCL_Pin, GPIO_PIN_RESET);
+    i2c_bus_delay();
+    HAL_GPIO_WritePin(I2C_BUS_GPIO_Port, I2C_BUS_SDA_Pin, GPIO_PIN_RESET);
+    i2c_bus_delay();
+    HAL_GPIO_WritePin(I2C_BUS_GPIO_Port, I2C_BUS_SCL_Pin, GPIO_PIN_SET);
+    i2c_bus_delay();
+    HAL_GPIO_WritePin(I2C_BUS_GPIO_Port, I2C_BUS_SDA_Pin, GPIO_PIN_SET);
+    i2c_bus_delay();
+
+    // MspInit hands the pins back to the peripheral
+    HAL_GPIO_DeInit(I2C_BUS_GPIO_Port, I2C_BUS_SCL_Pin | I2C_BUS_SDA_Pin);
+    MX_I2C1_Init();
+    i2c_bus_stats.recoveries++;
+}
+
+// Pre-scheduler path: plain polling HAL calls
+static i2c_status_t i2c_bus_run_blocking(i2c_xfer_t *x) {
+    uint32_t t;
+    HAL_StatusTypeDef rc;
+
+    if (hi2c1.State == HAL_I2C_STATE_RESET) return I2C_ERR_BUS;   // not initialised yet
+    t = i2c_bus_xfer_ms(x->len);
+
+    switch (x->op) {
+    case I2C_OP_WRITE:
+        rc = HAL_I2C_Master_Transmit(&hi2c1, x->addr, x->buf, x->len, t);
+        break;
+    case I2C_OP_READ:
+        rc = HAL_I2C_Master_Receive(&hi2c1, x->addr, x->buf, x->len, t);
+        break;
+    case I2C_OP_MEM_WRITE:
+        rc = HAL_I2C_Mem_Write(&hi2c1, x->addr, x->reg, I2C_MEMADD_SIZE_8BIT, x->buf, x->len, t);
+        break;
+    case I2C_OP_MEM_READ:
+        rc = HAL_I2C_Mem_Read(&hi2c1, x->addr, x->reg, I2C_MEMADD_SIZE_8BIT, x->buf, x->len, t);
+        break;
+    case I2C_OP_PROBE:
+    default:
+        rc = HAL_I2C_IsDeviceReady(&hi2c1, x->addr, 1, 2);
+        break;
+    }
+    return i2c_bus_hal_status(rc);
+}
+
+static HAL_StatusTypeDef i2c_bus_start(i2c_xfer_t *x) {
+    uint8_t dma = (x->len >= I2C_BUS_DMA_MIN);
+
+    switch (x->op) {
+    case I2C_OP_WRITE:
+        return dma ? HAL_I2C_Master_Transmit_DMA(&hi2c1, x->addr, x->buf, x->len)
+                   : HAL_I2C_Master_Transmit_IT(&hi2c1, x->addr, x->buf, x->len);
+    case I2C_OP_READ:
+        return dma ? HAL_I2C_Master_Receive_DMA(&hi2c1, x->addr, x->buf, x->len)
+                   : HAL_I2C_Master_Receive_IT(&hi2c1, x->addr, x->buf, x->len);
+    case I2C_OP_MEM_WRITE:
+        return dma ? HAL_I2C_Mem_Write_DMA(&hi2c1, x->addr, x->reg, I2C_MEMADD_SIZE_8BIT, x->buf, x->len)
+                   : HAL_I2C_Mem_Write_IT(&hi2c1, x->addr, x->reg, I2C_MEMADD_SIZE_8BIT, x->buf, x->len);
+    case I2C_OP_MEM_READ:
+        return dma ? HAL_I2C_Mem_Read_DMA(&hi2c1, x->addr, x->reg, I2C_MEMADD_SIZE_8BIT, x->buf, x->len)
+                   : HAL_I2C_Mem_Read_IT(&hi2c1, x->addr, x->reg, I2C_MEMADD_SIZE_8BIT, x->buf, x->len);
+    default:
+        return HAL_ERROR;
+    }
+}
+
+// Service task path: start the transfer and sleep until a HAL callback
+// reports the result or the bus time runs out
+static i2c_status_t i2c_bus_run(i2c_xfer_t *x) {
+    TickType_t start, limit, elapsed;
+    HAL_StatusTypeDef rc;
+
+    if (HAL_I2C_GetState(&hi2c1) != HAL_I2C_STATE_READY) i2c_bus_recover();
+
+    if (x->op == I2C_OP_PROBE) {
+        // Address phase only, not worth an interrupt round trip
+        return i2c_bus_hal_status(HAL_I2C_IsDeviceReady(&hi2c1, x->addr, 1, 2));
+    }
+
+    i2c_bus_result = I2C_PENDING;
+    rc = i2c_bus_start(x);
+    if (rc != HAL_OK) return i2c_bus_hal_status(rc);
+
+    start = xTaskGetTickCount();
+    limit = pdMS_TO_TICKS(i2c_bus_xfer_ms(x->len)) + 1;
+    while (i2c_bus_result == I2C_PENDING) {
+        elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= limit) return I2C_ERR_TIMEOUT;
+        // New requests also wake us; they stay queued until this one is done
+        xTaskNotifyWait(0, I2C_NOTIFY_DONE, NULL, limit - elapsed);
+    }
+    return i2c_bus_result;
+}
+
+static i2c_xfer_t *i2c_bus_next(void) {
+    i2c_xfer_t *x;
+
+    for (int p = I2C_PRIO_COUNT - 1; p >= 0; p--) {
+        if (xQueueReceive(i2c_bus_queue[p], &x, 0) == pdTRUE) return x;
+    }
+    return NULL;
+}
+
+void i2c_bus_task(void *argument) {
+    i2c_xfer_t *x;
+    i2c_status_t status;
+
+    for (;;) {
+        x = i2c_bus_next();
+        if (x == NULL) {
+            xTaskNotifyWait(0, I2C_NOTIFY_REQ, NULL, portMAX_DELAY);
+            continue;
+        }
+
+        if ((xTaskGetTickCount() - x->queued_at) > pdMS_TO_TICKS(x->timeout_ms)) {
+            status = I2C_ERR_TIMEOUT;   // waited too long for the bus, never started
+        } else {
+            status = i2c_bus_run(x);
+            if (status == I2C_ERR_BUS || status == I2C_ERR_TIMEOUT) i2c_bus_recover();
+        }
+        i2c_bus_count(status);
+
+        x->status = status;
+        xSemaphoreGive(x->done);   // x may go out of scope from here on
+    }
+}
+
+i2c_status_t i2c_bus_submit(i2c_xfer_t *x) {
+    x->queued = 0;
+    if (x->prio >= I2C_PRIO_COUNT) x->prio = I2C_PRIO_LOW;
+
+    if (i2c_bus_task_handle == NULL || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        x->status = i2c_bus_run_blocking(x);
+        i2c_bus_count(x->status);
+        return x->status;
+    }
+
+    x->status = I2C_PENDING;
+    x->done = xSemaphoreCreateBinaryStatic(&x->done_buf);
+    x->queued_at = xTaskGetTickCount();
+    if (xQueueSend(i2c_bus_queue[x->prio], &x, pdMS_TO_TICKS(x->timeout_ms)) != pdTRUE) {
+        x->status = I2C_ERR_FULL;
+        return x->status;
+    }
+    x->queued = 1;
+    xTaskNotify(i2c_bus_task_handle, I2C_NOTIFY_REQ, eSetBits);
+    return I2C_PENDING;
+}
+
+i2c_status_t i2c_bus_wait(i2c_xfer_t *x) {
+    if (x->queued) {
+        // The service completes every request, timeouts included, so an
+        // unbounded wait is safe and keeps *x alive until it is released
+        xSemaphoreTake(x->done, portMAX_DELAY);
+        x->queued = 0;
+    }
+    return x->status;
+}
+
+static i2c_status_t i2c_bus_do(i2c_op_t op, uint16_t addr, uint8_t reg,
+                               uint8_t *buf, uint16_t len, i2c_prio_t prio) {
+    i2c_xfer_t x = {
+        .op = op, .prio = prio, .addr = addr, .reg = reg,
+        .buf = buf, .len = len, .timeout_ms = I2C_BUS_TIMEOUT_MS,
+    };
+
+    i2c_bus_submit(&x);
+    return i2c_bus_wait(&x);
+}
+
+i2c_status_t i2c_bus_write(uint16_t addr, const uint8_t *buf, uint16_t len, i2c_prio_t prio) {
+    return i2c_bus_do(I2C_OP_WRITE, addr, 0, (uint8_t *)buf, len, prio);
+}
+
+i2c_status_t i2c_bus_read(uint16_t addr, uint8_t *buf, uint16_t len, i2c_prio_t prio) {
+    return i2c_bus_do(I2C_OP_READ, addr, 0, buf, len, prio);
+}
+
+i2c_status_t i2c_bus_mem_write(uint16_t addr, uint8_t reg, const uint8_t *buf, uint16_t len, i2c_prio_t prio) {
+    return i2c_bus_do(I2C_OP_MEM_WRITE, addr, reg, (uint8_t *)buf, len, prio);
+}
+
+i2c_status_t i2c_bus_mem_read(uint16_t addr, uint8_t reg, uint8_t *buf, uint16_t len, i2c_prio_t prio) {
+    return i2c_bus_do(I2C_OP_MEM_READ, addr, reg, buf, len, prio);
+}
+
+i2c_status_t i2c_bus_probe(uint16_t addr) {
+    return i2c_bus_do(I2C_OP_PROBE, addr, 0, NULL, 0, I2C_PRIO_NORMAL);
+}
+
+void i2c_bus_get_stats(i2c_bus_stats_t *out) {
+    *out = i2c_bus_stats;
+}
+
+static void i2c_bus_complete_from_isr(i2c_status_t status) {
+    BaseType_t woken = pdFALSE;
+
+    i2c_bus_result = status;
+    if (i2c_bus_task_handle != NULL) {
+        xTaskNotifyFromISR(i2c_bus_task_handle, I2C_NOTIFY_DONE, eSetBits, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c == &hi2c1) i2c_bus_complete_from_isr(I2C_OK);
+}
+
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c == &hi2c1) i2c_bus_complete_from_isr(I2C_OK);
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c == &hi2c1) i2c_bus_complete_from_isr(I2C_OK);
+}
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c == &hi2c1) i2c_bus_complete_from_isr(I2C_OK);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c != &hi2c1) return;
+    i2c_bus_complete_from_isr((hi2c->ErrorCode & HAL_I2C_ERROR_AF) ? I2C_ERR_NACK : I2C_ERR_BUS);
+}
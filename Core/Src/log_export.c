@@ -0,0 +1,209 @@
+#include "log_export.h"
+#include "log_flash.h"
+#include "cli_uart.h"
+#include "telemetry.h"
+#include "cli.h"
+#include <string.h>
+#include <stdlib.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "rtos_objects.h"
+
+static log_export_req_t req;
+static volatile log_export_state_t state = LOG_EXPORT_IDLE;
+static uint32_t cursor;
+static uint32_t sent, filtered, lost;
+static TickType_t started, finished;
+static volatile uint8_t task_busy;      // between wake-up and noticing a pause
+
+// Burst buffer and the binary frame being filled
+static log_entry_t burst[LOG_EXPORT_BURST];
+static uint8_t burst_valid[LOG_EXPORT_BURST];
+static struct __attribute__((packed)) {
+    tlm_log_data_t hdr;
+    log_entry_t rec[TLM_LOG_PER_FRAME];
+} frame;
+
+static void frame_flush(void) {
+    if (frame.hdr.count == 0) return;
+    telemetry_send(TLM_LOG_DATA, req.seq, &frame,
+                   sizeof(frame.hdr) + frame.hdr.count * sizeof(log_entry_t));
+    frame.hdr.count = 0;
+}
+
+// Frames carry runs of consecutive ids; a filtered-out record ends the run
+static void frame_add(uint32_t id, const log_entry_t *e, uint8_t valid) {
+    if (frame.hdr.count != 0 &&
+        (frame.hdr.id + frame.hdr.count != id || frame.hdr.count == TLM_LOG_PER_FRAME)) {
+        frame_flush();
+    }
+    if (frame.hdr.count == 0) {
+        frame.hdr.id = id;
+        frame.hdr.valid = 0;
+    }
+    if (valid) frame.hdr.valid |= 1 << frame.hdr.count;
+    frame.rec[frame.hdr.count++] = *e;
+}
+
+static void emit(uint32_t id, const log_entry_t *e, uint8_t valid) {
+    if (req.binary) {
+        frame_add(id, e, valid);
+    } else if (!valid) {
+        cli_printf("#%03lu  <corrupt>\r\n", id);
+    } else {
+        cli_printf("#%03lu  Time: %lu ms  M1: %u  M2: %u  ADS: %d %d %d %d\r\n",
+                   id, e->timestamp_ms, e->m1, e->m2,
+                   e->ads[0], e->ads[1], e->ads[2], e->ads[3]);
+    }
+}
+
+static void finish(void) {
+    finished = xTaskGetTickCount();
+    if (req.binary) {
+        tlm_log_end_t end = { cursor };
+        frame_flush();
+        telemetry_send(TLM_LOG_END, req.seq, &end, sizeof(end));
+    } else {
+        cli_printf("Export done: %lu records, %lu filtered, %lu lost, next id %lu\r\n",
+                   sent, filtered, lost, cursor);
+    }
+    state = LOG_EXPORT_DONE;
+}
+
+void log_export_task(void *argument) {
+    for (;;) {
+        TickType_t run_start;
+        uint32_t run_count = 0;
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        task_busy = 1;
+        run_start = xTaskGetTickCount();
+
+        while (state == LOG_EXPORT_RUNNING) {
+            uint32_t first = log_flash_first_id();
+            uint32_t end = first + flash_log_index;
+            uint32_t want;
+            uint16_t n;
+
+            if (cursor < first) {
+                lost += first - cursor;
+                cursor = first;
+            }
+            if (req.end_id != LOG_EXPORT_ALL && req.end_id < end) end = req.end_id;
+            if (cursor >= end) {
+                finish();
+                break;
+            }
+
+            want = end - cursor;
+            n = flash_read_log_range(cursor, burst, burst_valid,
+                                     want > LOG_EXPORT_BURST ? LOG_EXPORT_BURST : (uint16_t)want);
+            if (n == 0) {
+                vTaskDelay(1);      // reclaimed under us; resync on the next pass
+                continue;
+            }
+
+            for (uint16_t i = 0; i < n; i++) {
+                if (burst_valid[i] &&
+                    (burst[i].timestamp_ms < req.t_min || burst[i].timestamp_ms > req.t_max)) {
+                    filtered++;
+                    continue;
+                }
+                emit(cursor + i, &burst[i], burst_valid[i]);
+                sent++;
+                run_count++;
+            }
+            cursor += n;
+
+            if (req.rate != 0) {
+                TickType_t due = run_start + pdMS_TO_TICKS(run_count * 1000UL / req.rate);
+                TickType_t now = xTaskGetTickCount();
+                if ((int32_t)(due - now) > 0) vTaskDelay(due - now);
+            }
+        }
+
+        if (req.binary && state == LOG_EXPORT_PAUSED) frame_flush();
+        task_busy = 0;
+    }
+}
+
+static void cmd_export(int argc, char **argv) {
+    static const char *const states[] = { "idle", "running", "paused", "done" };
+    log_export_req_t req = { 0, LOG_EXPORT_ALL, 0, UINT32_MAX, 0, 0, 0 };
+    log_export_status_t st;
+
+    if (argc >= 2 && strcmp(argv[1], "stop") == 0) {
+        log_export_pause();
+    } else if (argc >= 2 && strcmp(argv[1], "resume") == 0) {
+        if (!log_export_resume()) cli_puts("Nothing to resume\r\n");
+        return;
+    } else if (argc >= 2) {
+        req.first_id = log_flash_first_id();
+        for (int i = 1; i + 1 < argc; i += 2) {
+            uint32_t v = strtoul(argv[i + 1], NULL, 0);
+            if (strcmp(argv[i], "from") == 0) req.first_id = v;
+            else if (strcmp(argv[i], "to") == 0) req.end_id = v + 1;
+            else if (strcmp(argv[i], "since") == 0) req.t_min = v;
+            else if (strcmp(argv[i], "until") == 0) req.t_max = v;
+            else if (strcmp(argv[i], "rate") == 0) req.rate = (uint16_t)v;
+            else {
+                cli_puts("Usage: export [from ID] [to ID] [since MS] [until MS] [rate R] | stop | resume\r\n");
+                return;
+            }
+        }
+        if (!log_export_start(&req)) cli_puts("Export already running (export stop)\r\n");
+        return;
+    }
+
+    log_export_get_status(&st);
+    cli_printf("Export %s: next id %lu, sent %lu, filtered %lu, lost %lu, %lu ms\r\n",
+               states[st.state], st.cursor, st.sent, st.filtered, st.lost, st.elapsed_ms);
+    cli_printf("Log ids %lu..%lu\r\n", log_flash_first_id(), log_flash_first_id() + flash_log_index);
+}
+
+static const cli_command_t export_commands[] = {
+    { "export", "export [from ID] [to ID] [since MS] [until MS] [rate R] | stop | resume", cmd_export },
+};
+
+void log_export_init(void) {
+    CLI_RegisterCommands(export_commands, sizeof(export_commands) / sizeof(export_commands[0]));
+}
+
+int log_export_start(const log_export_req_t *r) {
+    if (state == LOG_EXPORT_RUNNING || task_busy || log_export_task_handle == NULL) return 0;
+
+    req = *r;
+    cursor = req.first_id;
+    sent = filtered = lost = 0;
+    frame.hdr.count = 0;
+    started = xTaskGetTickCount();
+    state = LOG_EXPORT_RUNNING;
+    xTaskNotifyGive(log_export_task_handle);
+    return 1;
+}
+
+void log_export_pause(void) {
+    if (state == LOG_EXPORT_RUNNING) {
+        state = LOG_EXPORT_PAUSED;
+        finished = xTaskGetTickCount();
+    }
+}
+
+int log_export_resume(void) {
+    if (state != LOG_EXPORT_PAUSED || task_busy) return 0;
+    started += xTaskGetTickCount() - finished;  // paused time does not count
+    state = LOG_EXPORT_RUNNING;
+    xTaskNotifyGive(log_export_task_handle);
+    return 1;
+}
+
+void log_export_get_status(log_export_status_t *st) {
+    st->state = state;
+    st->cursor = cursor;
+    st->end_id = req.end_id;
+    st->sent = sent;
+    st->filtered = filtered;
+    st->lost = lost;
+    st->elapsed_ms = ((state == LOG_EXPORT_RUNNING ? xTaskGetTickCount() : finished) - started)
+                     * portTICK_PERIOD_MS;
+}
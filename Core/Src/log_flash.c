@@ -1,95 +1,310 @@
-#include "main.h"        // GPIOA, GPIO_PIN_4, and HAL defines
-#include "spi.h"         // hspi1 (your SPI handle)
+#include "main.h"
 #include <string.h>      // for memcpy or memset if used
 #include "log_flash.h"
-#include "gpio.h"
-#include "moisture.h"
+#include "spi_flash.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "rtos_objects.h"
 
-#define FLASH_TOTAL_SIZE  (64 * 1024)  // 64KB flash
-#define FLASH_PAGE_SIZE   256
-#define FLASH_ENTRY_SIZE  sizeof(log_entry_t)
-#define LOG_ENTRY_SIZE sizeof(log_entry_t)
-#define LOG_FLASH_BASE_ADDR 0x0000  // You can change this if needed
-#define FLASH_SECTOR_SIZE  4096  // Typical for GD25D05CT and similar flash
-
-
-static uint32_t log_write_address = 0x0000;
+#define LOG_SLOT_TABLE_OFFSET  sizeof(log_sector_hdr_t)
+#define LOG_SLOT_FREE          0xFF     // commit byte of an unwritten slot
 
 _Static_assert(sizeof(log_entry_t) == 16, "log_entry_t size mismatch!");
+_Static_assert(sizeof(log_sector_hdr_t) == 16, "log_sector_hdr_t size mismatch!");
+_Static_assert(LOG_SLOT_TABLE_OFFSET + LOG_SLOTS_PER_SECTOR <= LOG_PAGE_SIZE, "slot table overflows page 0");
+_Static_assert((LOG_SLOTS_PER_SECTOR + 16) * sizeof(log_entry_t) <= LOG_SECTOR_SIZE, "records overflow sector");
+
 uint32_t flash_log_index = 0;
 
-static void flash_select(void) {
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_RESET);
+static uint8_t head_sector;
+static uint8_t tail_sector;
+static uint8_t sectors_used;     // valid sectors from tail to head, 0 = empty log
+static uint16_t head_used;
+static uint32_t head_seq;
+static uint32_t head_erase_count;
+
+// Records for slots head_used.. of the head sector, never past a page end
+static log_entry_t stage[LOG_RECORDS_PER_PAGE];
+static uint8_t stage_count;
+static TickType_t stage_since;
+
+// CRC-8, polynomial 0x07
+static uint8_t log_crc8(const uint8_t *data, uint16_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Commit byte for a record; 0xFF is reserved for "slot free"
+static uint8_t log_commit_byte(const log_entry_t *entry) {
+    uint8_t crc = log_crc8((const uint8_t *)entry, sizeof(*entry));
+    return (crc == LOG_SLOT_FREE) ? 0xFE : crc;
 }
 
-static void flash_deselect(void) {
-    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, GPIO_PIN_SET);
+static uint32_t sector_addr(uint8_t sector) {
+    return LOG_FLASH_BASE + (uint32_t)sector * LOG_SECTOR_SIZE;
+}
+
+static uint32_t slot_addr(uint8_t sector, uint16_t slot) {
+    return sector_addr(sector) + LOG_PAGE_SIZE + (uint32_t)slot * sizeof(log_entry_t);
+}
+
+static int read_header(uint8_t sector, log_sector_hdr_t *hdr) {
+    spi_flash_read(sector_addr(sector), (uint8_t *)hdr, sizeof(*hdr));
+    return hdr->magic == LOG_HDR_MAGIC &&
+           hdr->crc == log_crc8((const uint8_t *)hdr, sizeof(*hdr) - 1);
+}
+
+static void update_count(void) {
+    flash_log_index = sectors_used ?
+        (uint32_t)(sectors_used - 1) * LOG_SLOTS_PER_SECTOR + head_used + stage_count : 0;
+}
+
+// Erase the sector after the head and make it the new head, reclaiming the
+// oldest sector when the ring is full. Returns 0 if the flash failed.
+static int open_next_sector(void) {
+    log_sector_hdr_t hdr;
+    uint8_t next = sectors_used ? (head_sector + 1) % LOG_FLASH_SECTORS : head_sector;
+    uint32_t erase_count = read_header(next, &hdr) ? hdr.erase_count + 1 : 1;
+
+    if (sectors_used == LOG_FLASH_SECTORS) {
+        tail_sector = (tail_sector + 1) % LOG_FLASH_SECTORS;
+        sectors_used--;
+    }
+
+    if (!spi_flash_erase_sector(sector_addr(next))) return 0;
+
+    memset(&hdr, 0xFF, sizeof(hdr));
+    hdr.magic = LOG_HDR_MAGIC;
+    hdr.seq = head_seq + 1;
+    hdr.erase_count = erase_count;
+    hdr.crc = log_crc8((const uint8_t *)&hdr, sizeof(hdr) - 1);
+    if (!spi_flash_program(sector_addr(next), (const uint8_t *)&hdr, sizeof(hdr))) return 0;
+
+    if (sectors_used == 0) tail_sector = next;
+    head_sector = next;
+    head_seq = hdr.seq;
+    head_erase_count = erase_count;
+    head_used = 0;
+    sectors_used++;
+    return 1;
+}
+
+void log_flash_init(void) {
+    log_sector_hdr_t hdr;
+    uint32_t seq[LOG_FLASH_SECTORS];
+    uint8_t valid[LOG_FLASH_SECTORS];
+    uint8_t table[LOG_SLOTS_PER_SECTOR];
+    uint8_t found = 0;
+
+    // The head is the valid sector with the highest sequence number
+    for (uint8_t s = 0; s < LOG_FLASH_SECTORS; s++) {
+        valid[s] = read_header(s, &hdr);
+        seq[s] = hdr.seq;
+        if (valid[s] && (!found || (int32_t)(hdr.seq - head_seq) > 0)) {
+            head_sector = s;
+            head_seq = hdr.seq;
+            head_erase_count = hdr.erase_count;
+            found = 1;
+        }
+    }
+
+    sectors_used = 0;
+    head_used = 0;
+    stage_count = 0;
+    if (!found) {
+        head_sector = 0;
+        head_seq = 0;
+        update_count();
+        return;
+    }
+
+    // Walk backwards while the sequence numbers stay contiguous; anything
+    // else is stale and will be erased when the head reaches it
+    tail_sector = head_sector;
+    sectors_used = 1;
+    while (sectors_used < LOG_FLASH_SECTORS) {
+        uint8_t prev = (tail_sector + LOG_FLASH_SECTORS - 1) % LOG_FLASH_SECTORS;
+        if (!valid[prev] || seq[prev] != head_seq - sectors_used) break;
+        tail_sector = prev;
+        sectors_used++;
+    }
+
+    // Slots are allocated in order, so the first free commit byte is the end
+    spi_flash_read(sector_addr(head_sector) + LOG_SLOT_TABLE_OFFSET, table, sizeof(table));
+    while (head_used < LOG_SLOTS_PER_SECTOR && table[head_used] != LOG_SLOT_FREE) {
+        head_used++;
+    }
+    update_count();
 }
 
-static void flash_write_enable(void) {
-    uint8_t cmd = 0x06;
-    flash_select();
-    HAL_SPI_Transmit(&hspi1, &cmd, 1, HAL_MAX_DELAY);
-    flash_deselect();
+void log_flash_get_info(log_flash_info_t *info) {
+    info->head_sector = head_sector;
+    info->tail_sector = tail_sector;
+    info->sectors_used = sectors_used;
+    info->head_used = head_used;
+    info->staged = stage_count;
+    info->head_seq = head_seq;
+    info->head_erase_count = head_erase_count;
 }
 
-static void flash_sector_erase(uint32_t addr) {
-    uint8_t cmd[4] = {
-        0x20,                      // Sector erase command
-        (addr >> 16) & 0xFF,
-        (addr >> 8)  & 0xFF,
-        (addr >> 0)  & 0xFF
-    };
-    flash_write_enable();
-    flash_select();
-    HAL_SPI_Transmit(&hspi1, cmd, 4, HAL_MAX_DELAY);
-    flash_deselect();
-    HAL_Delay(50);  // wait for erase to complete
+// Program the staged records: all their commit bytes in one operation,
+// then the records themselves as one (partial) page
+static void stage_commit(void) {
+    uint8_t commit[LOG_RECORDS_PER_PAGE];
+
+    if (stage_count == 0) return;
+    for (uint8_t i = 0; i < stage_count; i++) {
+        commit[i] = log_commit_byte(&stage[i]);
+    }
+
+    // Commit bytes first: a power cut now leaves slots that fail their CRC
+    // instead of ones that look free and get programmed twice
+    spi_flash_program(sector_addr(head_sector) + LOG_SLOT_TABLE_OFFSET + head_used, commit, stage_count);
+    spi_flash_program(slot_addr(head_sector, head_used), (const uint8_t *)stage, stage_count * sizeof(log_entry_t));
+    head_used += stage_count;
+    stage_count = 0;
 }
 
+static void stage_append(const log_entry_t *entry) {
+    if (stage_count == 0) {
+        if ((sectors_used == 0 || head_used == LOG_SLOTS_PER_SECTOR) && !open_next_sector()) {
+            return;
+        }
+        stage_since = xTaskGetTickCount();
+    }
+    stage[stage_count++] = *entry;
+    update_count();
+
+    if ((head_used + stage_count) % LOG_RECORDS_PER_PAGE == 0 ||
+        (xTaskGetTickCount() - stage_since) >= pdMS_TO_TICKS(LOG_STAGE_MAX_AGE_MS)) {
+        stage_commit();
+    }
+}
 
 void flash_write_log_entry(const log_entry_t *entry) {
-    uint32_t addr = flash_log_index * LOG_ENTRY_SIZE;
-    if (addr + LOG_ENTRY_SIZE > FLASH_TOTAL_SIZE) return;
+    xSemaphoreTake(log_flash_mutex, portMAX_DELAY);
+    stage_append(entry);
+    xSemaphoreGive(log_flash_mutex);
+}
+
+void log_flash_claim(void) {
+    xSemaphoreTake(log_flash_mutex, portMAX_DELAY);
+}
 
-    // 🔧 New: Erase if at beginning of sector
-    if ((addr % FLASH_SECTOR_SIZE) == 0) {
-        flash_sector_erase(addr);
+void log_flash_release(void) {
+    uint8_t kept = stage_count;
+
+    // The rescan empties the stage but leaves stage[] alone. Appending the
+    // kept records in place is safe: the write index never passes the read
+    // index.
+    log_flash_init();
+    for (uint8_t i = 0; i < kept; i++) {
+        stage_append(&stage[i]);
     }
+    stage_commit();
+    xSemaphoreGive(log_flash_mutex);
+}
 
-    flash_write_enable();
+void log_flash_flush(void) {
+    xSemaphoreTake(log_flash_mutex, portMAX_DELAY);
+    stage_commit();
+    xSemaphoreGive(log_flash_mutex);
+}
 
-    uint8_t cmd[4] = {
-        0x02,                      // Page program
-        (addr >> 16) & 0xFF,
-        (addr >> 8)  & 0xFF,
-        (addr >> 0)  & 0xFF
-    };
+TickType_t log_flash_service(void) {
+    TickType_t age, wait = portMAX_DELAY;
 
-    flash_select();
-    HAL_SPI_Transmit(&hspi1, cmd, 4, HAL_MAX_DELAY);
-    HAL_SPI_Transmit(&hspi1, (uint8_t*)entry, LOG_ENTRY_SIZE, HAL_MAX_DELAY);
-    flash_deselect();
+    xSemaphoreTake(log_flash_mutex, portMAX_DELAY);
+    if (stage_count != 0) {
+        age = xTaskGetTickCount() - stage_since;
+        if (age >= pdMS_TO_TICKS(LOG_STAGE_MAX_AGE_MS)) {
+            stage_commit();
+        } else {
+            wait = pdMS_TO_TICKS(LOG_STAGE_MAX_AGE_MS) - age;
+        }
+    }
+    xSemaphoreGive(log_flash_mutex);
+    return wait;
+}
+
+uint32_t log_flash_first_id(void) {
+    // Sector sequence numbers are contiguous from tail to head
+    if (sectors_used == 0) return head_seq * LOG_SLOTS_PER_SECTOR;
+    return (head_seq - sectors_used + 1) * LOG_SLOTS_PER_SECTOR;
+}
+
+uint16_t flash_read_log_range(uint32_t id, log_entry_t *entries, uint8_t *valid, uint16_t max) {
+    uint8_t commit[LOG_SLOTS_PER_SECTOR];
+    uint32_t first, index, flashed;
+    uint16_t n, slot;
+    uint8_t sector;
+
+    xSemaphoreTake(log_flash_mutex, portMAX_DELAY);
+    first = log_flash_first_id();
+    if (id < first || id - first >= flash_log_index || max == 0) {
+        xSemaphoreGive(log_flash_mutex);
+        return 0;
+    }
+    index = id - first;
+    flashed = flash_log_index - stage_count;
 
-    HAL_Delay(5);  // Ensure flash write completes
+    if (index >= flashed) {
+        // Staged records come straight from RAM
+        n = (uint16_t)(flash_log_index - index);
+        if (n > max) n = max;
+        memcpy(entries, &stage[index - flashed], n * sizeof(log_entry_t));
+        memset(valid, 1, n);
+        xSemaphoreGive(log_flash_mutex);
+        return n;
+    }
+
+    // One read for the commit bytes and one for the records, up to the end
+    // of the sector or of what is on flash
+    sector = (tail_sector + index / LOG_SLOTS_PER_SECTOR) % LOG_FLASH_SECTORS;
+    slot = index % LOG_SLOTS_PER_SECTOR;
+    n = LOG_SLOTS_PER_SECTOR - slot;
+    if (n > flashed - index) n = (uint16_t)(flashed - index);
+    if (n > max) n = max;
 
-    flash_log_index++;
+    spi_flash_read(sector_addr(sector) + LOG_SLOT_TABLE_OFFSET + slot, commit, n);
+    spi_flash_read(slot_addr(sector, slot), (uint8_t *)entries, n * sizeof(log_entry_t));
+    xSemaphoreGive(log_flash_mutex);
+
+    for (uint16_t i = 0; i < n; i++) {
+        valid[i] = (commit[i] == log_commit_byte(&entries[i]));
+    }
+    return n;
 }
 
+int flash_read_log_entry(uint32_t index, log_entry_t *entry) {
+    uint8_t sector, commit;
+    uint16_t slot;
 
-void flash_read_log_entry(uint32_t index, log_entry_t *entry) {
-    uint32_t addr = index * LOG_ENTRY_SIZE;
-    if (addr + LOG_ENTRY_SIZE > FLASH_TOTAL_SIZE) return;
+    xSemaphoreTake(log_flash_mutex, portMAX_DELAY);
+    if (index >= flash_log_index) {
+        xSemaphoreGive(log_flash_mutex);
+        memset(entry, 0xFF, sizeof(*entry));
+        return 0;
+    }
+
+    if (index >= flash_log_index - stage_count) {
+        *entry = stage[index - (flash_log_index - stage_count)];
+        xSemaphoreGive(log_flash_mutex);
+        return 1;
+    }
 
-    uint8_t cmd[4] = {
-        0x03,                      // Read data
-        (addr >> 16) & 0xFF,
-        (addr >> 8)  & 0xFF,
-        (addr >> 0)  & 0xFF
-    };
+    sector = (tail_sector + index / LOG_SLOTS_PER_SECTOR) % LOG_FLASH_SECTORS;
+    slot = index % LOG_SLOTS_PER_SECTOR;
+    spi_flash_read(sector_addr(sector) + LOG_SLOT_TABLE_OFFSET + slot, &commit, 1);
+    spi_flash_read(slot_addr(sector, slot), (uint8_t *)entry, sizeof(*entry));
+    xSemaphoreGive(log_flash_mutex);
 
-    flash_select();
-    HAL_SPI_Transmit(&hspi1, cmd, 4, HAL_MAX_DELAY);
-    HAL_SPI_Receive(&hspi1, (uint8_t*)entry, LOG_ENTRY_SIZE, HAL_MAX_DELAY);
-    flash_deselect();
+    return commit == log_commit_byte(entry);
 }
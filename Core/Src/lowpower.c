@@ -0,0 +1,357 @@
+#include "lowpower.h"
+#include "main.h"
+#include "usart.h"
+#include "i2c.h"
+#include "spi.h"
+#include "cli.h"
+#include "cli_uart.h"
+#include "sysmon.h"
+#include "task.h"
+#include <string.h>
+
+#define LP_EXTI_RX          ((uint32_t)LOWPOWER_WAKE_RX_Pin)   // EXTI line = pin number
+#define LP_EXTI_LPTIM       (1UL << 23)     // LPTIM1 wake-up event
+#define LP_LPTIM_MAX        0xFFF0U         // longest sleep in LSI counts, below the wrap
+#define LP_LPTIM_MIN        8U              // shorter sleeps keep SysTick running
+#define LP_LSI_MIN_HZ       17000U          // LSI range from the datasheet; a
+#define LP_LSI_MAX_HZ       47000U          // calibration outside it is discarded
+#define LP_SYSTICK_MIN      64U             // shortest first period after a sleep, core cycles
+
+static const char *const hold_names[] = { "adc", "telemetry", "user" };
+
+static lowpower_stats_t stats;
+static volatile uint32_t holds;
+static volatile TickType_t console_until;
+static volatile uint8_t console_recent;
+static volatile uint32_t lsi_hz = LSI_VALUE;
+static uint32_t carry;                  // core cycles slept past the last accounted tick
+static uint8_t cmp_written;
+
+// CNT runs from the LSI, asynchronous to the bus: read until two reads agree
+static uint32_t lptim_count(void) {
+    uint32_t a, b = LPTIM1->CNT;
+
+    do {
+        a = b;
+        b = LPTIM1->CNT;
+    } while (a != b);
+    return a;
+}
+
+void lowpower_hold(uint32_t reasons) {
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    holds |= reasons;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+void lowpower_release(uint32_t reasons) {
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    holds &= ~reasons;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+void lowpower_console_activity(void) {
+    console_until = xTaskGetTickCountFromISR() + pdMS_TO_TICKS(LOWPOWER_CONSOLE_HOLD_MS);
+    console_recent = 1;
+}
+
+void lowpower_get_stats(lowpower_stats_t *out) {
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    *out = stats;
+    out->lsi_hz = lsi_hz;
+    out->holds = holds;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+// Waits for the next LSI edge; *cycles is the cycle counter just after it
+static uint32_t lsi_edge(uint32_t *cycles) {
+    uint32_t c0 = lptim_count(), c;
+
+    while ((c = lptim_count()) == c0) {
+    }
+    *cycles = DWT->CYCCNT;
+    return c;
+}
+
+uint32_t lowpower_calibrate(void) {
+    uint32_t c0, c1, t0, t1, n, hz;
+    UBaseType_t mask;
+
+    // Both ends are taken on an LSI edge with interrupts masked, so a
+    // preemption in between only lengthens the measurement
+    mask = taskENTER_CRITICAL_FROM_ISR();
+    c0 = lsi_edge(&t0);
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+
+    while (((lptim_count() - c0) & 0xFFFFU) < LOWPOWER_CAL_COUNTS - 2U) {
+    }
+
+    mask = taskENTER_CRITICAL_FROM_ISR();
+    do {
+        c1 = lsi_edge(&t1);
+        n = (c1 - c0) & 0xFFFFU;
+    } while (n < LOWPOWER_CAL_COUNTS);
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+
+    hz = (uint32_t)(((uint64_t)SystemCoreClock * n + (t1 - t0) / 2U) / (t1 - t0));
+    if (hz >= LP_LSI_MIN_HZ && hz <= LP_LSI_MAX_HZ) lsi_hz = hz;
+    return lsi_hz;
+}
+
+// STOP gates every clock but the LSI: only when nothing is in flight and
+// nobody asked to keep them
+static int stop_allowed(TickType_t expected_idle) {
+    if (expected_idle < LOWPOWER_STOP_MIN_TICKS || holds != 0) return 0;
+    if (console_recent) {
+        if ((int32_t)(xTaskGetTickCount() - console_until) < 0) return 0;
+        console_recent = 0;
+    }
+    return huart6.gState == HAL_UART_STATE_READY && hi2c1.State == HAL_I2C_STATE_READY &&
+           hspi1.State == HAL_SPI_STATE_READY && hspi2.State == HAL_SPI_STATE_READY;
+}
+
+// The core wakes from STOP on the HSI with the PLL and HSE off; bring back
+// whatever clocked it before. Peripheral registers survive STOP, only their
+// clocks need restoring.
+static void restore_clocks(RCC_OscInitTypeDef *osc, RCC_ClkInitTypeDef *clk, uint32_t latency) {
+    if (clk->SYSCLKSource == RCC_SYSCLKSOURCE_HSI) return;
+    if (HAL_RCC_OscConfig(osc) != HAL_OK || HAL_RCC_ClockConfig(clk, latency) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
+void lowpower_suppress_ticks_and_sleep(TickType_t expected_idle) {
+    RCC_OscInitTypeDef osc = {0};
+    RCC_ClkInitTypeDef clk = {0};
+    uint32_t latency = 0;
+    uint32_t lsi = lsi_hz, hz = SystemCoreClock;
+    uint32_t load, ctrl, period, into, counts, start, end, elapsed, first, ticks;
+    uint32_t cyc_off, cyc_start, cyc_end, lp_cycles, awake;
+    int64_t target;
+    uint64_t total;
+    TickType_t max_ticks;
+    int stop, early;
+
+    period = SysTick->LOAD + 1U;
+    max_ticks = (TickType_t)((uint64_t)LP_LPTIM_MAX * hz / lsi / period);
+    if (expected_idle > max_ticks) expected_idle = max_ticks;
+
+    __disable_irq();
+    __DSB();
+    __ISB();
+
+    // A task was readied since the idle task decided to sleep
+    if (eTaskConfirmSleepModeStatus() == eAbortSleep) {
+        stats.aborted++;
+        __enable_irq();
+        return;
+    }
+
+    // Stop the tick and note how far into the current period it was
+    ctrl = SysTick->CTRL;
+    SysTick->CTRL = ctrl & ~SysTick_CTRL_ENABLE_Msk;
+    cyc_off = DWT->CYCCNT;
+    load = SysTick->LOAD;
+    into = load - SysTick->VAL;
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+        // The period ran out before the counter stopped; take that tick first
+        SysTick->CTRL = ctrl;
+        stats.aborted++;
+        __enable_irq();
+        return;
+    }
+
+    stop = stop_allowed(expected_idle);
+    target = (int64_t)expected_idle * period - into - carry;
+    if (stop) target -= (int64_t)LOWPOWER_STOP_WAKE_US * (hz / 1000000U);
+    counts = (target > 0) ? (uint32_t)((uint64_t)target * lsi / hz) : 0;
+    if (counts < LP_LPTIM_MIN) {
+        SysTick->CTRL = ctrl;
+        __enable_irq();
+        return;
+    }
+
+    // Wake-up on compare match. A CMP write has to be acknowledged before
+    // the next one; the previous write was a whole sleep ago.
+    if (cmp_written) {
+        while (!(LPTIM1->ISR & LPTIM_ISR_CMPOK)) {
+        }
+    }
+    start = lptim_count();
+    cyc_start = DWT->CYCCNT;
+    LPTIM1->ICR = LPTIM_ICR_CMPOKCF | LPTIM_ICR_CMPMCF;
+    LPTIM1->CMP = (start + counts) & 0xFFFFU;
+    cmp_written = 1;
+    EXTI->PR = LP_EXTI_LPTIM;
+    EXTI->IMR |= LP_EXTI_LPTIM;
+
+    if (stop) {
+        HAL_RCC_GetOscConfig(&osc);
+        HAL_RCC_GetClockConfig(&clk, &latency);
+        osc.OscillatorType = (osc.HSEState != RCC_HSE_OFF) ? RCC_OSCILLATORTYPE_HSE : RCC_OSCILLATORTYPE_NONE;
+        EXTI->PR = LP_EXTI_RX;
+        EXTI->IMR |= LP_EXTI_RX;
+        HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+        EXTI->IMR &= ~LP_EXTI_RX;
+        restore_clocks(&osc, &clk, latency);
+    } else {
+        HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+    }
+
+    EXTI->IMR &= ~LP_EXTI_LPTIM;
+    end = lptim_count();
+    cyc_end = DWT->CYCCNT;
+    early = !(LPTIM1->ISR & LPTIM_ISR_CMPM);
+    LPTIM1->ICR = LPTIM_ICR_CMPMCF;
+    EXTI->PR = LP_EXTI_LPTIM;
+    HAL_NVIC_ClearPendingIRQ(LPTIM1_IRQn);
+
+    elapsed = (end - start) & 0xFFFFU;
+    lp_cycles = (uint32_t)((uint64_t)elapsed * hz / lsi);
+    if (stop) {
+        stats.stop_count++;
+        stats.stop_us += (uint64_t)elapsed * 1000000U / lsi;
+    } else {
+        stats.sleep_count++;
+        stats.sleep_us += (uint64_t)elapsed * 1000000U / lsi;
+    }
+    if (early) stats.early++;
+
+    // The cycle counter stops with the core clock; give run-time stats the
+    // time it missed
+    if (lp_cycles > cyc_end - cyc_start) sysmon_runtime_skip(lp_cycles - (cyc_end - cyc_start));
+
+    // Time since the tick stopped: the LSI covers the sleep, the cycle
+    // counter the stretches awake on either side of it. An early wake-up
+    // (any other interrupt) is accounted the same way.
+    awake = (cyc_start - cyc_off) + (DWT->CYCCNT - cyc_end);
+    total = (uint64_t)into + awake + lp_cycles + carry;
+    carry = 0;
+
+    // Whole periods go to the kernel. The tick that unblocks the waiting
+    // task must come from SysTick, so a sleep that ran past it steps one
+    // short and keeps the excess for the next sleep.
+    ticks = (uint32_t)(total / period);
+    if (ticks >= expected_idle) {
+        uint64_t over = total - (uint64_t)expected_idle * period;
+        carry = (over < period) ? (uint32_t)over : period - 1U;
+        ticks = expected_idle - 1U;
+        first = LP_SYSTICK_MIN;
+    } else {
+        first = period - (uint32_t)(total - (uint64_t)ticks * period);
+        if (first < LP_SYSTICK_MIN) first = LP_SYSTICK_MIN;
+    }
+    vTaskStepTick(ticks);
+    uwTick += ticks * (uint32_t)uwTickFreq;
+
+    // The rest of the current period, then full periods again. The clock
+    // restore may have restarted SysTick through HAL_InitTick.
+    SysTick->CTRL = ctrl & ~SysTick_CTRL_ENABLE_Msk;
+    SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+    SysTick->LOAD = first - 1U;
+    SysTick->VAL = 0;
+    SysTick->CTRL = ctrl;
+    SysTick->LOAD = load;
+
+    __enable_irq();
+}
+
+void LPTIM1_IRQHandler(void) {
+    LPTIM1->ICR = LPTIM_ICR_CMPMCF | LPTIM_ICR_ARRMCF;
+    EXTI->PR = LP_EXTI_LPTIM;
+}
+
+static void print_mode(const char *name, uint32_t count, uint64_t us, uint32_t uptime_ms) {
+    uint32_t ms = (uint32_t)(us / 1000U);
+    uint32_t permille = uptime_ms ? (uint32_t)((uint64_t)ms * 1000U / uptime_ms) : 0;
+
+    cli_printf("%-6s %8lu entries %8lu.%03lu s  %3lu.%lu%%\r\n", name, count,
+               ms / 1000U, ms % 1000U, permille / 10U, permille % 10U);
+}
+
+static void cmd_power(int argc, char **argv) {
+    lowpower_stats_t s;
+    uint32_t uptime_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+    if (argc >= 2 && strcmp(argv[1], "cal") == 0) {
+        cli_printf("LSI %lu Hz\r\n", lowpower_calibrate());
+        return;
+    }
+    if (argc >= 3 && strcmp(argv[1], "stop") == 0 && strcmp(argv[2], "on") == 0) {
+        lowpower_release(LP_HOLD_USER);
+        cli_puts("STOP mode allowed\r\n");
+        return;
+    }
+    if (argc >= 3 && strcmp(argv[1], "stop") == 0 && strcmp(argv[2], "off") == 0) {
+        lowpower_hold(LP_HOLD_USER);
+        cli_puts("SLEEP mode only\r\n");
+        return;
+    }
+    if (argc >= 2) {
+        cli_puts("Usage: power [stop on|off | cal]\r\n");
+        return;
+    }
+
+    lowpower_get_stats(&s);
+    cli_printf("Uptime %lu s, LSI %lu Hz\r\n", uptime_ms / 1000U, s.lsi_hz);
+    print_mode("STOP", s.stop_count, s.stop_us, uptime_ms);
+    print_mode("SLEEP", s.sleep_count, s.sleep_us, uptime_ms);
+    cli_printf("Aborted %lu, woken early %lu\r\n", s.aborted, s.early);
+    cli_puts("Holding STOP off:");
+    for (uint32_t i = 0; i < sizeof(hold_names) / sizeof(hold_names[0]); i++) {
+        if (s.holds & (1U << i)) cli_printf(" %s", hold_names[i]);
+    }
+    if (console_recent && (int32_t)(xTaskGetTickCount() - console_until) < 0) cli_puts(" console");
+    cli_puts(s.holds == 0 && !console_recent ? " nothing\r\n" : "\r\n");
+}
+
+static const cli_command_t lowpower_commands[] = {
+    { "power", "power [stop on|off | cal] - Sleep statistics and STOP mode control", cmd_power },
+};
+
+void lowpower_init(void) {
+    RCC_OscInitTypeDef osc = {0};
+
+    osc.OscillatorType = RCC_OSCILLATORTYPE_LSI;
+    osc.LSIState = RCC_LSI_ON;
+    osc.PLL.PLLState = RCC_PLL_NONE;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK) {
+        Error_Handler();
+    }
+    __HAL_RCC_LPTIM1_CONFIG(RCC_LPTIM1CLKSOURCE_LSI);
+    __HAL_RCC_LPTIM1_CLK_ENABLE();
+
+    // Free-running 16-bit counter. IER can only be written while the timer
+    // is disabled, ARR and CMP only while it is enabled.
+    LPTIM1->CR = 0;
+    LPTIM1->CFGR = 0;                   // internal clock, no prescaler
+    LPTIM1->IER = LPTIM_IER_CMPMIE;
+    LPTIM1->CR = LPTIM_CR_ENABLE;
+    LPTIM1->ARR = 0xFFFFU;
+    while (!(LPTIM1->ISR & LPTIM_ISR_ARROK)) {
+    }
+    LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+    LPTIM1->CR = LPTIM_CR_ENABLE | LPTIM_CR_CNTSTRT;
+
+    // Wake-up lines, unmasked only around STOP. PA12 keeps its USART6
+    // function; the EXTI sees the start bit through the input stage.
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    SYSCFG->EXTICR[3] &= ~SYSCFG_EXTICR4_EXTI12;
+    EXTI->IMR &= ~(LP_EXTI_LPTIM | LP_EXTI_RX);
+    EXTI->RTSR |= LP_EXTI_LPTIM;
+    EXTI->FTSR |= LP_EXTI_RX;
+    HAL_NVIC_SetPriority(LPTIM1_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(LPTIM1_IRQn);
+    HAL_NVIC_SetPriority(EXTI15_10_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+
+    // Deeper STOP: flash powered down, low-power regulator at low voltage
+    HAL_PWREx_EnableFlashPowerDown();
+    HAL_PWREx_EnableLowRegulatorLowVoltage();
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    lowpower_calibrate();
+
+    CLI_RegisterCommands(lowpower_commands, sizeof(lowpower_commands) / sizeof(lowpower_commands[0]));
+}
@@ -41,6 +41,7 @@
 #include "log_flash.h"
 #include <stdio.h>
 #include "oled.h"
+#include "tim.h"
 
 
 /* USER CODE END Includes */
@@ -71,7 +72,6 @@ extern UART_HandleTypeDef huart6;
 void SystemClock_Config(void);
 void MX_FREERTOS_Init(void);
 /* USER CODE BEGIN PFP */
-void AdcTask(void *argument);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -120,6 +120,7 @@ int main(void)
   MX_SPI2_Init();
   oled_init();
   /* USER CODE BEGIN 2 */
+  MX_TIM1_Init();
   st7032_init(&hi2c1);
   st7032_clear();
   /* USER CODE END 2 */
@@ -193,36 +194,6 @@ void SystemClock_Config(void)
 
 /* USER CODE BEGIN 4 */
 // Your additional helper functions go here
-void AdcTask(void *argument) {
-  uint32_t adc_val_0 = 0;
-  uint32_t adc_val_1 = 0;
-  ADC_ChannelConfTypeDef sConfig = {0};
-  char msg[64];
-
-  for (;;) {
-    // Read from PA0
-    sConfig.Channel = ADC_CHANNEL_0;
-    sConfig.Rank = 1;
-    sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
-    HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-    HAL_ADC_Start(&hadc1);
-    HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-    adc_val_0 = HAL_ADC_GetValue(&hadc1);
-
-    // Read from PA1
-    sConfig.Channel = ADC_CHANNEL_1;
-    HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-    HAL_ADC_Start(&hadc1);
-    HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-    adc_val_1 = HAL_ADC_GetValue(&hadc1);
-
-    snprintf(msg, sizeof(msg), "ADC0: %lu, ADC1: %lu\r\n", adc_val_0, adc_val_1);
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-
-    vTaskDelay(pdMS_TO_TICKS(500));
-  }
-}
-
 
 /* USER CODE END 4 */
 
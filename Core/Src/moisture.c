@@ -3,3 +3,9 @@
 // These are the actual definitions
 moisture_cal_t m1_cal = { .dry = 3000, .wet = 1500 };
 moisture_cal_t m2_cal = { .dry = 3000, .wet = 1500 };
+
+uint8_t moisture_percent(uint16_t raw, const moisture_cal_t *cal) {
+    if (raw >= cal->dry) return 0;
+    if (raw <= cal->wet) return 100;
+    return 100 * (cal->dry - raw) / (cal->dry - cal->wet);
+}
@@ -7,19 +7,29 @@
 #include "u8g2.h"
 #include "u8x8.h"
 #include "i2c.h"
-#include "usart.h"
+#include "i2c_bus.h"
+#include "cli_uart.h"
 #include <stdarg.h>
 #include <string.h>
+#include "sensors.h"
+#include "u8g2_dirty.h"
+#include "perf.h"
+#include "app_sched.h"
 
 u8g2_t u8g2;  // Define the actual instance here
+
+// What the panel currently shows, so each refresh only sends changed tiles
+static uint8_t oled_shadow[128 * 64 / 8];
+static u8g2_dirty_t oled_dirty;
 extern moisture_cal_t m1_cal, m2_cal;
 extern uint8_t u8x8_byte_sw_i2c(u8x8_t *, uint8_t, uint8_t, void *);
 extern uint8_t u8x8_gpio_and_delay_stm32(u8x8_t *, uint8_t, uint8_t, void *);
 
-static uint8_t moisture_pct(uint16_t raw, uint16_t dry, uint16_t wet) {
-    if (raw >= dry) return 0;
-    if (raw <= wet) return 100;
-    return 100 * (dry - raw) / (dry - wet);
+// Text goes through here so glyph decoding shows up in `perf`
+static void oled_draw_str(u8g2_uint_t x, u8g2_uint_t y, const char *s) {
+    uint32_t t0 = perf_begin();
+    u8g2_DrawStr(&u8g2, x, y, s);
+    perf_end(PERF_OLED_TEXT, t0);
 }
 
 void debug_printf(const char *fmt, ...) {
@@ -30,7 +40,8 @@ void debug_printf(const char *fmt, ...) {
     va_end(args);
 
     if (len > 0) {
-        HAL_UART_Transmit(&huart6, (uint8_t *)buffer, len, HAL_MAX_DELAY);
+        if (len >= (int)sizeof(buffer)) len = sizeof(buffer) - 1;
+        cli_write(buffer, len);
     }
 }
 
@@ -39,7 +50,7 @@ void oled_test_basic_i2c(void) {
 
     // Display OFF (0xAE)
     uint8_t cmd_off[] = { 0x00, 0xAE };
-    if (HAL_I2C_Master_Transmit(&hi2c1, 0x3C << 1, cmd_off, sizeof(cmd_off), HAL_MAX_DELAY) == HAL_OK)
+    if (i2c_bus_write(0x3C << 1, cmd_off, sizeof(cmd_off), I2C_PRIO_NORMAL) == I2C_OK)
         debug_printf("Display OFF command acknowledged\n");
     else
         debug_printf("NACK on Display OFF command\n");
@@ -48,7 +59,7 @@ void oled_test_basic_i2c(void) {
 
     // Display ON (0xAF)
     uint8_t cmd_on[] = { 0x00, 0xAF };
-    if (HAL_I2C_Master_Transmit(&hi2c1, 0x3C << 1, cmd_on, sizeof(cmd_on), HAL_MAX_DELAY) == HAL_OK)
+    if (i2c_bus_write(0x3C << 1, cmd_on, sizeof(cmd_on), I2C_PRIO_NORMAL) == I2C_OK)
         debug_printf("Display ON command acknowledged\n");
     else
         debug_printf("NACK on Display ON command\n");
@@ -59,11 +70,11 @@ void oled_test_draw_line(void) {
 
     // Set page to 0
     uint8_t set_page[] = { 0x00, 0xB0 };
-    HAL_I2C_Master_Transmit(&hi2c1, 0x3C << 1, set_page, sizeof(set_page), HAL_MAX_DELAY);
+    i2c_bus_write(0x3C << 1, set_page, sizeof(set_page), I2C_PRIO_NORMAL);
 
     // Set column address to 0
     uint8_t set_col[] = { 0x00, 0x00, 0x10 };
-    HAL_I2C_Master_Transmit(&hi2c1, 0x3C << 1, set_col, sizeof(set_col), HAL_MAX_DELAY);
+    i2c_bus_write(0x3C << 1, set_col, sizeof(set_col), I2C_PRIO_NORMAL);
 
     // Fill data: 0x40 is control byte for display RAM
     uint8_t data[129];
@@ -72,20 +83,26 @@ void oled_test_draw_line(void) {
         data[i] = 0xFF;  // Full white line
     }
 
-    HAL_I2C_Master_Transmit(&hi2c1, 0x3C << 1, data, sizeof(data), HAL_MAX_DELAY);
+    i2c_bus_write(0x3C << 1, data, sizeof(data), I2C_PRIO_NORMAL);
     debug_printf("Test line sent to display\r\n");
 }
 
 
 // ADD THIS FUNCTION TO FIX "undefined reference to `oled_init`"
 void oled_init(void) {
+    uint8_t tile_buf_height;
+    uint8_t *buf;
+    uint32_t t0;
+
     debug_printf("OLED init start\r\n");
-    // Set up SSD1306 128x64 I2C display
-	u8g2_Setup_ssd1306_i2c_128x64_noname_f(
-	    &u8g2,U8G2_R0,
-	    u8x8_byte_hw_i2c_hal_stm32,
-	    u8x8_gpio_and_delay_stm32
-	);
+    // Set up SSD1306 128x64 I2C display. Same as
+    // u8g2_Setup_ssd1306_i2c_128x64_noname_f, but with a CAD that sends
+    // each tile row as a single DMA transfer.
+	u8g2_SetupDisplay(&u8g2, u8x8_d_ssd1306_128x64_noname, u8x8_cad_ssd13xx_i2c_dma,
+	    u8x8_byte_hw_i2c_hal_stm32, u8x8_gpio_and_delay_stm32);
+	buf = u8g2_m_16_8_f(&tile_buf_height);
+	u8g2_SetupBuffer(&u8g2, buf, tile_buf_height, u8g2_ll_hvline_vertical_top_lsb, U8G2_R0);
+	u8g2_DirtyInit(&oled_dirty, oled_shadow, sizeof(oled_shadow));
 	u8x8_SetI2CAddress(&u8g2.u8x8, 0x3C << 1);  // Set OLED to 0x78 (8-bit addr)
 	debug_printf("I2C Address Set to 0x%02X\r\n", u8g2.u8x8.i2c_address);
 
@@ -100,59 +117,61 @@ void oled_init(void) {
     u8g2_SendF(&u8g2, "c", 0xFF);  // Maximum brightness
     debug_printf("Font set\r\n");
     u8g2_ClearBuffer(&u8g2);
-    u8g2_DrawStr(&u8g2, 0, 24, "Hello OLED\r\n");
+    oled_draw_str(0, 24, "Hello OLED\r\n");
+    t0 = perf_begin();
     u8g2_SendBuffer(&u8g2);
+    perf_end(PERF_OLED_SEND, t0);
     debug_printf("Hello OLED drawn\r\n");
 }
 
 void OledDisplayTask(void *argument) {
-    ADC_ChannelConfTypeDef sConfig = {0};
-    uint32_t val_m1 = 0, val_m2 = 0;
+    sensor_snapshot_t snap;
+    i2c_bus_stats_t stats;
+    uint32_t t0, alarms, recoveries = 0;
+    uint8_t lost;
     char line[32];
 
+    // Redrawn for every new sample, and at once when a dry alarm comes or goes
+    sched_subscribe(SCHED_OLED, SCHED_EV_SAMPLE | SCHED_EV_THRESHOLD);
     for (;;) {
-
-        // --- Read M1 ---
-        sConfig.Channel = ADC_CHANNEL_0;
-        sConfig.Rank = 1;
-        sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
-        HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        val_m1 = HAL_ADC_GetValue(&hadc1);
-
-        // --- Read M2 ---
-        sConfig.Channel = ADC_CHANNEL_1;
-        HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-        HAL_ADC_Start(&hadc1);
-        HAL_ADC_PollForConversion(&hadc1, HAL_MAX_DELAY);
-        val_m2 = HAL_ADC_GetValue(&hadc1);
+        sched_wait(SCHED_OLED);
+        sensors_get(&snap);
+        alarms = sched_alarms();
 
         // --- Convert to % ---
-        uint8_t m1_pct = moisture_pct(val_m1, m1_cal.dry, m1_cal.wet);
-        uint8_t m2_pct = moisture_pct(val_m2, m2_cal.dry, m2_cal.wet);
+        uint8_t m1_pct = moisture_percent(snap.adc[SENSOR_M1], &m1_cal);
+        uint8_t m2_pct = moisture_percent(snap.adc[SENSOR_M2], &m2_cal);
 
         // --- Draw UI ---
         u8g2_ClearBuffer(&u8g2);
 
         // M1
         snprintf(line, sizeof(line), "M1: %3d%%", m1_pct);
-        u8g2_DrawStr(&u8g2, 0, 15, line);
+        oled_draw_str(0, 15, line);
         u8g2_DrawFrame(&u8g2, 40, 7, 60, 8);  // Bar
         u8g2_DrawBox(&u8g2, 40, 7, (60 * m1_pct) / 100, 8);  // Fill
         u8g2_DrawVLine(&u8g2, 40, 4, 12);  // left tick = dry
         u8g2_DrawVLine(&u8g2, 99, 4, 12);  // right tick = wet
+        if (alarms & (1U << SENSOR_M1)) oled_draw_str(104, 15, "DRY");
 
         // M2
         snprintf(line, sizeof(line), "M2: %3d%%", m2_pct);
-        u8g2_DrawStr(&u8g2, 0, 35, line);
+        oled_draw_str(0, 35, line);
         u8g2_DrawFrame(&u8g2, 40, 27, 60, 8);
         u8g2_DrawBox(&u8g2, 40, 27, (60 * m2_pct) / 100, 8);
         u8g2_DrawVLine(&u8g2, 40, 4, 12);  // left tick = dry
         u8g2_DrawVLine(&u8g2, 99, 4, 12);  // right tick = wet
-
-        u8g2_SendBuffer(&u8g2);
-
-        osDelay(2000);
+        if (alarms & (1U << SENSOR_M2)) oled_draw_str(104, 35, "DRY");
+
+        // The shadow assumes every tile sent last time arrived. After a
+        // failed transfer or a bus recovery the panel may differ: send it all.
+        lost = oled_i2c_sync();
+        i2c_bus_get_stats(&stats);
+        if (lost || stats.recoveries != recoveries) u8g2_DirtyInvalidate(&oled_dirty);
+        recoveries = stats.recoveries;
+
+        t0 = perf_begin();
+        u8g2_SendDirty(&u8g2, &oled_dirty);
+        perf_end(PERF_OLED_SEND, t0);
     }
 }
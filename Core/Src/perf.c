@@ -0,0 +1,163 @@
+#include "perf.h"
+#include "main.h"
+#include "cli.h"
+#include "cli_uart.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+static const char *const perf_names[PERF_PROBE_COUNT] = {
+    [PERF_ADC_SAMPLE]  = "adc_sample",
+    [PERF_ADS_READ]    = "ads_read",
+    [PERF_FLASH_WRITE] = "flash_write",
+    [PERF_OLED_SEND]   = "oled_send",
+    [PERF_OLED_TEXT]   = "oled_text",
+};
+
+static perf_probe_t probes[PERF_PROBE_COUNT];
+static uint32_t perf_overhead;      // cycles of an empty begin/end pair
+
+const char *perf_name(perf_probe_id_t id) {
+    return id < PERF_PROBE_COUNT ? perf_names[id] : "?";
+}
+
+uint32_t perf_cycles_to_us(uint32_t cycles) {
+    return (uint32_t)(((uint64_t)cycles * 1000000U) / SystemCoreClock);
+}
+
+static uint8_t perf_bin(uint32_t cycles) {
+    uint32_t us = perf_cycles_to_us(cycles);
+    uint8_t bin = 0;
+
+    while (us != 0 && bin < PERF_HIST_BINS - 1) {
+        us >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+static void perf_clear(perf_probe_t *p) {
+    memset(p, 0, sizeof(*p));
+    p->min = UINT32_MAX;
+}
+
+void perf_reset(void) {
+    for (int i = 0; i < PERF_PROBE_COUNT; i++) {
+        UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+        perf_clear(&probes[i]);
+        taskEXIT_CRITICAL_FROM_ISR(mask);
+    }
+}
+
+void perf_get(perf_probe_id_t id, perf_probe_t *out) {
+    UBaseType_t mask;
+
+    if (id >= PERF_PROBE_COUNT) {
+        perf_clear(out);
+        return;
+    }
+    mask = taskENTER_CRITICAL_FROM_ISR();
+    *out = probes[id];
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+#if PERF_ENABLE
+
+void perf_end(perf_probe_id_t id, uint32_t start) {
+    uint32_t cycles = DWT->CYCCNT - start;
+    perf_probe_t *p = &probes[id];
+    uint8_t bin;
+    UBaseType_t mask;
+
+    cycles = cycles > perf_overhead ? cycles - perf_overhead : 0;
+    bin = perf_bin(cycles);
+
+    mask = taskENTER_CRITICAL_FROM_ISR();
+    p->count++;
+    p->total += cycles;
+    if (cycles < p->min) p->min = cycles;
+    if (cycles > p->max) p->max = cycles;
+    p->hist[bin]++;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+#endif
+
+static void perf_print_hist(const perf_probe_t *p) {
+    uint32_t peak = 0;
+    int first = -1, last = -1;
+
+    for (int b = 0; b < PERF_HIST_BINS; b++) {
+        if (p->hist[b] > peak) peak = p->hist[b];
+        if (p->hist[b] != 0) {
+            if (first < 0) first = b;
+            last = b;
+        }
+    }
+    if (first < 0) return;
+    for (int b = first; b <= last; b++) {
+        char bar[33];
+        uint32_t n = (uint32_t)(((uint64_t)p->hist[b] * 32U + peak - 1) / peak);
+
+        memset(bar, '#', n);
+        bar[n] = '\0';
+        if (b == 0) cli_printf("  %7s..%-7lu %8lu %s\r\n", "0", 1UL, p->hist[b], bar);
+        else if (b == PERF_HIST_BINS - 1) cli_printf("  %7lu..%-7s %8lu %s\r\n", 1UL << (b - 1), "", p->hist[b], bar);
+        else cli_printf("  %7lu..%-7lu %8lu %s\r\n", 1UL << (b - 1), 1UL << b, p->hist[b], bar);
+    }
+}
+
+static void cmd_perf(int argc, char **argv) {
+    perf_probe_t p;
+    int hist = 0;
+
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        perf_reset();
+        cli_puts("Probes cleared\r\n");
+        return;
+    }
+    if (argc >= 2 && strcmp(argv[1], "hist") == 0) {
+        hist = 1;
+    } else if (argc >= 2) {
+        cli_puts("Usage: perf [hist | reset]\r\n");
+        return;
+    }
+
+    cli_printf("Probe          count     min us   avg us   max us  (%lu MHz, %lu cyc overhead removed)\r\n",
+               SystemCoreClock / 1000000U, perf_overhead);
+    for (int i = 0; i < PERF_PROBE_COUNT; i++) {
+        perf_get((perf_probe_id_t)i, &p);
+        if (p.count == 0) {
+            cli_printf("%-12s %7lu %8s %8s %8s\r\n", perf_names[i], 0UL, "-", "-", "-");
+            continue;
+        }
+        cli_printf("%-12s %7lu %8lu %8lu %8lu\r\n", perf_names[i], p.count,
+                   perf_cycles_to_us(p.min), perf_cycles_to_us((uint32_t)(p.total / p.count)),
+                   perf_cycles_to_us(p.max));
+        if (hist) perf_print_hist(&p);
+    }
+}
+
+static const cli_command_t perf_commands[] = {
+    { "perf", "perf [hist | reset] - Timing probes (DWT cycle counter)", cmd_perf },
+};
+
+void perf_init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+#if PERF_ENABLE
+    // What a probe around nothing measures, taken off every sample
+    uint32_t best = UINT32_MAX;
+    for (int i = 0; i < 8; i++) {
+        uint32_t t0 = perf_begin();
+        uint32_t dt = DWT->CYCCNT - t0;
+        if (dt < best) best = dt;
+    }
+    perf_overhead = best;
+#endif
+
+    perf_reset();
+    CLI_RegisterCommands(perf_commands, sizeof(perf_commands) / sizeof(perf_commands[0]));
+}
@@ -0,0 +1,159 @@
+#include "rtos_objects.h"
+#include "cmsis_os.h"
+#include "sensors.h"
+#include "oled.h"
+#include "cli.h"
+#include "cli_uart.h"
+#include "log_export.h"
+#include "sysmon.h"
+#include "app_sched.h"
+
+// In freertos.c
+void MoistureDisplayTask(void *argument);
+void MoistureLogTask(void *argument);
+void AlarmTask(void *argument);
+
+typedef enum {
+    RTOS_TASK,
+    RTOS_QUEUE,
+    RTOS_STREAM,
+    RTOS_EVENT_GROUP,
+    RTOS_MUTEX,
+    RTOS_BINARY,
+} rtos_kind_t;
+
+typedef struct {
+    rtos_kind_t kind;
+    const char *name;           // task name, or the name shown by `top`
+    void *handle;               // where the handle goes
+    TaskFunction_t fn;          // tasks only
+    UBaseType_t prio;
+    uint32_t length;            // stack words, queue items or stream bytes
+    uint32_t item_size;         // queues only
+    void *storage;              // stack, queue or stream storage
+    void *cb;                   // StaticTask_t, StaticQueue_t, ...
+} rtos_object_t;
+
+#define TASK(obj, fn, name, prio) \
+    { RTOS_TASK, name, &obj##_handle, fn, (UBaseType_t)(prio), \
+      sizeof(obj##_stack) / sizeof(StackType_t), 0, obj##_stack, &obj##_tcb }
+#define QUEUE(handle, storage, cb, name, len, size) \
+    { RTOS_QUEUE, name, &handle, NULL, 0, len, size, storage, &cb }
+#define STREAM(obj, name, size) \
+    { RTOS_STREAM, name, &obj, NULL, 0, size, 0, obj##_storage, &obj##_cb }
+#define EVENT_GROUP(obj) \
+    { RTOS_EVENT_GROUP, #obj, &obj, NULL, 0, 0, 0, NULL, &obj##_cb }
+#define SEMAPHORE(kind, obj) \
+    { kind, #obj, &obj, NULL, 0, 0, 0, NULL, &obj##_cb }
+
+TaskHandle_t sensors_task_handle;
+TaskHandle_t moisture_display_task_handle;
+TaskHandle_t moisture_log_task_handle;
+TaskHandle_t oled_task_handle;
+TaskHandle_t cli_task_handle;
+TaskHandle_t i2c_bus_task_handle;
+TaskHandle_t log_export_task_handle;
+TaskHandle_t alarm_task_handle;
+
+QueueHandle_t i2c_bus_queue[I2C_PRIO_COUNT];
+StreamBufferHandle_t cli_uart_rx_stream;
+EventGroupHandle_t app_sched_events;
+
+SemaphoreHandle_t cli_uart_tx_space;
+SemaphoreHandle_t spi_flash_mutex;
+SemaphoreHandle_t log_flash_mutex;
+SemaphoreHandle_t ads1115_sem;
+
+// Stack sizes in words. `top` shows what each task has left.
+static StackType_t sensors_task_stack[256];
+static StaticTask_t sensors_task_tcb;
+static StackType_t moisture_display_task_stack[256];
+static StaticTask_t moisture_display_task_tcb;
+static StackType_t moisture_log_task_stack[512];
+static StaticTask_t moisture_log_task_tcb;
+static StackType_t oled_task_stack[256];
+static StaticTask_t oled_task_tcb;
+static StackType_t cli_task_stack[1024];
+static StaticTask_t cli_task_tcb;
+static StackType_t i2c_bus_task_stack[256];
+static StaticTask_t i2c_bus_task_tcb;
+static StackType_t log_export_task_stack[384];
+static StaticTask_t log_export_task_tcb;
+static StackType_t alarm_task_stack[256];
+static StaticTask_t alarm_task_tcb;
+
+static uint8_t i2c_bus_queue_storage[I2C_PRIO_COUNT][I2C_BUS_QUEUE_LEN * sizeof(i2c_xfer_t *)];
+static StaticQueue_t i2c_bus_queue_cb[I2C_PRIO_COUNT];
+static uint8_t cli_uart_rx_stream_storage[CLI_RX_STREAM_SIZE + 1];  // +1: FreeRTOS keeps one byte free
+static StaticStreamBuffer_t cli_uart_rx_stream_cb;
+static StaticEventGroup_t app_sched_events_cb;
+
+static StaticSemaphore_t cli_uart_tx_space_cb;
+static StaticSemaphore_t spi_flash_mutex_cb;
+static StaticSemaphore_t log_flash_mutex_cb;
+static StaticSemaphore_t ads1115_sem_cb;
+
+// Queues and semaphores come first so no task can run into a missing one
+static const rtos_object_t rtos_objects[] = {
+    QUEUE(i2c_bus_queue[I2C_PRIO_LOW], i2c_bus_queue_storage[I2C_PRIO_LOW],
+          i2c_bus_queue_cb[I2C_PRIO_LOW], "i2c_low", I2C_BUS_QUEUE_LEN, sizeof(i2c_xfer_t *)),
+    QUEUE(i2c_bus_queue[I2C_PRIO_NORMAL], i2c_bus_queue_storage[I2C_PRIO_NORMAL],
+          i2c_bus_queue_cb[I2C_PRIO_NORMAL], "i2c_normal", I2C_BUS_QUEUE_LEN, sizeof(i2c_xfer_t *)),
+    QUEUE(i2c_bus_queue[I2C_PRIO_HIGH], i2c_bus_queue_storage[I2C_PRIO_HIGH],
+          i2c_bus_queue_cb[I2C_PRIO_HIGH], "i2c_high", I2C_BUS_QUEUE_LEN, sizeof(i2c_xfer_t *)),
+    STREAM(cli_uart_rx_stream, "cli_rx", CLI_RX_STREAM_SIZE),
+    EVENT_GROUP(app_sched_events),                 // sampler -> display, log and alarm tasks
+
+    SEMAPHORE(RTOS_BINARY, cli_uart_tx_space),     // given each time a TX DMA transfer ends
+    SEMAPHORE(RTOS_MUTEX, spi_flash_mutex),
+    SEMAPHORE(RTOS_MUTEX, log_flash_mutex),
+    SEMAPHORE(RTOS_BINARY, ads1115_sem),           // ALERT/RDY conversion ready
+
+    // Above every bus client so completions are handed back immediately
+    TASK(i2c_bus_task, i2c_bus_task, "I2CBus", osPriorityHigh),
+    // The acquisition task must outrank every snapshot reader (see sensors.c)
+    TASK(sensors_task, SensorTask, "Sensors", osPriorityAboveNormal),
+    TASK(cli_task, CLI_Task, "cliTask", osPriorityNormal),
+    TASK(log_export_task, log_export_task, "Export", osPriorityBelowNormal),
+    TASK(moisture_display_task, MoistureDisplayTask, "Moisture", 1),
+    TASK(moisture_log_task, MoistureLogTask, "LogTask", 1),
+    TASK(oled_task, OledDisplayTask, "OLED", 1),
+    TASK(alarm_task, AlarmTask, "Alarm", 1),
+};
+
+void rtos_objects_create(void) {
+    for (uint32_t i = 0; i < sizeof(rtos_objects) / sizeof(rtos_objects[0]); i++) {
+        const rtos_object_t *o = &rtos_objects[i];
+        void *h = NULL;
+
+        switch (o->kind) {
+            case RTOS_TASK:
+                h = xTaskCreateStatic(o->fn, o->name, o->length, NULL, o->prio, o->storage, o->cb);
+                *(TaskHandle_t *)o->handle = h;
+                break;
+            case RTOS_QUEUE:
+                h = xQueueCreateStatic(o->length, o->item_size, o->storage, o->cb);
+                *(QueueHandle_t *)o->handle = h;
+                sysmon_watch_queue(o->name, h);
+                break;
+            case RTOS_STREAM:
+                h = xStreamBufferCreateStatic(o->length, 1, o->storage, o->cb);
+                *(StreamBufferHandle_t *)o->handle = h;
+                sysmon_watch_stream(o->name, h, o->length);
+                break;
+            case RTOS_EVENT_GROUP:
+                h = xEventGroupCreateStatic(o->cb);
+                *(EventGroupHandle_t *)o->handle = h;
+                break;
+            case RTOS_MUTEX:
+                h = xSemaphoreCreateMutexStatic(o->cb);
+                *(SemaphoreHandle_t *)o->handle = h;
+                break;
+            case RTOS_BINARY:
+                h = xSemaphoreCreateBinaryStatic(o->cb);
+                *(SemaphoreHandle_t *)o->handle = h;
+                break;
+        }
+        configASSERT(h != NULL);
+    }
+}
@@ -0,0 +1,88 @@
+#include "sensors.h"
+#include "adc.h"
+#include "ads1115.h"
+#include "task.h"
+#include "rtos_objects.h"
+#include "app_sched.h"
+#include <string.h>
+
+// Seqlock protected snapshot. The sequence counter is odd while the
+// acquisition task is writing, so readers retry until they see the same even
+// value before and after their copy. Readers never block the writer; the
+// writer must run at a priority at least as high as every reader, otherwise
+// a reader could spin on an odd counter forever.
+static volatile uint32_t snapshot_seq = 0;
+static sensor_snapshot_t snapshot;
+
+static void sensors_publish(const sensor_snapshot_t *s) {
+    snapshot_seq++;          // odd: write in progress
+    __DMB();
+    snapshot.timestamp_ms = s->timestamp_ms;
+    memcpy(snapshot.adc, s->adc, sizeof(snapshot.adc));
+    memcpy(snapshot.ads, s->ads, sizeof(snapshot.ads));
+    snapshot.version = s->version;
+    __DMB();
+    snapshot_seq++;          // even: stable
+}
+
+uint32_t sensors_get(sensor_snapshot_t *out) {
+    uint32_t seq;
+    do {
+        seq = snapshot_seq;
+        __DMB();
+        memcpy(out, &snapshot, sizeof(*out));
+        __DMB();
+    } while ((seq & 1) || seq != snapshot_seq);
+    return out->version;
+}
+
+int sensors_sample_now(sensor_snapshot_t *out, TickType_t timeout) {
+    sensor_snapshot_t cur;
+    uint32_t start_version = sensors_get(&cur);
+    TickType_t start = xTaskGetTickCount();
+
+    if (sensors_task_handle == NULL) return 0;
+    xTaskNotifyGive(sensors_task_handle);
+
+    while (sensors_get(out) == start_version) {
+        if ((xTaskGetTickCount() - start) >= timeout) return 0;
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return 1;
+}
+
+// One oversampled ADC1 reading. TIM1 triggers scans, DMA fills the buffer
+// and the DMA ISR publishes the average of a block; the scan only runs for
+// that block so the clocks can stop between samples.
+static void sample_adc(uint16_t out[SENSOR_ADC_CHANNELS]) {
+    uint32_t seq = adc_scan_read(out);
+    TickType_t start;
+
+    adc_scan_start();
+    vTaskDelay(pdMS_TO_TICKS(ADC_BLOCK_MS));
+    start = xTaskGetTickCount();
+    while (adc_scan_read(out) == seq && (xTaskGetTickCount() - start) < pdMS_TO_TICKS(ADC_BLOCK_MS)) {
+        vTaskDelay(1);
+    }
+    adc_scan_stop();
+}
+
+void SensorTask(void *argument) {
+    sensor_snapshot_t s = {0};
+
+    ads_init();
+
+    for (;;) {
+        sample_adc(s.adc);
+        // Channels that fail keep their previous reading
+        ads_scan(s.ads);
+
+        s.timestamp_ms = xTaskGetTickCount();
+        s.version++;
+        sensors_publish(&s);
+        sched_sampled(&s);
+
+        // Sleep until the next period, or until someone asks for a fresh sample
+        ulTaskNotifyTake(pdTRUE, sched_next_sample());
+    }
+}
@@ -0,0 +1,290 @@
+#include "spi_flash.h"
+#include "main.h"
+#include "spi.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "perf.h"
+#include "rtos_objects.h"
+
+#define SPI_FLASH_CMD_TIMEOUT   100    // ms, HAL timeout per SPI call
+#define SPI_FLASH_DMA_MIN       16     // shorter data phases are cheaper polled
+
+#define SPI_DMA_IDLE    0
+#define SPI_DMA_BUSY    1
+#define SPI_DMA_DONE    2
+#define SPI_DMA_ERROR   3
+
+static const spi_flash_chip_t spi_flash_chips[] = {
+    { "GD25D05C", 0xC84010,  64 * 1024, 256, 4096, 700, 2400, 50, 300 },
+    { "GD25D10C", 0xC84011, 128 * 1024, 256, 4096, 700, 2400, 50, 300 },
+};
+
+// Unknown part: assume the smallest chip and generous worst cases
+static const spi_flash_chip_t spi_flash_generic =
+    { "generic", 0, 64 * 1024, 256, 4096, 700, 5000, 50, 400 };
+
+static const spi_flash_chip_t *chip = &spi_flash_generic;
+
+// Data phase in flight; only the mutex holder touches these from task level
+static volatile uint8_t dma_state = SPI_DMA_IDLE;
+static volatile TaskHandle_t dma_waiter;
+static uint16_t dma_len;
+
+static int scheduler_running(void) {
+    return xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+}
+
+static void spi_flash_lock(void) {
+    if (spi_flash_mutex != NULL && scheduler_running()) {
+        xSemaphoreTake(spi_flash_mutex, portMAX_DELAY);
+    }
+}
+
+static void spi_flash_unlock(void) {
+    if (spi_flash_mutex != NULL && scheduler_running()) {
+        xSemaphoreGive(spi_flash_mutex);
+    }
+}
+
+static void spi_flash_select(void) {
+    HAL_GPIO_WritePin(FLASH_CS_GPIO_Port, FLASH_CS_Pin, GPIO_PIN_RESET);
+}
+
+static void spi_flash_deselect(void) {
+    HAL_GPIO_WritePin(FLASH_CS_GPIO_Port, FLASH_CS_Pin, GPIO_PIN_SET);
+}
+
+static void spi_flash_addr_cmd(uint8_t cmd[4], uint8_t op, uint32_t addr) {
+    cmd[0] = op;
+    cmd[1] = (addr >> 16) & 0xFF;
+    cmd[2] = (addr >> 8) & 0xFF;
+    cmd[3] = addr & 0xFF;
+}
+
+static int spi_flash_command(uint8_t op) {
+    HAL_StatusTypeDef rc;
+
+    spi_flash_select();
+    rc = HAL_SPI_Transmit(&hspi1, &op, 1, SPI_FLASH_CMD_TIMEOUT);
+    spi_flash_deselect();
+    return rc == HAL_OK;
+}
+
+static uint8_t spi_flash_status(void) {
+    uint8_t cmd = SPI_FLASH_CMD_RDSR;
+    uint8_t sr = 0xFF;   // reads as busy on SPI failure
+
+    spi_flash_select();
+    if (HAL_SPI_Transmit(&hspi1, &cmd, 1, SPI_FLASH_CMD_TIMEOUT) == HAL_OK) {
+        HAL_SPI_Receive(&hspi1, &sr, 1, SPI_FLASH_CMD_TIMEOUT);
+    }
+    spi_flash_deselect();
+    return sr;
+}
+
+// Start the data phase of a command (CS already asserted). Long transfers
+// go by DMA and complete in the background; short ones, and anything
+// before the scheduler runs, use the blocking HAL calls and are already
+// finished on return.
+static int spi_flash_data_start(uint8_t *data, uint16_t n, int rx) {
+    HAL_StatusTypeDef rc;
+
+    dma_len = n;
+    if (n < SPI_FLASH_DMA_MIN || !scheduler_running()) {
+        rc = rx ? HAL_SPI_Receive(&hspi1, data, n, SPI_FLASH_CMD_TIMEOUT + n / 64)
+                : HAL_SPI_Transmit(&hspi1, data, n, SPI_FLASH_CMD_TIMEOUT + n / 64);
+        dma_state = (rc == HAL_OK) ? SPI_DMA_DONE : SPI_DMA_ERROR;
+        return rc == HAL_OK;
+    }
+
+    // Set before starting: the completion interrupt may beat us back here
+    dma_waiter = xTaskGetCurrentTaskHandle();
+    dma_state = SPI_DMA_BUSY;
+    rc = rx ? HAL_SPI_Receive_DMA(&hspi1, data, n)
+            : HAL_SPI_Transmit_DMA(&hspi1, data, n);
+    if (rc != HAL_OK) {
+        dma_waiter = NULL;
+        dma_state = SPI_DMA_ERROR;
+        return 0;
+    }
+    return 1;
+}
+
+// Block on the task notification until the data phase completes. The CPU
+// is free for other tasks meanwhile; a transfer that overruns its timeout
+// is aborted.
+static int spi_flash_data_wait(void) {
+    TickType_t start = xTaskGetTickCount();
+    TickType_t limit = pdMS_TO_TICKS(SPI_FLASH_CMD_TIMEOUT + dma_len / 64);
+    int ok;
+
+    while (dma_state == SPI_DMA_BUSY) {
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= limit) {
+            HAL_SPI_Abort(&hspi1);
+            dma_state = SPI_DMA_ERROR;
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, limit - waited);
+    }
+    dma_waiter = NULL;
+    ok = (dma_state == SPI_DMA_DONE);
+    dma_state = SPI_DMA_IDLE;
+    return ok;
+}
+
+static int spi_flash_data(uint8_t *data, uint16_t n, int rx) {
+    if (spi_flash_data_start(data, n, rx)) return spi_flash_data_wait();
+    dma_state = SPI_DMA_IDLE;
+    return 0;
+}
+
+static void spi_flash_dma_complete(uint8_t state) {
+    BaseType_t woken = pdFALSE;
+
+    dma_state = state;
+    if (dma_waiter != NULL) vTaskNotifyGiveFromISR(dma_waiter, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
+    if (hspi == &hspi1) spi_flash_dma_complete(SPI_DMA_DONE);
+}
+
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi) {
+    if (hspi == &hspi1) spi_flash_dma_complete(SPI_DMA_DONE);
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+    if (hspi == &hspi1) spi_flash_dma_complete(SPI_DMA_DONE);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+    if (hspi == &hspi1) spi_flash_dma_complete(SPI_DMA_ERROR);
+}
+
+static void spi_flash_sleep(uint32_t ms) {
+    if (scheduler_running()) vTaskDelay(pdMS_TO_TICKS(ms));
+    else HAL_Delay(ms);
+}
+
+// Poll WIP until the chip is idle. Sleeps through the typical duration
+// first, then polls, yielding to other tasks between reads of the status
+// register. Gives up once the maximum duration has passed.
+static int spi_flash_wait_ready(uint32_t typ_us, uint32_t max_us) {
+    uint32_t start = HAL_GetTick();
+    uint32_t limit = max_us / 1000 + 2;   // +2: tick granularity on both ends
+
+    if (typ_us >= 1000) spi_flash_sleep(typ_us / 1000);
+
+    for (;;) {
+        if (!(spi_flash_status() & SPI_FLASH_SR_WIP)) return 1;
+        if (HAL_GetTick() - start > limit) return 0;
+        if (!scheduler_running()) continue;
+        // Sub-millisecond operations (page program) only yield; longer
+        // ones sleep a tick between polls
+        if (HAL_GetTick() == start) taskYIELD();
+        else vTaskDelay(1);
+    }
+}
+
+void spi_flash_init(void) {
+    uint32_t id;
+
+    id = spi_flash_read_id();
+    chip = &spi_flash_generic;
+    for (uint32_t i = 0; i < sizeof(spi_flash_chips) / sizeof(spi_flash_chips[0]); i++) {
+        if (spi_flash_chips[i].jedec_id == id) {
+            chip = &spi_flash_chips[i];
+            break;
+        }
+    }
+}
+
+const spi_flash_chip_t *spi_flash_chip(void) {
+    return chip;
+}
+
+uint32_t spi_flash_read_id(void) {
+    uint8_t cmd = SPI_FLASH_CMD_RDID;
+    uint8_t id[3] = {0};
+    HAL_StatusTypeDef rc;
+
+    spi_flash_lock();
+    spi_flash_select();
+    rc = HAL_SPI_Transmit(&hspi1, &cmd, 1, SPI_FLASH_CMD_TIMEOUT);
+    if (rc == HAL_OK) rc = HAL_SPI_Receive(&hspi1, id, 3, SPI_FLASH_CMD_TIMEOUT);
+    spi_flash_deselect();
+    spi_flash_unlock();
+
+    if (rc != HAL_OK) return 0;
+    return ((uint32_t)id[0] << 16) | ((uint32_t)id[1] << 8) | id[2];
+}
+
+int spi_flash_read(uint32_t addr, uint8_t *data, uint32_t len) {
+    uint8_t cmd[4];
+    int ok;
+
+    spi_flash_addr_cmd(cmd, SPI_FLASH_CMD_READ, addr);
+    spi_flash_lock();
+    spi_flash_select();
+    ok = HAL_SPI_Transmit(&hspi1, cmd, 4, SPI_FLASH_CMD_TIMEOUT) == HAL_OK;
+    while (ok && len > 0) {
+        uint16_t n = (len > 0x8000) ? 0x8000 : (uint16_t)len;
+        ok = spi_flash_data(data, n, 1);
+        data += n;
+        len -= n;
+    }
+    spi_flash_deselect();
+    spi_flash_unlock();
+    return ok;
+}
+
+int spi_flash_program(uint32_t addr, const uint8_t *data, uint32_t len) {
+    uint32_t t0 = perf_begin();
+    uint8_t cmd[4];
+    int ok = 1;
+
+    spi_flash_lock();
+    while (ok && len > 0) {
+        // A page program wraps within its page, so never cross a boundary
+        uint32_t room = chip->page_size - (addr % chip->page_size);
+        uint16_t n = (len < room) ? (uint16_t)len : (uint16_t)room;
+
+        spi_flash_addr_cmd(cmd, SPI_FLASH_CMD_PP, addr);
+        ok = spi_flash_command(SPI_FLASH_CMD_WREN);
+        if (ok) {
+            spi_flash_select();
+            ok = HAL_SPI_Transmit(&hspi1, cmd, 4, SPI_FLASH_CMD_TIMEOUT) == HAL_OK &&
+                 spi_flash_data((uint8_t *)data, n, 0);
+            spi_flash_deselect();
+        }
+        if (ok) ok = spi_flash_wait_ready(chip->page_prog_typ_us, chip->page_prog_max_us);
+
+        addr += n;
+        data += n;
+        len -= n;
+    }
+    spi_flash_unlock();
+    perf_end(PERF_FLASH_WRITE, t0);
+    return ok;
+}
+
+int spi_flash_erase_sector(uint32_t addr) {
+    uint8_t cmd[4];
+    int ok;
+
+    spi_flash_addr_cmd(cmd, SPI_FLASH_CMD_SE, addr);
+    spi_flash_lock();
+    ok = spi_flash_command(SPI_FLASH_CMD_WREN);
+    if (ok) {
+        spi_flash_select();
+        ok = HAL_SPI_Transmit(&hspi1, cmd, 4, SPI_FLASH_CMD_TIMEOUT) == HAL_OK;
+        spi_flash_deselect();
+    }
+    if (ok) ok = spi_flash_wait_ready((uint32_t)chip->sector_erase_typ_ms * 1000,
+                                      (uint32_t)chip->sector_erase_max_ms * 1000);
+    spi_flash_unlock();
+    return ok;
+}
@@ -1,12 +1,11 @@
 #include "st7032.h"
+#include "i2c_bus.h"
 #include "string.h"
 #include "stdio.h"
 
-static I2C_HandleTypeDef *_lcd_i2c;
-
 static void st7032_write(uint8_t control, uint8_t data) {
     uint8_t buf[2] = { control, data };
-    HAL_I2C_Master_Transmit(_lcd_i2c, ST7032_ADDR, buf, 2, HAL_MAX_DELAY);
+    i2c_bus_write(ST7032_ADDR, buf, 2, I2C_PRIO_NORMAL);
 }
 
 void st7032_write_data(uint8_t data) {
@@ -19,7 +18,7 @@ static const char bar_chars[] = {
 };
 
 void st7032_init(I2C_HandleTypeDef *hi2c) {
-    _lcd_i2c = hi2c;
+    (void)hi2c;  // all traffic goes through the shared bus manager (i2c_bus.c)
 
     HAL_Delay(50); // Wait for power on
 
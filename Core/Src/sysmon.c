@@ -0,0 +1,247 @@
+#include "sysmon.h"
+#include "main.h"
+#include "usart.h"
+#include "cli.h"
+#include "cli_uart.h"
+#include "task.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SYSMON_FAULT_MAGIC  0x4B435453U     // "STCK"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t uptime_ms;
+    char task[configMAX_TASK_NAME_LEN];
+} sysmon_fault_t;
+
+typedef struct {
+    const char *name;
+    void *handle;
+    uint16_t size;              // stream buffers only
+    uint8_t stream;
+} sysmon_watch_t;
+
+// Survives the reset that follows a stack overflow; the startup code
+// clears .bss but leaves .noinit alone
+static sysmon_fault_t fault __attribute__((section(".noinit")));
+static sysmon_fault_t last_fault;
+
+static sysmon_watch_t watched[SYSMON_MAX_QUEUES];
+static uint8_t watched_count;
+
+static uint32_t rt_last;                // DWT->CYCCNT at the previous read
+static uint32_t rt_wraps;
+static uint64_t rt_skipped;             // cycles spent with the counter stopped
+
+// Load window: run-time counters as of the previous sample
+static TaskStatus_t status[SYSMON_MAX_TASKS];
+static struct {
+    TaskHandle_t handle;
+    uint32_t runtime;
+} prev[SYSMON_MAX_TASKS];
+static uint8_t prev_count;
+static uint32_t prev_total;
+static TickType_t prev_tick;
+static uint8_t sampled;
+static sysmon_snapshot_t snap;
+
+static const char *const state_names[] = { "run", "ready", "blocked", "suspend", "deleted" };
+
+void sysmon_runtime_init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    rt_last = DWT->CYCCNT;
+    rt_wraps = 0;
+}
+
+// The kernel reads this at every context switch, far more often than the
+// cycle counter wraps (43 s at 100 MHz), so each wrap is seen
+uint32_t sysmon_runtime_now(void) {
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    uint32_t now = DWT->CYCCNT;
+    uint64_t cycles;
+
+    if (now < rt_last) rt_wraps++;
+    rt_last = now;
+    cycles = (((uint64_t)rt_wraps << 32) | now) + rt_skipped;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    return (uint32_t)(cycles >> SYSMON_RUNTIME_SHIFT);
+}
+
+void sysmon_runtime_skip(uint32_t cycles) {
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    rt_skipped += cycles;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+static int watch(const char *name, void *handle, size_t size, uint8_t stream) {
+    int ok = 0;
+
+    taskENTER_CRITICAL();
+    if (watched_count < SYSMON_MAX_QUEUES && handle != NULL) {
+        watched[watched_count].name = name;
+        watched[watched_count].handle = handle;
+        watched[watched_count].size = (uint16_t)size;
+        watched[watched_count].stream = stream;
+        watched_count++;
+        ok = 1;
+    }
+    taskEXIT_CRITICAL();
+    return ok;
+}
+
+int sysmon_watch_queue(const char *name, QueueHandle_t q) {
+    return watch(name, q, 0, 0);
+}
+
+int sysmon_watch_stream(const char *name, StreamBufferHandle_t sb, size_t size) {
+    return watch(name, sb, size, 1);
+}
+
+static uint32_t prev_runtime(TaskHandle_t handle) {
+    for (uint8_t i = 0; i < prev_count; i++) {
+        if (prev[i].handle == handle) return prev[i].runtime;
+    }
+    return 0;       // created since the last sample
+}
+
+const sysmon_snapshot_t *sysmon_sample(void) {
+    uint32_t total = 0, window;
+    TickType_t now;
+    UBaseType_t n;
+
+    n = uxTaskGetSystemState(status, SYSMON_MAX_TASKS, &total);
+    now = xTaskGetTickCount();
+    window = total - prev_total;
+
+    // Creation order reads better than the kernel's list order
+    for (UBaseType_t i = 1; i < n; i++) {
+        TaskStatus_t t = status[i];
+        UBaseType_t j = i;
+        while (j > 0 && status[j - 1].xTaskNumber > t.xTaskNumber) {
+            status[j] = status[j - 1];
+            j--;
+        }
+        status[j] = t;
+    }
+
+    snap.uptime_ms = now * portTICK_PERIOD_MS;
+    snap.window_ms = sampled ? (now - prev_tick) * portTICK_PERIOD_MS : 0;
+    snap.heap_free = xPortGetFreeHeapSize();
+    snap.heap_min = xPortGetMinimumEverFreeHeapSize();
+    snap.task_count = (uint8_t)n;
+
+    for (UBaseType_t i = 0; i < n; i++) {
+        sysmon_task_t *t = &snap.task[i];
+        uint32_t delta = status[i].ulRunTimeCounter - prev_runtime(status[i].xHandle);
+        uint32_t permille = 0;
+
+        strncpy(t->name, status[i].pcTaskName, sizeof(t->name) - 1);
+        t->name[sizeof(t->name) - 1] = '\0';
+        t->number = (uint8_t)status[i].xTaskNumber;
+        t->state = (uint8_t)status[i].eCurrentState;
+        t->prio = (uint8_t)status[i].uxCurrentPriority;
+        t->stack_free = status[i].usStackHighWaterMark;
+        if (sampled && window != 0) permille = (uint32_t)(((uint64_t)delta * 1000U + window / 2) / window);
+        t->cpu_permille = (uint16_t)(permille > 1000 ? 1000 : permille);
+    }
+
+    for (uint8_t i = 0; i < n; i++) {
+        prev[i].handle = status[i].xHandle;
+        prev[i].runtime = status[i].ulRunTimeCounter;
+    }
+    prev_count = (uint8_t)n;
+    prev_total = total;
+    prev_tick = now;
+    sampled = 1;
+
+    snap.queue_count = watched_count;
+    for (uint8_t i = 0; i < watched_count; i++) {
+        sysmon_queue_t *q = &snap.queue[i];
+        q->name = watched[i].name;
+        if (watched[i].stream) {
+            q->waiting = (uint16_t)xStreamBufferBytesAvailable(watched[i].handle);
+            q->length = watched[i].size;
+        } else {
+            q->waiting = (uint16_t)uxQueueMessagesWaiting(watched[i].handle);
+            q->length = (uint16_t)(q->waiting + uxQueueSpacesAvailable(watched[i].handle));
+        }
+    }
+    return &snap;
+}
+
+void sysmon_stack_overflow(const char *task) {
+    static const char msg[] = "\r\n*** Stack overflow in task ";
+    static const char tail[] = ", resetting\r\n";
+
+    taskDISABLE_INTERRUPTS();
+    fault.magic = SYSMON_FAULT_MAGIC;
+    fault.uptime_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    strncpy(fault.task, task != NULL ? task : "?", sizeof(fault.task) - 1);
+    fault.task[sizeof(fault.task) - 1] = '\0';
+
+    // The console DMA may be mid-transfer and its interrupt will not come;
+    // say it by polling instead
+    HAL_UART_AbortTransmit(&huart6);
+    HAL_UART_Transmit(&huart6, (uint8_t *)msg, sizeof(msg) - 1, 100);
+    HAL_UART_Transmit(&huart6, (uint8_t *)fault.task, (uint16_t)strlen(fault.task), 100);
+    HAL_UART_Transmit(&huart6, (uint8_t *)tail, sizeof(tail) - 1, 100);
+    NVIC_SystemReset();
+    for (;;) {
+    }
+}
+
+static void cmd_top(int argc, char **argv) {
+    const sysmon_snapshot_t *s;
+    uint32_t ms = SYSMON_TOP_WINDOW_MS;
+
+    if (argc >= 2) {
+        ms = strtoul(argv[1], NULL, 10);
+        if (ms < 10 || ms > 60000) {
+            cli_puts("Usage: top [ms]  (10..60000, default 1000)\r\n");
+            return;
+        }
+    }
+
+    sysmon_sample();
+    vTaskDelay(pdMS_TO_TICKS(ms));
+    s = sysmon_sample();
+    if (s->task_count == 0) {
+        cli_printf("More than %u tasks, raise SYSMON_MAX_TASKS\r\n", SYSMON_MAX_TASKS);
+        return;
+    }
+
+    cli_printf("Uptime %lu s, load over %lu ms\r\n", s->uptime_ms / 1000U, s->window_ms);
+    cli_puts("  # Task             Pri State      CPU  Stack free\r\n");
+    for (uint8_t i = 0; i < s->task_count; i++) {
+        const sysmon_task_t *t = &s->task[i];
+        cli_printf("%3u %-16s %3u %-8s %3u.%u%% %7lu B\r\n", t->number, t->name, t->prio,
+                   t->state < 5 ? state_names[t->state] : "?",
+                   t->cpu_permille / 10U, t->cpu_permille % 10U,
+                   (unsigned long)t->stack_free * sizeof(StackType_t));
+    }
+    cli_printf("Heap %lu free, %lu lowest, of %lu B\r\n", (unsigned long)s->heap_free,
+               (unsigned long)s->heap_min, (unsigned long)configTOTAL_HEAP_SIZE);
+    for (uint8_t i = 0; i < s->queue_count; i++) {
+        cli_printf("Queue %-12s %4u/%u\r\n", s->queue[i].name, s->queue[i].waiting, s->queue[i].length);
+    }
+    if (last_fault.magic == SYSMON_FAULT_MAGIC) {
+        cli_printf("Last reset: stack overflow in %s after %lu s\r\n", last_fault.task,
+                   last_fault.uptime_ms / 1000U);
+    }
+}
+
+static const cli_command_t sysmon_commands[] = {
+    { "top", "top [ms] - Task load, stacks, heap and queues", cmd_top },
+};
+
+void sysmon_init(void) {
+    if (fault.magic == SYSMON_FAULT_MAGIC) {
+        last_fault = fault;
+        last_fault.task[sizeof(last_fault.task) - 1] = '\0';
+        cli_printf("Reset after a stack overflow in %s\r\n", last_fault.task);
+    }
+    fault.magic = 0;
+    CLI_RegisterCommands(sysmon_commands, sizeof(sysmon_commands) / sizeof(sysmon_commands[0]));
+}
@@ -0,0 +1,309 @@
+#include "telemetry.h"
+#include "cli.h"
+#include "cli_uart.h"
+#include "log_flash.h"
+#include "log_export.h"
+#include "sensors.h"
+#include "sysmon.h"
+#include "lowpower.h"
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define TLM_HDR_SIZE        3
+#define TLM_PAYLOAD_MAX     (TLM_HDR_SIZE + TLM_MAX_BODY + 2)
+#define TLM_ENCODED_MAX     (TLM_PAYLOAD_MAX + TLM_PAYLOAD_MAX / 254 + 2)
+
+_Static_assert(sizeof(sensor_snapshot_t) <= TLM_MAX_BODY, "sample does not fit a frame");
+_Static_assert(sizeof(tlm_log_data_t) + TLM_LOG_PER_FRAME * sizeof(log_entry_t) <= TLM_MAX_BODY,
+               "log frame too large");
+_Static_assert(TLM_LOG_PER_FRAME <= 8, "valid mask is 8 bits");
+_Static_assert(sizeof(tlm_log_read_t) <= TLM_MAX_BODY, "request too large");
+
+static volatile uint8_t active;
+static uint8_t tx_seq;                  // for unsolicited frames
+static uint16_t stream_period_ms;
+static TickType_t stream_last;
+
+static uint8_t rx_frame[TLM_ENCODED_MAX];
+static uint16_t rx_len;
+static uint8_t rx_overflow;             // discard until the next delimiter
+
+// CRC-16/CCITT-FALSE
+static uint16_t tlm_crc16(const uint8_t *data, uint16_t len) {
+    uint16_t crc = 0xFFFF;
+    while (len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t cobs_encode(const uint8_t *src, uint16_t len, uint8_t *dst) {
+    uint16_t code_pos = 0, out = 1;
+    uint8_t code = 1;
+
+    for (uint16_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+            continue;
+        }
+        dst[out++] = src[i];
+        if (++code == 0xFF) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+    }
+    dst[code_pos] = code;
+    return out;
+}
+
+// Returns the decoded length, 0 if the input is not valid COBS
+static uint16_t cobs_decode(const uint8_t *src, uint16_t len, uint8_t *dst) {
+    uint16_t in = 0, out = 0;
+
+    while (in < len) {
+        uint8_t code = src[in++];
+        if (code == 0 || in + code - 1 > len) return 0;
+        for (uint8_t i = 1; i < code; i++) dst[out++] = src[in++];
+        if (code != 0xFF && in < len) dst[out++] = 0;
+    }
+    return out;
+}
+
+int telemetry_send(uint8_t type, uint8_t seq, const void *body, uint16_t len) {
+    uint8_t payload[TLM_PAYLOAD_MAX];
+    uint8_t frame[TLM_ENCODED_MAX];
+    uint16_t crc, n;
+
+    if (len > TLM_MAX_BODY) return 0;
+
+    payload[0] = TLM_PROTO_VERSION;
+    payload[1] = type;
+    payload[2] = seq;
+    if (len) memcpy(&payload[TLM_HDR_SIZE], body, len);
+    crc = tlm_crc16(payload, TLM_HDR_SIZE + len);
+    payload[TLM_HDR_SIZE + len] = crc & 0xFF;
+    payload[TLM_HDR_SIZE + len + 1] = crc >> 8;
+
+    n = cobs_encode(payload, TLM_HDR_SIZE + len + 2, frame);
+    frame[n++] = 0x00;
+    // One call per frame: the UART ring never interleaves it with other output
+    return cli_uart_send(frame, n);
+}
+
+static void send_ack(uint8_t type, uint8_t seq, uint8_t status) {
+    tlm_ack_t ack = { type, seq, status };
+    telemetry_send(status == TLM_OK ? TLM_ACK : TLM_NAK, seq, &ack, sizeof(ack));
+}
+
+// Text hook for cli_write while binary mode is active
+static int tlm_text(const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    int ok = 1;
+
+    while (len > 0) {
+        uint16_t n = (len > TLM_TEXT_MAX) ? TLM_TEXT_MAX : (uint16_t)len;
+        ok &= telemetry_send(TLM_TEXT, tx_seq++, p, n);
+        p += n;
+        len -= n;
+    }
+    return ok;
+}
+
+void telemetry_enter(void) {
+    rx_len = 0;
+    rx_overflow = 0;
+    stream_period_ms = 0;
+    active = 1;
+    cli_set_text_hook(tlm_text);
+    // A host may send at any time; a byte lost to a STOP wake-up would
+    // break a frame
+    lowpower_hold(LP_HOLD_TELEMETRY);
+}
+
+void telemetry_exit(void) {
+    cli_set_text_hook(NULL);
+    active = 0;
+    stream_period_ms = 0;
+    lowpower_release(LP_HOLD_TELEMETRY);
+}
+
+int telemetry_active(void) {
+    return active;
+}
+
+static void send_sysmon(uint8_t seq) {
+    const sysmon_snapshot_t *s = sysmon_sample();
+    uint8_t body[sizeof(tlm_sys_task_t) + configMAX_TASK_NAME_LEN];
+    tlm_sys_info_t info = {
+        s->uptime_ms, s->window_ms, (uint32_t)s->heap_free, (uint32_t)s->heap_min,
+        s->task_count, s->queue_count
+    };
+
+    telemetry_send(TLM_SYS_INFO, seq, &info, sizeof(info));
+    for (uint8_t i = 0; i < s->task_count; i++) {
+        const sysmon_task_t *t = &s->task[i];
+        tlm_sys_task_t rec = { t->number, t->state, t->prio, t->cpu_permille, t->stack_free };
+        size_t n = strlen(t->name);
+
+        memcpy(body, &rec, sizeof(rec));
+        memcpy(&body[sizeof(rec)], t->name, n);
+        telemetry_send(TLM_SYS_TASK, seq, body, (uint16_t)(sizeof(rec) + n));
+    }
+    for (uint8_t i = 0; i < s->queue_count; i++) {
+        const sysmon_queue_t *q = &s->queue[i];
+        tlm_sys_queue_t rec = { q->waiting, q->length };
+        size_t n = strnlen(q->name, configMAX_TASK_NAME_LEN);
+
+        memcpy(body, &rec, sizeof(rec));
+        memcpy(&body[sizeof(rec)], q->name, n);
+        telemetry_send(TLM_SYS_QUEUE, seq, body, (uint16_t)(sizeof(rec) + n));
+    }
+}
+
+static void dispatch(const uint8_t *payload, uint16_t len) {
+    const uint8_t *body = &payload[TLM_HDR_SIZE];
+    uint16_t body_len;
+    uint8_t type, seq;
+    uint16_t crc;
+
+    if (len < TLM_HDR_SIZE + 2) return;     // too short to answer
+    type = payload[1];
+    seq = payload[2];
+    body_len = len - TLM_HDR_SIZE - 2;
+
+    crc = tlm_crc16(payload, len - 2);
+    if (payload[len - 2] != (crc & 0xFF) || payload[len - 1] != (crc >> 8)) {
+        send_ack(type, seq, TLM_ERR_CRC);
+        return;
+    }
+    if (payload[0] != TLM_PROTO_VERSION) {
+        send_ack(type, seq, TLM_ERR_VERSION);
+        return;
+    }
+
+    switch (type) {
+        case TLM_HELLO: {
+            tlm_hello_t hello = {
+                TLM_PROTO_VERSION, sizeof(log_entry_t), flash_log_index,
+                log_flash_first_id(), xTaskGetTickCount()
+            };
+            telemetry_send(TLM_HELLO, seq, &hello, sizeof(hello));
+            break;
+        }
+
+        case TLM_EXIT:
+            send_ack(type, seq, TLM_OK);
+            telemetry_exit();
+            break;
+
+        case TLM_STREAM: {
+            tlm_stream_t req;
+            if (body_len != sizeof(req)) {
+                send_ack(type, seq, TLM_ERR_LENGTH);
+                break;
+            }
+            memcpy(&req, body, sizeof(req));
+            stream_period_ms = req.period_ms;
+            stream_last = xTaskGetTickCount() - pdMS_TO_TICKS(stream_period_ms);  // first sample now
+            send_ack(type, seq, TLM_OK);
+            break;
+        }
+
+        case TLM_LOG_READ: {
+            tlm_log_read_t req;
+            log_export_req_t ex;
+            if (body_len != sizeof(req)) {
+                send_ack(type, seq, TLM_ERR_LENGTH);
+                break;
+            }
+            memcpy(&req, body, sizeof(req));
+            ex.first_id = req.start;
+            ex.end_id = req.count ? req.start + req.count : LOG_EXPORT_ALL;
+            ex.t_min = req.t_min;
+            ex.t_max = req.t_max;
+            ex.rate = req.rate;
+            ex.binary = 1;
+            ex.seq = seq;
+            send_ack(type, seq, log_export_start(&ex) ? TLM_OK : TLM_ERR_BUSY);
+            break;
+        }
+
+        case TLM_CMD: {
+            char line[TLM_MAX_BODY + 1];
+            memcpy(line, body, body_len);
+            line[body_len] = '\0';
+            CLI_Execute(line);
+            telemetry_send(TLM_CMD_DONE, seq, NULL, 0);
+            break;
+        }
+
+        case TLM_SYSMON:
+            send_sysmon(seq);
+            break;
+
+        default:
+            send_ack(type, seq, TLM_ERR_TYPE);
+            break;
+    }
+}
+
+void telemetry_input(const uint8_t *data, size_t len) {
+    uint8_t payload[TLM_PAYLOAD_MAX];
+
+    for (size_t i = 0; i < len && active; i++) {
+        uint8_t b = data[i];
+
+        if (b != 0x00) {
+            if (rx_len < sizeof(rx_frame)) rx_frame[rx_len++] = b;
+            else rx_overflow = 1;
+            continue;
+        }
+
+        // Delimiter: decode whatever was collected since the last one
+        if (rx_len > 0 && !rx_overflow) {
+            uint16_t n = 0;
+            if (rx_len <= TLM_PAYLOAD_MAX + 1) n = cobs_decode(rx_frame, rx_len, payload);
+            if (n > 0) dispatch(payload, n);
+        }
+        rx_len = 0;
+        rx_overflow = 0;
+    }
+}
+
+uint32_t telemetry_poll(void) {
+    TickType_t now, period, elapsed;
+    sensor_snapshot_t snap;
+
+    if (!active || stream_period_ms == 0) return CLI_WAIT_FOREVER;
+
+    now = xTaskGetTickCount();
+    period = pdMS_TO_TICKS(stream_period_ms);
+    elapsed = now - stream_last;
+    if (elapsed >= period) {
+        if (sensors_get(&snap)) telemetry_send(TLM_SAMPLE, tx_seq++, &snap, sizeof(snap));
+        stream_last = now;
+        elapsed = 0;
+    }
+    return (period - elapsed) * portTICK_PERIOD_MS;
+}
+
+static void cmd_bin(int argc, char **argv) {
+    cli_puts("Binary mode: COBS frames from now on, send TLM_EXIT to return\r\n");
+    cli_tx_flush(100);
+    telemetry_enter();
+}
+
+static const cli_command_t telemetry_commands[] = {
+    { "bin", "bin           - Switch the UART to binary telemetry frames", cmd_bin },
+};
+
+void telemetry_init(void) {
+    CLI_RegisterCommands(telemetry_commands, sizeof(telemetry_commands) / sizeof(telemetry_commands[0]));
+}
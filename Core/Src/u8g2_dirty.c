@@ -0,0 +1,72 @@
+#include "u8g2_dirty.h"
+#include <string.h>
+
+void u8g2_DirtyInit(u8g2_dirty_t *d, uint8_t *shadow, uint16_t size) {
+    d->shadow = shadow;
+    d->size = size;
+    d->valid = 0;
+}
+
+void u8g2_DirtyInvalidate(u8g2_dirty_t *d) {
+    d->valid = 0;
+}
+
+static uint8_t tile_changed(const uint8_t *buf, const uint8_t *shadow) {
+    return memcmp(buf, shadow, 8) != 0;
+}
+
+uint16_t u8g2_SendDirty(u8g2_t *u8g2, u8g2_dirty_t *d) {
+    uint8_t *buf = u8g2_GetBufferPtr(u8g2);
+    uint8_t tw = u8g2_GetBufferTileWidth(u8g2);
+    uint8_t th = u8g2_GetBufferTileHeight(u8g2);
+    uint16_t page_size = (uint16_t)tw * 8;
+    uint16_t sent = 0;
+
+    // Page mode, or a shadow that does not match the buffer: plain refresh
+    if (th != u8g2_GetU8x8(u8g2)->display_info->tile_height ||
+        d->shadow == NULL || d->size < u8g2_GetBufferSize(u8g2)) {
+        u8g2_SendBuffer(u8g2);
+        return (uint16_t)tw * th;
+    }
+
+    if (!d->valid) {
+        u8g2_SendBuffer(u8g2);
+        memcpy(d->shadow, buf, u8g2_GetBufferSize(u8g2));
+        d->valid = 1;
+        return (uint16_t)tw * th;
+    }
+
+    for (uint8_t ty = 0; ty < th; ty++) {
+        uint8_t *row = buf + ty * page_size;
+        uint8_t *shadow_row = d->shadow + ty * page_size;
+        uint8_t tx = 0;
+
+        while (tx < tw) {
+            uint8_t start, end, gap;
+
+            if (!tile_changed(row + tx * 8, shadow_row + tx * 8)) {
+                tx++;
+                continue;
+            }
+
+            // Extend the run, swallowing short clean gaps
+            start = tx;
+            end = tx + 1;
+            gap = 0;
+            for (tx = end; tx < tw; tx++) {
+                if (tile_changed(row + tx * 8, shadow_row + tx * 8)) {
+                    end = tx + 1;
+                    gap = 0;
+                } else if (++gap > U8G2_DIRTY_MERGE_GAP) {
+                    break;
+                }
+            }
+
+            u8g2_UpdateDisplayArea(u8g2, start, ty, end - start, 1);
+            memcpy(shadow_row + start * 8, row + start * 8, (end - start) * 8);
+            sent += end - start;
+            tx = end;
+        }
+    }
+    return sent;
+}
@@ -1,9 +1,41 @@
 #include "u8g2.h"
-#include "i2c.h"
+#include "i2c_bus.h"
+#include <string.h>
+
+// Staging area for outgoing display transfers. A full 128x64 frame is eight
+// tile-row transfers of 137 bytes each with u8x8_cad_ssd13xx_i2c_dma, so one
+// frame fits without waiting on the bus.
+#define OLED_I2C_BUF_SIZE    1152
+#define OLED_I2C_MAX_XFERS   12
+
+static uint8_t oled_i2c_buf[OLED_I2C_BUF_SIZE];
+static i2c_xfer_t oled_i2c_xfer[OLED_I2C_MAX_XFERS];
+static uint8_t oled_i2c_xfers;       // submitted, not yet waited on
+static uint16_t oled_i2c_used;       // bytes owned by submitted transfers
+static uint16_t seg_start;           // transfer currently being built
+static uint16_t seg_len;
+static uint8_t oled_i2c_failed;      // a transfer was lost since oled_i2c_sync()
+
+// Wait for every submitted transfer, then recycle the whole buffer
+static void oled_i2c_drain(void) {
+    for (uint8_t i = 0; i < oled_i2c_xfers; i++) {
+        if (i2c_bus_wait(&oled_i2c_xfer[i]) != I2C_OK) oled_i2c_failed = 1;
+    }
+    oled_i2c_xfers = 0;
+    oled_i2c_used = 0;
+}
+
+uint8_t oled_i2c_sync(void) {
+    uint8_t failed;
+
+    oled_i2c_drain();
+    failed = oled_i2c_failed;
+    oled_i2c_failed = 0;
+    return failed;
+}
 
 uint8_t u8x8_byte_hw_i2c_hal_stm32(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr) {
-    static uint8_t buffer[32];
-    static uint8_t buf_idx;
+    i2c_xfer_t *x;
 
     switch (msg) {
         case U8X8_MSG_BYTE_INIT:
@@ -11,18 +43,40 @@ uint8_t u8x8_byte_hw_i2c_hal_stm32(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, v
             return 1;
 
         case U8X8_MSG_BYTE_START_TRANSFER:
-            buf_idx = 0;
+            if (oled_i2c_xfers == OLED_I2C_MAX_XFERS) oled_i2c_drain();
+            seg_start = oled_i2c_used;
+            seg_len = 0;
             return 1;
 
         case U8X8_MSG_BYTE_SEND:
-            if ((buf_idx + arg_int) >= sizeof(buffer)) return 0;
-            memcpy(&buffer[buf_idx], (uint8_t *)arg_ptr, arg_int);
-            buf_idx += arg_int;
+            if (seg_start + seg_len + arg_int > sizeof(oled_i2c_buf)) {
+                // Out of room: let the bus catch up, then move the open
+                // transfer to the front of the buffer
+                oled_i2c_drain();
+                memmove(oled_i2c_buf, &oled_i2c_buf[seg_start], seg_len);
+                seg_start = 0;
+                if (seg_len + arg_int > sizeof(oled_i2c_buf)) return 0;
+            }
+            memcpy(&oled_i2c_buf[seg_start + seg_len], (uint8_t *)arg_ptr, arg_int);
+            seg_len += arg_int;
             return 1;
 
         case U8X8_MSG_BYTE_END_TRANSFER:
-            if (HAL_I2C_Master_Transmit(&hi2c1, u8x8_GetI2CAddress(u8x8), buffer, buf_idx, HAL_MAX_DELAY) != HAL_OK)
+            // Queue it and return; the bus manager ships it by DMA while the
+            // caller renders the next frame
+            x = &oled_i2c_xfer[oled_i2c_xfers];
+            x->op = I2C_OP_WRITE;
+            x->prio = I2C_PRIO_LOW;
+            x->addr = u8x8_GetI2CAddress(u8x8);
+            x->buf = &oled_i2c_buf[seg_start];
+            x->len = seg_len;
+            x->timeout_ms = I2C_BUS_TIMEOUT_MS;
+            if (i2c_bus_submit(x) == I2C_ERR_FULL) {
+                oled_i2c_failed = 1;
                 return 0;
+            }
+            oled_i2c_xfers++;
+            oled_i2c_used = seg_start + seg_len;
             return 1;
 
         case U8X8_MSG_BYTE_SET_DC:
@@ -33,3 +87,59 @@ uint8_t u8x8_byte_hw_i2c_hal_stm32(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, v
             return 0;
     }
 }
+
+// SSD13xx I2C command/data layer without the Arduino 24-byte chunking of
+// u8x8_cad_ssd13xx_fast_i2c. Commands are sent as Co=1 control byte pairs
+// and the data stream follows a single 0x40, so a complete DRAW_TILE
+// (position commands plus up to 128 data bytes) is one I2C transfer.
+#define CAD_IDLE   0
+#define CAD_CMD    1
+#define CAD_DATA   2
+
+uint8_t u8x8_cad_ssd13xx_i2c_dma(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr) {
+    static uint8_t state = CAD_IDLE;
+    uint8_t pair[2];
+
+    switch (msg) {
+        case U8X8_MSG_CAD_SEND_CMD:
+        case U8X8_MSG_CAD_SEND_ARG:
+            if (state == CAD_DATA) {
+                u8x8_byte_EndTransfer(u8x8);
+                state = CAD_IDLE;
+            }
+            if (state == CAD_IDLE) {
+                u8x8_byte_StartTransfer(u8x8);
+                state = CAD_CMD;
+            }
+            pair[0] = 0x80;     // Co=1, D/C#=0: one command byte follows
+            pair[1] = arg_int;
+            u8x8_byte_SendBytes(u8x8, 2, pair);
+            break;
+
+        case U8X8_MSG_CAD_SEND_DATA:
+            if (state == CAD_IDLE) u8x8_byte_StartTransfer(u8x8);
+            if (state != CAD_DATA) {
+                u8x8_byte_SendByte(u8x8, 0x40);   // Co=0, D/C#=1: data until STOP
+                state = CAD_DATA;
+            }
+            u8x8_byte_SendBytes(u8x8, arg_int, (uint8_t *)arg_ptr);
+            break;
+
+        case U8X8_MSG_CAD_INIT:
+            if (u8x8->i2c_address == 255) u8x8->i2c_address = 0x078;
+            return u8x8->byte_cb(u8x8, msg, arg_int, arg_ptr);
+
+        case U8X8_MSG_CAD_START_TRANSFER:
+            state = CAD_IDLE;
+            break;
+
+        case U8X8_MSG_CAD_END_TRANSFER:
+            if (state != CAD_IDLE) u8x8_byte_EndTransfer(u8x8);
+            state = CAD_IDLE;
+            break;
+
+        default:
+            return 0;
+    }
+    return 1;
+}
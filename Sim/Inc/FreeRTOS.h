@@ -0,0 +1,70 @@
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+// Host stand-in for the FreeRTOS kernel headers. Only the API the
+// application uses is declared; Sim/Src/sim_kernel.c implements it on
+// POSIX threads with one logical CPU (see sim.h). Configuration still comes
+// from Core/Inc/FreeRTOSConfig.h so tick rate, priorities and heap size
+// match the target.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "FreeRTOSConfig.h"
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define errQUEUE_EMPTY          ((BaseType_t)0)
+#define errQUEUE_FULL           ((BaseType_t)0)
+
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(x)        ((TickType_t)(((TickType_t)(x) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+// Storage for the *Static create functions; the kernel keeps its objects
+// inside these, so they must be at least as large as its structures
+typedef struct { void *p[24]; } StaticTask_t;
+typedef struct { void *p[16]; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+typedef struct { void *p[8]; } StaticStreamBuffer_t;
+typedef struct { void *p[4]; } StaticEventGroup_t;
+
+#ifndef configUSE_TICKLESS_IDLE
+#define configUSE_TICKLESS_IDLE                 0
+#endif
+#ifndef configEXPECTED_IDLE_TIME_BEFORE_SLEEP
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP   2
+#endif
+
+#undef configASSERT
+#define configASSERT(x)         do { if ((x) == 0) vAssertCalled(__FILE__, __LINE__); } while (0)
+void vAssertCalled(const char *file, int line);
+
+// Interrupts are threads in the simulator, critical sections lock them out
+#define portYIELD_FROM_ISR(x)           vPortYieldFromISR(x)
+#define portEND_SWITCHING_ISR(x)        vPortYieldFromISR(x)
+#define taskENTER_CRITICAL()            vPortEnterCritical()
+#define taskEXIT_CRITICAL()             vPortExitCritical()
+#define taskENTER_CRITICAL_FROM_ISR()   ulPortSetInterruptMask()
+#define taskEXIT_CRITICAL_FROM_ISR(x)   vPortClearInterruptMask(x)
+#define taskDISABLE_INTERRUPTS()        vPortEnterCritical()
+
+void vPortYieldFromISR(BaseType_t woken);
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+UBaseType_t ulPortSetInterruptMask(void);
+void vPortClearInterruptMask(UBaseType_t mask);
+
+// heap_4 accounting against configTOTAL_HEAP_SIZE
+void *pvPortMalloc(size_t size);
+void vPortFree(void *p);
+size_t xPortGetFreeHeapSize(void);
+size_t xPortGetMinimumEverFreeHeapSize(void);
+
+#endif // INC_FREERTOS_H
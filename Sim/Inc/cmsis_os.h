@@ -0,0 +1,13 @@
+#ifndef CMSIS_OS_H_
+#define CMSIS_OS_H_
+
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+
+// Static allocation types, as in the CMSIS-RTOS2 wrapper's cmsis_os.h
+typedef StaticTask_t osStaticThreadDef_t;
+typedef StaticQueue_t osStaticMessageQDef_t;
+typedef StaticSemaphore_t osStaticMutexDef_t;
+typedef StaticSemaphore_t osStaticSemaphoreDef_t;
+
+#endif // CMSIS_OS_H_
@@ -0,0 +1,56 @@
+#ifndef CMSIS_OS2_H_
+#define CMSIS_OS2_H_
+
+// CMSIS-RTOS2 subset used by the CubeMX generated code, mapped onto the
+// simulated FreeRTOS kernel the same way cmsis_os2.c does on the target
+// (osPriority values are FreeRTOS priorities).
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+    osOK = 0, osError = -1, osErrorTimeout = -2, osErrorResource = -3,
+    osErrorParameter = -4, osErrorNoMemory = -5, osErrorISR = -6,
+} osStatus_t;
+
+typedef void *osThreadId_t;
+typedef void *osMessageQueueId_t;
+typedef void (*osThreadFunc_t)(void *argument);
+
+typedef enum {
+    osPriorityNone = 0, osPriorityIdle = 1, osPriorityLow = 8, osPriorityBelowNormal = 16,
+    osPriorityNormal = 24, osPriorityAboveNormal = 32, osPriorityHigh = 40,
+    osPriorityRealtime = 48, osPriorityISR = 56,
+} osPriority_t;
+
+typedef struct {
+    const char *name;
+    uint32_t attr_bits;
+    void *cb_mem;
+    uint32_t cb_size;
+    void *stack_mem;
+    uint32_t stack_size;
+    osPriority_t priority;
+    uint32_t tz_module;
+    uint32_t reserved;
+} osThreadAttr_t;
+
+typedef struct {
+    const char *name;
+    uint32_t attr_bits;
+    void *cb_mem;
+    uint32_t cb_size;
+    void *mq_mem;
+    uint32_t mq_size;
+} osMessageQueueAttr_t;
+
+osStatus_t osKernelInitialize(void);
+osStatus_t osKernelStart(void);
+uint32_t osKernelGetTickCount(void);
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr);
+osStatus_t osDelay(uint32_t ticks);
+osMessageQueueId_t osMessageQueueNew(uint32_t count, uint32_t size, const osMessageQueueAttr_t *attr);
+osStatus_t osMessageQueuePut(osMessageQueueId_t q, const void *msg, uint8_t prio, uint32_t timeout);
+osStatus_t osMessageQueueGet(osMessageQueueId_t q, void *msg, uint8_t *prio, uint32_t timeout);
+
+#endif // CMSIS_OS2_H_
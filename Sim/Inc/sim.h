@@ -0,0 +1,49 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+// Host simulation of the Garden_mon board.
+//
+// The firmware runs unmodified on top of stand-in FreeRTOS and HAL headers.
+// There is one logical CPU: every task is a POSIX thread, but only the one
+// holding the CPU runs and the scheduler hands the CPU over at kernel calls,
+// HAL calls and tick boundaries, following FreeRTOS priority rules.
+// Interrupts are threads too (tick, UART receiver, device timers); an
+// interrupt takes the CPU at the next such point, runs its handler with
+// __get_IPSR() != 0 and returns it. Before the scheduler starts they stay
+// pending, the way the RTOS masks them on the target.
+//
+// Time is wall-clock time: the RTOS tick and HAL_GetTick follow the
+// monotonic clock, and peripheral transfers take as long as they would on
+// the wire at the configured clocks.
+
+// Kernel side, for the peripheral models
+void sim_kernel_init(void);
+void sim_isr_enter(void);               // from a device thread: take the CPU
+void sim_isr_exit(void);
+int sim_in_isr(void);
+void sim_yield_point(void);             // let pending interrupts and switches happen
+void sim_busy_wait_us(uint32_t us);     // CPU busy for us, interrupts still served
+uint64_t sim_time_us(void);             // since sim_kernel_init
+
+// Device timers: fn runs in interrupt context after delay_us
+typedef void (*sim_event_fn)(void *arg);
+void sim_event_init(void);
+void sim_event_schedule(uint32_t delay_us, sim_event_fn fn, void *arg);
+void sim_event_cancel(sim_event_fn fn, void *arg);
+
+// Low-power modes: the core is in STOP (clocks off, only EXTI wake-ups)
+int sim_power_stopped(void);
+
+// Board wiring
+void sim_gpio_set_input(void *port, uint16_t pin, int level);   // drive a pin from outside
+void sim_uart_init(void);
+void sim_i2c_init(void);
+
+// SPI NOR flash on SPI1, selected by FLASH_CS; file backed, see sim_flash.c
+void sim_flash_init(void);
+void sim_flash_select(int selected);
+uint8_t sim_flash_xfer(uint8_t mosi);
+
+#endif // SIM_H
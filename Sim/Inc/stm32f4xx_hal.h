@@ -0,0 +1,715 @@
+#ifndef STM32F4XX_HAL_H
+#define STM32F4XX_HAL_H
+
+// Host stand-in for the STM32F4 HAL. Types, constants and prototypes follow
+// the real driver closely enough for the CubeMX generated files and the
+// application to compile unchanged. Peripheral instances are plain structs
+// in the simulator; the register fields that exist are the ones the
+// peripheral models in Sim/Src act on.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+typedef enum { RESET = 0, SET = !RESET } FlagStatus, ITStatus;
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+
+#define HAL_MAX_DELAY       0xFFFFFFFFU
+#define __IO                volatile
+#define UNUSED(x)           ((void)(x))
+
+// --- Core ---
+
+extern uint32_t SystemCoreClock;
+
+HAL_StatusTypeDef HAL_Init(void);
+void HAL_MspInit(void);
+uint32_t HAL_GetTick(void);
+typedef enum { HAL_TICK_FREQ_10HZ = 100U, HAL_TICK_FREQ_100HZ = 10U, HAL_TICK_FREQ_1KHZ = 1U } HAL_TickFreqTypeDef;
+// HAL_GetTick follows the host clock; uwTick is kept only for code that steps it
+extern volatile uint32_t uwTick;
+extern HAL_TickFreqTypeDef uwTickFreq;
+void HAL_IncTick(void);
+void HAL_Delay(uint32_t ms);
+
+typedef enum {
+    NonMaskableInt_IRQn = -14, SVCall_IRQn = -5, PendSV_IRQn = -2, SysTick_IRQn = -1,
+    EXTI9_5_IRQn = 23, TIM1_CC_IRQn = 27, I2C1_EV_IRQn = 31, I2C1_ER_IRQn = 32,
+    EXTI15_10_IRQn = 40, DMA1_Stream0_IRQn = 11, DMA1_Stream5_IRQn = 16, DMA1_Stream6_IRQn = 17,
+    DMA1_Stream7_IRQn = 47, DMA2_Stream0_IRQn = 56, DMA2_Stream1_IRQn = 57,
+    DMA2_Stream2_IRQn = 58, DMA2_Stream3_IRQn = 59, DMA2_Stream6_IRQn = 69,
+    SPI1_IRQn = 35, USART6_IRQn = 71, ADC_IRQn = 18, LPTIM1_IRQn = 97,
+} IRQn_Type;
+
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub);
+void HAL_NVIC_EnableIRQ(IRQn_Type irq);
+void HAL_NVIC_DisableIRQ(IRQn_Type irq);
+void HAL_NVIC_ClearPendingIRQ(IRQn_Type irq);
+// Ends the simulation with exit status 4
+void NVIC_SystemReset(void) __attribute__((noreturn));
+
+// Cortex-M intrinsics. __get_IPSR reads non-zero inside simulated
+// interrupt handlers, like the exception number on the target. PRIMASK
+// keeps interrupts out like a critical section; __WFI waits for one, and
+// with PRIMASK set returns without running it.
+uint32_t __get_IPSR(void);
+void __disable_irq(void);
+void __enable_irq(void);
+void sim_wfi(void);
+#define __DMB()             __sync_synchronize()
+#define __DSB()             __sync_synchronize()
+#define __ISB()             __sync_synchronize()
+#define __WFI()             sim_wfi()
+#define __NOP()             ((void)0)
+
+// SysTick drives the RTOS tick (see sim_kernel.c): the period follows LOAD
+// and SystemCoreClock, VAL reads the cycles left and a write to it restarts
+// the period. SCB only has the SysTick pending bits.
+typedef struct { volatile uint32_t CTRL, LOAD, VAL, CALIB; } SysTick_Type;
+typedef struct { volatile uint32_t ICSR, SCR; } SCB_Type;
+SysTick_Type *sim_systick(void);
+SCB_Type *sim_scb(void);
+#define SysTick                     (sim_systick())
+#define SCB                         (sim_scb())
+#define SysTick_CTRL_ENABLE_Msk     (1UL << 0)
+#define SysTick_CTRL_TICKINT_Msk    (1UL << 1)
+#define SysTick_CTRL_CLKSOURCE_Msk  (1UL << 2)
+#define SysTick_CTRL_COUNTFLAG_Msk  (1UL << 16)
+#define SCB_ICSR_PENDSTCLR_Msk      (1UL << 25)
+#define SCB_ICSR_PENDSTSET_Msk      (1UL << 26)
+
+// Debug block. DWT->CYCCNT counts SystemCoreClock cycles of host time
+// while enabled; writes to it take effect like on the target.
+typedef struct { volatile uint32_t DEMCR; } CoreDebug_Type;
+typedef struct { volatile uint32_t CTRL, CYCCNT; } DWT_Type;
+extern CoreDebug_Type sim_coredebug;
+DWT_Type *sim_dwt(void);
+#define CoreDebug                   (&sim_coredebug)
+#define DWT                         (sim_dwt())
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+
+// --- RCC / PWR / FLASH ---
+
+typedef struct { uint32_t PLLState, PLLSource, PLLM, PLLN, PLLP, PLLQ, PLLR; } RCC_PLLInitTypeDef;
+typedef struct {
+    uint32_t OscillatorType, HSEState, LSEState, HSIState, HSICalibrationValue, LSIState;
+    RCC_PLLInitTypeDef PLL;
+} RCC_OscInitTypeDef;
+typedef struct {
+    uint32_t ClockType, SYSCLKSource, AHBCLKDivider, APB1CLKDivider, APB2CLKDivider;
+} RCC_ClkInitTypeDef;
+
+#define RCC_OSCILLATORTYPE_NONE     0x00U
+#define RCC_OSCILLATORTYPE_HSE      0x01U
+#define RCC_OSCILLATORTYPE_HSI      0x02U
+#define RCC_OSCILLATORTYPE_LSE      0x04U
+#define RCC_OSCILLATORTYPE_LSI      0x08U
+#define RCC_HSE_OFF                 0x00U
+#define RCC_HSE_ON                  0x01U
+#define RCC_HSI_OFF                 0x00U
+#define RCC_HSI_ON                  0x01U
+#define RCC_LSI_OFF                 0x00U
+#define RCC_LSI_ON                  0x01U
+#define RCC_HSICALIBRATION_DEFAULT  0x10U
+#define RCC_PLL_NONE                0x00U
+#define RCC_PLL_OFF                 0x01U
+#define RCC_PLL_ON                  0x02U
+#define RCC_PLLSOURCE_HSI           0x00000000U
+#define RCC_PLLSOURCE_HSE           0x00400000U
+#define RCC_PLLP_DIV2               0x02U
+#define RCC_PLLP_DIV4               0x04U
+#define RCC_PLLP_DIV6               0x06U
+#define RCC_PLLP_DIV8               0x08U
+
+#define RCC_CLOCKTYPE_SYSCLK        0x01U
+#define RCC_CLOCKTYPE_HCLK          0x02U
+#define RCC_CLOCKTYPE_PCLK1         0x04U
+#define RCC_CLOCKTYPE_PCLK2         0x08U
+#define RCC_SYSCLKSOURCE_HSI        0x00U
+#define RCC_SYSCLKSOURCE_HSE        0x01U
+#define RCC_SYSCLKSOURCE_PLLCLK     0x02U
+#define RCC_SYSCLK_DIV1             0x00U
+#define RCC_SYSCLK_DIV2             0x80U
+#define RCC_SYSCLK_DIV4             0x90U
+#define RCC_SYSCLK_DIV8             0xA0U
+#define RCC_SYSCLK_DIV16            0xB0U
+#define RCC_HCLK_DIV1               0x0000U
+#define RCC_HCLK_DIV2               0x1000U
+#define RCC_HCLK_DIV4               0x1400U
+#define RCC_HCLK_DIV8               0x1800U
+#define RCC_HCLK_DIV16              0x1C00U
+
+#define FLASH_LATENCY_0             0U
+#define FLASH_LATENCY_1             1U
+#define FLASH_LATENCY_2             2U
+#define FLASH_LATENCY_3             3U
+
+// Flash interface: wait states and the ART accelerator. HAL_RCC_ClockConfig
+// writes the latency; running faster than it allows is reported.
+typedef struct { volatile uint32_t ACR; } FLASH_TypeDef;
+extern FLASH_TypeDef sim_flash_if;
+#define FLASH                               (&sim_flash_if)
+#define FLASH_ACR_LATENCY                   0x0FU
+#define FLASH_ACR_PRFTEN                    (1UL << 8)
+#define FLASH_ACR_ICEN                      (1UL << 9)
+#define FLASH_ACR_DCEN                      (1UL << 10)
+#define __HAL_FLASH_GET_LATENCY()           (FLASH->ACR & FLASH_ACR_LATENCY)
+#define __HAL_FLASH_PREFETCH_BUFFER_ENABLE()    (FLASH->ACR |= FLASH_ACR_PRFTEN)
+#define __HAL_FLASH_PREFETCH_BUFFER_DISABLE()   (FLASH->ACR &= ~FLASH_ACR_PRFTEN)
+#define __HAL_FLASH_INSTRUCTION_CACHE_ENABLE()  (FLASH->ACR |= FLASH_ACR_ICEN)
+#define __HAL_FLASH_DATA_CACHE_ENABLE()         (FLASH->ACR |= FLASH_ACR_DCEN)
+
+#define PWR_REGULATOR_VOLTAGE_SCALE1    0xC000U
+#define PWR_REGULATOR_VOLTAGE_SCALE2    0x8000U
+#define PWR_REGULATOR_VOLTAGE_SCALE3    0x4000U
+
+#define PWR_MAINREGULATOR_ON        0x00U
+#define PWR_LOWPOWERREGULATOR_ON    0x01U
+#define PWR_SLEEPENTRY_WFI          0x01U
+#define PWR_STOPENTRY_WFI           0x01U
+
+#define LSI_VALUE                   32000U
+#define RCC_LPTIM1CLKSOURCE_LSI     0x40000000U
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *osc);
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *clk, uint32_t latency);
+void HAL_RCC_GetOscConfig(RCC_OscInitTypeDef *osc);
+void HAL_RCC_GetClockConfig(RCC_ClkInitTypeDef *clk, uint32_t *latency);
+uint32_t HAL_RCC_GetSysClockFreq(void);
+uint32_t HAL_RCC_GetHCLKFreq(void);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+
+// Called by HAL_RCC_ClockConfig, as on the target, to re-time SysTick for
+// the new HCLK
+extern uint32_t uwTickPrio;
+HAL_StatusTypeDef HAL_InitTick(uint32_t prio);
+
+// STOP stops every clock but the LSI until an armed EXTI line or interrupt
+// fires, then continues on the HSI; SLEEP only stops the core
+void HAL_PWR_EnterSTOPMode(uint32_t regulator, uint8_t entry);
+void HAL_PWR_EnterSLEEPMode(uint32_t regulator, uint8_t entry);
+void HAL_PWREx_EnableFlashPowerDown(void);
+void HAL_PWREx_EnableLowRegulatorLowVoltage(void);
+
+extern uint32_t sim_pwr_vos;
+#define __HAL_PWR_VOLTAGESCALING_CONFIG(x)  (sim_pwr_vos = (x))
+#define __HAL_RCC_PWR_CLK_ENABLE()          ((void)0)
+#define __HAL_RCC_SYSCFG_CLK_ENABLE()       ((void)0)
+#define __HAL_RCC_GPIOA_CLK_ENABLE()        ((void)0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()        ((void)0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()        ((void)0)
+#define __HAL_RCC_GPIOH_CLK_ENABLE()        ((void)0)
+#define __HAL_RCC_DMA1_CLK_ENABLE()         ((void)0)
+#define __HAL_RCC_DMA2_CLK_ENABLE()         ((void)0)
+#define __HAL_RCC_ADC1_CLK_ENABLE()         ((void)0)
+#define __HAL_RCC_ADC1_CLK_DISABLE()        ((void)0)
+#define __HAL_RCC_I2C1_CLK_ENABLE()         ((void)0)
+#define __HAL_RCC_I2C1_CLK_DISABLE()        ((void)0)
+#define __HAL_RCC_SPI1_CLK_ENABLE()         ((void)0)
+#define __HAL_RCC_SPI1_CLK_DISABLE()        ((void)0)
+#define __HAL_RCC_SPI2_CLK_ENABLE()         ((void)0)
+#define __HAL_RCC_SPI2_CLK_DISABLE()        ((void)0)
+#define __HAL_RCC_USART6_CLK_ENABLE()       ((void)0)
+#define __HAL_RCC_USART6_CLK_DISABLE()      ((void)0)
+#define __HAL_RCC_TIM1_CLK_ENABLE()         ((void)0)
+#define __HAL_RCC_TIM1_CLK_DISABLE()        ((void)0)
+#define __HAL_RCC_LPTIM1_CLK_ENABLE()       ((void)0)
+#define __HAL_RCC_LPTIM1_CONFIG(x)          ((void)(x))
+
+// --- EXTI / SYSCFG ---
+
+// Mask and edge registers only; PR is write-one-to-clear on the target
+// and nothing in the models reads it back
+typedef struct { volatile uint32_t IMR, EMR, RTSR, FTSR, SWIER, PR; } EXTI_TypeDef;
+typedef struct { volatile uint32_t MEMRMP, PMC, EXTICR[4], CMPCR; } SYSCFG_TypeDef;
+extern EXTI_TypeDef sim_exti;
+extern SYSCFG_TypeDef sim_syscfg;
+#define EXTI                        (&sim_exti)
+#define SYSCFG                      (&sim_syscfg)
+#define SYSCFG_EXTICR4_EXTI12       0x000FU
+
+// --- LPTIM1 ---
+//
+// Counts at SIM_LSI_HZ (default 32000) while enabled and started. Register
+// writes take effect at the next access, like the delayed APB writes of
+// the real one; CMPOK/ARROK are set at once.
+typedef struct { volatile uint32_t ISR, ICR, IER, CFGR, CR, CMP, ARR, CNT; } LPTIM_TypeDef;
+LPTIM_TypeDef *sim_lptim1(void);
+#define LPTIM1                      (sim_lptim1())
+#define LPTIM_ISR_CMPM              (1UL << 0)
+#define LPTIM_ISR_ARRM              (1UL << 1)
+#define LPTIM_ISR_CMPOK             (1UL << 3)
+#define LPTIM_ISR_ARROK             (1UL << 4)
+#define LPTIM_ICR_CMPMCF            (1UL << 0)
+#define LPTIM_ICR_ARRMCF            (1UL << 1)
+#define LPTIM_ICR_CMPOKCF           (1UL << 3)
+#define LPTIM_ICR_ARROKCF           (1UL << 4)
+#define LPTIM_IER_CMPMIE            (1UL << 0)
+#define LPTIM_IER_ARRMIE            (1UL << 1)
+#define LPTIM_CR_ENABLE             (1UL << 0)
+#define LPTIM_CR_SNGSTRT            (1UL << 1)
+#define LPTIM_CR_CNTSTRT            (1UL << 2)
+
+// --- GPIO ---
+
+typedef struct {
+    volatile uint32_t MODER;        // 1 bit per pin: driven by the MCU
+    volatile uint32_t IDR;          // level on the pin from outside
+    volatile uint32_t ODR;
+    uint32_t EXTI_FALLING;          // pins with a falling edge interrupt
+    uint32_t EXTI_RISING;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef sim_gpio[3];
+#define GPIOA   (&sim_gpio[0])
+#define GPIOB   (&sim_gpio[1])
+#define GPIOC   (&sim_gpio[2])
+
+typedef enum { GPIO_PIN_RESET = 0, GPIO_PIN_SET } GPIO_PinState;
+typedef struct { uint32_t Pin, Mode, Pull, Speed, Alternate; } GPIO_InitTypeDef;
+
+#define GPIO_PIN_0      0x0001U
+#define GPIO_PIN_1      0x0002U
+#define GPIO_PIN_2      0x0004U
+#define GPIO_PIN_3      0x0008U
+#define GPIO_PIN_4      0x0010U
+#define GPIO_PIN_5      0x0020U
+#define GPIO_PIN_6      0x0040U
+#define GPIO_PIN_7      0x0080U
+#define GPIO_PIN_8      0x0100U
+#define GPIO_PIN_9      0x0200U
+#define GPIO_PIN_10     0x0400U
+#define GPIO_PIN_11     0x0800U
+#define GPIO_PIN_12     0x1000U
+#define GPIO_PIN_13     0x2000U
+#define GPIO_PIN_14     0x4000U
+#define GPIO_PIN_15     0x8000U
+#define GPIO_PIN_All    0xFFFFU
+
+#define GPIO_MODE_INPUT             0x00000000U
+#define GPIO_MODE_OUTPUT_PP         0x00000001U
+#define GPIO_MODE_OUTPUT_OD         0x00000011U
+#define GPIO_MODE_AF_PP             0x00000002U
+#define GPIO_MODE_AF_OD             0x00000012U
+#define GPIO_MODE_ANALOG            0x00000003U
+#define GPIO_MODE_IT_RISING         0x10110000U
+#define GPIO_MODE_IT_FALLING        0x10210000U
+#define GPIO_MODE_IT_RISING_FALLING 0x10310000U
+#define GPIO_NOPULL                 0x00U
+#define GPIO_PULLUP                 0x01U
+#define GPIO_PULLDOWN               0x02U
+#define GPIO_SPEED_FREQ_LOW         0x00U
+#define GPIO_SPEED_FREQ_MEDIUM      0x01U
+#define GPIO_SPEED_FREQ_HIGH        0x02U
+#define GPIO_SPEED_FREQ_VERY_HIGH   0x03U
+#define GPIO_AF4_I2C1               0x04U
+#define GPIO_AF5_SPI1               0x05U
+#define GPIO_AF5_SPI2               0x05U
+#define GPIO_AF8_USART6             0x08U
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init);
+void HAL_GPIO_DeInit(GPIO_TypeDef *port, uint32_t pin);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state);
+void HAL_GPIO_TogglePin(GPIO_TypeDef *port, uint16_t pin);
+void HAL_GPIO_EXTI_IRQHandler(uint16_t pin);
+void HAL_GPIO_EXTI_Callback(uint16_t pin);
+
+// --- DMA ---
+
+typedef struct {
+    volatile uint32_t CR;
+    volatile uint32_t NDTR;         // items left in the current transfer
+} DMA_Stream_TypeDef;
+
+extern DMA_Stream_TypeDef sim_dma1[8], sim_dma2[8];
+#define DMA1_Stream0    (&sim_dma1[0])
+#define DMA1_Stream5    (&sim_dma1[5])
+#define DMA1_Stream6    (&sim_dma1[6])
+#define DMA1_Stream7    (&sim_dma1[7])
+#define DMA2_Stream0    (&sim_dma2[0])
+#define DMA2_Stream1    (&sim_dma2[1])
+#define DMA2_Stream2    (&sim_dma2[2])
+#define DMA2_Stream3    (&sim_dma2[3])
+#define DMA2_Stream6    (&sim_dma2[6])
+
+typedef struct {
+    uint32_t Channel, Direction, PeriphInc, MemInc, PeriphDataAlignment, MemDataAlignment;
+    uint32_t Mode, Priority, FIFOMode, FIFOThreshold, MemBurst, PeriphBurst;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef {
+    DMA_Stream_TypeDef *Instance;
+    DMA_InitTypeDef Init;
+    void *Parent;
+} DMA_HandleTypeDef;
+
+#define DMA_CHANNEL_0           0x00000000U
+#define DMA_CHANNEL_1           0x02000000U
+#define DMA_CHANNEL_3           0x06000000U
+#define DMA_CHANNEL_5           0x0A000000U
+#define DMA_PERIPH_TO_MEMORY    0x00000000U
+#define DMA_MEMORY_TO_PERIPH    0x00000040U
+#define DMA_PINC_DISABLE        0x00000000U
+#define DMA_MINC_ENABLE         0x00000400U
+#define DMA_PDATAALIGN_BYTE     0x00000000U
+#define DMA_PDATAALIGN_HALFWORD 0x00000800U
+#define DMA_PDATAALIGN_WORD     0x00001000U
+#define DMA_MDATAALIGN_BYTE     0x00000000U
+#define DMA_MDATAALIGN_HALFWORD 0x00002000U
+#define DMA_MDATAALIGN_WORD     0x00004000U
+#define DMA_NORMAL              0x00000000U
+#define DMA_CIRCULAR            0x00000100U
+#define DMA_PRIORITY_LOW        0x00000000U
+#define DMA_PRIORITY_MEDIUM     0x00010000U
+#define DMA_PRIORITY_HIGH       0x00020000U
+#define DMA_PRIORITY_VERY_HIGH  0x00030000U
+#define DMA_FIFOMODE_DISABLE    0x00000000U
+#define DMA_IT_HT               0x00000008U
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+
+#define __HAL_DMA_GET_COUNTER(h)        ((h)->Instance->NDTR)
+#define __HAL_DMA_DISABLE_IT(h, it)     ((void)(h))
+#define __HAL_LINKDMA(h, field, dma)    do { (h)->field = &(dma); (dma).Parent = (h); } while (0)
+
+// --- ADC ---
+
+typedef struct { volatile uint32_t SR, DR; } ADC_TypeDef;
+extern ADC_TypeDef sim_adc1;
+#define ADC1    (&sim_adc1)
+
+typedef struct {
+    uint32_t ClockPrescaler, Resolution, DataAlign, ScanConvMode, EOCSelection;
+    FunctionalState ContinuousConvMode;
+    uint32_t NbrOfConversion;
+    FunctionalState DiscontinuousConvMode;
+    uint32_t NbrOfDiscConversion, ExternalTrigConv, ExternalTrigConvEdge;
+    FunctionalState DMAContinuousRequests;
+} ADC_InitTypeDef;
+
+typedef struct __ADC_HandleTypeDef {
+    ADC_TypeDef *Instance;
+    ADC_InitTypeDef Init;
+    DMA_HandleTypeDef *DMA_Handle;
+    volatile uint32_t State;
+    volatile uint32_t ErrorCode;
+} ADC_HandleTypeDef;
+
+typedef struct { uint32_t Channel, Rank, SamplingTime, Offset; } ADC_ChannelConfTypeDef;
+
+#define ADC_CHANNEL_0                   0x00U
+#define ADC_CHANNEL_1                   0x01U
+#define ADC_CHANNEL_2                   0x02U
+#define ADC_CHANNEL_3                   0x03U
+#define ADC_SAMPLETIME_3CYCLES          0x00U
+#define ADC_SAMPLETIME_15CYCLES         0x01U
+#define ADC_SAMPLETIME_28CYCLES         0x02U
+#define ADC_SAMPLETIME_56CYCLES         0x03U
+#define ADC_SAMPLETIME_84CYCLES         0x04U
+#define ADC_SAMPLETIME_112CYCLES        0x05U
+#define ADC_SAMPLETIME_144CYCLES        0x06U
+#define ADC_SAMPLETIME_480CYCLES        0x07U
+#define ADC_CLOCK_SYNC_PCLK_DIV2        0x00000000U
+#define ADC_CLOCK_SYNC_PCLK_DIV4        0x00010000U
+#define ADC_CLOCK_SYNC_PCLK_DIV6        0x00020000U
+#define ADC_CLOCK_SYNC_PCLK_DIV8        0x00030000U
+#define ADC_RESOLUTION_12B              0x00000000U
+#define ADC_DATAALIGN_RIGHT             0x00000000U
+#define ADC_EXTERNALTRIGCONVEDGE_NONE   0x00000000U
+#define ADC_EXTERNALTRIGCONVEDGE_RISING 0x10000000U
+#define ADC_EXTERNALTRIGCONV_T1_CC1     0x00000000U
+#define ADC_SOFTWARE_START              0x0F000001U
+#define ADC_EOC_SEQ_CONV                0x00000000U
+#define ADC_EOC_SINGLE_CONV             0x00000001U
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADC_DeInit(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *hadc, ADC_ChannelConfTypeDef *conf);
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *buf, uint32_t len);
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc);
+void HAL_ADC_MspInit(ADC_HandleTypeDef *hadc);
+void HAL_ADC_MspDeInit(ADC_HandleTypeDef *hadc);
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc);
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc);
+void HAL_ADC_ErrorCallback(ADC_HandleTypeDef *hadc);
+
+// --- TIM ---
+
+typedef struct {
+    volatile uint32_t CR1, PSC, ARR;
+    volatile uint32_t CCR1, CCR2, CCR3, CCR4;
+} TIM_TypeDef;
+
+extern TIM_TypeDef sim_tim1;
+#define TIM1    (&sim_tim1)
+
+typedef struct {
+    uint32_t Prescaler, CounterMode, Period, ClockDivision, RepetitionCounter, AutoReloadPreload;
+} TIM_Base_InitTypeDef;
+
+typedef struct {
+    TIM_TypeDef *Instance;
+    TIM_Base_InitTypeDef Init;
+    volatile uint32_t State;
+} TIM_HandleTypeDef;
+
+typedef struct { uint32_t ClockSource, ClockPolarity, ClockPrescaler, ClockFilter; } TIM_ClockConfigTypeDef;
+typedef struct { uint32_t MasterOutputTrigger, MasterSlaveMode; } TIM_MasterConfigTypeDef;
+typedef struct {
+    uint32_t OCMode, Pulse, OCPolarity, OCNPolarity, OCFastMode, OCIdleState, OCNIdleState;
+} TIM_OC_InitTypeDef;
+
+#define TIM_COUNTERMODE_UP              0x00U
+#define TIM_CLOCKDIVISION_DIV1          0x00U
+#define TIM_AUTORELOAD_PRELOAD_DISABLE  0x00U
+#define TIM_AUTORELOAD_PRELOAD_ENABLE   0x80U
+#define TIM_CLOCKSOURCE_INTERNAL        0x1000U
+#define TIM_TRGO_RESET                  0x00U
+#define TIM_MASTERSLAVEMODE_DISABLE     0x00U
+#define TIM_OCMODE_PWM1                 0x60U
+#define TIM_OCPOLARITY_HIGH             0x00U
+#define TIM_OCNPOLARITY_HIGH            0x00U
+#define TIM_OCFAST_DISABLE              0x00U
+#define TIM_OCIDLESTATE_RESET           0x00U
+#define TIM_OCNIDLESTATE_RESET          0x00U
+#define TIM_CHANNEL_1                   0x00U
+#define TIM_CHANNEL_2                   0x04U
+#define TIM_CHANNEL_3                   0x08U
+#define TIM_CHANNEL_4                   0x0CU
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim, TIM_ClockConfigTypeDef *conf);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim,
+                                                        TIM_MasterConfigTypeDef *conf);
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef *htim, TIM_OC_InitTypeDef *conf,
+                                            uint32_t channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t channel);
+void HAL_TIM_Base_MspInit(TIM_HandleTypeDef *htim);
+void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef *htim);
+void HAL_TIM_MspPostInit(TIM_HandleTypeDef *htim);
+
+#define __HAL_TIM_SET_PRESCALER(h, v)       ((h)->Instance->PSC = (v))
+#define __HAL_TIM_SET_AUTORELOAD(h, v)      do { (h)->Instance->ARR = (v); (h)->Init.Period = (v); } while (0)
+#define __HAL_TIM_SET_COMPARE(h, ch, v)     (*(&(h)->Instance->CCR1 + ((ch) >> 2)) = (v))
+
+// --- I2C ---
+
+typedef struct { volatile uint32_t CR1, SR1; } I2C_TypeDef;
+extern I2C_TypeDef sim_i2c1;
+#define I2C1    (&sim_i2c1)
+
+typedef struct {
+    uint32_t ClockSpeed, DutyCycle, OwnAddress1, AddressingMode, DualAddressMode;
+    uint32_t OwnAddress2, GeneralCallMode, NoStretchMode;
+} I2C_InitTypeDef;
+
+typedef enum {
+    HAL_I2C_STATE_RESET = 0x00U, HAL_I2C_STATE_READY = 0x20U, HAL_I2C_STATE_BUSY = 0x24U,
+    HAL_I2C_STATE_BUSY_TX = 0x21U, HAL_I2C_STATE_BUSY_RX = 0x22U, HAL_I2C_STATE_ABORT = 0x60U,
+    HAL_I2C_STATE_ERROR = 0xE0U,
+} HAL_I2C_StateTypeDef;
+
+typedef struct __I2C_HandleTypeDef {
+    I2C_TypeDef *Instance;
+    I2C_InitTypeDef Init;
+    uint8_t *pBuffPtr;
+    uint16_t XferSize;
+    volatile uint16_t XferCount;
+    DMA_HandleTypeDef *hdmatx, *hdmarx;
+    volatile HAL_I2C_StateTypeDef State;
+    volatile uint32_t ErrorCode;
+} I2C_HandleTypeDef;
+
+#define I2C_DUTYCYCLE_2             0x0000U
+#define I2C_DUTYCYCLE_16_9          0x4000U
+#define I2C_ADDRESSINGMODE_7BIT     0x4000U
+#define I2C_DUALADDRESS_DISABLE     0x0000U
+#define I2C_GENERALCALL_DISABLE     0x0000U
+#define I2C_NOSTRETCH_DISABLE       0x0000U
+#define I2C_MEMADD_SIZE_8BIT        0x0001U
+#define I2C_MEMADD_SIZE_16BIT       0x0010U
+#define HAL_I2C_ERROR_NONE          0x00U
+#define HAL_I2C_ERROR_BERR          0x01U
+#define HAL_I2C_ERROR_ARLO          0x02U
+#define HAL_I2C_ERROR_AF            0x04U
+#define HAL_I2C_ERROR_TIMEOUT       0x20U
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                          uint16_t len, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                         uint16_t len, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                    uint16_t reg_size, uint8_t *data, uint16_t len, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                   uint16_t reg_size, uint8_t *data, uint16_t len, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t addr, uint32_t trials,
+                                        uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                             uint16_t len);
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                            uint16_t len);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                              uint16_t len);
+HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                             uint16_t len);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                       uint16_t reg_size, uint8_t *data, uint16_t len);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                      uint16_t reg_size, uint8_t *data, uint16_t len);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                        uint16_t reg_size, uint8_t *data, uint16_t len);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                       uint16_t reg_size, uint8_t *data, uint16_t len);
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c);
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MspInit(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MspDeInit(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+// --- SPI ---
+
+typedef struct { volatile uint32_t CR1, SR, DR; } SPI_TypeDef;
+extern SPI_TypeDef sim_spi1, sim_spi2;
+#define SPI1    (&sim_spi1)
+#define SPI2    (&sim_spi2)
+
+typedef struct {
+    uint32_t Mode, Direction, DataSize, CLKPolarity, CLKPhase, NSS, BaudRatePrescaler;
+    uint32_t FirstBit, TIMode, CRCCalculation, CRCPolynomial;
+} SPI_InitTypeDef;
+
+typedef enum {
+    HAL_SPI_STATE_RESET = 0x00U, HAL_SPI_STATE_READY = 0x01U, HAL_SPI_STATE_BUSY = 0x02U,
+    HAL_SPI_STATE_BUSY_TX = 0x03U, HAL_SPI_STATE_BUSY_RX = 0x04U, HAL_SPI_STATE_BUSY_TX_RX = 0x05U,
+    HAL_SPI_STATE_ERROR = 0x06U, HAL_SPI_STATE_ABORT = 0x07U,
+} HAL_SPI_StateTypeDef;
+
+typedef struct __SPI_HandleTypeDef {
+    SPI_TypeDef *Instance;
+    SPI_InitTypeDef Init;
+    uint8_t *pTxBuffPtr, *pRxBuffPtr;
+    uint16_t TxXferSize, RxXferSize;
+    DMA_HandleTypeDef *hdmatx, *hdmarx;
+    volatile HAL_SPI_StateTypeDef State;
+    volatile uint32_t ErrorCode;
+} SPI_HandleTypeDef;
+
+#define SPI_MODE_MASTER             0x0104U
+#define SPI_DIRECTION_2LINES        0x0000U
+#define SPI_DATASIZE_8BIT           0x0000U
+#define SPI_POLARITY_LOW            0x0000U
+#define SPI_PHASE_1EDGE             0x0000U
+#define SPI_NSS_SOFT                0x0200U
+#define SPI_BAUDRATEPRESCALER_2     0x0000U
+#define SPI_BAUDRATEPRESCALER_4     0x0008U
+#define SPI_BAUDRATEPRESCALER_8     0x0010U
+#define SPI_BAUDRATEPRESCALER_16    0x0018U
+#define SPI_BAUDRATEPRESCALER_32    0x0020U
+#define SPI_BAUDRATEPRESCALER_64    0x0028U
+#define SPI_BAUDRATEPRESCALER_128   0x0030U
+#define SPI_BAUDRATEPRESCALER_256   0x0038U
+#define SPI_FIRSTBIT_MSB            0x0000U
+#define SPI_TIMODE_DISABLE          0x0000U
+#define SPI_CRCCALCULATION_DISABLE  0x0000U
+#define HAL_SPI_ERROR_NONE          0x00U
+#define HAL_SPI_ERROR_ABORT         0x40U
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t len, uint32_t timeout);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t len, uint32_t timeout);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *tx, uint8_t *rx,
+                                          uint16_t len, uint32_t timeout);
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t len);
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t len);
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi);
+void HAL_SPI_IRQHandler(SPI_HandleTypeDef *hspi);
+void HAL_SPI_MspInit(SPI_HandleTypeDef *hspi);
+void HAL_SPI_MspDeInit(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi);
+
+// --- UART ---
+
+// BRR is written by HAL_UART_Init and sets the wire speed with PCLK2
+typedef struct { volatile uint32_t SR, DR, BRR; } USART_TypeDef;
+extern USART_TypeDef sim_usart6;
+#define USART6  (&sim_usart6)
+
+typedef struct {
+    uint32_t BaudRate, WordLength, StopBits, Parity, Mode, HwFlowCtl, OverSampling;
+} UART_InitTypeDef;
+
+typedef uint32_t HAL_UART_RxEventTypeTypeDef;
+
+typedef struct __UART_HandleTypeDef {
+    USART_TypeDef *Instance;
+    UART_InitTypeDef Init;
+    const uint8_t *pTxBuffPtr;
+    uint16_t TxXferSize;
+    uint8_t *pRxBuffPtr;
+    uint16_t RxXferSize;
+    DMA_HandleTypeDef *hdmatx, *hdmarx;
+    volatile HAL_UART_RxEventTypeTypeDef RxEventType;
+    volatile uint32_t gState;
+    volatile uint32_t RxState;
+    volatile uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+#define HAL_UART_STATE_RESET        0x00U
+#define HAL_UART_STATE_READY        0x20U
+#define HAL_UART_STATE_BUSY_TX      0x21U
+#define HAL_UART_STATE_BUSY_RX      0x22U
+#define HAL_UART_ERROR_NONE         0x00U
+#define HAL_UART_ERROR_ORE          0x08U
+#define HAL_UART_ERROR_DMA          0x10U
+#define HAL_UART_RXEVENT_TC         0x00U
+#define HAL_UART_RXEVENT_HT         0x01U
+#define HAL_UART_RXEVENT_IDLE       0x02U
+
+#define UART_WORDLENGTH_8B          0x0000U
+#define UART_STOPBITS_1             0x0000U
+#define UART_PARITY_NONE            0x0000U
+#define UART_MODE_TX_RX             0x000CU
+#define UART_HWCONTROL_NONE         0x0000U
+#define UART_OVERSAMPLING_16        0x0000U
+#define UART_OVERSAMPLING_8         0x8000U
+#define UART_BRR_SAMPLING16(pclk, baud) \
+    ((uint32_t)(((uint64_t)(pclk) + (baud) / 2U) / (baud)))
+#define UART_BRR_SAMPLING8(pclk, baud) \
+    ((UART_BRR_SAMPLING16(2U * (uint64_t)(pclk), baud) & ~0xFU) | \
+     ((UART_BRR_SAMPLING16(2U * (uint64_t)(pclk), baud) & 0xFU) >> 1))
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t len,
+                                    uint32_t timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t len);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t len);
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart);
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart);
+void HAL_UART_MspInit(UART_HandleTypeDef *huart);
+void HAL_UART_MspDeInit(UART_HandleTypeDef *huart);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t size);
+
+#endif // STM32F4XX_HAL_H
@@ -0,0 +1,22 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include "FreeRTOS.h"
+
+struct StreamBufferDef_t;
+typedef struct StreamBufferDef_t *StreamBufferHandle_t;
+
+StreamBufferHandle_t xStreamBufferCreate(size_t size, size_t trigger);
+StreamBufferHandle_t xStreamBufferCreateStatic(size_t size, size_t trigger,
+                                               uint8_t *storage, StaticStreamBuffer_t *buf);
+size_t xStreamBufferSend(StreamBufferHandle_t sb, const void *data, size_t len, TickType_t timeout);
+size_t xStreamBufferSendFromISR(StreamBufferHandle_t sb, const void *data, size_t len,
+                                BaseType_t *woken);
+size_t xStreamBufferReceive(StreamBufferHandle_t sb, void *data, size_t len, TickType_t timeout);
+size_t xStreamBufferReceiveFromISR(StreamBufferHandle_t sb, void *data, size_t len,
+                                   BaseType_t *woken);
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t sb);
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t sb);
+BaseType_t xStreamBufferReset(StreamBufferHandle_t sb);
+
+#endif // STREAM_BUFFER_H
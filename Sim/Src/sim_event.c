@@ -0,0 +1,112 @@
+// Device timers for the peripheral models: a callback runs in interrupt
+// context once its delay has passed, the way a DMA or conversion-complete
+// interrupt would fire.
+
+#define _GNU_SOURCE
+#include "sim.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SIM_EVENTS  32
+
+typedef struct {
+    uint64_t due_us;
+    sim_event_fn fn;
+    void *arg;
+} sim_event_t;
+
+static pthread_mutex_t ev_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ev_cond;
+static sim_event_t events[SIM_EVENTS];
+static int event_count;
+
+// Callback taken off the list but still waiting for the CPU; a cancel in
+// that window must still stop it
+static sim_event_t in_flight;
+static int in_flight_cancelled;
+
+static void *event_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&ev_lock);
+    for (;;) {
+        int first = -1;
+
+        for (int i = 0; i < event_count; i++) {
+            if (first < 0 || events[i].due_us < events[first].due_us) first = i;
+        }
+        if (first < 0) {
+            pthread_cond_wait(&ev_cond, &ev_lock);
+            continue;
+        }
+
+        uint64_t now = sim_time_us();
+        if (events[first].due_us > now) {
+            struct timespec ts;
+            uint64_t wait = events[first].due_us - now;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_sec += wait / 1000000U;
+            ts.tv_nsec += (long)(wait % 1000000U) * 1000;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_nsec -= 1000000000L;
+                ts.tv_sec++;
+            }
+            pthread_cond_timedwait(&ev_cond, &ev_lock, &ts);
+            continue;
+        }
+
+        sim_event_t ev = events[first];
+        in_flight = ev;
+        in_flight_cancelled = 0;
+        events[first] = events[--event_count];
+        pthread_mutex_unlock(&ev_lock);
+
+        sim_isr_enter();
+        pthread_mutex_lock(&ev_lock);
+        int cancelled = in_flight_cancelled;
+        in_flight.fn = NULL;
+        pthread_mutex_unlock(&ev_lock);
+        if (!cancelled) ev.fn(ev.arg);
+        sim_isr_exit();
+
+        pthread_mutex_lock(&ev_lock);
+    }
+    return NULL;
+}
+
+void sim_event_init(void) {
+    pthread_condattr_t attr;
+    pthread_t th;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ev_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_create(&th, NULL, event_thread, NULL);
+    pthread_detach(th);
+}
+
+void sim_event_schedule(uint32_t delay_us, sim_event_fn fn, void *arg) {
+    pthread_mutex_lock(&ev_lock);
+    if (event_count == SIM_EVENTS) {
+        fprintf(stderr, "sim: device timer table full\n");
+        abort();
+    }
+    events[event_count].due_us = sim_time_us() + delay_us;
+    events[event_count].fn = fn;
+    events[event_count].arg = arg;
+    event_count++;
+    pthread_cond_signal(&ev_cond);
+    pthread_mutex_unlock(&ev_lock);
+}
+
+void sim_event_cancel(sim_event_fn fn, void *arg) {
+    pthread_mutex_lock(&ev_lock);
+    for (int i = 0; i < event_count;) {
+        if (events[i].fn == fn && events[i].arg == arg) events[i] = events[--event_count];
+        else i++;
+    }
+    if (in_flight.fn == fn && in_flight.arg == arg) in_flight_cancelled = 1;
+    pthread_mutex_unlock(&ev_lock);
+}
@@ -0,0 +1,400 @@
+// SPI NOR flash on SPI1 for the host simulation: a GD25D05C/GD25D10C model
+// backed by a memory-mapped file, so the log survives restarts and power
+// cuts the way the chip does.
+//
+// Commands: RDID, RDSR (WIP, WEL), WREN, READ, PP (256-byte page, address
+// wraps within the page, bits only go 1 -> 0) and SE (4 KB to 0xFF). Program
+// and erase start when CS rises and take their configured latency; until
+// then the chip answers only RDSR and the array still holds the old data.
+//
+// Environment:
+//   SIM_FLASH_FILE       backing file (default garden_mon_flash.bin), created
+//                        erased; the data is at offset 0, so hexdump works
+//   SIM_FLASH_CHIP       GD25D05C or GD25D10C (default)
+//   SIM_FLASH_PP_US      page program time (default 700, typical)
+//   SIM_FLASH_SE_US      sector erase time (default 50000, typical)
+//   SIM_FLASH_CUT_AFTER  cut the power during the Nth program/erase
+//   SIM_FLASH_CUT_SEED   seed for where in that operation the cut lands
+//
+// A power cut leaves the operation in flight half done (a prefix of the
+// page programmed, a sector with a random mix of erased and old bits),
+// prints where it hit and exits with status 3; run again on the same file
+// to see what the firmware recovers. SIGUSR2 cuts the power at that moment.
+//
+// Per-sector erase counts are kept in the file after the array and add up
+// across runs. SIGUSR1, SIGINT, SIGTERM and a normal exit print them with
+// this run's program/erase statistics.
+
+#include "sim.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define FLASH_PAGE      256U
+#define FLASH_SECTOR    4096U
+#define FLASH_SECTORS_MAX   32U
+
+#define CMD_WREN        0x06
+#define CMD_RDSR        0x05
+#define CMD_READ        0x03
+#define CMD_PP          0x02
+#define CMD_SE          0x20
+#define CMD_RDID        0x9F
+
+#define POWER_CUT_EXIT  3
+
+typedef struct {
+    const char *name;
+    uint32_t jedec_id;
+    uint32_t size;
+} sim_flash_chip_t;
+
+static const sim_flash_chip_t chips[] = {
+    { "GD25D05C", 0xC84010, 64 * 1024 },
+    { "GD25D10C", 0xC84011, 128 * 1024 },
+};
+
+// Stored after the array
+typedef struct {
+    char magic[8];
+    uint32_t jedec_id;
+    uint32_t size;
+    uint32_t erase_count[FLASH_SECTORS_MAX];
+} flash_trailer_t;
+
+static const char flash_magic[8] = "GMFLASH1";
+
+typedef enum { OP_NONE, OP_PP, OP_SE } flash_op_t;
+
+static const sim_flash_chip_t *chip = &chips[1];
+static uint8_t *mem;
+static flash_trailer_t *trailer;
+static uint32_t pp_us = 700, se_us = 50000;
+
+static struct {
+    uint8_t selected;
+    uint8_t cmd;
+    uint32_t count;         // bytes clocked since CS went low
+    uint32_t addr;
+    uint8_t wel;
+
+    // Page buffer of the PP command being clocked in
+    uint8_t page[FLASH_PAGE];
+    uint8_t page_set[FLASH_PAGE];
+    uint32_t page_first;    // offset of the first data byte
+
+    // Program or erase in flight
+    flash_op_t op;
+    uint32_t op_addr;
+    uint64_t op_start, op_end;
+} flash;
+
+static struct {
+    uint32_t ops;           // program + erase operations started
+    uint32_t pp, pp_bytes, se, read_bytes, rdsr, ignored;
+    uint64_t busy_us;
+    uint64_t started_us;
+} stats;
+
+static uint32_t cut_after;
+static unsigned int cut_seed = 1;
+
+static void flash_die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static uint32_t env_u32(const char *name, uint32_t def) {
+    const char *v = getenv(name);
+    return (v != NULL && *v != '\0') ? (uint32_t)strtoul(v, NULL, 0) : def;
+}
+
+// --- Array operations ---
+
+static void apply_pp(uint32_t fraction_permille) {
+    uint32_t page = flash.op_addr & ~(FLASH_PAGE - 1);
+    uint32_t n = 0, total = 0, done;
+
+    for (uint32_t i = 0; i < FLASH_PAGE; i++) total += flash.page_set[i];
+    done = total * fraction_permille / 1000U;
+
+    // Bytes are programmed in the order they were sent
+    for (uint32_t k = 0; k < FLASH_PAGE; k++) {
+        uint32_t i = (flash.page_first + k) & (FLASH_PAGE - 1);
+        if (!flash.page_set[i]) continue;
+        if (n < done) {
+            mem[page | i] &= flash.page[i];
+        } else if (n == done && fraction_permille < 1000U) {
+            // The byte being programmed when the power went: some of its bits
+            mem[page | i] &= flash.page[i] | (uint8_t)rand_r(&cut_seed);
+        }
+        n++;
+    }
+}
+
+static void apply_se(uint32_t fraction_permille) {
+    uint8_t *p = &mem[flash.op_addr & ~(FLASH_SECTOR - 1)];
+
+    if (fraction_permille >= 1000U) {
+        memset(p, 0xFF, FLASH_SECTOR);
+        return;
+    }
+    for (uint32_t i = 0; i < FLASH_SECTOR; i++) {
+        if ((uint32_t)rand_r(&cut_seed) % 1000U < fraction_permille) p[i] = 0xFF;
+        else p[i] |= (uint8_t)(rand_r(&cut_seed) & rand_r(&cut_seed));
+    }
+}
+
+// Finish the operation in flight once its time is up
+static void settle(void) {
+    if (flash.op == OP_NONE || sim_time_us() < flash.op_end) return;
+    if (flash.op == OP_PP) apply_pp(1000U);
+    else apply_se(1000U);
+    stats.busy_us += flash.op_end - flash.op_start;
+    flash.op = OP_NONE;
+}
+
+static int busy(void) {
+    settle();
+    return flash.op != OP_NONE;
+}
+
+// --- Reports and power cuts ---
+
+static void flash_report(void) {
+    uint32_t sectors = chip->size / FLASH_SECTOR;
+    uint32_t min = UINT32_MAX, max = 0;
+    uint64_t sum = 0;
+    double secs = (sim_time_us() - stats.started_us) / 1e6;
+
+    for (uint32_t s = 0; s < sectors; s++) {
+        uint32_t c = trailer->erase_count[s];
+        if (c < min) min = c;
+        if (c > max) max = c;
+        sum += c;
+    }
+    fprintf(stderr, "flash: %s, %.1f s: %u PP (%u bytes, %.0f B/s), %u SE, %u bytes read, "
+            "%u RDSR polls, %u ignored while busy, busy %.1f%%\n",
+            chip->name, secs, stats.pp, stats.pp_bytes, secs > 0 ? stats.pp_bytes / secs : 0.0,
+            stats.se, stats.read_bytes, stats.rdsr, stats.ignored,
+            secs > 0 ? stats.busy_us / 1e4 / secs : 0.0);
+    fprintf(stderr, "flash: erase counts min %u max %u mean %.1f\n", min, max,
+            (double)sum / sectors);
+    for (uint32_t s = 0; s < sectors; s += 8) {
+        fprintf(stderr, "flash:  %05X", s * FLASH_SECTOR);
+        for (uint32_t i = s; i < s + 8 && i < sectors; i++) fprintf(stderr, " %6u", trailer->erase_count[i]);
+        fprintf(stderr, "\n");
+    }
+}
+
+static void power_cut(void *arg) {
+    uint32_t permille = 0;
+
+    (void)arg;
+    settle();
+    if (flash.op != OP_NONE) {
+        uint64_t now = sim_time_us();
+        permille = (uint32_t)((now - flash.op_start) * 1000U / (flash.op_end - flash.op_start));
+        if (flash.op == OP_PP) apply_pp(permille);
+        else apply_se(permille);
+        fprintf(stderr, "flash: power cut %u.%u%% into %s at 0x%05X\n", permille / 10, permille % 10,
+                flash.op == OP_PP ? "page program" : "sector erase", flash.op_addr);
+    } else {
+        fprintf(stderr, "flash: power cut with the flash idle\n");
+    }
+    flash_report();
+    msync(mem, chip->size + sizeof(flash_trailer_t), MS_SYNC);
+    _exit(POWER_CUT_EXIT);
+}
+
+static void at_exit(void) {
+    if (flash.op != OP_NONE) {
+        // Power stays on through a normal exit: let the chip finish
+        flash.op_end = sim_time_us();
+        settle();
+    }
+    flash_report();
+    msync(mem, chip->size + sizeof(flash_trailer_t), MS_SYNC);
+}
+
+// Signals are blocked in every thread and taken here instead
+static void *signal_thread(void *arg) {
+    sigset_t *set = arg;
+    int sig;
+
+    for (;;) {
+        if (sigwait(set, &sig) != 0) continue;
+        if (sig == SIGUSR2) {
+            sim_isr_enter();
+            power_cut(NULL);
+        }
+        sim_isr_enter();
+        if (sig == SIGUSR1) {
+            settle();
+            flash_report();
+            sim_isr_exit();
+            continue;
+        }
+        exit(0);        // SIGINT, SIGTERM: report from at_exit
+    }
+    return NULL;
+}
+
+// --- Setup ---
+
+static void open_backing_file(void) {
+    const char *path = getenv("SIM_FLASH_FILE");
+    size_t bytes = chip->size + sizeof(flash_trailer_t);
+    int fresh = 0;
+    int fd;
+
+    if (path == NULL || *path == '\0') path = "garden_mon_flash.bin";
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) flash_die(path);
+    if (lseek(fd, 0, SEEK_END) != (off_t)bytes) {
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)bytes) != 0) flash_die(path);
+        fresh = 1;
+    }
+    mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) flash_die(path);
+    close(fd);
+
+    trailer = (flash_trailer_t *)(mem + chip->size);
+    if (fresh || memcmp(trailer->magic, flash_magic, sizeof(flash_magic)) != 0 ||
+        trailer->jedec_id != chip->jedec_id || trailer->size != chip->size) {
+        memset(mem, 0xFF, chip->size);
+        memset(trailer, 0, sizeof(*trailer));
+        memcpy(trailer->magic, flash_magic, sizeof(flash_magic));
+        trailer->jedec_id = chip->jedec_id;
+        trailer->size = chip->size;
+        fprintf(stderr, "flash: new erased %s in %s\n", chip->name, path);
+    } else {
+        fprintf(stderr, "flash: %s from %s\n", chip->name, path);
+    }
+}
+
+// Called first thing in HAL_Init, before any other thread exists, so the
+// signal mask is inherited by all of them
+void sim_flash_init(void) {
+    static sigset_t set;
+    const char *name = getenv("SIM_FLASH_CHIP");
+    pthread_t th;
+
+    if (name != NULL) {
+        chip = NULL;
+        for (size_t i = 0; i < sizeof(chips) / sizeof(chips[0]); i++) {
+            if (strcmp(name, chips[i].name) == 0) chip = &chips[i];
+        }
+        if (chip == NULL) {
+            fprintf(stderr, "flash: unknown SIM_FLASH_CHIP %s\n", name);
+            exit(1);
+        }
+    }
+    pp_us = env_u32("SIM_FLASH_PP_US", pp_us);
+    se_us = env_u32("SIM_FLASH_SE_US", se_us);
+    cut_after = env_u32("SIM_FLASH_CUT_AFTER", 0);
+    cut_seed = env_u32("SIM_FLASH_CUT_SEED", cut_seed);
+
+    open_backing_file();
+    atexit(at_exit);
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    pthread_create(&th, NULL, signal_thread, &set);
+    pthread_detach(th);
+}
+
+// --- SPI side ---
+
+static void start_op(flash_op_t op, uint32_t us) {
+    flash.op = op;
+    flash.op_addr = (op == OP_PP) ? (flash.addr & ~(FLASH_PAGE - 1)) | flash.page_first : flash.addr;
+    flash.op_start = sim_time_us();
+    flash.op_end = flash.op_start + us;
+    flash.wel = 0;
+    if (++stats.ops == cut_after) {
+        sim_event_schedule((uint32_t)(rand_r(&cut_seed) % (us ? us : 1U)), power_cut, NULL);
+    }
+}
+
+void sim_flash_select(int selected) {
+    if (selected == flash.selected) return;
+    flash.selected = (uint8_t)selected;
+    if (selected) {
+        flash.count = 0;
+        flash.cmd = 0;
+        flash.addr = 0;
+        return;
+    }
+
+    // Program and erase start when CS goes high after a whole command
+    if (!flash.wel || busy()) return;
+    if (flash.cmd == CMD_PP && flash.count > 4) {
+        stats.pp++;
+        for (uint32_t i = 0; i < FLASH_PAGE; i++) stats.pp_bytes += flash.page_set[i];
+        start_op(OP_PP, pp_us);
+    } else if (flash.cmd == CMD_SE && flash.count == 4) {
+        stats.se++;
+        trailer->erase_count[flash.addr / FLASH_SECTOR]++;
+        start_op(OP_SE, se_us);
+    }
+}
+
+uint8_t sim_flash_xfer(uint8_t mosi) {
+    uint32_t n;
+
+    if (!flash.selected) return 0xFF;
+    n = flash.count++;
+    if (n == 0) {
+        flash.cmd = mosi;
+        if (mosi == CMD_RDSR) stats.rdsr++;
+        else if (busy()) stats.ignored++;
+        else if (mosi == CMD_WREN) flash.wel = 1;
+        return 0xFF;
+    }
+
+    switch (flash.cmd) {
+    case CMD_RDSR:
+        return (uint8_t)((busy() ? 0x01 : 0x00) | (flash.wel ? 0x02 : 0x00));
+    case CMD_RDID:
+        if (busy() || n > 3) return 0xFF;
+        return (uint8_t)(chip->jedec_id >> (8 * (3 - n)));
+    case CMD_READ:
+    case CMD_PP:
+    case CMD_SE:
+        if (busy()) return 0xFF;
+        if (n <= 3) {
+            flash.addr = (flash.addr << 8 | mosi) & (chip->size - 1);
+            if (n == 3 && flash.cmd == CMD_PP) {
+                memset(flash.page_set, 0, sizeof(flash.page_set));
+                flash.page_first = flash.addr & (FLASH_PAGE - 1);
+            }
+            return 0xFF;
+        }
+        if (flash.cmd == CMD_READ) {
+            uint8_t v = mem[flash.addr];
+            flash.addr = (flash.addr + 1) & (chip->size - 1);
+            stats.read_bytes++;
+            return v;
+        }
+        if (flash.cmd == CMD_PP && flash.wel) {
+            // Latched into the page buffer; the address wraps within the page
+            uint32_t i = flash.addr & (FLASH_PAGE - 1);
+            flash.page[i] = mosi;
+            flash.page_set[i] = 1;
+            flash.addr = (flash.addr & ~(FLASH_PAGE - 1)) | ((i + 1) & (FLASH_PAGE - 1));
+        }
+        return 0xFF;
+    default:
+        return 0xFF;
+    }
+}
@@ -0,0 +1,638 @@
+// Core HAL for the host simulation: startup, clocks, power modes,
+// GPIO/EXTI, NVIC, LPTIM1, and the TIM1 triggered ADC1 scan with its
+// circular DMA.
+
+#include "main.h"
+#include "sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define HSI_VALUE   16000000U
+#define HSE_VALUE   8000000U
+
+uint32_t SystemCoreClock = HSI_VALUE;
+
+GPIO_TypeDef sim_gpio[3];
+DMA_Stream_TypeDef sim_dma1[8], sim_dma2[8];
+ADC_TypeDef sim_adc1;
+TIM_TypeDef sim_tim1;
+
+CoreDebug_Type sim_coredebug;
+EXTI_TypeDef sim_exti;
+SYSCFG_TypeDef sim_syscfg;
+
+FLASH_TypeDef sim_flash_if;
+uint32_t sim_pwr_vos = PWR_REGULATOR_VOLTAGE_SCALE2;    // reset value
+
+volatile uint32_t uwTick;
+HAL_TickFreqTypeDef uwTickFreq = HAL_TICK_FREQ_1KHZ;
+uint32_t uwTickPrio = 15U;
+
+static uint8_t nvic_enabled[128];
+static int stopped;
+
+// --- Core ---
+
+HAL_StatusTypeDef HAL_Init(void) {
+    for (int i = 0; i < 3; i++) sim_gpio[i].IDR = 0xFFFF;      // pulled up, nothing driving
+    sim_flash_init();       // first: sets the signal mask every thread inherits
+    sim_kernel_init();
+    sim_event_init();
+    sim_uart_init();
+    sim_i2c_init();
+    // As the real HAL_Init with the caches and prefetch on in stm32f4xx_hal_conf.h
+    sim_flash_if.ACR |= FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN;
+    HAL_MspInit();
+    return HAL_OK;
+}
+
+uint32_t HAL_GetTick(void) {
+    return (uint32_t)(sim_time_us() / 1000U);
+}
+
+void HAL_IncTick(void) {
+}
+
+// Busy wait like the real one, at least ms full milliseconds
+void HAL_Delay(uint32_t ms) {
+    if (ms < HAL_MAX_DELAY) ms++;
+    sim_yield_point();
+    sim_busy_wait_us(ms * 1000U);
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub) {
+    (void)irq;
+    (void)preempt;
+    (void)sub;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type irq) {
+    if (irq >= 0 && irq < (int)sizeof(nvic_enabled)) nvic_enabled[irq] = 1;
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type irq) {
+    if (irq >= 0 && irq < (int)sizeof(nvic_enabled)) nvic_enabled[irq] = 0;
+}
+
+void HAL_NVIC_ClearPendingIRQ(IRQn_Type irq) {
+    (void)irq;
+}
+
+void NVIC_SystemReset(void) {
+    fprintf(stderr, "sim: system reset\n");
+    exit(4);
+}
+
+// The counter runs from the nanosecond clock. A value that differs from
+// the one handed out last time was written by the firmware and becomes the
+// new starting point.
+DWT_Type *sim_dwt(void) {
+    static DWT_Type dwt;
+    static uint32_t last, base;
+    static uint8_t running;
+    struct timespec ts;
+    uint64_t ns;
+    uint32_t now;
+
+    if (!(dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk) || !(sim_coredebug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk)) {
+        running = 0;
+        return &dwt;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ns = (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+    now = (uint32_t)(ns * (SystemCoreClock / 1000000U) / 1000U);
+    if (!running || dwt.CYCCNT != last) base = now - dwt.CYCCNT;
+    running = 1;
+    dwt.CYCCNT = last = now - base;
+    return &dwt;
+}
+
+// --- RCC ---
+
+static struct {
+    uint8_t hse_on, lsi_on, pll_on;
+    uint32_t pll_source, pllm, plln, pllp, pllq, pllr;
+    uint32_t sysclk_source;
+    uint32_t ahb_div, apb1_div, apb2_div;
+    uint32_t latency;
+} rcc = { .ahb_div = RCC_SYSCLK_DIV1, .apb1_div = RCC_HCLK_DIV1, .apb2_div = RCC_HCLK_DIV1 };
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *osc) {
+    if (osc->OscillatorType & RCC_OSCILLATORTYPE_HSE) rcc.hse_on = (osc->HSEState != RCC_HSE_OFF);
+    if (osc->OscillatorType & RCC_OSCILLATORTYPE_LSI) rcc.lsi_on = (osc->LSIState != RCC_LSI_OFF);
+    if (osc->PLL.PLLState == RCC_PLL_ON) {
+        // Reconfiguring the PLL that clocks the system is refused on the target too
+        if (rcc.sysclk_source == RCC_SYSCLKSOURCE_PLLCLK) return HAL_ERROR;
+        if (osc->PLL.PLLM < 2 || osc->PLL.PLLN < 50 || osc->PLL.PLLP == 0) return HAL_ERROR;
+        rcc.pll_on = 1;
+        rcc.pll_source = osc->PLL.PLLSource;
+        rcc.pllm = osc->PLL.PLLM;
+        rcc.plln = osc->PLL.PLLN;
+        rcc.pllp = osc->PLL.PLLP;
+        rcc.pllq = osc->PLL.PLLQ;
+        rcc.pllr = osc->PLL.PLLR;
+    } else if (osc->PLL.PLLState == RCC_PLL_OFF) {
+        if (rcc.sysclk_source == RCC_SYSCLKSOURCE_PLLCLK) return HAL_ERROR;
+        rcc.pll_on = 0;
+    }
+    return HAL_OK;
+}
+
+uint32_t HAL_RCC_GetSysClockFreq(void) {
+    if (rcc.sysclk_source == RCC_SYSCLKSOURCE_PLLCLK) {
+        uint32_t in = (rcc.pll_source == RCC_PLLSOURCE_HSE) ? HSE_VALUE : HSI_VALUE;
+        return (uint32_t)((uint64_t)in / rcc.pllm * rcc.plln / rcc.pllp);
+    }
+    return (rcc.sysclk_source == RCC_SYSCLKSOURCE_HSE) ? HSE_VALUE : HSI_VALUE;
+}
+
+static uint32_t ahb_shift(uint32_t div) {
+    return (div & 0x80U) ? ((div >> 4) & 0x7U) + 1U : 0U;
+}
+
+static uint32_t apb_shift(uint32_t div) {
+    return (div & 0x1000U) ? ((div >> 10) & 0x3U) + 1U : 0U;
+}
+
+// Limits of the F410 at 2.7..3.6 V (RM0401, DS10086): wait states per
+// 30 MHz of HCLK, HCLK by regulator scale (with the PLL on), APB1 50 MHz
+static void rcc_check(void) {
+    uint32_t hclk = SystemCoreClock;
+    uint32_t vos_max = sim_pwr_vos == PWR_REGULATOR_VOLTAGE_SCALE3 ? 64000000U :
+                       sim_pwr_vos == PWR_REGULATOR_VOLTAGE_SCALE2 ? 84000000U : 100000000U;
+    uint32_t ws = (hclk - 1U) / 30000000U;
+
+    if (rcc.latency < ws) {
+        fprintf(stderr, "sim: %lu MHz needs %lu flash wait states, latency is %lu\n",
+                (unsigned long)(hclk / 1000000U), (unsigned long)ws, (unsigned long)rcc.latency);
+    }
+    if (rcc.sysclk_source == RCC_SYSCLKSOURCE_PLLCLK && hclk > vos_max) {
+        fprintf(stderr, "sim: %lu MHz above the regulator scale limit\n", (unsigned long)(hclk / 1000000U));
+    }
+    if (HAL_RCC_GetPCLK1Freq() > 50000000U) {
+        fprintf(stderr, "sim: PCLK1 %lu MHz above 50 MHz\n", (unsigned long)(HAL_RCC_GetPCLK1Freq() / 1000000U));
+    }
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *clk, uint32_t latency) {
+    rcc.latency = latency;
+    FLASH->ACR = (FLASH->ACR & ~FLASH_ACR_LATENCY) | latency;
+    if (clk->ClockType & RCC_CLOCKTYPE_SYSCLK) {
+        if (clk->SYSCLKSource == RCC_SYSCLKSOURCE_PLLCLK && !rcc.pll_on) return HAL_ERROR;
+        rcc.sysclk_source = clk->SYSCLKSource;
+    }
+    if (clk->ClockType & RCC_CLOCKTYPE_HCLK) rcc.ahb_div = clk->AHBCLKDivider;
+    if (clk->ClockType & RCC_CLOCKTYPE_PCLK1) rcc.apb1_div = clk->APB1CLKDivider;
+    if (clk->ClockType & RCC_CLOCKTYPE_PCLK2) rcc.apb2_div = clk->APB2CLKDivider;
+    SystemCoreClock = HAL_RCC_GetSysClockFreq() >> ahb_shift(rcc.ahb_div);
+    rcc_check();
+    return HAL_InitTick(uwTickPrio);
+}
+
+// HAL_GetTick runs off the host clock here, so only a SysTick the kernel
+// has started needs re-timing
+HAL_StatusTypeDef HAL_InitTick(uint32_t prio) {
+    (void)prio;
+    if (SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) {
+        SysTick->LOAD = SystemCoreClock / (1000U / uwTickFreq) - 1U;
+        SysTick->VAL = 0;
+    }
+    return HAL_OK;
+}
+
+void HAL_RCC_GetOscConfig(RCC_OscInitTypeDef *osc) {
+    osc->OscillatorType = RCC_OSCILLATORTYPE_HSE | RCC_OSCILLATORTYPE_HSI |
+                          RCC_OSCILLATORTYPE_LSE | RCC_OSCILLATORTYPE_LSI;
+    osc->HSEState = rcc.hse_on ? RCC_HSE_ON : RCC_HSE_OFF;
+    osc->HSIState = RCC_HSI_ON;
+    osc->HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+    osc->LSEState = 0;
+    osc->LSIState = rcc.lsi_on ? RCC_LSI_ON : RCC_LSI_OFF;
+    osc->PLL.PLLState = rcc.pll_on ? RCC_PLL_ON : RCC_PLL_OFF;
+    osc->PLL.PLLSource = rcc.pll_source;
+    osc->PLL.PLLM = rcc.pllm;
+    osc->PLL.PLLN = rcc.plln;
+    osc->PLL.PLLP = rcc.pllp;
+    osc->PLL.PLLQ = rcc.pllq;
+    osc->PLL.PLLR = rcc.pllr;
+}
+
+void HAL_RCC_GetClockConfig(RCC_ClkInitTypeDef *clk, uint32_t *latency) {
+    clk->ClockType = RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clk->SYSCLKSource = rcc.sysclk_source;
+    clk->AHBCLKDivider = rcc.ahb_div;
+    clk->APB1CLKDivider = rcc.apb1_div;
+    clk->APB2CLKDivider = rcc.apb2_div;
+    *latency = rcc.latency;
+}
+
+uint32_t HAL_RCC_GetHCLKFreq(void) {
+    return SystemCoreClock;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void) {
+    return SystemCoreClock >> apb_shift(rcc.apb1_div);
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void) {
+    return SystemCoreClock >> apb_shift(rcc.apb2_div);
+}
+
+// --- PWR ---
+
+// The core waits for an interrupt either way. STOP leaves it on the HSI
+// with the PLL and HSE off; SystemCoreClock keeps its old value, as on the
+// target, until the firmware restores the clocks.
+void HAL_PWR_EnterSTOPMode(uint32_t regulator, uint8_t entry) {
+    (void)regulator;
+    (void)entry;
+    __atomic_store_n(&stopped, 1, __ATOMIC_RELEASE);
+    sim_wfi();
+    __atomic_store_n(&stopped, 0, __ATOMIC_RELEASE);
+    rcc.sysclk_source = RCC_SYSCLKSOURCE_HSI;
+    rcc.pll_on = 0;
+    rcc.hse_on = 0;
+}
+
+void HAL_PWR_EnterSLEEPMode(uint32_t regulator, uint8_t entry) {
+    (void)regulator;
+    (void)entry;
+    sim_wfi();
+}
+
+void HAL_PWREx_EnableFlashPowerDown(void) {
+}
+
+void HAL_PWREx_EnableLowRegulatorLowVoltage(void) {
+}
+
+int sim_power_stopped(void) {
+    return __atomic_load_n(&stopped, __ATOMIC_ACQUIRE);
+}
+
+// --- GPIO ---
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init) {
+    uint32_t pins = init->Pin;
+
+    if (init->Mode == GPIO_MODE_OUTPUT_PP || init->Mode == GPIO_MODE_OUTPUT_OD) port->MODER |= pins;
+    else port->MODER &= ~pins;
+
+    port->EXTI_FALLING &= ~pins;
+    port->EXTI_RISING &= ~pins;
+    if (init->Mode == GPIO_MODE_IT_FALLING || init->Mode == GPIO_MODE_IT_RISING_FALLING) {
+        port->EXTI_FALLING |= pins;
+    }
+    if (init->Mode == GPIO_MODE_IT_RISING || init->Mode == GPIO_MODE_IT_RISING_FALLING) {
+        port->EXTI_RISING |= pins;
+    }
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *port, uint32_t pin) {
+    port->MODER &= ~pin;
+    port->EXTI_FALLING &= ~pin;
+    port->EXTI_RISING &= ~pin;
+}
+
+// Open-drain and push-pull outputs alike read back as the wired-AND of what
+// the MCU drives and what the outside world does
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin) {
+    uint32_t level = port->IDR;
+
+    if (port->MODER & pin) level &= port->ODR;
+    return (level & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state) {
+    if (state == GPIO_PIN_SET) port->ODR |= pin;
+    else port->ODR &= ~(uint32_t)pin;
+
+    if (port == FLASH_CS_GPIO_Port && (pin & FLASH_CS_Pin)) sim_flash_select(state == GPIO_PIN_RESET);
+    sim_yield_point();
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *port, uint16_t pin) {
+    HAL_GPIO_WritePin(port, pin, (port->ODR & pin) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
+static IRQn_Type exti_irq(uint16_t pin) {
+    if (pin & 0x03E0U) return EXTI9_5_IRQn;
+    if (pin & 0xFC00U) return EXTI15_10_IRQn;
+    return (IRQn_Type)-1;       // EXTI0..4 are not used on this board
+}
+
+// From a device model, in interrupt context
+void sim_gpio_set_input(void *p, uint16_t pin, int level) {
+    GPIO_TypeDef *port = p;
+    uint32_t old = port->IDR & pin;
+    IRQn_Type irq = exti_irq(pin);
+
+    if (level) port->IDR |= pin;
+    else port->IDR &= ~(uint32_t)pin;
+
+    if (irq < 0 || !nvic_enabled[irq]) return;
+    if ((old && !level && (port->EXTI_FALLING & pin)) || (!old && level && (port->EXTI_RISING & pin))) {
+        HAL_GPIO_EXTI_IRQHandler(pin);
+    }
+}
+
+void HAL_GPIO_EXTI_IRQHandler(uint16_t pin) {
+    HAL_GPIO_EXTI_Callback(pin);
+}
+
+// --- LPTIM1 ---
+//
+// The count follows the host clock at SIM_LSI_HZ from the moment it was
+// started. A compare match is a device timer event; its interrupt reaches
+// the NVIC through EXTI line 23, as on the F410.
+
+#define LPTIM_EXTI_LINE     (1UL << 23)
+
+void LPTIM1_IRQHandler(void);           // application vector
+
+static LPTIM_TypeDef lptim;
+static struct {
+    uint32_t lsi_hz;
+    uint32_t cmp, arr;                  // as of the last access
+    uint8_t counting;
+    uint64_t start_us;                  // when the count was 0
+    uint64_t seen;                      // counts up to the last access
+} lp;
+
+static uint32_t lptim_period(void) {
+    return (lptim.ARR & 0xFFFFU) + 1U;
+}
+
+static void lptim_event(void *arg);
+
+static void lptim_schedule(void) {
+    uint32_t period = lptim_period();
+    uint64_t d, due_us, now = sim_time_us();
+
+    sim_event_cancel(lptim_event, NULL);
+    if (!lp.counting || !(lptim.IER & LPTIM_IER_CMPMIE)) return;
+    d = ((uint64_t)(lptim.CMP & 0xFFFFU) + period - lp.seen % period) % period;
+    if (d == 0) d = period;
+    due_us = lp.start_us + ((lp.seen + d) * 1000000U + lp.lsi_hz - 1U) / lp.lsi_hz;
+    sim_event_schedule(due_us > now ? (uint32_t)(due_us - now) : 0U, lptim_event, NULL);
+}
+
+// Catch up with the time and with the writes made since the last access
+static void lptim_sync(void) {
+    uint32_t period = lptim_period();
+    uint64_t now = lp.seen;
+    int changed = 0;
+
+    if (lp.lsi_hz == 0) {
+        const char *env = getenv("SIM_LSI_HZ");
+        lp.lsi_hz = env != NULL ? (uint32_t)strtoul(env, NULL, 10) : LSI_VALUE;
+        if (lp.lsi_hz == 0) lp.lsi_hz = LSI_VALUE;
+    }
+    if (lp.counting) now = (sim_time_us() - lp.start_us) * lp.lsi_hz / 1000000U;
+    if (now > lp.seen) {
+        uint64_t d = ((uint64_t)lp.cmp + period - lp.seen % period) % period;
+        if (d == 0) d = period;
+        if (now - lp.seen >= d) lptim.ISR |= LPTIM_ISR_CMPM;
+        if (now / period != lp.seen / period) lptim.ISR |= LPTIM_ISR_ARRM;
+        lp.seen = now;
+    }
+
+    lptim.ISR &= ~lptim.ICR;
+    lptim.ICR = 0;
+    if (!(lptim.CR & LPTIM_CR_ENABLE)) {
+        // Disabling resets the counter
+        changed = lp.counting;
+        lp.counting = 0;
+        lp.seen = 0;
+    } else if ((lptim.CR & LPTIM_CR_CNTSTRT) && !lp.counting) {
+        lp.counting = 1;
+        lp.start_us = sim_time_us();
+        lp.seen = 0;
+        changed = 1;
+    }
+    lptim.CR &= ~(LPTIM_CR_CNTSTRT | LPTIM_CR_SNGSTRT);     // cleared by hardware
+    if (lptim.CMP != lp.cmp || lptim.ARR != lp.arr) {
+        lp.cmp = lptim.CMP & 0xFFFFU;
+        lp.arr = lptim.ARR & 0xFFFFU;
+        changed = 1;
+    }
+    // Writes complete at once, so the acknowledge flags always read set
+    if (lptim.CR & LPTIM_CR_ENABLE) lptim.ISR |= LPTIM_ISR_CMPOK | LPTIM_ISR_ARROK;
+    lptim.CNT = (uint32_t)(lp.seen % period);
+    if (changed) lptim_schedule();
+}
+
+static void lptim_event(void *arg) {
+    (void)arg;
+    lptim_sync();
+    if ((lptim.ISR & LPTIM_ISR_CMPM) && (lptim.IER & LPTIM_IER_CMPMIE) &&
+        (sim_exti.IMR & LPTIM_EXTI_LINE) && nvic_enabled[LPTIM1_IRQn]) {
+        LPTIM1_IRQHandler();
+    }
+    lptim_schedule();
+}
+
+// Busy loops on the counter stay preemptible, as on the target
+LPTIM_TypeDef *sim_lptim1(void) {
+    sim_yield_point();
+    lptim_sync();
+    return &lptim;
+}
+
+// --- DMA ---
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma) {
+    hdma->Instance->CR = hdma->Init.Mode;
+    hdma->Instance->NDTR = 0;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma) {
+    hdma->Instance->CR = 0;
+    return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) {
+    (void)hdma;
+}
+
+// --- TIM1 ---
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim) {
+    if (htim->State == 0) HAL_TIM_Base_MspInit(htim);
+    htim->Instance->PSC = htim->Init.Prescaler;
+    htim->Instance->ARR = htim->Init.Period;
+    htim->State = 1;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef *htim) {
+    htim->Instance->PSC = htim->Init.Prescaler;
+    htim->Instance->ARR = htim->Init.Period;
+    htim->State = 1;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim, TIM_ClockConfigTypeDef *conf) {
+    (void)htim;
+    (void)conf;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim,
+                                                        TIM_MasterConfigTypeDef *conf) {
+    (void)htim;
+    (void)conf;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef *htim, TIM_OC_InitTypeDef *conf,
+                                            uint32_t channel) {
+    *(&htim->Instance->CCR1 + (channel >> 2)) = conf->Pulse;
+    return HAL_OK;
+}
+
+static void adc_timer_changed(void);
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t channel) {
+    (void)channel;
+    htim->Instance->CR1 |= 1U;
+    adc_timer_changed();
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t channel) {
+    (void)channel;
+    htim->Instance->CR1 &= ~1U;
+    adc_timer_changed();
+    return HAL_OK;
+}
+
+// --- ADC1 ---
+//
+// Each TIM1 update triggers one scan of the configured ranks into the
+// circular DMA buffer. The model fills half a buffer at a time and raises
+// the half/complete interrupt when that half would have been written.
+// Inputs are slow sine waves with a little noise, different per channel.
+
+static struct {
+    ADC_HandleTypeDef *hadc;
+    uint16_t *buf;
+    uint32_t len;
+    uint8_t half;           // half being filled next
+    uint8_t running;
+    uint8_t scheduled;
+} adc;
+
+static uint32_t adc_sample(uint32_t ch, double t) {
+    double v = 2048.0 + 1200.0 * sin(2.0 * M_PI * t / (120.0 + 30.0 * ch) + ch) +
+               (rand() % 17) - 8;
+    return v < 0 ? 0U : (v > 4095 ? 4095U : (uint32_t)v);
+}
+
+// APB2 timers run at twice PCLK2 when APB2 is divided down
+static uint32_t tim1_clock(void) {
+    return HAL_RCC_GetPCLK2Freq() << (rcc.apb2_div != RCC_HCLK_DIV1 ? 1 : 0);
+}
+
+// Microseconds per half buffer at the current TIM1 rate, 0 if stopped
+static uint32_t adc_half_us(void) {
+    uint64_t tim_ticks;
+    uint32_t ranks = adc.hadc->Init.NbrOfConversion ? adc.hadc->Init.NbrOfConversion : 1;
+
+    if (!(TIM1->CR1 & 1U) || adc.hadc->Init.ExternalTrigConv != ADC_EXTERNALTRIGCONV_T1_CC1) return 0;
+    tim_ticks = (uint64_t)(TIM1->PSC + 1) * (TIM1->ARR + 1);
+    return (uint32_t)(tim_ticks * (adc.len / 2 / ranks) * 1000000U / tim1_clock());
+}
+
+static void adc_event(void *arg) {
+    uint32_t ranks = adc.hadc->Init.NbrOfConversion ? adc.hadc->Init.NbrOfConversion : 1;
+    uint16_t *p = adc.buf + adc.half * (adc.len / 2);
+    double t = sim_time_us() / 1e6;
+    uint32_t us;
+
+    (void)arg;
+    adc.scheduled = 0;
+    if (!adc.running) return;
+
+    for (uint32_t i = 0; i < adc.len / 2; i++) p[i] = (uint16_t)adc_sample(i % ranks, t);
+    adc.hadc->DMA_Handle->Instance->NDTR = adc.half ? adc.len : adc.len / 2;
+    if (adc.half) HAL_ADC_ConvCpltCallback(adc.hadc);
+    else HAL_ADC_ConvHalfCpltCallback(adc.hadc);
+    adc.half ^= 1;
+
+    us = adc_half_us();
+    if (us != 0) {
+        sim_event_schedule(us, adc_event, NULL);
+        adc.scheduled = 1;
+    }
+}
+
+static void adc_timer_changed(void) {
+    uint32_t us;
+
+    if (!adc.running || adc.scheduled) return;
+    us = adc_half_us();
+    if (us == 0) return;
+    sim_event_schedule(us, adc_event, NULL);
+    adc.scheduled = 1;
+}
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc) {
+    uint32_t adcclk = HAL_RCC_GetPCLK2Freq() / (2U * ((hadc->Init.ClockPrescaler >> 16) + 1U));
+
+    if (adcclk > 36000000U) {
+        fprintf(stderr, "sim: ADC clock %lu MHz above 36 MHz\n", (unsigned long)(adcclk / 1000000U));
+    }
+    if (hadc->State == 0) HAL_ADC_MspInit(hadc);
+    hadc->State = 1;
+    hadc->ErrorCode = 0;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_DeInit(ADC_HandleTypeDef *hadc) {
+    HAL_ADC_Stop_DMA(hadc);
+    HAL_ADC_MspDeInit(hadc);
+    hadc->State = 0;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *hadc, ADC_ChannelConfTypeDef *conf) {
+    (void)hadc;
+    return conf->Rank >= 1 && conf->Rank <= 16 ? HAL_OK : HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *buf, uint32_t len) {
+    if (adc.running || len < 2) return HAL_BUSY;
+    adc.hadc = hadc;
+    adc.buf = (uint16_t *)buf;
+    adc.len = len;
+    adc.half = 0;
+    adc.running = 1;
+    hadc->DMA_Handle->Instance->NDTR = len;
+    adc_timer_changed();
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc) {
+    (void)hadc;
+    adc.running = 0;
+    adc.scheduled = 0;
+    sim_event_cancel(adc_event, NULL);
+    return HAL_OK;
+}
+
+// --- Weak defaults, as in the HAL ---
+
+__attribute__((weak)) void HAL_MspInit(void) {}
+__attribute__((weak)) void HAL_GPIO_EXTI_Callback(uint16_t pin) { (void)pin; }
+__attribute__((weak)) void HAL_ADC_MspInit(ADC_HandleTypeDef *hadc) { (void)hadc; }
+__attribute__((weak)) void HAL_ADC_MspDeInit(ADC_HandleTypeDef *hadc) { (void)hadc; }
+__attribute__((weak)) void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc) { (void)hadc; }
+__attribute__((weak)) void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc) { (void)hadc; }
+__attribute__((weak)) void HAL_ADC_ErrorCallback(ADC_HandleTypeDef *hadc) { (void)hadc; }
+__attribute__((weak)) void HAL_TIM_Base_MspInit(TIM_HandleTypeDef *htim) { (void)htim; }
+__attribute__((weak)) void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef *htim) { (void)htim; }
+__attribute__((weak)) void HAL_TIM_MspPostInit(TIM_HandleTypeDef *htim) { (void)htim; }
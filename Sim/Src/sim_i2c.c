@@ -0,0 +1,464 @@
+// I2C1 for the host simulation, with the devices on the board's bus:
+// the ADS1115 ADC, the ST7032 character LCD and the SSD1306 OLED.
+// Addresses without a device NACK.
+//
+// Transfers take their wire time at the configured clock. Blocking calls
+// busy wait for it; interrupt and DMA transfers complete from a device
+// timer, moving the data at that moment.
+
+#include "main.h"
+#include "sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+I2C_TypeDef sim_i2c1;
+
+typedef struct {
+    uint8_t addr;                                   // 8-bit form, as the HAL takes it
+    void (*write)(const uint8_t *data, uint16_t len);
+    void (*read)(uint8_t *data, uint16_t len);
+} sim_i2c_dev_t;
+
+// --- ADS1115 ---
+//
+// Inputs are slow waves around 0.5, 1.0, 1.5 and 2.0 V. The conversion
+// takes 1/DR; ALERT/RDY in conversion-ready mode (lo threshold MSB 0, hi
+// threshold MSB 1) pulses low after each continuous conversion and goes
+// low at the end of a single shot until the next one starts.
+
+#define ADS_OS          0x8000U
+#define ADS_MODE_SINGLE 0x0100U
+
+static const uint16_t ads_sps[8] = { 8, 16, 32, 64, 128, 250, 475, 860 };
+static const double ads_fs[8] = { 6.144, 4.096, 2.048, 1.024, 0.512, 0.256, 0.256, 0.256 };
+
+static struct {
+    uint8_t pointer;
+    uint16_t config, lo, hi, conv;
+    uint8_t converting;
+} ads = { .config = 0x8583, .lo = 0x8000, .hi = 0x7FFF };
+
+static double ads_input(uint32_t ch) {
+    double t = sim_time_us() / 1e6;
+    return 0.5 * (ch + 1) + 0.1 * sin(2.0 * M_PI * t / (60.0 + 20.0 * ch)) +
+           ((rand() % 201) - 100) * 1e-5;
+}
+
+static int ads_rdy_mode(void) {
+    return (ads.config & 0x3U) != 0x3U && !(ads.lo & 0x8000U) && (ads.hi & 0x8000U);
+}
+
+static void ads_convert(void *arg) {
+    static const uint8_t diff[4][2] = { { 0, 1 }, { 0, 3 }, { 1, 3 }, { 2, 3 } };
+    uint32_t mux = (ads.config >> 12) & 0x7U;
+    double v, code;
+
+    (void)arg;
+    if (mux >= 4) v = ads_input(mux - 4);
+    else v = ads_input(diff[mux][0]) - ads_input(diff[mux][1]);
+    code = v / ads_fs[(ads.config >> 9) & 0x7U] * 32768.0;
+    if (code > 32767.0) code = 32767.0;
+    if (code < -32768.0) code = -32768.0;
+    ads.conv = (uint16_t)(int16_t)code;
+
+    if (ads.config & ADS_MODE_SINGLE) {
+        ads.converting = 0;
+        ads.config |= ADS_OS;
+        if (ads_rdy_mode()) sim_gpio_set_input(ADS_ALRT_GPIO_Port, ADS_ALRT_Pin, 0);
+    } else {
+        if (ads_rdy_mode()) {
+            sim_gpio_set_input(ADS_ALRT_GPIO_Port, ADS_ALRT_Pin, 0);
+            sim_gpio_set_input(ADS_ALRT_GPIO_Port, ADS_ALRT_Pin, 1);
+        }
+        sim_event_schedule(1000000U / ads_sps[(ads.config >> 5) & 0x7U], ads_convert, NULL);
+    }
+}
+
+static void ads_config_written(uint16_t value) {
+    sim_event_cancel(ads_convert, NULL);
+    ads.converting = 0;
+    ads.config = (value & ~ADS_OS) | ADS_OS;    // idle until a conversion starts
+
+    if ((value & ADS_MODE_SINGLE) && !(value & ADS_OS)) return;
+    sim_gpio_set_input(ADS_ALRT_GPIO_Port, ADS_ALRT_Pin, 1);
+    ads.converting = 1;
+    if (value & ADS_MODE_SINGLE) ads.config &= ~ADS_OS;
+    sim_event_schedule(1000000U / ads_sps[(value >> 5) & 0x7U], ads_convert, NULL);
+}
+
+static void ads_write(const uint8_t *data, uint16_t len) {
+    uint16_t value;
+
+    if (len == 0) return;
+    ads.pointer = data[0] & 0x3U;
+    if (len < 3) return;
+    value = (uint16_t)(data[1] << 8 | data[2]);
+    switch (ads.pointer) {
+    case 1: ads_config_written(value); break;
+    case 2: ads.lo = value; break;
+    case 3: ads.hi = value; break;
+    default: break;                             // conversion register is read only
+    }
+}
+
+static void ads_read(uint8_t *data, uint16_t len) {
+    uint16_t regs[4] = { ads.conv, ads.config, ads.lo, ads.hi };
+    uint16_t value = regs[ads.pointer];
+
+    for (uint16_t i = 0; i < len; i++) data[i] = (i & 1) ? (value & 0xFF) : (value >> 8);
+}
+
+// --- ST7032 ---
+//
+// Keeps the DDRAM and prints both visible lines to stderr once they have
+// been stable for 100 ms after a change.
+
+static struct {
+    uint8_t ddram[0x68];
+    uint8_t addr;
+    uint8_t is;             // instruction table select
+    uint8_t cgram;          // data goes to CGRAM
+    uint8_t shown[2][17];
+} lcd;
+
+static void lcd_show(void *arg) {
+    char line[2][17];
+
+    (void)arg;
+    for (int row = 0; row < 2; row++) {
+        for (int col = 0; col < 16; col++) {
+            uint8_t c = lcd.ddram[row * 0x40 + col];
+            line[row][col] = (c < 8 || c == 0xFF) ? '#' : ((c < 0x20 || c > 0x7E) ? '?' : (char)c);
+        }
+        line[row][16] = '\0';
+    }
+    if (memcmp(line, lcd.shown, sizeof(line)) == 0) return;
+    memcpy(lcd.shown, line, sizeof(line));
+    fprintf(stderr, "lcd: [%s] [%s]\n", line[0], line[1]);
+}
+
+static void lcd_changed(void) {
+    sim_event_cancel(lcd_show, NULL);
+    sim_event_schedule(100000U, lcd_show, NULL);
+}
+
+static void lcd_command(uint8_t cmd) {
+    if (cmd & 0x80) {
+        lcd.addr = cmd & 0x7F;
+        lcd.cgram = 0;
+    } else if ((cmd & 0xC0) == 0x40 && !lcd.is) {
+        lcd.cgram = 1;
+    } else if ((cmd & 0xE0) == 0x20) {
+        lcd.is = cmd & 0x01;
+    } else if (cmd == 0x01) {
+        memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+        lcd.addr = 0;
+        lcd.cgram = 0;
+        lcd_changed();
+    } else if ((cmd & 0xFE) == 0x02) {
+        lcd.addr = 0;
+    }
+}
+
+static void lcd_data(uint8_t c) {
+    if (lcd.cgram) return;
+    if (lcd.addr < sizeof(lcd.ddram)) lcd.ddram[lcd.addr] = c;
+    lcd.addr = (lcd.addr == 0x27) ? 0x40 : (lcd.addr == 0x67 ? 0x00 : lcd.addr + 1);
+    lcd_changed();
+}
+
+// Control byte: Co (bit 7) = another control byte follows the next byte,
+// RS (bit 6) = data instead of command
+static void lcd_write(const uint8_t *data, uint16_t len) {
+    uint16_t i = 0;
+
+    while (i < len) {
+        uint8_t control = data[i++];
+        int rs = control & 0x40;
+
+        if (control & 0x80) {
+            if (i < len) {
+                if (rs) lcd_data(data[i]);
+                else lcd_command(data[i]);
+                i++;
+            }
+            continue;
+        }
+        for (; i < len; i++) {
+            if (rs) lcd_data(data[i]);
+            else lcd_command(data[i]);
+        }
+    }
+}
+
+static void lcd_read(uint8_t *data, uint16_t len) {
+    memset(data, 0, len);       // busy flag clear
+}
+
+// --- SSD1306 ---
+
+static void oled_write(const uint8_t *data, uint16_t len) {
+    (void)data;
+    (void)len;
+}
+
+static void oled_read(uint8_t *data, uint16_t len) {
+    memset(data, 0, len);
+}
+
+static const sim_i2c_dev_t devices[] = {
+    { 0x48 << 1, ads_write, ads_read },
+    { 0x3E << 1, lcd_write, lcd_read },
+    { 0x3C << 1, oled_write, oled_read },
+};
+
+static const sim_i2c_dev_t *find_device(uint16_t addr) {
+    for (size_t i = 0; i < sizeof(devices) / sizeof(devices[0]); i++) {
+        if (devices[i].addr == (addr & 0xFE)) return &devices[i];
+    }
+    return NULL;
+}
+
+void sim_i2c_init(void) {
+    memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+}
+
+// --- Transfers ---
+
+typedef enum { XFER_TX, XFER_RX, XFER_MEM_TX, XFER_MEM_RX } xfer_kind_t;
+
+static struct {
+    I2C_HandleTypeDef *hi2c;
+    xfer_kind_t kind;
+    uint16_t addr, reg;
+    uint8_t *data;
+    uint16_t len;
+} pending;
+
+static uint32_t wire_us(I2C_HandleTypeDef *hi2c, uint32_t bytes) {
+    uint32_t hz = hi2c->Init.ClockSpeed ? hi2c->Init.ClockSpeed : 100000U;
+    return (uint32_t)((uint64_t)bytes * 9U * 1000000U / hz) + 1U;
+}
+
+// Moves the data; returns 0 on an address NACK
+static int do_xfer(xfer_kind_t kind, uint16_t addr, uint16_t reg, uint8_t *data, uint16_t len) {
+    const sim_i2c_dev_t *dev = find_device(addr);
+    uint8_t buf[260];
+
+    if (dev == NULL) return 0;
+    switch (kind) {
+    case XFER_TX:
+        dev->write(data, len);
+        break;
+    case XFER_RX:
+        dev->read(data, len);
+        break;
+    case XFER_MEM_TX:
+        while (len > sizeof(buf) - 1) {         // only the OLED sends more, and it ignores it
+            dev->write(data, sizeof(buf) - 1);
+            data += sizeof(buf) - 1;
+            len -= sizeof(buf) - 1;
+        }
+        buf[0] = (uint8_t)reg;
+        memcpy(&buf[1], data, len);
+        dev->write(buf, len + 1);
+        break;
+    case XFER_MEM_RX:
+        buf[0] = (uint8_t)reg;
+        dev->write(buf, 1);
+        dev->read(data, len);
+        break;
+    }
+    return 1;
+}
+
+static uint32_t xfer_bytes(xfer_kind_t kind, uint16_t len) {
+    // address byte, plus register and repeated start address for memory access
+    return 1U + len + (kind == XFER_MEM_TX ? 1U : 0U) + (kind == XFER_MEM_RX ? 2U : 0U);
+}
+
+static HAL_StatusTypeDef run_blocking(I2C_HandleTypeDef *hi2c, xfer_kind_t kind, uint16_t addr,
+                                      uint16_t reg, uint8_t *data, uint16_t len) {
+    int acked;
+
+    if (hi2c->State != HAL_I2C_STATE_READY) return HAL_BUSY;
+    hi2c->State = (kind == XFER_RX || kind == XFER_MEM_RX) ? HAL_I2C_STATE_BUSY_RX : HAL_I2C_STATE_BUSY_TX;
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    acked = do_xfer(kind, addr, reg, data, len);
+    sim_busy_wait_us(wire_us(hi2c, acked ? xfer_bytes(kind, len) : 1U));
+    hi2c->State = HAL_I2C_STATE_READY;
+    if (!acked) {
+        hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+        return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+static void xfer_done(void *arg) {
+    I2C_HandleTypeDef *hi2c = pending.hi2c;
+    int acked;
+
+    (void)arg;
+    acked = do_xfer(pending.kind, pending.addr, pending.reg, pending.data, pending.len);
+    pending.hi2c = NULL;
+    hi2c->State = HAL_I2C_STATE_READY;
+    if (!acked) {
+        hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+        HAL_I2C_ErrorCallback(hi2c);
+        return;
+    }
+    switch (pending.kind) {
+    case XFER_TX: HAL_I2C_MasterTxCpltCallback(hi2c); break;
+    case XFER_RX: HAL_I2C_MasterRxCpltCallback(hi2c); break;
+    case XFER_MEM_TX: HAL_I2C_MemTxCpltCallback(hi2c); break;
+    case XFER_MEM_RX: HAL_I2C_MemRxCpltCallback(hi2c); break;
+    }
+}
+
+static HAL_StatusTypeDef start_async(I2C_HandleTypeDef *hi2c, xfer_kind_t kind, uint16_t addr,
+                                     uint16_t reg, uint8_t *data, uint16_t len) {
+    uint32_t bytes;
+
+    if (hi2c->State != HAL_I2C_STATE_READY) return HAL_BUSY;
+    if (data == NULL || len == 0) return HAL_ERROR;
+    hi2c->State = (kind == XFER_RX || kind == XFER_MEM_RX) ? HAL_I2C_STATE_BUSY_RX : HAL_I2C_STATE_BUSY_TX;
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    hi2c->pBuffPtr = data;
+    hi2c->XferSize = len;
+    pending.hi2c = hi2c;
+    pending.kind = kind;
+    pending.addr = addr;
+    pending.reg = reg;
+    pending.data = data;
+    pending.len = len;
+    bytes = find_device(addr) ? xfer_bytes(kind, len) : 1U;
+    sim_event_schedule(wire_us(hi2c, bytes), xfer_done, NULL);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c) {
+    if (hi2c->State == HAL_I2C_STATE_RESET) HAL_I2C_MspInit(hi2c);
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    hi2c->State = HAL_I2C_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c) {
+    if (pending.hi2c == hi2c) {
+        sim_event_cancel(xfer_done, NULL);
+        pending.hi2c = NULL;
+    }
+    HAL_I2C_MspDeInit(hi2c);
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    hi2c->State = HAL_I2C_STATE_RESET;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                          uint16_t len, uint32_t timeout) {
+    (void)timeout;
+    return run_blocking(hi2c, XFER_TX, addr, 0, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                         uint16_t len, uint32_t timeout) {
+    (void)timeout;
+    return run_blocking(hi2c, XFER_RX, addr, 0, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                    uint16_t reg_size, uint8_t *data, uint16_t len, uint32_t timeout) {
+    (void)reg_size;
+    (void)timeout;
+    return run_blocking(hi2c, XFER_MEM_TX, addr, reg, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                   uint16_t reg_size, uint8_t *data, uint16_t len, uint32_t timeout) {
+    (void)reg_size;
+    (void)timeout;
+    return run_blocking(hi2c, XFER_MEM_RX, addr, reg, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t addr, uint32_t trials,
+                                        uint32_t timeout) {
+    (void)timeout;
+    if (hi2c->State != HAL_I2C_STATE_READY) return HAL_BUSY;
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    for (uint32_t i = 0; i < trials; i++) {
+        sim_busy_wait_us(wire_us(hi2c, 1U));
+        if (find_device(addr) != NULL) return HAL_OK;
+    }
+    hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                             uint16_t len) {
+    return start_async(hi2c, XFER_TX, addr, 0, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                            uint16_t len) {
+    return start_async(hi2c, XFER_RX, addr, 0, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                              uint16_t len) {
+    return start_async(hi2c, XFER_TX, addr, 0, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data,
+                                             uint16_t len) {
+    return start_async(hi2c, XFER_RX, addr, 0, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                       uint16_t reg_size, uint8_t *data, uint16_t len) {
+    (void)reg_size;
+    return start_async(hi2c, XFER_MEM_TX, addr, reg, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                      uint16_t reg_size, uint8_t *data, uint16_t len) {
+    (void)reg_size;
+    return start_async(hi2c, XFER_MEM_RX, addr, reg, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                        uint16_t reg_size, uint8_t *data, uint16_t len) {
+    (void)reg_size;
+    return start_async(hi2c, XFER_MEM_TX, addr, reg, data, len);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t addr, uint16_t reg,
+                                       uint16_t reg_size, uint8_t *data, uint16_t len) {
+    (void)reg_size;
+    return start_async(hi2c, XFER_MEM_RX, addr, reg, data, len);
+}
+
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c) {
+    return hi2c->State;
+}
+
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c) {
+    return hi2c->ErrorCode;
+}
+
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef *hi2c) {
+    (void)hi2c;
+}
+
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef *hi2c) {
+    (void)hi2c;
+}
+
+__attribute__((weak)) void HAL_I2C_MspInit(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_MspDeInit(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
@@ -0,0 +1,1310 @@
+// FreeRTOS kernel stand-in for the host simulation: tasks are POSIX
+// threads, scheduled one at a time on a single logical CPU (see sim.h).
+//
+// The CPU is the `cpu` mutex. The task in `current` owns it while it runs;
+// every other task thread sleeps on its own condition variable until the
+// scheduler makes it current. Interrupt threads take the mutex between two
+// yield points of the running task. Priorities, round-robin time slicing,
+// blocking with timeouts and the FromISR wake-ups follow FreeRTOS; priority
+// inheritance and stack overflow checking are not modelled.
+//
+// Run-time stats are kept as on the target: at every switch the outgoing
+// task is charged with portGET_RUN_TIME_COUNTER_VALUE() since it got the
+// CPU. The idle task is a real task at priority 0; with
+// configUSE_TICKLESS_IDLE it calls portSUPPRESS_TICKS_AND_SLEEP, and the
+// tick comes from a SysTick model the firmware can stop and reprogram.
+
+#define _GNU_SOURCE
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "stream_buffer.h"
+#include "event_groups.h"
+#include "cmsis_os2.h"
+#include "stm32f4xx_hal.h"
+#include "sim.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_THREAD_STACK    (256 * 1024)    // host stack per task
+#define SIM_TCB_BYTES       92              // size of a TCB on the target
+#define SIM_HEAP_OVERHEAD   8               // heap_4 block header
+
+typedef struct tskTaskControlBlock {
+    pthread_t thread;
+    pthread_cond_t run;                 // signalled when the task gets the CPU
+    TaskFunction_t fn;
+    void *arg;
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    UBaseType_t number;
+    uint32_t stack_words;
+    eTaskState state;
+    const void *wait_obj;               // what a blocked task sleeps on
+    TickType_t wake_tick;
+    uint8_t timed;                      // wake_tick applies
+    uint8_t timed_out;
+    uint8_t dynamic;
+    uint8_t notify_pending;
+    uint32_t notify_value;
+    uint32_t runtime;                   // run-time counter ticks on the CPU
+    struct tskTaskControlBlock *next;   // all tasks, in creation order
+} TCB_t;
+
+enum { Q_QUEUE, Q_BINARY, Q_COUNTING, Q_MUTEX, Q_RECURSIVE };
+
+struct QueueDefinition {
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t read;                   // index of the oldest item
+    uint8_t type;
+    uint8_t dynamic;
+    TCB_t *holder;                      // mutexes
+    UBaseType_t recursion;
+};
+
+struct StreamBufferDef_t {
+    uint8_t *buf;
+    size_t size;
+    size_t trigger;
+    size_t head;                        // free-running byte counters
+    size_t tail;
+    uint8_t dynamic;
+};
+
+struct EventGroupDef_t {
+    EventBits_t bits;
+    uint8_t dynamic;
+};
+
+_Static_assert(sizeof(struct QueueDefinition) <= sizeof(StaticQueue_t), "StaticQueue_t too small");
+_Static_assert(sizeof(struct StreamBufferDef_t) <= sizeof(StaticStreamBuffer_t),
+               "StaticStreamBuffer_t too small");
+_Static_assert(sizeof(struct EventGroupDef_t) <= sizeof(StaticEventGroup_t), "StaticEventGroup_t too small");
+
+static pthread_mutex_t cpu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t isr_done = PTHREAD_COND_INITIALIZER;
+static struct timespec boot_time;
+
+static TCB_t *tasks;
+static TCB_t *current;                  // owns the CPU, NULL before the scheduler starts
+static TCB_t *idle_task;
+static uint32_t switched_at;            // run-time counter when current got the CPU
+static volatile int started;
+static int suspended;                   // vTaskSuspendAll nesting
+static int critical_nesting;
+static int primask;                     // __disable_irq
+static int need_switch;                 // a task was readied
+static int slice_due;                   // a tick went by
+static int isr_pending;                 // interrupt threads waiting for the CPU
+static UBaseType_t task_count;
+static TickType_t tick_count;
+static const char delay_key;            // what vTaskDelay sleeps on
+
+static __thread TCB_t *self;            // NULL in the main thread and interrupts
+static __thread int in_isr;
+
+static pthread_mutex_t wfi_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wfi_cond = PTHREAD_COND_INITIALIZER;
+
+// SysTick. The registers are what the firmware reads and writes; `st` is
+// the counter behind them, brought up to date at every access.
+static SysTick_Type systick;
+static SCB_Type scb;
+static pthread_mutex_t systick_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    uint32_t ctrl;                      // registers as of the last access
+    uint32_t val;
+    uint64_t next_ns;                   // end of the running period
+    uint64_t left_ns;                   // rest of the period while stopped
+    uint32_t pended;                    // periods ended, tick not yet taken
+} st = { .val = UINT32_MAX };           // so the first VAL write is seen
+
+static size_t heap_used;
+static size_t heap_min_free = configTOTAL_HEAP_SIZE;
+
+// --- Time ---
+
+uint64_t sim_time_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - boot_time.tv_sec) * 1000000U +
+           (now.tv_nsec - boot_time.tv_nsec) / 1000;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+}
+
+static void sleep_us(uint32_t us) {
+    struct timespec ts = { us / 1000000U, (long)(us % 1000000U) * 1000 };
+    while (nanosleep(&ts, &ts) != 0) {}
+}
+
+// --- Scheduler core, all with the CPU held ---
+
+static int runnable(const TCB_t *t) {
+    return t->state == eReady || t->state == eRunning;
+}
+
+// Highest priority runnable task; ties go to the first one after `after`
+// so equal priorities take turns
+static TCB_t *pick_next(TCB_t *after) {
+    TCB_t *start = (after != NULL && after->next != NULL) ? after->next : tasks;
+    TCB_t *best = NULL;
+    TCB_t *t = start;
+
+    if (tasks == NULL) return NULL;
+    do {
+        if (runnable(t) && (best == NULL || t->priority > best->priority)) best = t;
+        t = (t->next != NULL) ? t->next : tasks;
+    } while (t != start);
+    return best;
+}
+
+static uint32_t runtime_now(void) {
+    uint32_t now;
+
+    critical_nesting++;                 // the counter masks interrupts; no switch from in here
+    now = portGET_RUN_TIME_COUNTER_VALUE();
+    critical_nesting--;
+    return now;
+}
+
+static void make_current(TCB_t *t) {
+    uint32_t now = runtime_now();
+
+    if (current != NULL) current->runtime += now - switched_at;
+    switched_at = now;
+    current = t;
+    if (t != NULL) {
+        t->state = eRunning;
+        pthread_cond_signal(&t->run);
+    }
+}
+
+// Give the CPU to the best other task and sleep until it comes back
+static void switch_out(TCB_t *me) {
+    TCB_t *next;
+
+    if (me->state == eRunning) me->state = eReady;
+    next = pick_next(me);
+    if (next == me) {
+        me->state = eRunning;
+        return;
+    }
+    make_current(next);
+    while (current != me) pthread_cond_wait(&me->run, &cpu);
+}
+
+static void make_ready(TCB_t *t) {
+    t->state = eReady;
+    t->wait_obj = NULL;
+    t->timed = 0;
+    if (current == NULL || t->priority > current->priority) need_switch = 1;
+}
+
+// Block the calling task on obj for up to timeout ticks; 0 on timeout.
+// Only tasks can block: the main thread and interrupts get 0 at once.
+static int block_on(const void *obj, TickType_t timeout) {
+    TCB_t *me = self;
+
+    if (timeout == 0 || me == NULL || in_isr || !started) return 0;
+    me->state = eBlocked;
+    me->wait_obj = obj;
+    me->timed = (timeout != portMAX_DELAY);
+    me->wake_tick = tick_count + timeout;
+    me->timed_out = 0;
+    switch_out(me);
+    return !me->timed_out;
+}
+
+// Wake the highest priority task sleeping on obj
+static TCB_t *wake_one(const void *obj, BaseType_t *woken) {
+    TCB_t *best = NULL;
+
+    for (TCB_t *t = tasks; t != NULL; t = t->next) {
+        if (t->state == eBlocked && t->wait_obj == obj &&
+            (best == NULL || t->priority > best->priority)) {
+            best = t;
+        }
+    }
+    if (best == NULL) return NULL;
+    make_ready(best);
+    if (woken != NULL && current != NULL && best->priority > current->priority) *woken = pdTRUE;
+    return best;
+}
+
+static void systick_isr(void);
+
+void sim_yield_point(void) {
+    TCB_t *me = self;
+    int slice;
+
+    if (me == NULL || in_isr || critical_nesting != 0 || primask) return;
+    while (__atomic_load_n(&isr_pending, __ATOMIC_ACQUIRE) != 0) {
+        pthread_cond_wait(&isr_done, &cpu);
+    }
+    // A tick the firmware saw pending (SCB->ICSR) is taken now, without
+    // waiting for the tick thread to be scheduled by the host
+    if (st.pended != 0) {
+        in_isr = 1;
+        systick_isr();
+        in_isr = 0;
+    }
+    if (suspended != 0 || (!need_switch && !slice_due)) return;
+
+    slice = slice_due;
+    need_switch = slice_due = 0;
+    TCB_t *next = pick_next(me);
+    if (next != me && (slice || next->priority > me->priority)) switch_out(me);
+}
+
+static TickType_t remaining(TickType_t start, TickType_t timeout) {
+    TickType_t elapsed = tick_count - start;
+
+    if (timeout == portMAX_DELAY) return portMAX_DELAY;
+    return (elapsed >= timeout) ? 0 : timeout - elapsed;
+}
+
+// --- Interrupts ---
+
+void sim_isr_enter(void) {
+    __atomic_add_fetch(&isr_pending, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_lock(&wfi_lock);
+    pthread_cond_broadcast(&wfi_cond);
+    pthread_mutex_unlock(&wfi_lock);
+    pthread_mutex_lock(&cpu);
+    __atomic_sub_fetch(&isr_pending, 1, __ATOMIC_ACQ_REL);
+    in_isr = 1;
+}
+
+void sim_isr_exit(void) {
+    in_isr = 0;
+    if (started && current == NULL) make_current(pick_next(NULL));
+    pthread_cond_broadcast(&isr_done);
+    pthread_mutex_unlock(&cpu);
+}
+
+int sim_in_isr(void) {
+    return in_isr;
+}
+
+uint32_t __get_IPSR(void) {
+    return in_isr ? 16U : 0U;
+}
+
+void vPortYieldFromISR(BaseType_t woken) {
+    if (woken) need_switch = 1;
+}
+
+static void tick_one(void) {
+    tick_count++;
+    for (TCB_t *t = tasks; t != NULL; t = t->next) {
+        if (t->state == eBlocked && t->timed && (int32_t)(tick_count - t->wake_tick) >= 0) {
+            t->timed_out = 1;
+            make_ready(t);
+        }
+    }
+    slice_due = 1;
+}
+
+static uint64_t cycles_ns(uint64_t cycles) {
+    return cycles * 1000000000U / SystemCoreClock;
+}
+
+// Brings the counter up to date with the time and with register writes
+// made since the last access. Called with systick_lock and the CPU held.
+static void systick_sync(void) {
+    uint64_t now = now_ns();
+    uint64_t cycles;
+
+    // Periods that ran out; each reload takes LOAD as it is at that moment
+    if ((st.ctrl & SysTick_CTRL_ENABLE_Msk) && systick.LOAD != 0) {
+        while (now >= st.next_ns) {
+            if (st.ctrl & SysTick_CTRL_TICKINT_Msk) st.pended++;
+            st.next_ns += cycles_ns((uint64_t)systick.LOAD + 1U);
+        }
+        st.left_ns = st.next_ns - now;
+    }
+    if (scb.ICSR & SCB_ICSR_PENDSTCLR_Msk) st.pended = 0;
+    if (systick.VAL != st.val) st.left_ns = cycles_ns((uint64_t)systick.LOAD + 1U);
+    if (systick.CTRL & SysTick_CTRL_ENABLE_Msk) st.next_ns = now + st.left_ns;
+
+    cycles = st.left_ns * SystemCoreClock / 1000000000U;
+    cycles = cycles != 0 ? cycles - 1U : 0;
+    st.val = systick.VAL = (uint32_t)(cycles > systick.LOAD ? systick.LOAD : cycles);
+    st.ctrl = systick.CTRL;
+    scb.ICSR = st.pended ? SCB_ICSR_PENDSTSET_Msk : 0;
+}
+
+SysTick_Type *sim_systick(void) {
+    pthread_mutex_lock(&systick_lock);
+    systick_sync();
+    pthread_mutex_unlock(&systick_lock);
+    return &systick;
+}
+
+SCB_Type *sim_scb(void) {
+    sim_systick();
+    return &scb;
+}
+
+// SysTick interrupt, with the CPU held. Ticks missed while the CPU was
+// held are all taken, so host stalls do not slow the tick down.
+static void systick_isr(void) {
+    uint32_t ticks;
+
+    pthread_mutex_lock(&systick_lock);
+    systick_sync();
+    ticks = st.pended;
+    st.pended = 0;
+    scb.ICSR = 0;
+    pthread_mutex_unlock(&systick_lock);
+    while (ticks-- > 0) tick_one();
+}
+
+static void *tick_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        uint64_t wake = now_ns() + 1000000U;
+        struct timespec ts;
+        int due;
+
+        pthread_mutex_lock(&systick_lock);
+        if ((st.ctrl & SysTick_CTRL_ENABLE_Msk) && st.next_ns < wake) wake = st.next_ns;
+        pthread_mutex_unlock(&systick_lock);
+        ts.tv_sec = (time_t)(wake / 1000000000U);
+        ts.tv_nsec = (long)(wake % 1000000000U);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        if (!started) continue;
+
+        // Only take the CPU for a period that ended; a stopped SysTick
+        // must not end a WFI
+        pthread_mutex_lock(&systick_lock);
+        due = st.pended != 0 || ((st.ctrl & SysTick_CTRL_ENABLE_Msk) && now_ns() >= st.next_ns);
+        pthread_mutex_unlock(&systick_lock);
+        if (!due) continue;
+
+        sim_isr_enter();
+        systick_isr();
+        sim_isr_exit();
+    }
+    return NULL;
+}
+
+void sim_busy_wait_us(uint32_t us) {
+    static uint32_t debt_us;
+
+    // Sleeping has a floor of tens of microseconds, so short waits are
+    // collected and slept off together
+    debt_us += us;
+    if (debt_us < 200) return;
+    us = debt_us;
+    debt_us = 0;
+
+    if (self == NULL || in_isr || critical_nesting != 0 || primask) {
+        sleep_us(us);
+        return;
+    }
+    // Interrupts run meanwhile, and a task they wake can preempt us
+    while (us > 0) {
+        uint32_t step = us > 1000 ? 1000 : us;
+        pthread_mutex_unlock(&cpu);
+        sleep_us(step);
+        pthread_mutex_lock(&cpu);
+        us -= step;
+        sim_yield_point();
+    }
+}
+
+void sim_kernel_init(void) {
+    pthread_t th;
+
+    clock_gettime(CLOCK_MONOTONIC, &boot_time);
+    pthread_mutex_lock(&cpu);          // the main thread runs until the scheduler starts
+    pthread_create(&th, NULL, tick_thread, NULL);
+    pthread_detach(th);
+}
+
+void vAssertCalled(const char *file, int line) {
+    fprintf(stderr, "sim: assertion failed at %s:%d\n", file, line);
+    abort();
+}
+
+// --- PRIMASK and WFI ---
+
+void __disable_irq(void) {
+    primask = 1;
+}
+
+void __enable_irq(void) {
+    primask = 0;
+    sim_yield_point();
+}
+
+// With interrupts masked the CPU is kept and the pending interrupt runs
+// after they are unmasked; otherwise it runs here
+void sim_wfi(void) {
+    if (self == NULL || in_isr) return;
+    if (primask || critical_nesting != 0) {
+        pthread_mutex_lock(&wfi_lock);
+        while (__atomic_load_n(&isr_pending, __ATOMIC_ACQUIRE) == 0) {
+            pthread_cond_wait(&wfi_cond, &wfi_lock);
+        }
+        pthread_mutex_unlock(&wfi_lock);
+        return;
+    }
+    if (__atomic_load_n(&isr_pending, __ATOMIC_ACQUIRE) == 0) pthread_cond_wait(&isr_done, &cpu);
+    sim_yield_point();
+}
+
+// --- Critical sections ---
+
+void vPortEnterCritical(void) {
+    critical_nesting++;
+}
+
+void vPortExitCritical(void) {
+    if (--critical_nesting == 0) sim_yield_point();
+}
+
+UBaseType_t ulPortSetInterruptMask(void) {
+    critical_nesting++;
+    return 0;
+}
+
+void vPortClearInterruptMask(UBaseType_t mask) {
+    (void)mask;
+    if (--critical_nesting == 0) sim_yield_point();
+}
+
+// --- Heap ---
+
+// Charge cost bytes to the simulated heap; 0 if it does not fit
+static int heap_take(size_t cost) {
+    if (heap_used + cost > configTOTAL_HEAP_SIZE) return 0;
+    heap_used += cost;
+    if (configTOTAL_HEAP_SIZE - heap_used < heap_min_free) heap_min_free = configTOTAL_HEAP_SIZE - heap_used;
+    return 1;
+}
+
+static size_t heap_cost(size_t size) {
+    return ((size + 7) & ~(size_t)7) + SIM_HEAP_OVERHEAD;
+}
+
+// The host allocates; the block records what it costs on the target
+void *pvPortMalloc(size_t size) {
+    size_t *p;
+
+    if (!heap_take(heap_cost(size))) return NULL;
+    p = malloc(sizeof(size_t) * 2 + size);
+    if (p == NULL) abort();
+    p[0] = heap_cost(size);
+    return &p[2];
+}
+
+void vPortFree(void *ptr) {
+    size_t *p = (size_t *)ptr - 2;
+
+    if (ptr == NULL) return;
+    heap_used -= p[0];
+    free(p);
+}
+
+size_t xPortGetFreeHeapSize(void) {
+    return configTOTAL_HEAP_SIZE - heap_used;
+}
+
+size_t xPortGetMinimumEverFreeHeapSize(void) {
+    return heap_min_free;
+}
+
+// --- Tasks ---
+
+static void *task_thread(void *arg) {
+    TCB_t *t = arg;
+
+    self = t;
+    pthread_mutex_lock(&cpu);
+    while (current != t) pthread_cond_wait(&t->run, &cpu);
+    t->fn(t->arg);
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+static TCB_t *task_create(TaskFunction_t fn, const char *name, uint32_t stack_words,
+                          void *arg, UBaseType_t prio, TCB_t *t) {
+    pthread_attr_t attr;
+
+    memset(t, 0, sizeof(*t));
+    t->fn = fn;
+    t->arg = arg;
+    snprintf(t->name, sizeof(t->name), "%s", name != NULL ? name : "");
+    t->priority = prio < configMAX_PRIORITIES ? prio : configMAX_PRIORITIES - 1;
+    t->stack_words = stack_words;
+    t->number = ++task_count;
+    t->state = eReady;
+    pthread_cond_init(&t->run, NULL);
+
+    if (tasks == NULL) {
+        tasks = t;
+    } else {
+        TCB_t *last = tasks;
+        while (last->next != NULL) last = last->next;
+        last->next = t;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SIM_THREAD_STACK);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&t->thread, &attr, task_thread, t) != 0) {
+        fprintf(stderr, "sim: cannot start thread for task %s\n", t->name);
+        abort();
+    }
+    pthread_attr_destroy(&attr);
+
+    if (started && (current == NULL || t->priority > current->priority)) need_switch = 1;
+    sim_yield_point();
+    return t;
+}
+
+// Stack and TCB are separate heap blocks on the target
+static size_t task_heap_cost(uint32_t stack_words) {
+    return heap_cost(SIM_TCB_BYTES) + heap_cost(stack_words * sizeof(StackType_t));
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint16_t stack_words,
+                       void *arg, UBaseType_t prio, TaskHandle_t *handle) {
+    TCB_t *t;
+
+    if (!heap_take(task_heap_cost(stack_words))) return pdFAIL;    // errCOULD_NOT_ALLOCATE_REQUIRED_MEMORY
+    t = calloc(1, sizeof(TCB_t));
+    task_create(fn, name, stack_words, arg, prio, t);
+    t->dynamic = 1;
+    if (handle != NULL) *handle = t;
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack_words,
+                               void *arg, UBaseType_t prio, StackType_t *stack, StaticTask_t *tcb) {
+    (void)stack;
+    (void)tcb;
+    return task_create(fn, name, stack_words, arg, prio, calloc(1, sizeof(TCB_t)));
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    TCB_t *t = (task != NULL) ? task : self;
+
+    if (t == NULL) return;
+    t->state = eDeleted;
+    if (t->dynamic) heap_used -= task_heap_cost(t->stack_words);
+    if (t != self) return;
+
+    // The thread ends here; its TCB stays listed so handles remain valid
+    make_current(pick_next(t));
+    pthread_mutex_unlock(&cpu);
+    pthread_exit(NULL);
+}
+
+// Ticks until the next timed wake-up; 0 when a task other than idle can run
+static TickType_t expected_idle_time(void) {
+    TickType_t expected = portMAX_DELAY;
+
+    for (TCB_t *t = tasks; t != NULL; t = t->next) {
+        if (t == idle_task) continue;
+        if (runnable(t)) return 0;
+        if (t->state == eBlocked && t->timed) {
+            int32_t left = (int32_t)(t->wake_tick - tick_count);
+            if (left <= 0) return 0;
+            if ((TickType_t)left < expected) expected = (TickType_t)left;
+        }
+    }
+    return expected;
+}
+
+// As in tasks.c: sleep through the idle time when it is long enough,
+// otherwise wait for the next interrupt
+static void idle_fn(void *arg) {
+    (void)arg;
+    for (;;) {
+#if configUSE_TICKLESS_IDLE != 0
+        if (expected_idle_time() >= configEXPECTED_IDLE_TIME_BEFORE_SLEEP) {
+            TickType_t expected;
+
+            vTaskSuspendAll();
+            expected = expected_idle_time();
+            if (expected >= configEXPECTED_IDLE_TIME_BEFORE_SLEEP) portSUPPRESS_TICKS_AND_SLEEP(expected);
+            xTaskResumeAll();
+            continue;
+        }
+#endif
+        sim_wfi();
+    }
+}
+
+eSleepModeStatus eTaskConfirmSleepModeStatus(void) {
+    return expected_idle_time() == 0 ? eAbortSleep : eStandardSleep;
+}
+
+void vTaskStepTick(TickType_t ticks) {
+    tick_count += ticks;
+}
+
+void vTaskStartScheduler(void) {
+    portCONFIGURE_TIMER_FOR_RUN_TIME_STATS();
+    switched_at = runtime_now();
+    // Static on the target (configSUPPORT_STATIC_ALLOCATION), so no heap
+    idle_task = task_create(idle_fn, "IDLE", configMINIMAL_STACK_SIZE, NULL, tskIDLE_PRIORITY,
+                            calloc(1, sizeof(TCB_t)));
+
+    // vPortSetupTimerInterrupt
+    pthread_mutex_lock(&systick_lock);
+    systick.LOAD = SystemCoreClock / configTICK_RATE_HZ - 1U;
+    systick.VAL = 0;
+    systick.CTRL = SysTick_CTRL_ENABLE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_CLKSOURCE_Msk;
+    systick_sync();
+    pthread_mutex_unlock(&systick_lock);
+
+    started = 1;
+    make_current(pick_next(NULL));
+    pthread_mutex_unlock(&cpu);
+    for (;;) sleep_us(1000000);
+}
+
+void vTaskYield(void) {
+    slice_due = 1;
+    sim_yield_point();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim_yield_point();
+    block_on(&delay_key, ticks);
+}
+
+void vTaskDelayUntil(TickType_t *prev_wake, TickType_t increment) {
+    TickType_t wake = *prev_wake + increment;
+    TickType_t now = tick_count;
+    int delay;
+
+    if (now < *prev_wake) delay = (wake < *prev_wake) && (wake > now);   // tick count wrapped
+    else delay = (wake < *prev_wake) || (wake > now);
+    *prev_wake = wake;
+    if (delay) block_on(&delay_key, wake - now);
+    else sim_yield_point();
+}
+
+void vTaskSuspendAll(void) {
+    suspended++;
+}
+
+BaseType_t xTaskResumeAll(void) {
+    if (--suspended == 0) sim_yield_point();
+    return pdFALSE;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return tick_count;
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+    return tick_count;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return self;
+}
+
+BaseType_t xTaskGetSchedulerState(void) {
+    if (!started) return taskSCHEDULER_NOT_STARTED;
+    return suspended ? taskSCHEDULER_SUSPENDED : taskSCHEDULER_RUNNING;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    UBaseType_t n = 0;
+
+    for (TCB_t *t = tasks; t != NULL; t = t->next) {
+        if (t->state != eDeleted) n++;
+    }
+    return n;
+}
+
+const char *pcTaskGetName(TaskHandle_t task) {
+    return (task != NULL ? task : self)->name;
+}
+
+eTaskState eTaskGetState(TaskHandle_t task) {
+    return task->state;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task != NULL ? task : self)->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return (task != NULL ? task : self)->stack_words;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t size, uint32_t *total_runtime) {
+    UBaseType_t n = 0;
+    uint32_t now;
+
+    if (uxTaskGetNumberOfTasks() > size) return 0;
+    critical_nesting++;
+    now = runtime_now();
+    if (current != NULL) current->runtime += now - switched_at;
+    switched_at = now;
+    for (TCB_t *t = tasks; t != NULL; t = t->next) {
+        if (t->state != eDeleted) {
+            status[n].xHandle = t;
+            status[n].pcTaskName = t->name;
+            status[n].xTaskNumber = t->number;
+            status[n].eCurrentState = t->state;
+            status[n].uxCurrentPriority = t->priority;
+            status[n].uxBasePriority = t->priority;
+            status[n].ulRunTimeCounter = t->runtime;
+            status[n].pxStackBase = NULL;
+            status[n].usStackHighWaterMark = (uint16_t)t->stack_words;
+            n++;
+        }
+    }
+    critical_nesting--;
+    if (total_runtime != NULL) *total_runtime = now;
+    return n;
+}
+
+// --- Task notifications ---
+
+static BaseType_t notify(TCB_t *t, uint32_t value, eNotifyAction action, BaseType_t *woken) {
+    BaseType_t rc = pdPASS;
+
+    switch (action) {
+    case eSetBits:
+        t->notify_value |= value;
+        break;
+    case eIncrement:
+        t->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        t->notify_value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (t->notify_pending) rc = pdFAIL;
+        else t->notify_value = value;
+        break;
+    case eNoAction:
+    default:
+        break;
+    }
+    t->notify_pending = 1;
+    if (t->state == eBlocked && t->wait_obj == &t->notify_value) {
+        make_ready(t);
+        if (woken != NULL && current != NULL && t->priority > current->priority) *woken = pdTRUE;
+    }
+    return rc;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    BaseType_t rc = notify(task, value, action, NULL);
+    sim_yield_point();
+    return rc;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+                              BaseType_t *woken) {
+    return notify(task, value, action, woken);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+    notify(task, 0, eIncrement, woken);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+                           uint32_t *value, TickType_t timeout) {
+    TCB_t *me = self;
+    BaseType_t rc = pdFALSE;
+
+    sim_yield_point();
+    if (!me->notify_pending) {
+        me->notify_value &= ~clear_on_entry;
+        block_on(&me->notify_value, timeout);
+    }
+    if (value != NULL) *value = me->notify_value;
+    if (me->notify_pending) {
+        me->notify_value &= ~clear_on_exit;
+        rc = pdTRUE;
+    }
+    me->notify_pending = 0;
+    return rc;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) {
+    TCB_t *me = self;
+    uint32_t v;
+
+    sim_yield_point();
+    if (me->notify_value == 0) block_on(&me->notify_value, timeout);
+    v = me->notify_value;
+    if (v != 0) me->notify_value = clear ? 0 : v - 1;
+    me->notify_pending = 0;
+    return v;
+}
+
+// --- Queues and semaphores ---
+
+static QueueHandle_t queue_init(struct QueueDefinition *q, UBaseType_t length, UBaseType_t item_size,
+                                uint8_t *storage, uint8_t type, uint8_t dynamic) {
+    memset(q, 0, sizeof(*q));
+    q->storage = storage;
+    q->length = length;
+    q->item_size = item_size;
+    q->type = type;
+    q->dynamic = dynamic;
+    return q;
+}
+
+static QueueHandle_t queue_alloc(UBaseType_t length, UBaseType_t item_size, uint8_t type) {
+    uint8_t *mem = pvPortMalloc(sizeof(struct QueueDefinition) + (size_t)length * item_size);
+
+    if (mem == NULL) return NULL;
+    return queue_init((struct QueueDefinition *)mem, length, item_size,
+                      mem + sizeof(struct QueueDefinition), type, 1);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return queue_alloc(length, item_size, Q_QUEUE);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size,
+                                 uint8_t *storage, StaticQueue_t *buf) {
+    return queue_init((struct QueueDefinition *)buf, length, item_size, storage, Q_QUEUE, 0);
+}
+
+void vQueueDelete(QueueHandle_t q) {
+    if (q->dynamic) vPortFree(q);
+}
+
+static void queue_put(QueueHandle_t q, const void *item, int front) {
+    if (q->item_size != 0) {
+        UBaseType_t slot;
+        if (front) slot = q->read = (q->read + q->length - 1) % q->length;
+        else slot = (q->read + q->count) % q->length;
+        if (item != NULL) memcpy(q->storage + slot * q->item_size, item, q->item_size);
+    }
+    q->count++;
+}
+
+static void queue_get(QueueHandle_t q, void *item, int peek) {
+    if (q->item_size != 0 && item != NULL) {
+        memcpy(item, q->storage + q->read * q->item_size, q->item_size);
+    }
+    if (peek) return;
+    q->read = (q->read + 1) % q->length;
+    q->count--;
+}
+
+static BaseType_t queue_send(QueueHandle_t q, const void *item, TickType_t timeout, int front) {
+    TickType_t start = tick_count;
+
+    sim_yield_point();
+    while (q->count >= q->length) {
+        if (!block_on(&q->length, remaining(start, timeout))) return errQUEUE_FULL;
+    }
+    queue_put(q, item, front);
+    wake_one(q, NULL);
+    sim_yield_point();
+    return pdPASS;
+}
+
+static BaseType_t queue_receive(QueueHandle_t q, void *item, TickType_t timeout, int peek) {
+    TickType_t start = tick_count;
+
+    sim_yield_point();
+    while (q->count == 0) {
+        if (!block_on(q, remaining(start, timeout))) return errQUEUE_EMPTY;
+    }
+    queue_get(q, item, peek);
+    if (peek) wake_one(q, NULL);        // let another reader see it too
+    else wake_one(&q->length, NULL);
+    sim_yield_point();
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t timeout) {
+    return queue_send(q, item, timeout, 0);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t timeout) {
+    return queue_send(q, item, timeout, 0);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t timeout) {
+    return queue_send(q, item, timeout, 1);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken) {
+    if (q->count >= q->length) return errQUEUE_FULL;
+    queue_put(q, item, 0);
+    wake_one(q, woken);
+    return pdPASS;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void *item) {
+    q->count = 0;
+    q->read = 0;
+    return queue_send(q, item, 0, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t timeout) {
+    return queue_receive(q, item, timeout, 0);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t timeout) {
+    return queue_receive(q, item, timeout, 1);
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t q, void *item, BaseType_t *woken) {
+    if (q->count == 0) return errQUEUE_EMPTY;
+    queue_get(q, item, 0);
+    wake_one(&q->length, woken);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    return q->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+    return q->length - q->count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+    q->count = 0;
+    q->read = 0;
+    wake_one(&q->length, NULL);
+    return pdPASS;
+}
+
+void vQueueAddToRegistry(QueueHandle_t q, const char *name) {
+    (void)q;
+    (void)name;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return queue_alloc(1, 0, Q_BINARY);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf) {
+    return queue_init((struct QueueDefinition *)buf, 1, 0, NULL, Q_BINARY, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+    SemaphoreHandle_t s = queue_alloc(max, 0, Q_COUNTING);
+    if (s != NULL) s->count = initial;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(UBaseType_t max, UBaseType_t initial,
+                                                 StaticSemaphore_t *buf) {
+    SemaphoreHandle_t s = queue_init((struct QueueDefinition *)buf, max, 0, NULL, Q_COUNTING, 0);
+    s->count = initial;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t s = queue_alloc(1, 0, Q_MUTEX);
+    if (s != NULL) s->count = 1;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf) {
+    SemaphoreHandle_t s = queue_init((struct QueueDefinition *)buf, 1, 0, NULL, Q_MUTEX, 0);
+    s->count = 1;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+    SemaphoreHandle_t s = queue_alloc(1, 0, Q_RECURSIVE);
+    if (s != NULL) s->count = 1;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *buf) {
+    SemaphoreHandle_t s = queue_init((struct QueueDefinition *)buf, 1, 0, NULL, Q_RECURSIVE, 0);
+    s->count = 1;
+    return s;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t timeout) {
+    if (queue_receive(s, NULL, timeout, 0) != pdPASS) return pdFAIL;
+    if (s->type == Q_MUTEX || s->type == Q_RECURSIVE) s->holder = self;
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+    if (s->type == Q_MUTEX || s->type == Q_RECURSIVE) {
+        if (s->holder != self) return pdFAIL;
+        s->holder = NULL;
+    }
+    return queue_send(s, NULL, 0, 0);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t s, TickType_t timeout) {
+    if (s->holder != NULL && s->holder == self) {
+        s->recursion++;
+        return pdPASS;
+    }
+    if (xSemaphoreTake(s, timeout) != pdPASS) return pdFAIL;
+    s->recursion = 1;
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t s) {
+    if (s->holder != self) return pdFAIL;
+    if (--s->recursion != 0) return pdPASS;
+    return xSemaphoreGive(s);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t s, BaseType_t *woken) {
+    return xQueueSendFromISR(s, NULL, woken);
+}
+
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t s, BaseType_t *woken) {
+    return xQueueReceiveFromISR(s, NULL, woken);
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t s) {
+    return s->count;
+}
+
+// --- Stream buffers ---
+
+static StreamBufferHandle_t stream_init(struct StreamBufferDef_t *sb, size_t size, size_t trigger,
+                                        uint8_t *storage, uint8_t dynamic) {
+    memset(sb, 0, sizeof(*sb));
+    sb->buf = storage;
+    sb->size = size;
+    sb->trigger = trigger != 0 ? trigger : 1;
+    sb->dynamic = dynamic;
+    return sb;
+}
+
+StreamBufferHandle_t xStreamBufferCreate(size_t size, size_t trigger) {
+    uint8_t *mem = pvPortMalloc(sizeof(struct StreamBufferDef_t) + size);
+
+    if (mem == NULL) return NULL;
+    return stream_init((struct StreamBufferDef_t *)mem, size, trigger,
+                       mem + sizeof(struct StreamBufferDef_t), 1);
+}
+
+StreamBufferHandle_t xStreamBufferCreateStatic(size_t size, size_t trigger,
+                                               uint8_t *storage, StaticStreamBuffer_t *buf) {
+    return stream_init((struct StreamBufferDef_t *)buf, size, trigger, storage, 0);
+}
+
+static size_t stream_put(StreamBufferHandle_t sb, const uint8_t *data, size_t len, BaseType_t *woken) {
+    size_t space = sb->size - (sb->head - sb->tail);
+
+    if (len > space) len = space;
+    for (size_t i = 0; i < len; i++) sb->buf[(sb->head + i) % sb->size] = data[i];
+    sb->head += len;
+    if (len != 0 && sb->head - sb->tail >= sb->trigger) wake_one(sb, woken);
+    return len;
+}
+
+static size_t stream_get(StreamBufferHandle_t sb, uint8_t *data, size_t len, BaseType_t *woken) {
+    size_t avail = sb->head - sb->tail;
+
+    if (len > avail) len = avail;
+    for (size_t i = 0; i < len; i++) data[i] = sb->buf[(sb->tail + i) % sb->size];
+    sb->tail += len;
+    if (len != 0) wake_one(&sb->size, woken);
+    return len;
+}
+
+size_t xStreamBufferSend(StreamBufferHandle_t sb, const void *data, size_t len, TickType_t timeout) {
+    TickType_t start = tick_count;
+    size_t sent;
+
+    sim_yield_point();
+    while (sb->size - (sb->head - sb->tail) < len) {
+        if (!block_on(&sb->size, remaining(start, timeout))) break;
+    }
+    sent = stream_put(sb, data, len, NULL);
+    sim_yield_point();
+    return sent;
+}
+
+size_t xStreamBufferSendFromISR(StreamBufferHandle_t sb, const void *data, size_t len,
+                                BaseType_t *woken) {
+    return stream_put(sb, data, len, woken);
+}
+
+size_t xStreamBufferReceive(StreamBufferHandle_t sb, void *data, size_t len, TickType_t timeout) {
+    TickType_t start = tick_count;
+    size_t got;
+
+    sim_yield_point();
+    while (sb->head == sb->tail) {
+        if (!block_on(sb, remaining(start, timeout))) return 0;
+    }
+    got = stream_get(sb, data, len, NULL);
+    sim_yield_point();
+    return got;
+}
+
+size_t xStreamBufferReceiveFromISR(StreamBufferHandle_t sb, void *data, size_t len,
+                                   BaseType_t *woken) {
+    return stream_get(sb, data, len, woken);
+}
+
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t sb) {
+    return sb->head - sb->tail;
+}
+
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t sb) {
+    return sb->size - (sb->head - sb->tail);
+}
+
+BaseType_t xStreamBufferReset(StreamBufferHandle_t sb) {
+    sb->head = sb->tail = 0;
+    return pdPASS;
+}
+
+// --- Event groups ---
+
+#define EG_BITS_MASK    0x00FFFFFFU     // the top byte is the kernel's on the target
+
+static EventGroupHandle_t event_group_init(struct EventGroupDef_t *eg, uint8_t dynamic) {
+    memset(eg, 0, sizeof(*eg));
+    eg->dynamic = dynamic;
+    return eg;
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    struct EventGroupDef_t *eg = pvPortMalloc(sizeof(*eg));
+
+    if (eg == NULL) return NULL;
+    return event_group_init(eg, 1);
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf) {
+    return event_group_init((struct EventGroupDef_t *)buf, 0);
+}
+
+void vEventGroupDelete(EventGroupHandle_t eg) {
+    if (eg->dynamic) vPortFree(eg);
+}
+
+// Every waiter re-checks its own condition, so all of them are woken
+EventBits_t xEventGroupSetBits(EventGroupHandle_t eg, EventBits_t bits) {
+    EventBits_t ret;
+
+    eg->bits |= bits & EG_BITS_MASK;
+    while (wake_one(eg, NULL) != NULL) {
+    }
+    ret = eg->bits;
+    sim_yield_point();
+    return ret;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t eg, EventBits_t bits) {
+    EventBits_t ret = eg->bits;
+
+    eg->bits &= ~bits;
+    return ret;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t eg) {
+    return eg->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t eg, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t timeout) {
+    TickType_t start = tick_count;
+    EventBits_t ret;
+
+    sim_yield_point();
+    for (;;) {
+        ret = eg->bits;
+        if (wait_for_all ? (ret & bits) == bits : (ret & bits) != 0) break;
+        if (!block_on(eg, remaining(start, timeout))) return eg->bits;
+    }
+    if (clear_on_exit) eg->bits &= ~bits;
+    return ret;
+}
+
+// --- CMSIS-RTOS2 ---
+
+osStatus_t osKernelInitialize(void) {
+    return osOK;
+}
+
+osStatus_t osKernelStart(void) {
+    vTaskStartScheduler();
+    return osError;
+}
+
+uint32_t osKernelGetTickCount(void) {
+    return tick_count;
+}
+
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr) {
+    const char *name = NULL;
+    uint32_t stack = configMINIMAL_STACK_SIZE;
+    UBaseType_t prio = osPriorityNormal;
+    TaskHandle_t h = NULL;
+
+    if (in_isr) return NULL;
+    if (attr != NULL) {
+        name = attr->name;
+        if (attr->stack_size != 0) stack = attr->stack_size / sizeof(StackType_t);
+        if (attr->priority != osPriorityNone) prio = attr->priority;
+        if (attr->cb_mem != NULL && attr->stack_mem != NULL) {
+            return xTaskCreateStatic(func, name, stack, argument, prio, attr->stack_mem, attr->cb_mem);
+        }
+    }
+    if (xTaskCreate(func, name, (uint16_t)stack, argument, prio, &h) != pdPASS) return NULL;
+    return h;
+}
+
+osStatus_t osDelay(uint32_t ticks) {
+    if (in_isr) return osErrorISR;
+    if (ticks != 0) vTaskDelay(ticks);
+    return osOK;
+}
+
+osMessageQueueId_t osMessageQueueNew(uint32_t count, uint32_t size, const osMessageQueueAttr_t *attr) {
+    if (attr != NULL && attr->cb_mem != NULL && attr->mq_mem != NULL) {
+        return xQueueCreateStatic(count, size, attr->mq_mem, attr->cb_mem);
+    }
+    return xQueueCreate(count, size);
+}
+
+osStatus_t osMessageQueuePut(osMessageQueueId_t q, const void *msg, uint8_t prio, uint32_t timeout) {
+    (void)prio;
+    if (in_isr) return xQueueSendFromISR(q, msg, NULL) == pdPASS ? osOK : osErrorResource;
+    if (xQueueSend(q, msg, timeout) == pdPASS) return osOK;
+    return timeout != 0 ? osErrorTimeout : osErrorResource;
+}
+
+osStatus_t osMessageQueueGet(osMessageQueueId_t q, void *msg, uint8_t *prio, uint32_t timeout) {
+    if (prio != NULL) *prio = 0;
+    if (in_isr) return xQueueReceiveFromISR(q, msg, NULL) == pdPASS ? osOK : osErrorResource;
+    if (xQueueReceive(q, msg, timeout) == pdPASS) return osOK;
+    return timeout != 0 ? osErrorTimeout : osErrorResource;
+}
@@ -0,0 +1,137 @@
+// SPI1/SPI2 for the host simulation. SPI1 carries the log flash
+// (sim_flash.c); SPI2 has nothing attached and reads back 0xFF.
+//
+// Transfers take their wire time at PCLK / prescaler. DMA transfers move
+// their bytes when the completion interrupt fires.
+
+#include "stm32f4xx_hal.h"
+#include "sim.h"
+
+SPI_TypeDef sim_spi1, sim_spi2;
+
+static struct {
+    SPI_HandleTypeDef *hspi;
+    uint8_t *data;
+    uint16_t len;
+    uint8_t rx;
+} pending;
+
+static uint8_t exchange(SPI_HandleTypeDef *hspi, uint8_t mosi) {
+    return (hspi->Instance == SPI1) ? sim_flash_xfer(mosi) : 0xFF;
+}
+
+static uint32_t wire_us(SPI_HandleTypeDef *hspi, uint32_t len) {
+    uint32_t pclk = (hspi->Instance == SPI1) ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+    uint32_t hz = pclk / (2U << (hspi->Init.BaudRatePrescaler >> 3));
+    return (uint32_t)((uint64_t)len * 8U * 1000000U / hz);
+}
+
+static void move(SPI_HandleTypeDef *hspi, uint8_t *tx, uint8_t *rx, uint16_t len) {
+    for (uint16_t i = 0; i < len; i++) {
+        uint8_t miso = exchange(hspi, tx ? tx[i] : 0xFF);
+        if (rx) rx[i] = miso;
+    }
+}
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi) {
+    if (hspi->State == HAL_SPI_STATE_RESET) HAL_SPI_MspInit(hspi);
+    hspi->ErrorCode = HAL_SPI_ERROR_NONE;
+    hspi->State = HAL_SPI_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef *hspi) {
+    HAL_SPI_Abort(hspi);
+    HAL_SPI_MspDeInit(hspi);
+    hspi->State = HAL_SPI_STATE_RESET;
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef run_blocking(SPI_HandleTypeDef *hspi, uint8_t *tx, uint8_t *rx, uint16_t len,
+                                      HAL_SPI_StateTypeDef state) {
+    if (hspi->State != HAL_SPI_STATE_READY) return HAL_BUSY;
+    if (len == 0) return HAL_ERROR;
+    hspi->State = state;
+    hspi->ErrorCode = HAL_SPI_ERROR_NONE;
+    move(hspi, tx, rx, len);
+    sim_busy_wait_us(wire_us(hspi, len));
+    hspi->State = HAL_SPI_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t len, uint32_t timeout) {
+    (void)timeout;
+    return run_blocking(hspi, data, NULL, len, HAL_SPI_STATE_BUSY_TX);
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t len, uint32_t timeout) {
+    (void)timeout;
+    return run_blocking(hspi, NULL, data, len, HAL_SPI_STATE_BUSY_RX);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *tx, uint8_t *rx,
+                                          uint16_t len, uint32_t timeout) {
+    (void)timeout;
+    return run_blocking(hspi, tx, rx, len, HAL_SPI_STATE_BUSY_TX_RX);
+}
+
+static void dma_done(void *arg) {
+    SPI_HandleTypeDef *hspi = pending.hspi;
+
+    (void)arg;
+    if (hspi == NULL) return;
+    move(hspi, pending.rx ? NULL : pending.data, pending.rx ? pending.data : NULL, pending.len);
+    pending.hspi = NULL;
+    hspi->State = HAL_SPI_STATE_READY;
+    if (pending.rx) HAL_SPI_RxCpltCallback(hspi);
+    else HAL_SPI_TxCpltCallback(hspi);
+}
+
+static HAL_StatusTypeDef start_dma(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t len, uint8_t rx) {
+    if (hspi->State != HAL_SPI_STATE_READY) return HAL_BUSY;
+    if (data == NULL || len == 0) return HAL_ERROR;
+    hspi->State = rx ? HAL_SPI_STATE_BUSY_RX : HAL_SPI_STATE_BUSY_TX;
+    hspi->ErrorCode = HAL_SPI_ERROR_NONE;
+    if (rx) {
+        hspi->pRxBuffPtr = data;
+        hspi->RxXferSize = len;
+    } else {
+        hspi->pTxBuffPtr = data;
+        hspi->TxXferSize = len;
+    }
+    pending.hspi = hspi;
+    pending.data = data;
+    pending.len = len;
+    pending.rx = rx;
+    sim_event_schedule(wire_us(hspi, len) + 1U, dma_done, NULL);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t len) {
+    return start_dma(hspi, data, len, 0);
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t len) {
+    return start_dma(hspi, data, len, 1);
+}
+
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi) {
+    if (pending.hspi == hspi) {
+        sim_event_cancel(dma_done, NULL);
+        pending.hspi = NULL;
+        hspi->ErrorCode = HAL_SPI_ERROR_ABORT;
+    }
+    if (hspi->State != HAL_SPI_STATE_RESET) hspi->State = HAL_SPI_STATE_READY;
+    return HAL_OK;
+}
+
+void HAL_SPI_IRQHandler(SPI_HandleTypeDef *hspi) {
+    (void)hspi;
+}
+
+__attribute__((weak)) void HAL_SPI_MspInit(SPI_HandleTypeDef *hspi) { (void)hspi; }
+__attribute__((weak)) void HAL_SPI_MspDeInit(SPI_HandleTypeDef *hspi) { (void)hspi; }
+__attribute__((weak)) void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) { (void)hspi; }
+__attribute__((weak)) void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi) { (void)hspi; }
+__attribute__((weak)) void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) { (void)hspi; }
+__attribute__((weak)) void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) { (void)hspi; }
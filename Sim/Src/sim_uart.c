@@ -0,0 +1,257 @@
+// USART6 console for the host simulation.
+//
+// The console is a pseudo terminal: connect to the path printed at startup
+// with any terminal program (picocom, screen, minicom). SIM_PTY_LINK names a
+// symlink to create for it. With SIM_CONSOLE=stdio the console is the
+// simulator's own stdin/stdout instead, which suits scripted runs; end of
+// input then ends the simulation a second later.
+//
+// Transmission takes the time the bytes need on the wire at the configured
+// baud rate. Reception fills the circular DMA buffer and raises the same
+// half, complete and idle line events as the ReceiveToIdle DMA mode.
+
+#define _GNU_SOURCE
+#include "stm32f4xx_hal.h"
+#include "sim.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+USART_TypeDef sim_usart6;
+
+static int in_fd = -1, out_fd = -1;
+static UART_HandleTypeDef *rx_huart;    // armed receiver, NULL when stopped
+static uint16_t rx_pos;
+
+// The speed BRR gives at the current PCLK2, so a stale BRR after a clock
+// change shows up as a wrong wire time
+static uint32_t wire_us(UART_HandleTypeDef *huart, uint32_t len) {
+    uint32_t brr = huart->Instance->BRR;
+    uint32_t baud = huart->Init.BaudRate ? huart->Init.BaudRate : 115200U;
+
+    if (brr != 0) {
+        uint64_t pclk = HAL_RCC_GetPCLK2Freq();
+
+        if (huart->Init.OverSampling == UART_OVERSAMPLING_8) {
+            brr = (brr & ~0xFU) | ((brr & 0x7U) << 1);
+            pclk *= 2U;
+        }
+        baud = (uint32_t)(pclk / brr);
+    }
+    return (uint32_t)((uint64_t)len * 10U * 1000000U / baud);
+}
+
+static void console_write(const uint8_t *data, uint32_t len) {
+    while (len > 0) {
+        ssize_t n = write(out_fd, data, len);
+        if (n < 0) {
+            // Nobody reading the pty: the bytes are lost, as on an open line
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        len -= (uint32_t)n;
+    }
+}
+
+// Called in interrupt context with a chunk that arrived on the line
+static void rx_bytes(const uint8_t *data, size_t len) {
+    UART_HandleTypeDef *huart = rx_huart;
+    uint16_t size, idle_from;
+
+    if (huart == NULL || huart->RxState != HAL_UART_STATE_BUSY_RX) {
+        if (huart != NULL) huart->ErrorCode |= HAL_UART_ERROR_ORE;
+        return;
+    }
+    size = huart->RxXferSize;
+    idle_from = rx_pos;
+
+    for (size_t i = 0; i < len && rx_huart == huart; i++) {
+        huart->pRxBuffPtr[rx_pos++] = data[i];
+        huart->hdmarx->Instance->NDTR = size - rx_pos;
+        if (rx_pos == size / 2) {
+            huart->RxEventType = HAL_UART_RXEVENT_HT;
+            HAL_UARTEx_RxEventCallback(huart, rx_pos);
+            idle_from = rx_pos;
+        } else if (rx_pos == size) {
+            rx_pos = 0;
+            huart->hdmarx->Instance->NDTR = size;
+            huart->RxEventType = HAL_UART_RXEVENT_TC;
+            HAL_UARTEx_RxEventCallback(huart, size);
+            idle_from = 0;
+        }
+    }
+
+    // The idle line event reports the DMA position, and not at all when it
+    // is where the last half/complete event left it
+    if (rx_huart == huart && rx_pos != idle_from) {
+        huart->RxEventType = HAL_UART_RXEVENT_IDLE;
+        HAL_UARTEx_RxEventCallback(huart, rx_pos);
+    }
+}
+
+static void *rx_thread(void *arg) {
+    uint8_t buf[64];
+    int lost;
+
+    (void)arg;
+    for (;;) {
+        ssize_t n = read(in_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n < 0 && errno == EIO) {
+                // pty master with no terminal attached yet
+                usleep(100000);
+                continue;
+            }
+            sleep(1);
+            sim_isr_enter();    // exit handlers see the models at rest
+            exit(0);
+        }
+        // In STOP the USART has no clock: the start bit wakes the core
+        // through EXTI12 and the character is lost
+        lost = sim_power_stopped() && (EXTI->IMR & GPIO_PIN_12) ? 1 : 0;
+        sim_isr_enter();
+        if (lost) HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_12);
+        rx_bytes(buf + lost, (size_t)n - lost);
+        sim_isr_exit();
+    }
+    return NULL;
+}
+
+static void open_pty(void) {
+    struct termios tio;
+    const char *link_path = getenv("SIM_PTY_LINK");
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    int slave;
+
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("sim: pty");
+        exit(1);
+    }
+    // Keep a slave descriptor open so the master does not see hangups
+    // while no terminal program is connected
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0 || tcgetattr(slave, &tio) != 0) {
+        perror("sim: pty");
+        exit(1);
+    }
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    fprintf(stderr, "sim: console on %s\n", ptsname(master));
+    if (link_path != NULL) {
+        unlink(link_path);
+        if (symlink(ptsname(master), link_path) != 0) perror("sim: pty link");
+    }
+
+    // Reads block in the receiver thread; only writes must not
+    in_fd = dup(master);
+    fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) & ~O_NONBLOCK);
+    out_fd = master;
+}
+
+void sim_uart_init(void) {
+    const char *mode = getenv("SIM_CONSOLE");
+    pthread_t th;
+
+    if (mode != NULL && strcmp(mode, "stdio") == 0) {
+        in_fd = STDIN_FILENO;
+        out_fd = STDOUT_FILENO;
+    } else {
+        open_pty();
+    }
+    pthread_create(&th, NULL, rx_thread, NULL);
+    pthread_detach(th);
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart) {
+    if (huart->gState == HAL_UART_STATE_RESET) HAL_UART_MspInit(huart);
+    huart->Instance->BRR = (huart->Init.OverSampling == UART_OVERSAMPLING_8) ?
+        UART_BRR_SAMPLING8(HAL_RCC_GetPCLK2Freq(), huart->Init.BaudRate) :
+        UART_BRR_SAMPLING16(HAL_RCC_GetPCLK2Freq(), huart->Init.BaudRate);
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+    huart->gState = HAL_UART_STATE_READY;
+    huart->RxState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart) {
+    HAL_UART_AbortReceive(huart);
+    HAL_UART_MspDeInit(huart);
+    huart->gState = HAL_UART_STATE_RESET;
+    huart->RxState = HAL_UART_STATE_RESET;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t len,
+                                    uint32_t timeout) {
+    (void)timeout;
+    if (huart->gState != HAL_UART_STATE_READY) return HAL_BUSY;
+    huart->gState = HAL_UART_STATE_BUSY_TX;
+    console_write(data, len);
+    sim_busy_wait_us(wire_us(huart, len));
+    huart->gState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+static void tx_done(void *arg) {
+    UART_HandleTypeDef *huart = arg;
+
+    huart->gState = HAL_UART_STATE_READY;
+    HAL_UART_TxCpltCallback(huart);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t len) {
+    if (huart->gState != HAL_UART_STATE_READY) return HAL_BUSY;
+    if (data == NULL || len == 0) return HAL_ERROR;
+    huart->gState = HAL_UART_STATE_BUSY_TX;
+    huart->pTxBuffPtr = data;
+    huart->TxXferSize = len;
+    console_write(data, len);
+    sim_event_schedule(wire_us(huart, len), tx_done, huart);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t len) {
+    if (huart->RxState != HAL_UART_STATE_READY) return HAL_BUSY;
+    if (data == NULL || len == 0) return HAL_ERROR;
+    huart->pRxBuffPtr = data;
+    huart->RxXferSize = len;
+    huart->hdmarx->Instance->NDTR = len;
+    huart->RxState = HAL_UART_STATE_BUSY_RX;
+    rx_pos = 0;
+    rx_huart = huart;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart) {
+    sim_event_cancel(tx_done, huart);
+    if (huart->gState != HAL_UART_STATE_RESET) huart->gState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart) {
+    if (rx_huart == huart) rx_huart = NULL;
+    huart->RxState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart) {
+    (void)huart;
+}
+
+__attribute__((weak)) void HAL_UART_MspInit(UART_HandleTypeDef *huart) { (void)huart; }
+__attribute__((weak)) void HAL_UART_MspDeInit(UART_HandleTypeDef *huart) { (void)huart; }
+__attribute__((weak)) void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) { (void)huart; }
+__attribute__((weak)) void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) { (void)huart; }
+__attribute__((weak)) void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t size) {
+    (void)huart;
+    (void)size;
+}
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""RAM budget from a GNU ld map file.
+
+Run by STM32CubeIDE after each link (see the post-build step in .cproject):
+
+    python ram_report.py Debug/blinky_try.map [--min-free BYTES]
+
+Needs -fdata-sections (on by default in CubeIDE) so that every variable has
+its own input section. Prints the RAM left over, the stack and TCB of every
+statically allocated task, and .data + .bss + .noinit per subsystem (the
+object file a variable comes from). Storage in rtos_objects.o is charged to
+the module its name starts with, so i2c_bus_queue_storage counts towards
+i2c_bus. With --min-free the build fails when less RAM than that is left.
+"""
+
+import argparse
+import os
+import re
+import sys
+from collections import defaultdict
+
+RAM_SECTIONS = (".data", ".bss", ".noinit")
+RESERVE_SECTION = "._user_heap_stack"       # _Min_Heap_Size + _Min_Stack_Size
+
+SECTION_RE = re.compile(r"^(\.\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+))?")
+INPUT_RE = re.compile(r"^ (\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*))?$")
+WRAPPED_RE = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+NUMBERS_RE = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s*$")
+REGION_RE = re.compile(r"^RAM\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)")
+
+# Static task storage: <name>_task_stack/_tcb from rtos_objects.c, CubeMX
+# <name>Buffer/<name>ControlBlock, and the kernel's idle and timer tasks
+TASK_PATTERNS = (
+    (re.compile(r"^(\w+_task)_stack$"), "stack"),
+    (re.compile(r"^(\w+_task)_tcb$"), "tcb"),
+    (re.compile(r"^(\w+Task)Buffer$"), "stack"),
+    (re.compile(r"^(\w+Task)ControlBlock$"), "tcb"),
+    (re.compile(r"^(Idle|Timer)_Stack$"), "stack"),
+    (re.compile(r"^(Idle|Timer)_TCB$"), "tcb"),
+)
+
+
+def subsystem(path):
+    """Name to charge an object file's RAM to."""
+    path = path.replace("\\", "/")
+    archive = re.match(r"(.*/)?([^/(]+\.a)\(", path)
+    if archive:
+        return archive.group(2)
+    name = re.sub(r"(\.c)?\.o$", "", os.path.basename(path))
+    if "/FreeRTOS/" in path:
+        return "FreeRTOS heap" if name.startswith("heap_") else "FreeRTOS kernel"
+    if "/Drivers/" in path:
+        return "HAL"
+    if "/U8g2/" in path:
+        return "U8g2"
+    return name
+
+
+def symbol(section):
+    """Variable name from a -fdata-sections input section name."""
+    for prefix in RAM_SECTIONS + (".sbss", ".sdata"):
+        if section.startswith(prefix + "."):
+            name = section[len(prefix) + 1:]
+            return re.sub(r"\.\d+$", "", name)     # function-local statics
+    return None
+
+
+def parse(path):
+    ram_size = None
+    sections = {}
+    inputs = []          # (output section, input section, size, object file)
+    current = None
+    pending = None       # section whose numbers wrapped onto the next line
+    in_map = False
+
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_map:
+                m = REGION_RE.match(line)
+                if m:
+                    ram_size = int(m.group(2), 16)
+                in_map = line.startswith("Linker script and memory map")
+                continue
+
+            if pending is not None:
+                kind, name = pending
+                pending = None
+                m = WRAPPED_RE.match(line) or NUMBERS_RE.match(line)
+                if m:
+                    size = int(m.group(2), 16)
+                    if kind == "output":
+                        if name in sections:
+                            sections[name] = size
+                    elif current in sections and m.lastindex == 3:
+                        inputs.append((current, name, size, m.group(3)))
+                    continue
+
+            if line.startswith("."):
+                m = SECTION_RE.match(line)
+                current = m.group(1)
+                if current in RAM_SECTIONS or current == RESERVE_SECTION:
+                    sections[current] = 0
+                    if m.group(3) is None:
+                        pending = ("output", current)
+                    else:
+                        sections[current] = int(m.group(3), 16)
+                continue
+
+            if current not in sections:
+                continue
+            m = INPUT_RE.match(line)
+            if not m or m.group(1).startswith("*"):
+                continue
+            if m.group(2) is None:
+                pending = ("input", m.group(1))
+            else:
+                inputs.append((current, m.group(1), int(m.group(3), 16), m.group(4)))
+
+    return ram_size, sections, inputs
+
+
+def report(path, min_free):
+    ram_size, sections, inputs = parse(path)
+    if not sections:
+        sys.exit("%s: no .data/.bss found, is this a GNU ld map file?" % path)
+
+    modules = {subsystem(obj) for _, _, _, obj in inputs}
+    by_subsystem = defaultdict(int)
+    tasks = defaultdict(lambda: {"stack": 0, "tcb": 0})
+
+    for out, sec, size, obj in inputs:
+        if size == 0:
+            continue
+        owner = subsystem(obj)
+        name = symbol(sec)
+        if name is not None:
+            for pattern, part in TASK_PATTERNS:
+                m = pattern.match(name)
+                if m:
+                    tasks[m.group(1)][part] += size
+                    break
+            if owner == "rtos_objects":
+                matches = [mod for mod in modules if name.startswith(mod + "_")]
+                if matches:
+                    owner = max(matches, key=len)
+        by_subsystem[owner] += size
+
+    used = sum(sections.values())
+    print("RAM budget from %s" % path)
+    if ram_size is not None:
+        print("  %-28s %7d B" % ("RAM", ram_size))
+    for name in RAM_SECTIONS:
+        print("  %-28s %7d B" % (name, sections.get(name, 0)))
+    print("  %-28s %7d B" % ("main stack + newlib heap", sections.get(RESERVE_SECTION, 0)))
+    free = None
+    if ram_size is not None:
+        free = ram_size - used
+        print("  %-28s %7d B" % ("free", free))
+
+    print("\nTasks %31s %7s %7s" % ("stack", "TCB", "total"))
+    for name, t in sorted(tasks.items(), key=lambda kv: -(kv[1]["stack"] + kv[1]["tcb"])):
+        print("  %-28s %7d %7d %7d" % (name, t["stack"], t["tcb"], t["stack"] + t["tcb"]))
+
+    print("\nSubsystems (.data + .bss + .noinit)")
+    for name, size in sorted(by_subsystem.items(), key=lambda kv: -kv[1]):
+        print("  %-28s %7d B" % (name, size))
+
+    if min_free is not None and free is not None and free < min_free:
+        print("\nerror: %d B of RAM free, the budget asks for %d B" % (free, min_free))
+        return 1
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", help="linker map file")
+    parser.add_argument("--min-free", type=int, metavar="BYTES",
+                        help="fail if less RAM than this is left over")
+    args = parser.parse_args()
+    return report(args.map, args.min_free)
+
+
+if __name__ == "__main__":
+    sys.exit(main())